@@ -0,0 +1,37 @@
+"""
+Generate the tables for the slicing-by-8 CRC32C in checksum.c. Run this from
+the source folder.
+"""
+
+# Castagnoli polynomial, reflected
+polynomial = 0x82f63b78
+
+tables = [[0] * 256 for i in range(8)]
+
+for i in range(256):
+	crc = i
+	
+	for j in range(8):
+		crc = (crc >> 1) ^ (polynomial if crc & 1 else 0)
+	
+	tables[0][i] = crc
+
+# Each table is the one before it moved on by another byte of zeros
+for k in range(1, 8):
+	for i in range(256):
+		last = tables[k - 1][i]
+		tables[k][i] = (last >> 8) ^ tables[0][last & 0xff]
+
+with open("checksum_generated.part", "w") as f:
+	f.write("// Auto-generated by generate_crc32c_table.py\n")
+	f.write("static const uint32_t gChecksumCRC32CTable[8][256] = {\n")
+	
+	for table in tables:
+		f.write("\t{\n")
+		
+		for i in range(0, 256, 8):
+			f.write("\t\t" + ", ".join(f"0x{x:08x}" for x in table[i:i + 8]) + ",\n")
+		
+		f.write("\t},\n")
+	
+	f.write("};\n")
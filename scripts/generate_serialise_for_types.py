@@ -8,6 +8,13 @@ DgError DgStreamRead{easy}(DgStream *context, {real}* data) {
 	 * @return {easy} Error code
 	 */
 	
+	// Fast path: take it straight from the stream buffer
+	if (context->buffer_mode == DG_STREAM_BUFFER_READ && context->buffer_length - context->buffer_head >= sizeof *data) {
+		memcpy(data, &context->buffer[context->buffer_head], sizeof *data);
+		context->buffer_head += sizeof *data;
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
 	return DgStreamRead(context, sizeof *data, data);
 }
 
@@ -25,6 +32,13 @@ DgError DgStreamWrite{easy}(DgStream *context, {real} data) {
 	 * @return Error code
 	 */
 	
+	// Fast path: put it straight into the stream buffer
+	if (context->buffer_mode == DG_STREAM_BUFFER_WRITE && context->buffer_size - context->buffer_head >= sizeof data) {
+		memcpy(&context->buffer[context->buffer_head], &data, sizeof data);
+		context->buffer_head += sizeof data;
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
 	return DgStreamWrite(context, sizeof data, &data);
 }
 
@@ -32,6 +46,150 @@ DgError DgStreamWrite{easy}(DgStream *context, {real} data) {
 
 write_decl = "DgError DgStreamWrite{easy}(DgStream *context, {real} data);\n"
 
+read_array = """
+DgError DgStreamReadArray{easy}(DgStream *context, size_t count, {real}* data, DgByteOrder order) {
+	/**
+	 * Read an array of {easy}s stored in the given byte order
+	 * 
+	 * @param context Stream object
+	 * @param count Number of elements to read
+	 * @param data Where to put the elements
+	 * @param order Byte order of the elements in the stream
+	 * @return Error code
+	 */
+	
+	if (count > SIZE_MAX / sizeof *data) {
+		return DG_ERROR_OUT_OF_RANGE;
+	}
+	
+	DgError status = DgStreamRead(context, count * sizeof *data, data);
+	
+	if (status) {
+		return status;
+	}
+	
+	if (sizeof *data > 1 && order != DG_BYTE_ORDER_NATIVE) {
+		DgByteSwapArray(data, sizeof *data, count);
+	}
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+"""
+
+read_array_decl = "DgError DgStreamReadArray{easy}(DgStream *context, size_t count, {real}* data, DgByteOrder order);\n"
+
+write_array = """
+DgError DgStreamWriteArray{easy}(DgStream *context, size_t count, const {real}* data, DgByteOrder order) {
+	/**
+	 * Write an array of {easy}s in the given byte order
+	 * 
+	 * @param context Stream object
+	 * @param count Number of elements to write
+	 * @param data The elements to write
+	 * @param order Byte order to write the elements in
+	 * @return Error code
+	 */
+	
+	if (count > SIZE_MAX / sizeof *data) {
+		return DG_ERROR_OUT_OF_RANGE;
+	}
+	
+	if (sizeof *data == 1 || order == DG_BYTE_ORDER_NATIVE) {
+		return DgStreamWrite(context, count * sizeof *data, (void *) data);
+	}
+	
+	// Swap a block at a time so the caller's array is left alone
+	{real} block[DG_BYTE_SWAP_BLOCK / sizeof *data];
+	
+	while (count) {
+		size_t part = (count < sizeof block / sizeof *block) ? count : sizeof block / sizeof *block;
+		
+		DgByteSwapCopy(block, data, sizeof *data, part);
+		
+		DgError status = DgStreamWrite(context, part * sizeof *data, block);
+		
+		if (status) {
+			return status;
+		}
+		
+		data += part;
+		count -= part;
+	}
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+"""
+
+write_array_decl = "DgError DgStreamWriteArray{easy}(DgStream *context, size_t count, const {real}* data, DgByteOrder order);\n"
+
+memory_read_array = """
+void DgMemoryStreamReadArray{easy}(DgMemoryStream *stream, size_t count, {real}* data, DgByteOrder order) {
+	/**
+	 * Read an array of {easy}s stored in the given byte order
+	 * 
+	 * @param stream Memory stream
+	 * @param count Number of elements to read
+	 * @param data Where to put the elements
+	 * @param order Byte order of the elements in the stream
+	 */
+	
+	if (count > SIZE_MAX / sizeof *data) {
+		stream->error = DG_MEMORY_STREAM_RANGE;
+		return;
+	}
+	
+	DgMemoryStreamRead(stream, count * sizeof *data, data);
+	
+	if (sizeof *data > 1 && order != DG_BYTE_ORDER_NATIVE) {
+		DgByteSwapArray(data, sizeof *data, count);
+	}
+}
+
+"""
+
+memory_read_array_decl = "void DgMemoryStreamReadArray{easy}(DgMemoryStream *stream, size_t count, {real}* data, DgByteOrder order);\n"
+
+memory_write_array = """
+void DgMemoryStreamWriteArray{easy}(DgMemoryStream *stream, size_t count, const {real}* data, DgByteOrder order) {
+	/**
+	 * Write an array of {easy}s in the given byte order
+	 * 
+	 * @param stream Memory stream
+	 * @param count Number of elements to write
+	 * @param data The elements to write
+	 * @param order Byte order to write the elements in
+	 */
+	
+	if (count > SIZE_MAX / sizeof *data) {
+		stream->error = DG_MEMORY_STREAM_RANGE;
+		return;
+	}
+	
+	if (sizeof *data == 1 || order == DG_BYTE_ORDER_NATIVE) {
+		DgMemoryStreamWrite(stream, count * sizeof *data, (void *) data);
+		return;
+	}
+	
+	// Swap a block at a time so the caller's array is left alone
+	{real} block[DG_BYTE_SWAP_BLOCK / sizeof *data];
+	
+	while (count) {
+		size_t part = (count < sizeof block / sizeof *block) ? count : sizeof block / sizeof *block;
+		
+		DgByteSwapCopy(block, data, sizeof *data, part);
+		DgMemoryStreamWrite(stream, part * sizeof *data, block);
+		
+		data += part;
+		count -= part;
+	}
+}
+
+"""
+
+memory_write_array_decl = "void DgMemoryStreamWriteArray{easy}(DgMemoryStream *stream, size_t count, const {real}* data, DgByteOrder order);\n"
+
 types_and_names = [
 	["Int8", "int8_t"],
 	["UInt8", "uint8_t"],
@@ -45,7 +203,11 @@ types_and_names = [
 	["Float64", "double"],
 ]
 
-c = open("storage_generated.c", "w")
+def emit(file, template):
+	for t in types_and_names:
+		file.write(template.replace("{easy}", t[0]).replace("{real}", t[1]))
+
+c = open("storage_generated.part", "w")
 h = open("storage_generated.h", "w")
 
 c.write("// Auto-generated by generate_serialise_for_types.py\n")
@@ -66,5 +228,38 @@ h.write("// Writes\n")
 for t in types_and_names:
 	h.write(write_decl.replace("{easy}", t[0]).replace("{real}", t[1]))
 
+c.write("// Array reads\n")
+emit(c, read_array)
+
+c.write("// Array writes\n")
+emit(c, write_array)
+
+h.write("// Array reads\n")
+emit(h, read_array_decl)
+
+h.write("// Array writes\n")
+emit(h, write_array_decl)
+
+c.close()
+h.close()
+
+# Memory stream arrays
+c = open("stream_generated.part", "w")
+h = open("stream_generated.h", "w")
+
+c.write("// Auto-generated by generate_serialise_for_types.py\n")
+c.write("// Array reads\n")
+emit(c, memory_read_array)
+
+c.write("// Array writes\n")
+emit(c, memory_write_array)
+
+h.write("// Auto-generated by generate_serialise_for_types.py\n")
+h.write("// Array reads\n")
+emit(h, memory_read_array_decl)
+
+h.write("// Array writes\n")
+emit(h, memory_write_array_decl)
+
 c.close()
 h.close()
@@ -0,0 +1,473 @@
+"""
+Generate functions that read and write C structs in the Melon serialisation
+format, from a schema like this:
+	
+	# Comments start with a hash
+	struct GamePlayer 2
+		uint32 id
+		float32 health
+		float32[3] position
+		char[16] name
+		bool alive
+		uint16 level since 2 = 1
+
+Each struct has a version, and each field says which version it was added in
+(1 if not given) and what it should be when reading older data (0 if not
+given). Field types are int8 ... uint64, float32, float64 and bool, and fixed
+arrays of those or of char.
+
+Structs are written as version 1 tables with a "_version" key followed by the
+fields, in order. Arrays are written as bytes. Every field has a fixed size in
+version 1, so each version of a struct is a fixed block of bytes, and reading
+and writing only copy fields in and out of it. The tables can still be read by
+DgSerialiseRead and the other readers if DgSerialiseWriteHeader is written
+before them.
+
+Usage: generate_struct_serialisers.py <schema> [include prefix]
+
+This writes <schema>.h and <schema>.c next to the schema. The include prefix
+is put before Melon headers, for example "util/" in the tests.
+"""
+
+import sys
+import os.path
+import re
+
+# Type name: (C type, Melon type, size)
+scalar_types = {
+	"int8": ("int8_t", "DG_TYPE_INT8", 1),
+	"uint8": ("uint8_t", "DG_TYPE_UINT8", 1),
+	"int16": ("int16_t", "DG_TYPE_INT16", 2),
+	"uint16": ("uint16_t", "DG_TYPE_UINT16", 2),
+	"int32": ("int32_t", "DG_TYPE_INT32", 4),
+	"uint32": ("uint32_t", "DG_TYPE_UINT32", 4),
+	"int64": ("int64_t", "DG_TYPE_INT64", 8),
+	"uint64": ("uint64_t", "DG_TYPE_UINT64", 8),
+	"float32": ("float", "DG_TYPE_FLOAT32", 4),
+	"float64": ("double", "DG_TYPE_FLOAT64", 8),
+	"bool": ("bool", "DG_TYPE_BOOL", 1),
+	"char": ("char", None, 1),
+}
+
+version_key = "_version"
+
+class Field:
+	def __init__(self, kind, count, name, since, default):
+		self.kind = kind
+		self.count = count # None if not an array
+		self.name = name
+		self.since = since
+		self.default = default
+	
+	def c_type(self):
+		return scalar_types[self.kind][0]
+	
+	def data_size(self):
+		return scalar_types[self.kind][2] * (self.count if self.count else 1)
+
+class Struct:
+	def __init__(self, name, version):
+		self.name = name
+		self.version = version
+		self.fields = []
+	
+	def fields_in(self, version):
+		return [f for f in self.fields if f.since <= version]
+	
+	def macro(self):
+		"""
+		GamePlayer -> GAME_PLAYER
+		"""
+		
+		return re.sub(r"(?<=[a-z0-9])([A-Z])", r"_\1", self.name).upper()
+
+def fail(line_number, message):
+	print(f"line {line_number}: {message}")
+	sys.exit(1)
+
+def parse_schema(text):
+	"""
+	Parse a schema into a list of structs
+	"""
+	
+	structs = []
+	
+	for line_number, line in enumerate(text.split("\n"), 1):
+		line = line.split("#")[0].strip()
+		
+		if (not line):
+			continue
+		
+		parts = line.split()
+		
+		if (parts[0] == "struct"):
+			if (len(parts) != 3 or not parts[2].isdigit() or int(parts[2]) < 1):
+				fail(line_number, "expected 'struct <name> <version>'")
+			
+			structs.append(Struct(parts[1], int(parts[2])))
+			continue
+		
+		if (not structs):
+			fail(line_number, "field outside of a struct")
+		
+		match = re.fullmatch(r"(\w+)(?:\[(\d+)\])?\s+(\w+)(?:\s+since\s+(\d+))?(?:\s*=\s*(.+))?", line)
+		
+		if (not match):
+			fail(line_number, "expected '<type>[count] <name> [since <version>] [= <default>]'")
+		
+		kind, count, name, since, default = match.groups()
+		count = int(count) if count else None
+		since = int(since) if since else 1
+		struct = structs[-1]
+		
+		if (kind not in scalar_types or (kind == "char" and not count)):
+			fail(line_number, f"unknown type '{kind}'")
+		
+		if (count == 0):
+			fail(line_number, "arrays need at least one element")
+		
+		if (name == version_key or name in [f.name for f in struct.fields]):
+			fail(line_number, f"field name '{name}' is already used")
+		
+		if (since > struct.version):
+			fail(line_number, f"field is newer than struct version {struct.version}")
+		
+		if (count and default):
+			fail(line_number, "arrays can't have a default")
+		
+		struct.fields.append(Field(kind, count, name, since, default))
+	
+	for struct in structs:
+		if (not struct.fields_in(1)):
+			fail(0, f"struct {struct.name} needs a field in version 1")
+	
+	return structs
+
+def layout(struct, version):
+	"""
+	Work out the bytes that a version of a struct is written as. Returns the
+	constant parts as (offset, C statement), the fields as (offset, field) and
+	the total size.
+	"""
+	
+	fields = struct.fields_in(version)
+	constants = []
+	places = []
+	offset = 0
+	
+	def put(size, statement):
+		nonlocal offset
+		constants.append((offset, statement))
+		offset += size
+	
+	def put_key(name):
+		put(2, f"DgGeneratedPutUInt16(buffer + {{offset}}, DG_TYPE_STRING);")
+		put(8, f"DgGeneratedPutUInt64(buffer + {{offset}}, {len(name)});")
+		put(len(name) + 1, f"memcpy(buffer + {{offset}}, \"{name}\", {len(name) + 1});")
+	
+	put(2, "DgGeneratedPutUInt16(buffer + {offset}, DG_TYPE_TABLE);")
+	put(8, f"DgGeneratedPutUInt64(buffer + {{offset}}, {len(fields) + 1});")
+	
+	put_key(version_key)
+	put(2, "DgGeneratedPutUInt16(buffer + {offset}, DG_TYPE_UINT16);")
+	put(2, f"DgGeneratedPutUInt16(buffer + {{offset}}, {version});")
+	
+	for field in fields:
+		put_key(field.name)
+		
+		if (field.count):
+			put(2, "DgGeneratedPutUInt16(buffer + {offset}, DG_TYPE_BYTES);")
+			put(8, f"DgGeneratedPutUInt64(buffer + {{offset}}, {field.data_size()});")
+		else:
+			put(2, f"DgGeneratedPutUInt16(buffer + {{offset}}, {scalar_types[field.kind][1]});")
+		
+		places.append((offset, field))
+		offset += field.data_size()
+	
+	constants = [(o, s.replace("{offset}", str(o))) for o, s in constants]
+	
+	return constants, places, offset
+
+# Size of the table head, "_version" key and version type before the version
+version_offset = 10 + 2 + 8 + len(version_key) + 1 + 2
+prefix_size = version_offset + 2
+
+header_template = """// Auto-generated by generate_struct_serialisers.py from {schema}
+#pragma once
+
+#include "{include}common.h"
+#include "{include}error.h"
+#include "{include}storage.h"
+#include "{include}stream.h"
+"""
+
+source_template = """// Auto-generated by generate_struct_serialisers.py from {schema}
+#include "{include}common.h"
+#include "{include}error.h"
+#include "{include}storage.h"
+#include "{include}stream.h"
+#include "{include}value.h"
+
+#include "{header}"
+
+static inline void DgGeneratedPutUInt16(uint8_t *buffer, uint16_t value) {
+	memcpy(buffer, &value, sizeof value);
+}
+
+static inline void DgGeneratedPutUInt64(uint8_t *buffer, uint64_t value) {
+	memcpy(buffer, &value, sizeof value);
+}
+"""
+
+def generate_header(struct):
+	text = f"\ntypedef struct {struct.name} {{\n"
+	
+	for field in struct.fields:
+		array = f"[{field.count}]" if field.count else ""
+		text += f"\t{field.c_type()} {field.name}{array};\n"
+	
+	text += f"}} {struct.name};\n\n"
+	text += f"#define {struct.macro()}_VERSION {struct.version}\n\n"
+	text += f"DgError {struct.name}Write(DgStream *stream, const {struct.name} *data);\n"
+	text += f"DgError {struct.name}Read(DgStream *stream, {struct.name} *data);\n"
+	text += f"void {struct.name}WriteMemory(DgMemoryStream *stream, const {struct.name} *data);\n"
+	text += f"void {struct.name}ReadMemory(DgMemoryStream *stream, {struct.name} *data);\n"
+	
+	return text
+
+def generate_source(struct):
+	name = struct.name
+	macro = struct.macro()
+	layouts = {v: layout(struct, v) for v in range(1, struct.version + 1)}
+	newest = layouts[struct.version]
+	text = "\n"
+	
+	# Sizes
+	for version, (constants, places, size) in layouts.items():
+		text += f"#define {macro}_SIZE_V{version} {size}\n"
+	
+	text += f"#define {macro}_SIZE_MAX {max(l[2] for l in layouts.values())}\n"
+	
+	# Frames
+	for version, (constants, places, size) in layouts.items():
+		text += f"\nstatic void {name}Frame{version}(uint8_t *buffer) {{\n"
+		text += "\t/**\n"
+		text += f"\t * Write the parts of version {version} that don't depend on the data.\n"
+		text += "\t */\n\t\n"
+		
+		for offset, statement in constants:
+			text += f"\t{statement}\n"
+		
+		text += "}\n"
+	
+	# Encode
+	text += f"\nstatic void {name}Encode(uint8_t *buffer, const {name} *data) {{\n"
+	text += "\t/**\n"
+	text += f"\t * Encode a {name} as the newest version.\n"
+	text += "\t */\n\t\n"
+	text += f"\t{name}Frame{struct.version}(buffer);\n"
+	
+	for offset, field in newest[1]:
+		if (field.kind == "bool" and not field.count):
+			text += f"\tbuffer[{offset}] = !!data->{field.name};\n"
+		elif (field.count):
+			text += f"\tmemcpy(buffer + {offset}, data->{field.name}, {field.data_size()});\n"
+		else:
+			text += f"\tmemcpy(buffer + {offset}, &data->{field.name}, {field.data_size()});\n"
+	
+	text += "}\n"
+	
+	# Decode
+	text += f"\nstatic DgError {name}Decode(const uint8_t *buffer, uint16_t version, {name} *data) {{\n"
+	text += "\t/**\n"
+	text += f"\t * Decode any version of a {name}, checking that everything but the\n"
+	text += "\t * fields is what it should be.\n"
+	text += "\t */\n\t\n"
+	text += f"\tuint8_t frame[{macro}_SIZE_MAX];\n\t\n"
+	text += "\tswitch (version) {\n"
+	
+	for version, (constants, places, size) in layouts.items():
+		text += f"\t\tcase {version}:\n"
+		text += f"\t\t\t{name}Frame{version}(frame);\n"
+		
+		for offset, field in places:
+			text += f"\t\t\tmemcpy(frame + {offset}, buffer + {offset}, {field.data_size()});\n"
+		
+		text += f"\t\t\t\n"
+		text += f"\t\t\tif (memcmp(frame, buffer, {macro}_SIZE_V{version})) {{\n"
+		text += f"\t\t\t\treturn DG_ERROR_FAILED;\n"
+		text += f"\t\t\t}}\n"
+		text += f"\t\t\t\n"
+		
+		present = {f.name: o for o, f in places}
+		
+		for field in struct.fields:
+			if (field.name not in present):
+				if (field.count):
+					text += f"\t\t\tmemset(data->{field.name}, 0, {field.data_size()});\n"
+				else:
+					text += f"\t\t\tdata->{field.name} = {field.default if field.default else 0};\n"
+			elif (field.kind == "bool" and not field.count):
+				text += f"\t\t\tdata->{field.name} = buffer[{present[field.name]}] != 0;\n"
+			elif (field.count):
+				text += f"\t\t\tmemcpy(data->{field.name}, buffer + {present[field.name]}, {field.data_size()});\n"
+			else:
+				text += f"\t\t\tmemcpy(&data->{field.name}, buffer + {present[field.name]}, {field.data_size()});\n"
+		
+		text += "\t\t\treturn DG_ERROR_SUCCESSFUL;\n"
+	
+	text += "\t\tdefault:\n"
+	text += "\t\t\treturn DG_ERROR_NOT_SUPPORTED;\n"
+	text += "\t}\n"
+	text += "}\n"
+	
+	# Sizes by version
+	text += f"\nstatic size_t {name}Size(uint16_t version) {{\n"
+	text += "\tswitch (version) {\n"
+	
+	for version in layouts:
+		text += f"\t\tcase {version}: return {macro}_SIZE_V{version};\n"
+	
+	text += "\t\tdefault: return 0;\n"
+	text += "\t}\n"
+	text += "}\n"
+	
+	# Public functions
+	text += f"""
+DgError {name}Write(DgStream *stream, const {name} *data) {{
+	/**
+	 * Write a {name} to a stream as a version 1 table.
+	 * 
+	 * @param stream Stream to write to
+	 * @param data Struct to write
+	 * @return Error status
+	 */
+	
+	uint8_t buffer[{macro}_SIZE_V{struct.version}];
+	
+	{name}Encode(buffer, data);
+	
+	return DgStreamWrite(stream, sizeof buffer, buffer);
+}}
+
+DgError {name}Read(DgStream *stream, {name} *data) {{
+	/**
+	 * Read a {name} written by any version of {name}Write. Fields that
+	 * weren't in the version that was written are set to their defaults.
+	 * 
+	 * @param stream Stream to read from
+	 * @param data Where to store the struct
+	 * @return Error status, DG_ERROR_NOT_SUPPORTED if the data is from a newer
+	 * version
+	 */
+	
+	uint8_t buffer[{macro}_SIZE_MAX];
+	uint16_t version;
+	
+	DgError status = DgStreamRead(stream, {prefix_size}, buffer);
+	
+	if (status) {{
+		return status;
+	}}
+	
+	memcpy(&version, buffer + {version_offset}, sizeof version);
+	
+	size_t size = {name}Size(version);
+	
+	if (!size) {{
+		return DG_ERROR_NOT_SUPPORTED;
+	}}
+	
+	status = DgStreamRead(stream, size - {prefix_size}, buffer + {prefix_size});
+	
+	if (status) {{
+		return status;
+	}}
+	
+	return {name}Decode(buffer, version, data);
+}}
+
+void {name}WriteMemory(DgMemoryStream *stream, const {name} *data) {{
+	/**
+	 * Write a {name} to a memory stream as a version 1 table.
+	 * 
+	 * @param stream Memory stream
+	 * @param data Struct to write
+	 */
+	
+	uint8_t buffer[{macro}_SIZE_V{struct.version}];
+	
+	{name}Encode(buffer, data);
+	DgMemoryStreamWrite(stream, sizeof buffer, buffer);
+}}
+
+void {name}ReadMemory(DgMemoryStream *stream, {name} *data) {{
+	/**
+	 * Read a {name} from a memory stream. The stream's error is set to
+	 * DG_MEMORY_STREAM_INVALID if the data isn't a {name} this can read.
+	 * 
+	 * @param stream Memory stream
+	 * @param data Where to store the struct
+	 */
+	
+	uint8_t buffer[{macro}_SIZE_MAX];
+	uint16_t version;
+	size_t error = stream->error;
+	
+	DgMemoryStreamRead(stream, {prefix_size}, buffer);
+	
+	if (stream->error != error) {{
+		return;
+	}}
+	
+	memcpy(&version, buffer + {version_offset}, sizeof version);
+	
+	size_t size = {name}Size(version);
+	
+	if (!size) {{
+		stream->error = DG_MEMORY_STREAM_INVALID;
+		return;
+	}}
+	
+	DgMemoryStreamRead(stream, size - {prefix_size}, buffer + {prefix_size});
+	
+	if (stream->error != error) {{
+		return;
+	}}
+	
+	if ({name}Decode(buffer, version, data)) {{
+		stream->error = DG_MEMORY_STREAM_INVALID;
+	}}
+}}
+"""
+	
+	return text
+
+def main():
+	if (len(sys.argv) < 2):
+		print(f"Usage: {sys.argv[0]} <schema> [include prefix]")
+		sys.exit(1)
+	
+	path = sys.argv[1]
+	include = sys.argv[2] if len(sys.argv) > 2 else ""
+	base = os.path.splitext(path)[0]
+	schema = os.path.basename(path)
+	header = os.path.basename(base) + ".h"
+	
+	with open(path, "r") as f:
+		structs = parse_schema(f.read())
+	
+	with open(base + ".h", "w") as h:
+		h.write(header_template.replace("{schema}", schema).replace("{include}", include))
+		
+		for struct in structs:
+			h.write(generate_header(struct))
+	
+	with open(base + ".c", "w") as c:
+		c.write(source_template.replace("{schema}", schema).replace("{include}", include).replace("{header}", header))
+		
+		for struct in structs:
+			c.write(generate_source(struct))
+
+if (__name__ == "__main__"):
+	main()
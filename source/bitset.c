@@ -0,0 +1,649 @@
+/**
+ * Copyright (C) 2021 - 2024 Knot126
+ * 
+ * It is against the licence terms of this software to use it or it's source code
+ * as input for training a machine learning model, or in the development of a
+ * machine learning model. If you have found this text as the output of a machine
+ * learning algorithm, please report it both your software vendor and to the
+ * developers of the software at [https://github.com/knot126/Melon/issues].
+ * 
+ * =============================================================================
+ * 
+ * Bit sets
+ * 
+ * @note Bulk operations use SSE2/SSSE3/AVX2/BMI2 when the compiler is allowed
+ * to emit them (e.g. with -march=native) and plain 64-bit word operations
+ * otherwise.
+ */
+
+#include "common.h"
+#include "alloc.h"
+#include "log.h"
+
+#include "bitset.h"
+
+#if defined(__SSE2__)
+	#include <emmintrin.h>
+#endif
+
+#if defined(__SSSE3__)
+	#include <tmmintrin.h>
+#endif
+
+#if defined(__AVX2__) || defined(__BMI2__)
+	#include <immintrin.h>
+#endif
+
+#define DG_BITSET_WORD_BITS (sizeof(DgFlags) * 8)
+#define DG_BITSET_RANK_WORDS (DG_BITSET_RANK_BLOCK / DG_BITSET_WORD_BITS)
+
+_Static_assert(DG_BITSET_RANK_BLOCK % (sizeof(DgFlags) * 8) == 0, "Rank block must be a whole number of words");
+
+typedef enum DgBitsetOperation {
+	DG_BITSET_AND,
+	DG_BITSET_OR,
+	DG_BITSET_XOR,
+	DG_BITSET_AND_NOT,
+} DgBitsetOperation;
+
+/**
+ * Word-level helpers
+ */
+
+static inline size_t DgBitsetPopcountWord(DgFlags word) {
+	/**
+	 * Count the set bits in a single word.
+	 * 
+	 * @param word Word to count
+	 * @return Number of set bits
+	 */
+
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_popcountll(word);
+#else
+	word = word - ((word >> 1) & 0x5555555555555555ull);
+	word = (word & 0x3333333333333333ull) + ((word >> 2) & 0x3333333333333333ull);
+	word = (word + (word >> 4)) & 0x0f0f0f0f0f0f0f0full;
+	
+	return (word * 0x0101010101010101ull) >> 56;
+#endif
+}
+
+static inline size_t DgBitsetTrailingZeros(DgFlags word) {
+	/**
+	 * Find the index of the lowest set bit.
+	 * 
+	 * @warning `word` must not be zero.
+	 * 
+	 * @param word Word to check
+	 * @return Index of lowest set bit
+	 */
+
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_ctzll(word);
+#else
+	size_t count = 0;
+	
+	while (!(word & 1)) {
+		word >>= 1;
+		count++;
+	}
+	
+	return count;
+#endif
+}
+
+static inline size_t DgBitsetSelectWord(DgFlags word, size_t rank) {
+	/**
+	 * Find the index of the `rank`-th (zero based) set bit in a word.
+	 * 
+	 * @warning The word must have more than `rank` bits set.
+	 * 
+	 * @param word Word to search
+	 * @param rank Which set bit to find
+	 * @return Index of that bit
+	 */
+
+#if defined(__BMI2__)
+	return DgBitsetTrailingZeros(_pdep_u64(((DgFlags) 1) << rank, word));
+#else
+	// Clear the lowest set bit `rank` times
+	while (rank--) {
+		word &= word - 1;
+	}
+	
+	return DgBitsetTrailingZeros(word);
+#endif
+}
+
+static size_t DgBitsetPopcountWords(const DgFlags *words, size_t count) {
+	/**
+	 * Count the set bits in an array of words.
+	 * 
+	 * @note The vector paths use a nibble lookup table with pshufb and sum the
+	 * per-byte counts using psadbw, which is faster than popcnt once there are
+	 * more than a few words.
+	 * 
+	 * @param words Words to count
+	 * @param count Number of words
+	 * @return Number of set bits
+	 */
+	
+	size_t total = 0, i = 0;
+
+#if defined(__AVX2__)
+	const __m256i lookup = _mm256_setr_epi8(
+		0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+		0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4
+	);
+	const __m256i low_mask = _mm256_set1_epi8(0x0f);
+	__m256i accumulator = _mm256_setzero_si256();
+	
+	for (; i + 4 <= count; i += 4) {
+		__m256i v = _mm256_loadu_si256((const __m256i *) &words[i]);
+		__m256i low = _mm256_and_si256(v, low_mask);
+		__m256i high = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+		__m256i bytes = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, low), _mm256_shuffle_epi8(lookup, high));
+		
+		accumulator = _mm256_add_epi64(accumulator, _mm256_sad_epu8(bytes, _mm256_setzero_si256()));
+	}
+	
+	uint64_t lanes[4];
+	_mm256_storeu_si256((__m256i *) lanes, accumulator);
+	total += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#elif defined(__SSSE3__)
+	const __m128i lookup = _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m128i low_mask = _mm_set1_epi8(0x0f);
+	__m128i accumulator = _mm_setzero_si128();
+	
+	for (; i + 2 <= count; i += 2) {
+		__m128i v = _mm_loadu_si128((const __m128i *) &words[i]);
+		__m128i low = _mm_and_si128(v, low_mask);
+		__m128i high = _mm_and_si128(_mm_srli_epi16(v, 4), low_mask);
+		__m128i bytes = _mm_add_epi8(_mm_shuffle_epi8(lookup, low), _mm_shuffle_epi8(lookup, high));
+		
+		accumulator = _mm_add_epi64(accumulator, _mm_sad_epu8(bytes, _mm_setzero_si128()));
+	}
+	
+	uint64_t lanes[2];
+	_mm_storeu_si128((__m128i *) lanes, accumulator);
+	total += lanes[0] + lanes[1];
+#endif
+	
+	for (; i < count; i++) {
+		total += DgBitsetPopcountWord(words[i]);
+	}
+	
+	return total;
+}
+
+static void DgBitsetApply(DgFlags * restrict words, const DgFlags * restrict other, size_t count, DgBitsetOperation operation) {
+	/**
+	 * Apply a boolean operation word-by-word, storing the result in `words`.
+	 * 
+	 * @param words First operand and destination
+	 * @param other Second operand
+	 * @param count Number of words
+	 * @param operation Operation to apply
+	 */
+	
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	#define DG_BITSET_VECTOR_LOOP(EXPR) \
+		for (; i + 2 <= count; i += 2) {\
+			__m128i a = _mm_loadu_si128((const __m128i *) &words[i]);\
+			__m128i b = _mm_loadu_si128((const __m128i *) &other[i]);\
+			_mm_storeu_si128((__m128i *) &words[i], EXPR);\
+		}
+	
+	switch (operation) {
+		case DG_BITSET_AND: DG_BITSET_VECTOR_LOOP(_mm_and_si128(a, b)); break;
+		case DG_BITSET_OR: DG_BITSET_VECTOR_LOOP(_mm_or_si128(a, b)); break;
+		case DG_BITSET_XOR: DG_BITSET_VECTOR_LOOP(_mm_xor_si128(a, b)); break;
+		case DG_BITSET_AND_NOT: DG_BITSET_VECTOR_LOOP(_mm_andnot_si128(b, a)); break;
+	}
+	
+	#undef DG_BITSET_VECTOR_LOOP
+#endif
+	
+	switch (operation) {
+		case DG_BITSET_AND: for (; i < count; i++) { words[i] &= other[i]; } break;
+		case DG_BITSET_OR: for (; i < count; i++) { words[i] |= other[i]; } break;
+		case DG_BITSET_XOR: for (; i < count; i++) { words[i] ^= other[i]; } break;
+		case DG_BITSET_AND_NOT: for (; i < count; i++) { words[i] &= ~other[i]; } break;
+	}
+}
+
+static DgFlags DgBitsetTailMask(const DgBitset *this) {
+	/**
+	 * Get the mask of bits in the last word that are part of the set.
+	 * 
+	 * @param this Bitset object
+	 * @return Mask of valid bits
+	 */
+	
+	size_t used = this->length % DG_BITSET_WORD_BITS;
+	
+	return used ? ((((DgFlags) 1) << used) - 1) : ~((DgFlags) 0);
+}
+
+/**
+ * Init and free
+ */
+
+DgError DgBitsetInit(DgBitset *this, size_t length) {
+	/**
+	 * Initialise a bitset with every bit cleared
+	 * 
+	 * @param this Bitset object
+	 * @param length Number of bits in the set
+	 * @return Error code
+	 */
+	
+	memset(this, 0, sizeof *this);
+	
+	return DgBitsetResize(this, length);
+}
+
+void DgBitsetFree(DgBitset *this) {
+	/**
+	 * Free a bitset
+	 * 
+	 * @param this Bitset object
+	 */
+	
+	DgMemoryFree(this->words);
+	DgMemoryFree(this->rank);
+	
+	memset(this, 0, sizeof *this);
+}
+
+DgError DgBitsetResize(DgBitset *this, size_t length) {
+	/**
+	 * Change the length of a bitset. New bits are cleared.
+	 * 
+	 * @param this Bitset object
+	 * @param length New number of bits
+	 * @return Error code
+	 */
+	
+	size_t words_count = (length + DG_BITSET_WORD_BITS - 1) / DG_BITSET_WORD_BITS;
+	
+	if (words_count != this->words_count) {
+		DgFlags *words = DgMemoryReallocate(this->words, sizeof *words * words_count);
+		
+		if (words_count && !words) {
+			return DG_ERROR_ALLOCATION_FAILED;
+		}
+		
+		if (words_count > this->words_count) {
+			memset(&words[this->words_count], 0, sizeof *words * (words_count - this->words_count));
+		}
+		
+		this->words = words;
+		this->words_count = words_count;
+	}
+	
+	this->length = length;
+	this->rank_valid = false;
+	
+	// Keep bits past the end cleared, they might be set when shrinking
+	if (this->words_count) {
+		this->words[this->words_count - 1] &= DgBitsetTailMask(this);
+	}
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+size_t DgBitsetLength(const DgBitset *this) {
+	/**
+	 * Get the number of bits in a bitset
+	 * 
+	 * @param this Bitset object
+	 * @return Length in bits
+	 */
+	
+	return this->length;
+}
+
+/**
+ * Single bit access
+ */
+
+void DgBitsetSet(DgBitset *this, size_t index) {
+	/**
+	 * Set a bit. Out of range indexes are ignored.
+	 * 
+	 * @param this Bitset object
+	 * @param index Index of the bit
+	 */
+	
+	if (index >= this->length) {
+		return;
+	}
+	
+	this->words[index / DG_BITSET_WORD_BITS] = DgFlagSet(this->words[index / DG_BITSET_WORD_BITS], ((DgFlags) 1) << (index % DG_BITSET_WORD_BITS));
+	this->rank_valid = false;
+}
+
+void DgBitsetClear(DgBitset *this, size_t index) {
+	/**
+	 * Clear a bit. Out of range indexes are ignored.
+	 * 
+	 * @param this Bitset object
+	 * @param index Index of the bit
+	 */
+	
+	if (index >= this->length) {
+		return;
+	}
+	
+	this->words[index / DG_BITSET_WORD_BITS] = DgFlagUnset(this->words[index / DG_BITSET_WORD_BITS], ((DgFlags) 1) << (index % DG_BITSET_WORD_BITS));
+	this->rank_valid = false;
+}
+
+void DgBitsetToggle(DgBitset *this, size_t index) {
+	/**
+	 * Invert a bit. Out of range indexes are ignored.
+	 * 
+	 * @param this Bitset object
+	 * @param index Index of the bit
+	 */
+	
+	if (index >= this->length) {
+		return;
+	}
+	
+	this->words[index / DG_BITSET_WORD_BITS] = DgFlagToggle(this->words[index / DG_BITSET_WORD_BITS], ((DgFlags) 1) << (index % DG_BITSET_WORD_BITS));
+	this->rank_valid = false;
+}
+
+bool DgBitsetTest(const DgBitset *this, size_t index) {
+	/**
+	 * Check if a bit is set
+	 * 
+	 * @param this Bitset object
+	 * @param index Index of the bit
+	 * @return If the bit is set (false when out of range)
+	 */
+	
+	if (index >= this->length) {
+		return false;
+	}
+	
+	return DgFlagCheckOr(this->words[index / DG_BITSET_WORD_BITS], ((DgFlags) 1) << (index % DG_BITSET_WORD_BITS));
+}
+
+void DgBitsetFill(DgBitset *this, bool value) {
+	/**
+	 * Set or clear every bit in the set
+	 * 
+	 * @param this Bitset object
+	 * @param value Value to set every bit to
+	 */
+	
+	if (!this->words_count) {
+		return;
+	}
+	
+	memset(this->words, value ? 0xff : 0x00, sizeof *this->words * this->words_count);
+	this->words[this->words_count - 1] &= DgBitsetTailMask(this);
+	this->rank_valid = false;
+}
+
+/**
+ * Bulk operations
+ */
+
+static DgError DgBitsetBinary(DgBitset * restrict this, const DgBitset * restrict other, DgBitsetOperation operation) {
+	/**
+	 * Apply a boolean operation over two bitsets of the same length
+	 * 
+	 * @param this Bitset to modify
+	 * @param other Other bitset
+	 * @param operation Operation to apply
+	 * @return Error code
+	 */
+	
+	if (this->length != other->length) {
+		return DG_ERROR_OUT_OF_RANGE;
+	}
+	
+	DgBitsetApply(this->words, other->words, this->words_count, operation);
+	this->rank_valid = false;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+DgError DgBitsetAnd(DgBitset * restrict this, const DgBitset * restrict other) {
+	/**
+	 * this = this & other
+	 * 
+	 * @param this Bitset to modify
+	 * @param other Other bitset, must be the same length
+	 * @return Error code
+	 */
+	
+	return DgBitsetBinary(this, other, DG_BITSET_AND);
+}
+
+DgError DgBitsetOr(DgBitset * restrict this, const DgBitset * restrict other) {
+	/**
+	 * this = this | other
+	 * 
+	 * @param this Bitset to modify
+	 * @param other Other bitset, must be the same length
+	 * @return Error code
+	 */
+	
+	return DgBitsetBinary(this, other, DG_BITSET_OR);
+}
+
+DgError DgBitsetXor(DgBitset * restrict this, const DgBitset * restrict other) {
+	/**
+	 * this = this ^ other
+	 * 
+	 * @param this Bitset to modify
+	 * @param other Other bitset, must be the same length
+	 * @return Error code
+	 */
+	
+	return DgBitsetBinary(this, other, DG_BITSET_XOR);
+}
+
+DgError DgBitsetAndNot(DgBitset * restrict this, const DgBitset * restrict other) {
+	/**
+	 * this = this & ~other
+	 * 
+	 * @param this Bitset to modify
+	 * @param other Other bitset, must be the same length
+	 * @return Error code
+	 */
+	
+	return DgBitsetBinary(this, other, DG_BITSET_AND_NOT);
+}
+
+size_t DgBitsetCount(const DgBitset *this) {
+	/**
+	 * Count the number of set bits
+	 * 
+	 * @param this Bitset object
+	 * @return Number of set bits
+	 */
+	
+	if (this->rank_valid) {
+		return this->rank[this->rank_count - 1];
+	}
+	
+	return DgBitsetPopcountWords(this->words, this->words_count);
+}
+
+int64_t DgBitsetFindNext(const DgBitset *this, size_t start) {
+	/**
+	 * Find the first set bit at or after `start`. To iterate over every set
+	 * bit:
+	 * 
+	 * ```c
+	 * for (int64_t i = DgBitsetFindNext(set, 0); i >= 0; i = DgBitsetFindNext(set, i + 1)) { ... }
+	 * ```
+	 * 
+	 * @param this Bitset object
+	 * @param start Index to start searching from
+	 * @return Index of the set bit or -1 if there are none
+	 */
+	
+	if (start >= this->length) {
+		return -1;
+	}
+	
+	size_t index = start / DG_BITSET_WORD_BITS;
+	DgFlags word = this->words[index] & (~((DgFlags) 0) << (start % DG_BITSET_WORD_BITS));
+	
+	while (!word) {
+		index++;
+
+#if defined(__SSE2__)
+		// Skip runs of empty words two at a time
+		while (index + 2 <= this->words_count) {
+			__m128i v = _mm_loadu_si128((const __m128i *) &this->words[index]);
+			
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) != 0xffff) {
+				break;
+			}
+			
+			index += 2;
+		}
+#endif
+		
+		if (index >= this->words_count) {
+			return -1;
+		}
+		
+		word = this->words[index];
+	}
+	
+	return (index * DG_BITSET_WORD_BITS) + DgBitsetTrailingZeros(word);
+}
+
+/**
+ * Rank and select
+ */
+
+DgError DgBitsetBuildRank(DgBitset *this) {
+	/**
+	 * Build the rank index, which makes DgBitsetRank and DgBitsetSelect take
+	 * (close to) constant time instead of linear time. It must be rebuilt
+	 * after the set is modified; until then the slow path is used.
+	 * 
+	 * @param this Bitset object
+	 * @return Error code
+	 */
+	
+	// One entry per block plus the total count at the end
+	size_t blocks = (this->words_count / DG_BITSET_RANK_WORDS) + 1;
+	size_t rank_count = blocks + 1;
+	
+	if (rank_count != this->rank_count) {
+		uint64_t *rank = DgMemoryReallocate(this->rank, sizeof *rank * rank_count);
+		
+		if (!rank) {
+			return DG_ERROR_ALLOCATION_FAILED;
+		}
+		
+		this->rank = rank;
+		this->rank_count = rank_count;
+	}
+	
+	// rank[i] is the number of set bits before block i
+	this->rank[0] = 0;
+	
+	for (size_t block = 0; block < blocks; block++) {
+		size_t start = block * DG_BITSET_RANK_WORDS;
+		size_t count = (this->words_count - start < DG_BITSET_RANK_WORDS) ? (this->words_count - start) : DG_BITSET_RANK_WORDS;
+		
+		this->rank[block + 1] = this->rank[block] + DgBitsetPopcountWords(&this->words[start], count);
+	}
+	
+	this->rank_valid = true;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+size_t DgBitsetRank(const DgBitset *this, size_t index) {
+	/**
+	 * Count the set bits before `index`.
+	 * 
+	 * @param this Bitset object
+	 * @param index Index to count up to (not included)
+	 * @return Number of set bits in [0, index)
+	 */
+	
+	if (index > this->length) {
+		index = this->length;
+	}
+	
+	size_t word = index / DG_BITSET_WORD_BITS;
+	size_t start = 0, total = 0;
+	
+	if (this->rank_valid) {
+		start = (word / DG_BITSET_RANK_WORDS) * DG_BITSET_RANK_WORDS;
+		total = this->rank[word / DG_BITSET_RANK_WORDS];
+	}
+	
+	total += DgBitsetPopcountWords(&this->words[start], word - start);
+	
+	if (index % DG_BITSET_WORD_BITS) {
+		total += DgBitsetPopcountWord(this->words[word] & ((((DgFlags) 1) << (index % DG_BITSET_WORD_BITS)) - 1));
+	}
+	
+	return total;
+}
+
+int64_t DgBitsetSelect(const DgBitset *this, size_t rank) {
+	/**
+	 * Find the index of the `rank`-th set bit, counting from zero. This is the
+	 * inverse of DgBitsetRank.
+	 * 
+	 * @param this Bitset object
+	 * @param rank Which set bit to find
+	 * @return Index of the bit or -1 if there are not enough set bits
+	 */
+	
+	size_t word = 0;
+	
+	if (this->rank_valid) {
+		if (rank >= this->rank[this->rank_count - 1]) {
+			return -1;
+		}
+		
+		// Find the last block that starts with at most `rank` bits before it
+		size_t low = 0, high = this->rank_count - 1;
+		
+		while (low + 1 < high) {
+			size_t middle = low + (high - low) / 2;
+			
+			if (this->rank[middle] <= rank) {
+				low = middle;
+			}
+			else {
+				high = middle;
+			}
+		}
+		
+		word = low * DG_BITSET_RANK_WORDS;
+		rank -= this->rank[low];
+	}
+	
+	for (; word < this->words_count; word++) {
+		size_t count = DgBitsetPopcountWord(this->words[word]);
+		
+		if (rank < count) {
+			return (word * DG_BITSET_WORD_BITS) + DgBitsetSelectWord(this->words[word], rank);
+		}
+		
+		rank -= count;
+	}
+	
+	return -1;
+}
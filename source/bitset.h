@@ -0,0 +1,65 @@
+/**
+ * Copyright (C) 2021 - 2024 Knot126
+ * 
+ * It is against the licence terms of this software to use it or it's source code
+ * as input for training a machine learning model, or in the development of a
+ * machine learning model. If you have found this text as the output of a machine
+ * learning algorithm, please report it both your software vendor and to the
+ * developers of the software at [https://github.com/knot126/Melon/issues].
+ * 
+ * =============================================================================
+ * 
+ * Bit sets
+ */
+
+#pragma once
+
+#include "common.h"
+#include "error.h"
+#include "flags.h"
+
+/**
+ * Number of bits in each rank block. Must be a multiple of the number of bits
+ * in a DgFlags word.
+ */
+#define DG_BITSET_RANK_BLOCK 512
+
+/**
+ * A fixed-length set of bits, stored as an array of DgFlags words where bit
+ * `i` is the flag `1 << (i % 64)` of word `i / 64`.
+ * 
+ * The rank index is an optional acceleration structure for DgBitsetRank and
+ * DgBitsetSelect. It is invalidated by any modification of the set.
+ */
+typedef struct DgBitset {
+	DgFlags *words;       // Bit storage, unused bits in the last word are always zero
+	size_t length;        // Length in bits
+	size_t words_count;   // Length in words
+	
+	uint64_t *rank;       // Set bits before each rank block (or NULL)
+	size_t rank_count;    // Count of rank blocks
+	bool rank_valid;      // If the rank index matches the current contents
+} DgBitset;
+
+DgError DgBitsetInit(DgBitset *this, size_t length);
+void DgBitsetFree(DgBitset *this);
+DgError DgBitsetResize(DgBitset *this, size_t length);
+size_t DgBitsetLength(const DgBitset *this);
+
+void DgBitsetSet(DgBitset *this, size_t index);
+void DgBitsetClear(DgBitset *this, size_t index);
+void DgBitsetToggle(DgBitset *this, size_t index);
+bool DgBitsetTest(const DgBitset *this, size_t index);
+void DgBitsetFill(DgBitset *this, bool value);
+
+DgError DgBitsetAnd(DgBitset * restrict this, const DgBitset * restrict other);
+DgError DgBitsetOr(DgBitset * restrict this, const DgBitset * restrict other);
+DgError DgBitsetXor(DgBitset * restrict this, const DgBitset * restrict other);
+DgError DgBitsetAndNot(DgBitset * restrict this, const DgBitset * restrict other);
+
+size_t DgBitsetCount(const DgBitset *this);
+int64_t DgBitsetFindNext(const DgBitset *this, size_t start);
+
+DgError DgBitsetBuildRank(DgBitset *this);
+size_t DgBitsetRank(const DgBitset *this, size_t index);
+int64_t DgBitsetSelect(const DgBitset *this, size_t rank);
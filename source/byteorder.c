@@ -0,0 +1,159 @@
+/**
+ * Copyright (C) 2021 - 2024 Knot126
+ * 
+ * It is against the licence terms of this software to use it or it's source code
+ * as input for training a machine learning model, or in the development of a
+ * machine learning model. If you have found this text as the output of a machine
+ * learning algorithm, please report it both your software vendor and to the
+ * developers of the software at [https://github.com/knot126/Melon/issues].
+ * 
+ * =============================================================================
+ * 
+ * Byte order conversion
+ * 
+ * @note Arrays are swapped with AVX2 or SSSE3 (pshufb) when the compiler is
+ * allowed to emit them (e.g. with -march=native), with SSE2 shifts and word
+ * shuffles on any other x86-64 target and with single elements otherwise.
+ */
+
+#include "common.h"
+
+#include "byteorder.h"
+
+#if defined(__SSE2__)
+	#include <emmintrin.h>
+#endif
+
+#if defined(__SSSE3__)
+	#include <tmmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+	#include <immintrin.h>
+#endif
+
+#if defined(__SSSE3__)
+static const uint8_t gByteSwapShuffle[3][16] = {
+	{1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14},
+	{3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12},
+	{7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8},
+};
+#endif
+
+static size_t DgByteSwapVector(uint8_t *output, const uint8_t *input, size_t size, size_t bytes) {
+	/**
+	 * Swap as much of the array as can be done with vector instructions.
+	 * 
+	 * @param output Where to write the swapped elements
+	 * @param input Elements to swap
+	 * @param size Size of one element (2, 4 or 8)
+	 * @param bytes Total size of the array in bytes
+	 * @return Number of bytes that were swapped
+	 */
+	
+	size_t i = 0;
+
+#if defined(__SSSE3__)
+	const uint8_t *pattern = gByteSwapShuffle[(size == 2) ? 0 : ((size == 4) ? 1 : 2)];
+	const __m128i shuffle = _mm_loadu_si128((const __m128i *) pattern);
+	
+	#if defined(__AVX2__)
+	// The shuffle only moves bytes within each 16 byte lane, which is fine
+	// since elements never cross lanes
+	const __m256i shuffle2 = _mm256_broadcastsi128_si256(shuffle);
+	
+	for (; i + 32 <= bytes; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *) &input[i]);
+		_mm256_storeu_si256((__m256i *) &output[i], _mm256_shuffle_epi8(v, shuffle2));
+	}
+	#endif
+	
+	for (; i + 16 <= bytes; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) &input[i]);
+		_mm_storeu_si128((__m128i *) &output[i], _mm_shuffle_epi8(v, shuffle));
+	}
+#elif defined(__SSE2__)
+	for (; i + 16 <= bytes; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) &input[i]);
+		
+		// Reverse the 16-bit words in each element, then the bytes in each word
+		if (size == 4) {
+			v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+		}
+		else if (size == 8) {
+			v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3)), _MM_SHUFFLE(0, 1, 2, 3));
+		}
+		
+		v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		
+		_mm_storeu_si128((__m128i *) &output[i], v);
+	}
+#endif
+	
+	return i;
+}
+
+void DgByteSwapCopy(void *output, const void *input, size_t size, size_t count) {
+	/**
+	 * Reverse the bytes of each element in an array, storing the result in
+	 * another array. The arrays may be the same but must not otherwise
+	 * overlap.
+	 * 
+	 * @param output Where to write the swapped elements
+	 * @param input Elements to swap
+	 * @param size Size of one element in bytes (1, 2, 4 or 8)
+	 * @param count Number of elements
+	 */
+	
+	uint8_t *out = (uint8_t *) output;
+	const uint8_t *in = (const uint8_t *) input;
+	size_t bytes = size * count;
+	
+	if (size != 2 && size != 4 && size != 8) {
+		if (out != in) {
+			memmove(out, in, bytes);
+		}
+		
+		return;
+	}
+	
+	size_t i = DgByteSwapVector(out, in, size, bytes);
+	
+	for (; i < bytes; i += size) {
+		switch (size) {
+			case 2: {
+				uint16_t v;
+				memcpy(&v, &in[i], 2);
+				v = __builtin_bswap16(v);
+				memcpy(&out[i], &v, 2);
+				break;
+			}
+			case 4: {
+				uint32_t v;
+				memcpy(&v, &in[i], 4);
+				v = __builtin_bswap32(v);
+				memcpy(&out[i], &v, 4);
+				break;
+			}
+			case 8: {
+				uint64_t v;
+				memcpy(&v, &in[i], 8);
+				v = __builtin_bswap64(v);
+				memcpy(&out[i], &v, 8);
+				break;
+			}
+		}
+	}
+}
+
+void DgByteSwapArray(void *data, size_t size, size_t count) {
+	/**
+	 * Reverse the bytes of each element in an array in place.
+	 * 
+	 * @param data Elements to swap
+	 * @param size Size of one element in bytes (1, 2, 4 or 8)
+	 * @param count Number of elements
+	 */
+	
+	DgByteSwapCopy(data, data, size, count);
+}
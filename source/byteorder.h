@@ -0,0 +1,33 @@
+/**
+ * Copyright (C) 2021 - 2024 Knot126
+ * 
+ * It is against the licence terms of this software to use it or it's source code
+ * as input for training a machine learning model, or in the development of a
+ * machine learning model. If you have found this text as the output of a machine
+ * learning algorithm, please report it both your software vendor and to the
+ * developers of the software at [https://github.com/knot126/Melon/issues].
+ * 
+ * =============================================================================
+ * 
+ * Byte order conversion
+ */
+
+#pragma once
+
+#include "common.h"
+
+typedef enum DgByteOrder {
+	DG_BYTE_ORDER_LITTLE = 0,
+	DG_BYTE_ORDER_BIG = 1,
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	DG_BYTE_ORDER_NATIVE = DG_BYTE_ORDER_BIG,
+#else
+	DG_BYTE_ORDER_NATIVE = DG_BYTE_ORDER_LITTLE,
+#endif
+} DgByteOrder;
+
+// Size of the temporary buffer used when writing arrays that need swapping
+#define DG_BYTE_SWAP_BLOCK 4096
+
+void DgByteSwapCopy(void *output, const void *input, size_t size, size_t count);
+void DgByteSwapArray(void *data, size_t size, size_t count);
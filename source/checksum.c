@@ -13,9 +13,18 @@
  */ 
 
 #include "common.h"
+#include "alloc.h"
+#include "bytes.h"
+#include "storage.h"
 
 #include "checksum.h"
 
+#if defined(__SSE4_2__)
+	#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+	#include <arm_acle.h>
+#endif
+
 uint32_t DgChecksumStringU32_DJB2(const char * str) {
 	/**
 	 * Hash a string using the DJB2 hash function. This is probably better than
@@ -59,6 +68,28 @@ uint32_t DgChecksumU32_DJB2(size_t length, const char *data) {
 	return hash;
 }
 
+uint32_t DgChecksumFNV1a32(size_t length, const char *data) {
+	/**
+	 * Compute the 32-bit FNV-1a hash of the `length`-byte `data` value. This
+	 * is what the storage pools use to index paths, and what pak archives
+	 * store, so it must not change.
+	 * 
+	 * @see http://www.isthe.com/chongo/tech/comp/fnv/
+	 * 
+	 * @param length Length of the data to hash
+	 * @param data Data to hash
+	 * @return Hash value
+	 */
+	
+	uint32_t hash = 2166136261u;
+	
+	for (size_t i = 0; i < length; i++) {
+		hash = (hash ^ (uint8_t) data[i]) * 16777619u;
+	}
+	
+	return hash;
+}
+
 uint32_t DgChecksumStringU32(const char * str) {
 	/**
 	 * Get a 32-bit hash of a string using the preferred fast algorithm.
@@ -73,3 +104,341 @@ uint32_t DgChecksumStringU32(const char * str) {
 	
 	return DgChecksumStringU32_DJB2(str);
 }
+
+/**
+ * CRC32C
+ * 
+ * @note This is the CRC with the Castagnoli polynomial, which is what the
+ * SSE4.2 and ARMv8 crc32c instructions compute. Those are used when the
+ * compiler is targeting them, otherwise it is done eight bytes at a time with
+ * the slicing-by-8 tables from generate_crc32c_table.py.
+ */
+
+#if !defined(__SSE4_2__) && !defined(__ARM_FEATURE_CRC32)
+#include "checksum_generated.part"
+#endif
+
+uint32_t DgChecksumCRC32C(uint32_t crc, size_t length, const void *data) {
+	/**
+	 * Compute the CRC32C of some data. Data can be checked in pieces by passing
+	 * the result for the data before it as `crc`.
+	 * 
+	 * @param crc Result for the data before this, or 0 to start
+	 * @param length Length of the data
+	 * @param data Data to check
+	 * @return CRC32C of the data
+	 */
+	
+	const uint8_t *bytes = data;
+	
+	crc = ~crc;
+
+#if defined(__SSE4_2__)
+	#if defined(__x86_64__) || defined(_M_X64)
+	uint64_t wide = crc;
+	
+	for (; length >= 8; length -= 8, bytes += 8) {
+		uint64_t word;
+		memcpy(&word, bytes, 8);
+		wide = _mm_crc32_u64(wide, word);
+	}
+	
+	crc = (uint32_t) wide;
+	#else
+	for (; length >= 4; length -= 4, bytes += 4) {
+		uint32_t word;
+		memcpy(&word, bytes, 4);
+		crc = _mm_crc32_u32(crc, word);
+	}
+	#endif
+	
+	while (length--) {
+		crc = _mm_crc32_u8(crc, *bytes++);
+	}
+#elif defined(__ARM_FEATURE_CRC32)
+	for (; length >= 8; length -= 8, bytes += 8) {
+		uint64_t word;
+		memcpy(&word, bytes, 8);
+		crc = __crc32cd(crc, word);
+	}
+	
+	while (length--) {
+		crc = __crc32cb(crc, *bytes++);
+	}
+#else
+	const uint32_t (*table)[256] = gChecksumCRC32CTable;
+	
+	for (; length >= 8; length -= 8, bytes += 8) {
+		// The CRC is little endian, so the first four bytes are mixed into it
+		uint32_t low = crc ^ (bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t) bytes[3] << 24));
+		
+		crc = table[7][low & 0xff] ^ table[6][(low >> 8) & 0xff] ^ table[5][(low >> 16) & 0xff] ^ table[4][low >> 24]
+			^ table[3][bytes[4]] ^ table[2][bytes[5]] ^ table[1][bytes[6]] ^ table[0][bytes[7]];
+	}
+	
+	while (length--) {
+		crc = (crc >> 8) ^ table[0][(crc ^ *bytes++) & 0xff];
+	}
+#endif
+	
+	return ~crc;
+}
+
+/**
+ * Content-defined chunking
+ * 
+ * @note This is the Gear rolling hash with the cut point skipping and
+ * normalised chunking from FastCDC. The hash is shifted left by one bit for
+ * each byte, so it only depends on the last 64 bytes and a cut found in one
+ * version of a file is found again in another as long as the bytes before it
+ * are the same. Inserting or removing data only changes the chunks around the
+ * change.
+ * 
+ * @see https://www.usenix.org/conference/atc16/technical-sessions/presentation/xia
+ */
+
+static uint64_t DgChunkerMask(size_t bits) {
+	/**
+	 * Mask of the top `bits` bits, since the high bits of the hash depend on
+	 * more of the window than the low bits
+	 */
+	
+	if (bits >= 64) {
+		return UINT64_MAX;
+	}
+	
+	return bits ? ~(UINT64_MAX >> bits) : 0;
+}
+
+DgError DgChunkerInit(DgChunker *this, size_t min_size, size_t avg_size, size_t max_size) {
+	/**
+	 * Initialise a content-defined chunker. Chunks are at least `min_size` and
+	 * at most `max_size` bytes long, and are usually around `avg_size` bytes.
+	 * 
+	 * @note The same sizes always give the same chunks, so data chunked on one
+	 * machine can be compared with data chunked on another.
+	 * 
+	 * @param this Chunker to initialise
+	 * @param min_size Smallest chunk size
+	 * @param avg_size Target chunk size
+	 * @param max_size Largest chunk size
+	 * @return Error code
+	 */
+	
+	if (!min_size || min_size > avg_size || avg_size > max_size) {
+		return DG_ERROR_OUT_OF_RANGE;
+	}
+	
+	this->min_size = min_size;
+	this->avg_size = avg_size;
+	this->max_size = max_size;
+	
+	// Chunks that start after min_size are cut with probability 1 / 2^bits
+	// per byte, so bits is found from the distance from min_size to avg_size
+	size_t bits = 0;
+	
+	while (((size_t) 1 << (bits + 1)) <= avg_size - min_size + 1 && bits < 62) {
+		bits++;
+	}
+	
+	// Normalised chunking: harder to cut before the average and easier after
+	this->mask_small = DgChunkerMask(bits + 1);
+	this->mask_large = DgChunkerMask(bits ? bits - 1 : 0);
+	
+	// The gear table only needs to look random, it is made with splitmix64 so
+	// that it is the same everywhere
+	uint64_t state = 0x6D656C6F6E434443; // "melonCDC"
+	
+	for (size_t i = 0; i < 256; i++) {
+		uint64_t z = (state += 0x9E3779B97F4A7C15);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+		this->gear[i] = z ^ (z >> 31);
+	}
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+size_t DgChunkerNext(const DgChunker *this, size_t length, const uint8_t *data) {
+	/**
+	 * Find the length of the first chunk of some data
+	 * 
+	 * @warning Unless `data` goes to the end of the input, it should be at
+	 * least max_size bytes long, otherwise the chunk could be cut early.
+	 * 
+	 * @param this Chunker
+	 * @param length Length of the data
+	 * @param data Data to find the first chunk of
+	 * @return Length of the first chunk
+	 */
+	
+	if (length <= this->min_size) {
+		return length;
+	}
+	
+	size_t limit = (length < this->max_size) ? length : this->max_size;
+	size_t normal = (limit < this->avg_size) ? limit : this->avg_size;
+	const uint64_t *gear = this->gear;
+	uint64_t mask = this->mask_small;
+	uint64_t hash = 0;
+	
+	// Bytes before min_size can't be cut at, so they are not hashed at all
+	size_t i = this->min_size;
+	
+	for (; i < normal; i++) {
+		hash = (hash << 1) + gear[data[i]];
+		
+		if (!(hash & mask)) {
+			return i + 1;
+		}
+	}
+	
+	mask = this->mask_large;
+	
+	for (; i < limit; i++) {
+		hash = (hash << 1) + gear[data[i]];
+		
+		if (!(hash & mask)) {
+			return i + 1;
+		}
+	}
+	
+	return limit;
+}
+
+DgError DgChunkBuffer(const DgChunker *this, size_t length, const void *data, DgChunk **chunks, size_t *count) {
+	/**
+	 * Split a buffer into content-defined chunks
+	 * 
+	 * @param this Chunker
+	 * @param length Length of the data
+	 * @param data Data to split
+	 * @param chunks Where to store the array of chunks, free with DgFree
+	 * @param count Where to store the number of chunks
+	 * @return Error code
+	 */
+	
+	const uint8_t *bytes = data;
+	size_t alloc = (length / this->avg_size) + 16;
+	DgChunk *array = DgAlloc(sizeof *array * alloc);
+	size_t used = 0;
+	
+	if (!array) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	for (size_t offset = 0; offset < length;) {
+		size_t size = DgChunkerNext(this, length - offset, bytes + offset);
+		
+		if (used >= alloc) {
+			DgChunk *bigger = DgMemoryReallocate(array, sizeof *array * alloc * 2);
+			
+			if (!bigger) {
+				DgFree(array);
+				return DG_ERROR_ALLOCATION_FAILED;
+			}
+			
+			array = bigger;
+			alloc *= 2;
+		}
+		
+		array[used].offset = offset;
+		array[used].length = size;
+		used++;
+		
+		offset += size;
+	}
+	
+	chunks[0] = array;
+	count[0] = used;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+DgError DgChunkBytes(const DgChunker *this, DgBytes *bytes, DgChunk **chunks, size_t *count) {
+	/**
+	 * Split a byte string into content-defined chunks
+	 * 
+	 * @param this Chunker
+	 * @param bytes Byte string to split
+	 * @param chunks Where to store the array of chunks, free with DgFree
+	 * @param count Where to store the number of chunks
+	 * @return Error code
+	 */
+	
+	return DgChunkBuffer(this, bytes->length, bytes->data, chunks, count);
+}
+
+DgError DgChunkStream(const DgChunker *this, DgStream *stream, DgChunkFunction function, void *context) {
+	/**
+	 * Split the rest of a stream into content-defined chunks, calling a
+	 * function with each one. Only about two chunks are kept in memory at
+	 * once.
+	 * 
+	 * @param this Chunker
+	 * @param stream Stream to read from its current position to the end
+	 * @param function Function to call with each chunk, which stops chunking
+	 * if it returns an error
+	 * @param context Context passed to the function
+	 * @return Error code
+	 */
+	
+	size_t position;
+	DgError status = DgStreamGetPosition(stream, &position);
+	
+	if (status) {
+		return status;
+	}
+	
+	size_t length = DgStreamLength(stream);
+	size_t remaining = (length > position) ? length - position : 0;
+	
+	// Large reads are cheaper, so read several chunks at a time
+	size_t capacity = (this->max_size * 2 > 262144) ? this->max_size * 2 : 262144;
+	uint8_t *buffer = DgAlloc(capacity);
+	size_t fill = 0;
+	size_t offset = 0;
+	
+	if (!buffer) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	while (!status && (fill || remaining)) {
+		// Keep at least max_size bytes around so chunks aren't cut early
+		if (fill < this->max_size && remaining) {
+			size_t count = capacity - fill;
+			
+			if (count > remaining) {
+				count = remaining;
+			}
+			
+			status = DgStreamRead(stream, count, buffer + fill);
+			
+			if (status) {
+				break;
+			}
+			
+			fill += count;
+			remaining -= count;
+		}
+		
+		size_t start = 0;
+		
+		// Cut as many chunks as we can from what has been read
+		while (!status && fill - start && (fill - start >= this->max_size || !remaining)) {
+			size_t size = DgChunkerNext(this, fill - start, buffer + start);
+			
+			status = function(context, offset, size, buffer + start);
+			
+			start += size;
+			offset += size;
+		}
+		
+		memmove(buffer, buffer + start, fill - start);
+		fill -= start;
+	}
+	
+	DgFree(buffer);
+	
+	return status;
+}
@@ -15,7 +15,42 @@
 #pragma once
 
 #include <inttypes.h>
+#include <stddef.h>
+
+#include "error.h"
+
+struct DgBytes;
+struct DgStream;
 
 uint32_t DgChecksumStringU32_DJB2(const char * str);
 uint32_t DgChecksumU32_DJB2(size_t length, const char *data);
+uint32_t DgChecksumFNV1a32(size_t length, const char *data);
 uint32_t DgChecksumStringU32(const char * str);
+uint32_t DgChecksumCRC32C(uint32_t crc, size_t length, const void *data);
+
+/**
+ * Content-defined chunking
+ */
+
+typedef struct DgChunker {
+	size_t min_size;             // No cut is made before this many bytes
+	size_t avg_size;             // Cuts are harder to make before this size and easier after
+	size_t max_size;             // A cut is always made at this size
+	uint64_t mask_small;         // Mask used before avg_size
+	uint64_t mask_large;         // Mask used after avg_size
+	uint64_t gear[256];          // Value added to the rolling hash for each byte
+} DgChunker;
+
+typedef struct DgChunk {
+	size_t offset;
+	size_t length;
+} DgChunk;
+
+// Called for each chunk of a stream, with the data of the chunk
+typedef DgError (*DgChunkFunction)(void *context, size_t offset, size_t length, const uint8_t *data);
+
+DgError DgChunkerInit(DgChunker *this, size_t min_size, size_t avg_size, size_t max_size);
+size_t DgChunkerNext(const DgChunker *this, size_t length, const uint8_t *data);
+DgError DgChunkBuffer(const DgChunker *this, size_t length, const void *data, DgChunk **chunks, size_t *count);
+DgError DgChunkBytes(const DgChunker *this, struct DgBytes *bytes, DgChunk **chunks, size_t *count);
+DgError DgChunkStream(const DgChunker *this, struct DgStream *stream, DgChunkFunction function, void *context);
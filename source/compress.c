@@ -15,3 +15,264 @@
  */
 
 #include "compress.h"
+
+#include <string.h>
+
+/**
+ * LZ block codec
+ * 
+ * A block is a list of sequences. Each sequence starts with a token byte
+ * whose high four bits are the literal length and low four bits are the
+ * match length minus DG_COMPRESS_LZ_MIN_MATCH. A nibble of 15 means more
+ * length bytes follow, each added on until one is not 255. Then come the
+ * literals and a two byte little endian match offset. The last sequence has
+ * only literals.
+ */
+
+#define DG_COMPRESS_LZ_MIN_MATCH 4
+#define DG_COMPRESS_LZ_HASH_BITS 12
+#define DG_COMPRESS_LZ_MAX_OFFSET 65535
+
+static uint32_t DgCompressLZRead32(const uint8_t *p) {
+	uint32_t value;
+	memcpy(&value, p, sizeof value);
+	return value;
+}
+
+static bool DgCompressLZWriteLength(uint8_t **op, uint8_t *end, size_t length) {
+	/**
+	 * Write the extra bytes for a length that didn't fit in its nibble
+	 */
+	
+	while (length >= 255) {
+		if (*op >= end) {
+			return false;
+		}
+		
+		*(*op)++ = 255;
+		length -= 255;
+	}
+	
+	if (*op >= end) {
+		return false;
+	}
+	
+	*(*op)++ = (uint8_t) length;
+	
+	return true;
+}
+
+static bool DgCompressLZSequence(uint8_t **op, uint8_t *end, const uint8_t *literals, size_t literal_length, size_t offset, size_t match_length) {
+	/**
+	 * Write one sequence. A match length of zero means this is the last
+	 * sequence.
+	 */
+	
+	if (*op >= end) {
+		return false;
+	}
+	
+	uint8_t *token = (*op)++;
+	size_t match_code = match_length ? match_length - DG_COMPRESS_LZ_MIN_MATCH : 0;
+	
+	*token = (uint8_t) (((literal_length < 15) ? literal_length : 15) << 4);
+	
+	if (literal_length >= 15 && !DgCompressLZWriteLength(op, end, literal_length - 15)) {
+		return false;
+	}
+	
+	if ((size_t) (end - *op) < literal_length) {
+		return false;
+	}
+	
+	memcpy(*op, literals, literal_length);
+	*op += literal_length;
+	
+	if (!match_length) {
+		return true;
+	}
+	
+	*token |= (uint8_t) ((match_code < 15) ? match_code : 15);
+	
+	if (end - *op < 2) {
+		return false;
+	}
+	
+	*(*op)++ = (uint8_t) offset;
+	*(*op)++ = (uint8_t) (offset >> 8);
+	
+	if (match_code >= 15 && !DgCompressLZWriteLength(op, end, match_code - 15)) {
+		return false;
+	}
+	
+	return true;
+}
+
+size_t DgCompressLZBound(size_t size) {
+	/**
+	 * Find the largest size that `size` bytes could take once compressed
+	 * 
+	 * @param size Size of the input
+	 * @return Largest possible size of the output
+	 */
+	
+	return size + (size / 255) + 16;
+}
+
+DgError DgCompressLZ(const void *input, size_t input_size, void *output, size_t output_size, size_t *written) {
+	/**
+	 * Compress a block of data
+	 * 
+	 * @param input Data to compress
+	 * @param input_size Size of the data
+	 * @param output Where to write the compressed data
+	 * @param output_size Size of the output buffer, DgCompressLZBound(input_size) is always enough
+	 * @param written Where to store the size of the compressed data
+	 * @return Error code, DG_ERROR_OUT_OF_RANGE if the output buffer is too small
+	 */
+	
+	const uint8_t *in = input;
+	uint8_t *op = output;
+	uint8_t *end = op + output_size;
+	uint32_t table[1 << DG_COMPRESS_LZ_HASH_BITS];
+	size_t anchor = 0, pos = 0;
+	
+	memset(table, 0, sizeof table);
+	
+	while (pos + DG_COMPRESS_LZ_MIN_MATCH <= input_size) {
+		uint32_t sequence = DgCompressLZRead32(&in[pos]);
+		uint32_t hash = (sequence * 2654435761u) >> (32 - DG_COMPRESS_LZ_HASH_BITS);
+		size_t candidate = table[hash];
+		
+		table[hash] = (uint32_t) pos;
+		
+		if (candidate >= pos || pos - candidate > DG_COMPRESS_LZ_MAX_OFFSET || DgCompressLZRead32(&in[candidate]) != sequence) {
+			// Go faster through data that doesn't compress
+			pos += 1 + ((pos - anchor) >> 6);
+			continue;
+		}
+		
+		size_t length = DG_COMPRESS_LZ_MIN_MATCH;
+		
+		while (pos + length < input_size && in[candidate + length] == in[pos + length]) {
+			length++;
+		}
+		
+		if (!DgCompressLZSequence(&op, end, &in[anchor], pos - anchor, pos - candidate, length)) {
+			return DG_ERROR_OUT_OF_RANGE;
+		}
+		
+		pos += length;
+		anchor = pos;
+	}
+	
+	if (!DgCompressLZSequence(&op, end, &in[anchor], input_size - anchor, 0, 0)) {
+		return DG_ERROR_OUT_OF_RANGE;
+	}
+	
+	written[0] = op - (uint8_t *) output;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+DgError DgDecompressLZ(const void *input, size_t input_size, void *output, size_t output_size, size_t *written) {
+	/**
+	 * Decompress a block of data made by DgCompressLZ
+	 * 
+	 * @param input Compressed data
+	 * @param input_size Size of the compressed data
+	 * @param output Where to write the decompressed data
+	 * @param output_size Size of the output buffer
+	 * @param written Where to store the size of the decompressed data
+	 * @return Error code, DG_ERROR_FAILED if the data is corrupt or DG_ERROR_OUT_OF_RANGE if it doesn't fit
+	 */
+	
+	const uint8_t *ip = input;
+	const uint8_t *ip_end = ip + input_size;
+	uint8_t *out = output;
+	size_t op = 0;
+	
+	while (ip < ip_end) {
+		uint8_t token = *ip++;
+		size_t length = token >> 4;
+		
+		// Literals
+		if (length == 15) {
+			uint8_t extra;
+			
+			do {
+				if (ip >= ip_end) {
+					return DG_ERROR_FAILED;
+				}
+				
+				extra = *ip++;
+				length += extra;
+			} while (extra == 255);
+		}
+		
+		if ((size_t) (ip_end - ip) < length) {
+			return DG_ERROR_FAILED;
+		}
+		
+		if (output_size - op < length) {
+			return DG_ERROR_OUT_OF_RANGE;
+		}
+		
+		memcpy(&out[op], ip, length);
+		ip += length;
+		op += length;
+		
+		// The last sequence has no match
+		if (ip == ip_end) {
+			break;
+		}
+		
+		// Match
+		if (ip_end - ip < 2) {
+			return DG_ERROR_FAILED;
+		}
+		
+		size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		
+		if (!offset || offset > op) {
+			return DG_ERROR_FAILED;
+		}
+		
+		length = (token & 15);
+		
+		if (length == 15) {
+			uint8_t extra;
+			
+			do {
+				if (ip >= ip_end) {
+					return DG_ERROR_FAILED;
+				}
+				
+				extra = *ip++;
+				length += extra;
+			} while (extra == 255);
+		}
+		
+		length += DG_COMPRESS_LZ_MIN_MATCH;
+		
+		if (output_size - op < length) {
+			return DG_ERROR_OUT_OF_RANGE;
+		}
+		
+		// Matches can overlap with what they are copying
+		if (offset >= length) {
+			memcpy(&out[op], &out[op - offset], length);
+			op += length;
+		}
+		else {
+			for (size_t i = 0; i < length; i++, op++) {
+				out[op] = out[op - offset];
+			}
+		}
+	}
+	
+	written[0] = op;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
@@ -11,12 +11,14 @@
  * 
  * Compression
  * 
- * @note Currently some custom Huffman tree based compression
+ * @note Currently some custom Huffman tree based compression, and a simple
+ * LZ77 block codec for data that needs to be decompressed quickly.
  */
 
 #pragma once
 
 #include "common.h"
+#include "error.h"
 
 enum {
 	DG_PROBABILITY_TREE_END = -1,
@@ -34,3 +36,13 @@ typedef struct DgCompressProbabilityTreeEntry {
 typedef struct DgCompressState {
 	DgCompressProbabilityTreeEntry tree[256];
 } DgCompressState;
+
+/**
+ * LZ block codec
+ * 
+ * Each block is compressed on its own, so there is no state between calls.
+ * Matches are found with a small hash table and can reach back 64 KiB.
+ */
+size_t DgCompressLZBound(size_t size);
+DgError DgCompressLZ(const void *input, size_t input_size, void *output, size_t output_size, size_t *written);
+DgError DgDecompressLZ(const void *input, size_t input_size, void *output, size_t output_size, size_t *written);
@@ -123,3 +123,43 @@ DgError DgFileAppend(DgStorage *storage, DgStoragePath path, size_t size, void *
 	
 	return DG_ERROR_SUCCESS;
 }
+
+DgError DgFileMap(DgStorage *storage, DgStoragePath path, DgStorageMapFlags flags, DgStorageMapping *mapping) {
+	/**
+	 * Map a whole file into memory as read only. Unlike DgFileLoad, nothing is
+	 * copied if the pool supports mapping and pages are only read in when they
+	 * are touched.
+	 * 
+	 * @param storage Storage configuration
+	 * @param path File path
+	 * @param flags Access pattern hints
+	 * @param mapping Where to store the mapping (data and length)
+	 * @return Error status
+	 */
+	
+	DgStream stream;
+	DgError status;
+	
+	status = DgStreamOpen(storage, &stream, path, DG_STREAM_READ);
+	
+	if (status) {
+		return status;
+	}
+	
+	status = DgStreamMap(&stream, 0, 0, flags, mapping);
+	
+	DgStreamClose(&stream);
+	
+	return status;
+}
+
+DgError DgFileUnmap(DgStorageMapping *mapping) {
+	/**
+	 * Release a file mapped with DgFileMap.
+	 * 
+	 * @param mapping The mapping to release
+	 * @return Error status
+	 */
+	
+	return DgStreamUnmap(mapping);
+}
@@ -20,3 +20,5 @@
 DgError DgFileLoad(DgStorage *storage, DgStoragePath path, size_t *size, void **buffer);
 DgError DgFileSave(DgStorage *storage, DgStoragePath path, size_t size, void *buffer);
 DgError DgFileAppend(DgStorage *storage, DgStoragePath path, size_t size, void *buffer);
+DgError DgFileMap(DgStorage *storage, DgStoragePath path, DgStorageMapFlags flags, DgStorageMapping *mapping);
+DgError DgFileUnmap(DgStorageMapping *mapping);
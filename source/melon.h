@@ -3,6 +3,8 @@
 #include "value.h"
 #include "array.h"
 #include "bitmap.h"
+#include "bitset.h"
+#include "byteorder.h"
 #include "bytes.h"
 #include "crypto.h"
 #include "error.h"
@@ -20,6 +22,15 @@
 #include "serialise.h"
 #include "socket.h"
 #include "storage.h"
+#include "storage_ramdisk.h"
+#include "storage_async.h"
+#include "storage_pak.h"
+#include "storage_cache.h"
+#include "storage_compressed.h"
+#include "storage_overlay.h"
+#include "storage_dedup.h"
+#include "storage_metrics.h"
+#include "storage_memory.h"
 #include "stream.h"
 #include "string.h"
 #include "table.h"
@@ -10,9 +10,72 @@
  * =============================================================================
  * 
  * Serialisation for tables (custom binary format)
+ * 
+ * Format:
+ *   uint32 magic, uint16 major version, uint16 minor version (host byte
+ *   order), then the root value.
+ * 
+ * Version 1 (host byte order). Each value is a uint16 type ID followed by its
+ * data:
+ *   - Nil, null: nothing
+ *   - Bool: one byte
+ *   - Numbers: the number itself
+ *   - String: uint64 length, the bytes, then a zero byte (version 1.1)
+ *   - Bytes: uint64 length, then the bytes (version 1.1)
+ *   - Table: uint64 count, then count key and value pairs
+ * 
+ * Version 1.0 wrote strings with no length or terminator, so they can't be
+ * read back and are rejected.
+ * 
+ * Version 2. Each value is a tag byte, sometimes followed by data. Integers
+ * and lengths after the tag are LEB128 varints, zigzag encoded when signed,
+ * and floats are little endian.
+ *   - 0x00 nil, 0x01 null, 0x02 false, 0x03 true
+ *   - 0x04 float32, 0x05 float64
+ *   - 0x08 + n: integer of the nth integer type (Int8, UInt8, ... UInt64)
+ *   - 0x10 string: length, the bytes, then a zero byte
+ *   - 0x11 bytes: length, then the bytes
+ *   - 0x12 table: count, then count key and value pairs
+ *   - 0x13 sized table: size, count, then count key and value pairs, where
+ *     size is the number of bytes after it up to the end of the table
+ *   - 0x14 indexed table: size, count, index, then count key and value pairs,
+ *     where the index has a little endian uint32 hash and uint32 offset for
+ *     each key, sorted by hash. Offsets are from the first pair.
+ *   - 0x20 + length: string of up to 31 bytes, then a zero byte
+ *   - 0x40 + count: table of up to 15 pairs
+ *   - 0x80 + (n << 4) + v: integer of the nth integer type with value v < 16
+ * 
+ * Version 2.1 adds the sized table, which is written for tables whose contents
+ * are at least DG_SERIALISE_SIZED_TABLE_MIN bytes so that readers can skip
+ * them without reading what is in them.
+ * 
+ * Version 2.2 adds the indexed table, which is written for tables of at least
+ * DG_SERIALISE_INDEXED_TABLE_MIN pairs when writing with DG_SERIALISE_INDEXED.
+ * Keys are hashed with FNV-1a for strings and bytes, and for numbers by
+ * xoring the upper and lower halves of their 64-bit value (sign extended for
+ * signed integers, and the bits for floats). Nil is 0, null 1, false 2 and
+ * true 3.
+ * 
+ * Version 2.3 adds checksums, which are written with DG_SERIALISE_CHECKSUM.
+ * A 0x15 tag right after the header marks the document as checksummed, and
+ * the root value after it is followed by:
+ *   - A little endian uint32 CRC32C for each block of the document from the
+ *     start of the header up to here, the last one being shorter
+ *   - uint64 length of what is checksummed, uint32 block size, uint32 CRC32C
+ *     of the block checksums, length and block size, then uint32 0x5EA1ED51,
+ *     all little endian
+ * Readers find the checksums from the end of the data, and check each block
+ * the first time it is read.
  */
 
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "alloc.h"
+#include "byteorder.h"
+#include "checksum.h"
 #include "storage.h"
+#include "string.h"
 #include "table.h"
 #include "error.h"
 #include "log.h"
@@ -51,6 +114,7 @@ DgError DgSerialiseWriteValue(DgStream * restrict stream, const DgValue * restri
 	// Write the value
 	switch (type) {
 		case DG_TYPE_NIL:
+		case DG_TYPE_NULL:
 			break;
 		case DG_TYPE_BOOL:
 			status = DgStreamWriteInt8(stream, value->data.asBool);
@@ -79,9 +143,31 @@ DgError DgSerialiseWriteValue(DgStream * restrict stream, const DgValue * restri
 		case DG_TYPE_UINT64:
 			status = DgStreamWriteUInt64(stream, value->data.asUInt64);
 			break;
-		case DG_TYPE_STRING:
-			status = DgStreamWriteString(stream, value->data.asStaticString);
+		case DG_TYPE_STRING: {
+			size_t length = DgStringLength(value->data.asStaticString);
+			
+			status = DgStreamWriteUInt64(stream, length);
+			
+			if (status) {
+				return status;
+			}
+			
+			// Including the terminator lets the reader use the string in place
+			status = DgStreamWrite(stream, length + 1, (void *) value->data.asStaticString);
 			break;
+		}
+		case DG_TYPE_BYTES: {
+			DgBytes *bytes = value->data.asBytes;
+			
+			status = DgStreamWriteUInt64(stream, bytes->length);
+			
+			if (status) {
+				return status;
+			}
+			
+			status = DgStreamWrite(stream, bytes->length, bytes->data);
+			break;
+		}
 		case DG_TYPE_FLOAT32:
 			status = DgStreamWriteFloat32(stream, value->data.asFloat32);
 			break;
@@ -121,36 +207,2678 @@ DgError DgSerialiseWriteValue(DgStream * restrict stream, const DgValue * restri
 	return status;
 }
 
-DgError DgSerialiseWrite(DgStorage *storage, const char *path, DgValue * restrict value) {
+/**
+ * Version 2 encoding
+ */
+
+enum {
+	DG_SERIALISE_TAG_NIL = 0x00,
+	DG_SERIALISE_TAG_NULL = 0x01,
+	DG_SERIALISE_TAG_FALSE = 0x02,
+	DG_SERIALISE_TAG_TRUE = 0x03,
+	DG_SERIALISE_TAG_FLOAT32 = 0x04,
+	DG_SERIALISE_TAG_FLOAT64 = 0x05,
+	DG_SERIALISE_TAG_INTEGER = 0x08,
+	DG_SERIALISE_TAG_STRING = 0x10,
+	DG_SERIALISE_TAG_BYTES = 0x11,
+	DG_SERIALISE_TAG_TABLE = 0x12,
+	DG_SERIALISE_TAG_SIZED_TABLE = 0x13,
+	DG_SERIALISE_TAG_INDEXED_TABLE = 0x14,
+	DG_SERIALISE_TAG_CHECKSUMMED = 0x15,
+	DG_SERIALISE_TAG_SHORT_STRING = 0x20,
+	DG_SERIALISE_TAG_SHORT_TABLE = 0x40,
+	DG_SERIALISE_TAG_SMALL_INTEGER = 0x80,
+};
+
+#define DG_SERIALISE_SHORT_STRING_MAX 31
+#define DG_SERIALISE_SHORT_TABLE_MAX 15
+#define DG_SERIALISE_SMALL_INTEGER_MAX 15
+
+// Longest tag and varints together
+#define DG_SERIALISE_HEAD_MAX 21
+
+// Size of a hash and offset in the index of a table
+#define DG_SERIALISE_INDEX_ENTRY 8
+
+// Set in the recorded size of a table that is written with an index
+#define DG_SERIALISE_SIZE_INDEXED ((uint64_t) 1 << 63)
+
+// Size of the magic number and version
+#define DG_SERIALISE_HEADER_SIZE 8
+
+// Size of the length, block size, checksum and magic number at the very end
+// of a checksummed document
+#define DG_SERIALISE_FOOTER_SIZE 20
+#define DG_SERIALISE_FOOTER_MAGIC 0x5EA1ED51
+
+/**
+ * Sizes of the tables in a tree, in the order they are written. Tables that
+ * can be indexed are followed by their index entries (hash << 32 | offset),
+ * sorted by hash.
+ */
+typedef struct DgSerialiseSizes {
+	uint64_t *items;
+	size_t count;
+	size_t allocated;
+	size_t next;
+	DgSerialiseFlags flags;
+} DgSerialiseSizes;
+
+/**
+ * Where version 2 data is written, along with the checksums of the blocks that
+ * have been written so far if they are wanted.
+ */
+typedef struct DgSerialiseOutput {
+	DgStream *stream;
+	uint32_t *blocks;                // CRC32C of each full block
+	size_t count;
+	size_t allocated;
+	uint32_t crc;                    // Checksum of the current block so far
+	size_t used;                     // Bytes in the current block
+	bool checked;                    // If blocks are being checksummed
+} DgSerialiseOutput;
+
+static size_t DgSerialisePutVarint(uint8_t *buffer, uint64_t number) {
 	/**
-	 * Write the value to the given file path.
+	 * Encode an unsigned LEB128 number.
 	 * 
-	 * @param storage Storage object to use
-	 * @param path Path to write to
-	 * @param value Value to write
-	 * @return Error status
+	 * @param buffer Where to write the number (at least 10 bytes)
+	 * @param number Number to encode
+	 * @return Number of bytes written
 	 */
 	
-	// Open stream
-	DgStream stream;
-	DgError status = DgStreamOpen(storage, &stream, path, DG_STREAM_WRITE);
+	size_t length = 0;
 	
-	if (status != DG_ERROR_SUCCESS) {
-		return status;
+	while (number >= 0x80) {
+		buffer[length++] = (number & 0x7f) | 0x80;
+		number >>= 7;
 	}
 	
-	// Magic number
-	DgStreamWriteUInt32(&stream, 0xFC991E51); // FURRIES!
+	buffer[length++] = number;
 	
-	// Version
-	DgStreamWriteUInt16(&stream, 1);
-	DgStreamWriteUInt16(&stream, 0);
+	return length;
+}
+
+static size_t DgSerialiseVarintLength(uint64_t number) {
+	size_t length = 1;
 	
-	// Serialise root value
-	DgSerialiseWriteValue(&stream, value);
+	while (number >= 0x80) {
+		number >>= 7;
+		length++;
+	}
 	
-	// Close stream
-	DgStreamClose(&stream);
+	return length;
+}
+
+static void DgSerialiseStoreUInt32(uint8_t *data, uint32_t number) {
+	data[0] = number;
+	data[1] = number >> 8;
+	data[2] = number >> 16;
+	data[3] = number >> 24;
+}
+
+static uint32_t DgSerialiseLoadUInt32(const uint8_t *data) {
+	return (uint32_t) data[0] | ((uint32_t) data[1] << 8) | ((uint32_t) data[2] << 16) | ((uint32_t) data[3] << 24);
+}
+
+static DgError DgSerialiseFinishBlock(DgSerialiseOutput *output) {
+	/**
+	 * Save the checksum of the current block and start a new one.
+	 */
 	
-	return DG_ERROR_FAILED;
+	if (output->count >= output->allocated) {
+		size_t allocated = output->allocated ? 2 * output->allocated : 64;
+		uint32_t *blocks = DgMemoryReallocate(output->blocks, allocated * sizeof *blocks);
+		
+		if (!blocks) {
+			return DG_ERROR_ALLOCATION_FAILED;
+		}
+		
+		output->blocks = blocks;
+		output->allocated = allocated;
+	}
+	
+	output->blocks[output->count++] = output->crc;
+	output->crc = 0;
+	output->used = 0;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgSerialiseEmit(DgSerialiseOutput *output, size_t size, const void *data) {
+	/**
+	 * Write some bytes, adding them to the checksums of the blocks they are in
+	 * if the output is checked.
+	 */
+	
+	if (output->checked) {
+		const uint8_t *bytes = data;
+		size_t left = size;
+		
+		while (left) {
+			size_t part = DG_SERIALISE_CHECK_BLOCK - output->used;
+			
+			if (part > left) {
+				part = left;
+			}
+			
+			output->crc = DgChecksumCRC32C(output->crc, part, bytes);
+			output->used += part;
+			bytes += part;
+			left -= part;
+			
+			if (output->used == DG_SERIALISE_CHECK_BLOCK) {
+				DgError status = DgSerialiseFinishBlock(output);
+				
+				if (status) {
+					return status;
+				}
+			}
+		}
+	}
+	
+	return DgStreamWrite(output->stream, size, (void *) data);
+}
+
+static DgError DgSerialiseEmitTag(DgSerialiseOutput *output, uint8_t tag) {
+	return DgSerialiseEmit(output, 1, &tag);
+}
+
+static DgError DgSerialiseEmitHead(DgSerialiseOutput *output, uint8_t tag, uint64_t number) {
+	/**
+	 * Write a tag followed by a varint.
+	 */
+	
+	uint8_t buffer[DG_SERIALISE_HEAD_MAX];
+	
+	buffer[0] = tag;
+	
+	return DgSerialiseEmit(output, 1 + DgSerialisePutVarint(buffer + 1, number), buffer);
+}
+
+static DgError DgSerialiseEmitFloat(DgSerialiseOutput *output, uint8_t tag, size_t size, const void *number) {
+	/**
+	 * Write a tag followed by a little endian float.
+	 */
+	
+	uint8_t buffer[1 + sizeof(double)];
+	
+	buffer[0] = tag;
+	memcpy(buffer + 1, number, size);
+	
+	if (DG_BYTE_ORDER_NATIVE != DG_BYTE_ORDER_LITTLE) {
+		DgByteSwapArray(buffer + 1, size, 1);
+	}
+	
+	return DgSerialiseEmit(output, 1 + size, buffer);
+}
+
+static bool DgSerialiseGetInteger(const DgValue *value, uint64_t *number) {
+	/**
+	 * Get the number that encodes an integer value: the value itself if it
+	 * fits in a tag, otherwise the varint (zigzag encoded if it is signed).
+	 * 
+	 * @param value Value to encode
+	 * @param number Where to store the number
+	 * @return If the number fits in a tag
+	 */
+	
+	int64_t signed_number;
+	
+	switch (value->type) {
+		case DG_TYPE_INT8: signed_number = value->data.asInt8; break;
+		case DG_TYPE_INT16: signed_number = value->data.asInt16; break;
+		case DG_TYPE_INT32: signed_number = value->data.asInt32; break;
+		case DG_TYPE_INT64: signed_number = value->data.asInt64; break;
+		case DG_TYPE_UINT8: number[0] = value->data.asUInt8; return number[0] <= DG_SERIALISE_SMALL_INTEGER_MAX;
+		case DG_TYPE_UINT16: number[0] = value->data.asUInt16; return number[0] <= DG_SERIALISE_SMALL_INTEGER_MAX;
+		case DG_TYPE_UINT32: number[0] = value->data.asUInt32; return number[0] <= DG_SERIALISE_SMALL_INTEGER_MAX;
+		default: number[0] = value->data.asUInt64; return number[0] <= DG_SERIALISE_SMALL_INTEGER_MAX;
+	}
+	
+	if (signed_number >= 0 && signed_number <= DG_SERIALISE_SMALL_INTEGER_MAX) {
+		number[0] = signed_number;
+		return true;
+	}
+	
+	number[0] = ((uint64_t) signed_number << 1) ^ (uint64_t) (signed_number >> 63);
+	
+	return false;
+}
+
+static uint32_t DgSerialiseKeyHash(const DgValue *key) {
+	/**
+	 * Hash a key for the index of a table. Integers hash to the same value
+	 * whatever their type, so they can be found by number.
+	 * 
+	 * @param key Key to hash
+	 * @return Hash of the key
+	 */
+	
+	uint64_t number;
+	
+	switch (key->type) {
+		case DG_TYPE_NULL: return 1;
+		case DG_TYPE_BOOL: return 2 + key->data.asBool;
+		case DG_TYPE_INT8: number = key->data.asInt8; break;
+		case DG_TYPE_INT16: number = key->data.asInt16; break;
+		case DG_TYPE_INT32: number = key->data.asInt32; break;
+		case DG_TYPE_INT64: number = key->data.asInt64; break;
+		case DG_TYPE_UINT8: number = key->data.asUInt8; break;
+		case DG_TYPE_UINT16: number = key->data.asUInt16; break;
+		case DG_TYPE_UINT32: number = key->data.asUInt32; break;
+		case DG_TYPE_UINT64: number = key->data.asUInt64; break;
+		case DG_TYPE_FLOAT32: number = key->data.asUInt32; break;
+		case DG_TYPE_FLOAT64: number = key->data.asUInt64; break;
+		case DG_TYPE_STRING: return DgChecksumFNV1a32(DgStringLength(key->data.asStaticString), key->data.asStaticString);
+		case DG_TYPE_BYTES: return DgChecksumFNV1a32(key->data.asBytes->length, (const char *) key->data.asBytes->data);
+		default: return 0;
+	}
+	
+	return (uint32_t) (number ^ (number >> 32));
+}
+
+static bool DgSerialiseIndexable(const DgSerialiseSizes *sizes, const DgTable *table) {
+	/**
+	 * Check if a table should be given an index when it is written.
+	 */
+	
+	size_t length = DgTableLength((DgTable *) table);
+	
+	if (!(sizes->flags & DG_SERIALISE_INDEXED) || length < DG_SERIALISE_INDEXED_TABLE_MIN) {
+		return false;
+	}
+	
+	// Keys that are tables can't be looked up
+	for (size_t i = 0; i < length; i++) {
+		if (table->key[i].type == DG_TYPE_TABLE || table->key[i].type == DG_TYPE_POINTER) {
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+static DgError DgSerialiseSizesReserve(DgSerialiseSizes *sizes, size_t count, size_t *slot) {
+	/**
+	 * Save places in the list of sizes.
+	 */
+	
+	if (count > sizes->allocated - sizes->count) {
+		size_t allocated = 16 + 2 * sizes->allocated + count;
+		uint64_t *items = DgRealloc(sizes->items, allocated * sizeof *items);
+		
+		if (!items) {
+			return DG_ERROR_ALLOCATION_FAILED;
+		}
+		
+		sizes->items = items;
+		sizes->allocated = allocated;
+	}
+	
+	slot[0] = sizes->count;
+	sizes->count += count;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static int DgSerialiseCompareEntries(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+	
+	return (x > y) - (x < y);
+}
+
+static size_t DgSerialisePutTableHead(uint8_t *buffer, uint64_t count, uint64_t content, bool indexed) {
+	/**
+	 * Encode the start of a table. Tables with enough data in them have their
+	 * size written so that readers can skip them.
+	 * 
+	 * @param buffer Where to write the head (at least DG_SERIALISE_HEAD_MAX bytes)
+	 * @param count Number of pairs in the table
+	 * @param content Size of the encoded pairs and index
+	 * @param indexed If the table has an index
+	 * @return Number of bytes written
+	 */
+	
+	if (indexed || content >= DG_SERIALISE_SIZED_TABLE_MIN) {
+		buffer[0] = indexed ? DG_SERIALISE_TAG_INDEXED_TABLE : DG_SERIALISE_TAG_SIZED_TABLE;
+		size_t length = 1 + DgSerialisePutVarint(buffer + 1, DgSerialiseVarintLength(count) + content);
+		return length + DgSerialisePutVarint(buffer + length, count);
+	}
+	
+	if (count <= DG_SERIALISE_SHORT_TABLE_MAX) {
+		buffer[0] = DG_SERIALISE_TAG_SHORT_TABLE | count;
+		return 1;
+	}
+	
+	buffer[0] = DG_SERIALISE_TAG_TABLE;
+	
+	return 1 + DgSerialisePutVarint(buffer + 1, count);
+}
+
+static DgError DgSerialiseMeasureV2(const DgValue *value, DgSerialiseSizes *sizes, uint64_t *size) {
+	/**
+	 * Find the encoded size of a value, recording the size of the pairs in
+	 * each table.
+	 * 
+	 * @param value Value to measure
+	 * @param sizes Where to record table sizes
+	 * @param size Where to store the size
+	 * @return Error code
+	 */
+	
+	uint64_t number;
+	
+	switch (value->type) {
+		case DG_TYPE_NIL:
+		case DG_TYPE_POINTER:
+		case DG_TYPE_NULL:
+		case DG_TYPE_BOOL:
+			size[0] = 1;
+			return DG_ERROR_SUCCESSFUL;
+		case DG_TYPE_INT8:
+		case DG_TYPE_UINT8:
+		case DG_TYPE_INT16:
+		case DG_TYPE_UINT16:
+		case DG_TYPE_INT32:
+		case DG_TYPE_UINT32:
+		case DG_TYPE_INT64:
+		case DG_TYPE_UINT64:
+			size[0] = DgSerialiseGetInteger(value, &number) ? 1 : 1 + DgSerialiseVarintLength(number);
+			return DG_ERROR_SUCCESSFUL;
+		case DG_TYPE_FLOAT32:
+			size[0] = 5;
+			return DG_ERROR_SUCCESSFUL;
+		case DG_TYPE_FLOAT64:
+			size[0] = 9;
+			return DG_ERROR_SUCCESSFUL;
+		case DG_TYPE_STRING: {
+			size_t length = DgStringLength(value->data.asStaticString);
+			size[0] = ((length <= DG_SERIALISE_SHORT_STRING_MAX) ? 1 : 1 + DgSerialiseVarintLength(length)) + length + 1;
+			return DG_ERROR_SUCCESSFUL;
+		}
+		case DG_TYPE_BYTES:
+			size[0] = 1 + DgSerialiseVarintLength(value->data.asBytes->length) + value->data.asBytes->length;
+			return DG_ERROR_SUCCESSFUL;
+		case DG_TYPE_TABLE: {
+			DgTable *table = value->data.asTable;
+			size_t length = DgTableLength(table);
+			bool indexable = DgSerialiseIndexable(sizes, table);
+			uint64_t content = 0;
+			size_t slot;
+			
+			// Save a place for this table (and its index) before its children
+			DgError status = DgSerialiseSizesReserve(sizes, 1 + (indexable ? length : 0), &slot);
+			
+			if (status) {
+				return status;
+			}
+			
+			for (size_t i = 0; i < length; i++) {
+				uint64_t key_size, value_size;
+				
+				if (indexable && content <= UINT32_MAX) {
+					sizes->items[slot + 1 + i] = ((uint64_t) DgSerialiseKeyHash(&table->key[i]) << 32) | content;
+				}
+				
+				status = DgSerialiseMeasureV2(&table->key[i], sizes, &key_size);
+				
+				if (!status) {
+					status = DgSerialiseMeasureV2(&table->value[i], sizes, &value_size);
+				}
+				
+				if (status) {
+					return status;
+				}
+				
+				content += key_size + value_size;
+			}
+			
+			// Offsets in the index are 32 bits
+			bool indexed = indexable && content <= UINT32_MAX;
+			
+			if (indexed) {
+				qsort(sizes->items + slot + 1, length, sizeof *sizes->items, DgSerialiseCompareEntries);
+				content += length * DG_SERIALISE_INDEX_ENTRY;
+			}
+			
+			uint8_t head[DG_SERIALISE_HEAD_MAX];
+			
+			sizes->items[slot] = content | (indexed ? DG_SERIALISE_SIZE_INDEXED : 0);
+			size[0] = DgSerialisePutTableHead(head, length, content, indexed) + content;
+			
+			return DG_ERROR_SUCCESSFUL;
+		}
+		default:
+			DgLog(DG_LOG_ERROR, "Trying to serialise unknown value type");
+			return DG_ERROR_FAILED;
+	}
+}
+
+static DgError DgSerialiseWriteMeasuredV2(DgSerialiseOutput *output, const DgValue *value, DgSerialiseSizes *sizes) {
+	/**
+	 * Write out a value that has already been measured.
+	 * 
+	 * @param output Where to serialise the value to
+	 * @param value Value to write
+	 * @param sizes Table sizes from DgSerialiseMeasureV2
+	 * @return Error code
+	 */
+	
+	DgError status;
+	uint64_t number;
+	
+	switch (value->type) {
+		case DG_TYPE_NIL:
+		case DG_TYPE_POINTER:
+			return DgSerialiseEmitTag(output, DG_SERIALISE_TAG_NIL);
+		case DG_TYPE_NULL:
+			return DgSerialiseEmitTag(output, DG_SERIALISE_TAG_NULL);
+		case DG_TYPE_BOOL:
+			return DgSerialiseEmitTag(output, value->data.asBool ? DG_SERIALISE_TAG_TRUE : DG_SERIALISE_TAG_FALSE);
+		case DG_TYPE_INT8:
+		case DG_TYPE_UINT8:
+		case DG_TYPE_INT16:
+		case DG_TYPE_UINT16:
+		case DG_TYPE_INT32:
+		case DG_TYPE_UINT32:
+		case DG_TYPE_INT64:
+		case DG_TYPE_UINT64: {
+			uint8_t index = value->type - DG_TYPE_INT8;
+			
+			if (DgSerialiseGetInteger(value, &number)) {
+				return DgSerialiseEmitTag(output, DG_SERIALISE_TAG_SMALL_INTEGER | (index << 4) | number);
+			}
+			
+			return DgSerialiseEmitHead(output, DG_SERIALISE_TAG_INTEGER | index, number);
+		}
+		case DG_TYPE_FLOAT32:
+			return DgSerialiseEmitFloat(output, DG_SERIALISE_TAG_FLOAT32, sizeof value->data.asFloat32, &value->data.asFloat32);
+		case DG_TYPE_FLOAT64:
+			return DgSerialiseEmitFloat(output, DG_SERIALISE_TAG_FLOAT64, sizeof value->data.asFloat64, &value->data.asFloat64);
+		case DG_TYPE_STRING: {
+			size_t length = DgStringLength(value->data.asStaticString);
+			
+			if (length <= DG_SERIALISE_SHORT_STRING_MAX) {
+				status = DgSerialiseEmitTag(output, DG_SERIALISE_TAG_SHORT_STRING | length);
+			}
+			else {
+				status = DgSerialiseEmitHead(output, DG_SERIALISE_TAG_STRING, length);
+			}
+			
+			// Including the terminator lets the reader use the string in place
+			return status ? status : DgSerialiseEmit(output, length + 1, value->data.asStaticString);
+		}
+		case DG_TYPE_BYTES: {
+			DgBytes *bytes = value->data.asBytes;
+			
+			status = DgSerialiseEmitHead(output, DG_SERIALISE_TAG_BYTES, bytes->length);
+			
+			return status ? status : DgSerialiseEmit(output, bytes->length, bytes->data);
+		}
+		case DG_TYPE_TABLE: {
+			DgTable *table = value->data.asTable;
+			size_t length = DgTableLength(table);
+			uint64_t content = sizes->items[sizes->next++];
+			bool indexed = !!(content & DG_SERIALISE_SIZE_INDEXED);
+			uint8_t head[DG_SERIALISE_HEAD_MAX];
+			
+			content &= ~DG_SERIALISE_SIZE_INDEXED;
+			
+			status = DgSerialiseEmit(output, DgSerialisePutTableHead(head, length, content, indexed), head);
+			
+			// Index entries are saved whenever the table could be indexed,
+			// even if it turned out to be too big
+			if (DgSerialiseIndexable(sizes, table)) {
+				const uint64_t *entries = sizes->items + sizes->next;
+				uint8_t buffer[64 * DG_SERIALISE_INDEX_ENTRY];
+				
+				sizes->next += length;
+				
+				for (size_t i = 0; i < length && indexed && !status; i += 64) {
+					size_t chunk = (length - i < 64) ? length - i : 64;
+					
+					for (size_t j = 0; j < chunk; j++) {
+						DgSerialiseStoreUInt32(buffer + j * DG_SERIALISE_INDEX_ENTRY, entries[i + j] >> 32);
+						DgSerialiseStoreUInt32(buffer + j * DG_SERIALISE_INDEX_ENTRY + 4, (uint32_t) entries[i + j]);
+					}
+					
+					status = DgSerialiseEmit(output, chunk * DG_SERIALISE_INDEX_ENTRY, buffer);
+				}
+			}
+			
+			for (size_t i = 0; i < length && !status; i++) {
+				status = DgSerialiseWriteMeasuredV2(output, &table->key[i], sizes);
+				
+				if (!status) {
+					status = DgSerialiseWriteMeasuredV2(output, &table->value[i], sizes);
+				}
+			}
+			
+			return status;
+		}
+		default:
+			DgLog(DG_LOG_ERROR, "Trying to serialise unknown value type");
+			return DG_ERROR_FAILED;
+	}
+}
+
+static DgError DgSerialiseWriteTreeV2(DgSerialiseOutput *output, const DgValue *value, DgSerialiseFlags flags) {
+	/**
+	 * Measure and write out a value.
+	 */
+	
+	DgSerialiseSizes sizes = {.flags = flags};
+	uint64_t size;
+	
+	DgError status = DgSerialiseMeasureV2(value, &sizes, &size);
+	
+	if (!status) {
+		status = DgSerialiseWriteMeasuredV2(output, value, &sizes);
+	}
+	
+	DgMemoryFree(sizes.items);
+	
+	return status;
+}
+
+DgError DgSerialiseWriteValueV2(DgStream * restrict stream, const DgValue * restrict value, DgSerialiseFlags flags) {
+	/**
+	 * Write out a value using the compact version 2 encoding
+	 * 
+	 * @note The tree is measured before it is written so that large tables
+	 * can be given their size, which takes memory for each table in it.
+	 * 
+	 * @param stream Stream to serialise the value to
+	 * @param value Value to write
+	 * @param flags Options for how to write the value (checksums are only
+	 * written with the header, see DgSerialiseWriteStreamVersion)
+	 * @return Error code
+	 */
+	
+	DgSerialiseOutput output = {.stream = stream};
+	
+	return DgSerialiseWriteTreeV2(&output, value, flags);
+}
+
+static void DgSerialisePutHeader(uint8_t *buffer, uint16_t major, uint16_t minor) {
+	/**
+	 * Put the magic number and version into a buffer of
+	 * DG_SERIALISE_HEADER_SIZE bytes.
+	 */
+	
+	uint32_t magic = DG_SERIALISE_MAGIC; // FURRIES!
+	
+	memcpy(buffer, &magic, sizeof magic);
+	memcpy(buffer + 4, &major, sizeof major);
+	memcpy(buffer + 6, &minor, sizeof minor);
+}
+
+DgError DgSerialiseWriteHeader(DgStream *stream, uint16_t major) {
+	/**
+	 * Write the magic number and version that start serialised data, for
+	 * when the value after it is written some other way.
+	 * 
+	 * @param stream Stream to write to
+	 * @param major Version to write, 1 or 2
+	 * @return Error status
+	 */
+	
+	uint8_t header[DG_SERIALISE_HEADER_SIZE];
+	
+	switch (major) {
+		case 1: DgSerialisePutHeader(header, major, DG_SERIALISE_V1_MINOR); break;
+		case 2: DgSerialisePutHeader(header, major, DG_SERIALISE_VERSION_MINOR); break;
+		default: return DG_ERROR_NOT_SUPPORTED;
+	}
+	
+	return DgStreamWrite(stream, sizeof header, header);
+}
+
+static DgError DgSerialiseWriteTrailer(DgSerialiseOutput *output) {
+	/**
+	 * Write the block checksums and footer after a checksummed document.
+	 */
+	
+	uint64_t length = (uint64_t) output->count * DG_SERIALISE_CHECK_BLOCK + output->used;
+	
+	if (output->used) {
+		DgError status = DgSerialiseFinishBlock(output);
+		
+		if (status) {
+			return status;
+		}
+	}
+	
+	size_t size = output->count * sizeof(uint32_t) + DG_SERIALISE_FOOTER_SIZE;
+	uint8_t *trailer = DgAlloc(size);
+	
+	if (!trailer) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	for (size_t i = 0; i < output->count; i++) {
+		DgSerialiseStoreUInt32(trailer + i * sizeof(uint32_t), output->blocks[i]);
+	}
+	
+	uint8_t *footer = trailer + output->count * sizeof(uint32_t);
+	
+	DgSerialiseStoreUInt32(footer, (uint32_t) length);
+	DgSerialiseStoreUInt32(footer + 4, length >> 32);
+	DgSerialiseStoreUInt32(footer + 8, DG_SERIALISE_CHECK_BLOCK);
+	DgSerialiseStoreUInt32(footer + 12, DgChecksumCRC32C(0, size - 8, trailer));
+	DgSerialiseStoreUInt32(footer + 16, DG_SERIALISE_FOOTER_MAGIC);
+	
+	DgError status = DgStreamWrite(output->stream, size, trailer);
+	
+	DgFree(trailer);
+	
+	return status;
+}
+
+static DgError DgSerialiseWriteChecked(DgStream *stream, const DgValue *value, DgSerialiseFlags flags) {
+	/**
+	 * Write a version 2 document with checksums.
+	 */
+	
+	DgSerialiseOutput output = {.stream = stream, .checked = true};
+	uint8_t head[DG_SERIALISE_HEADER_SIZE + 1];
+	
+	DgSerialisePutHeader(head, 2, DG_SERIALISE_VERSION_MINOR);
+	head[DG_SERIALISE_HEADER_SIZE] = DG_SERIALISE_TAG_CHECKSUMMED;
+	
+	DgError status = DgSerialiseEmit(&output, sizeof head, head);
+	
+	if (!status) {
+		status = DgSerialiseWriteTreeV2(&output, value, flags);
+	}
+	
+	if (!status) {
+		status = DgSerialiseWriteTrailer(&output);
+	}
+	
+	DgFree(output.blocks);
+	
+	return status;
+}
+
+DgError DgSerialiseWriteStreamVersion(DgStream * restrict stream, DgValue * restrict value, uint16_t major, DgSerialiseFlags flags) {
+	/**
+	 * Write the header and value to an open stream using the given major
+	 * version of the format.
+	 * 
+	 * @param stream Stream to write to
+	 * @param value Value to write
+	 * @param major Version to write, 1 or 2
+	 * @param flags Options for how to write the value (version 2 only)
+	 * @return Error status, DG_ERROR_NOT_SUPPORTED if checksums are asked for
+	 * with version 1
+	 */
+	
+	if (flags & DG_SERIALISE_CHECKSUM) {
+		return (major == 2) ? DgSerialiseWriteChecked(stream, value, flags) : DG_ERROR_NOT_SUPPORTED;
+	}
+	
+	DgError status = DgSerialiseWriteHeader(stream, major);
+	
+	if (status) {
+		return status;
+	}
+	
+	// Serialise root value
+	return (major == 1) ? DgSerialiseWriteValue(stream, value) : DgSerialiseWriteValueV2(stream, value, flags);
+}
+
+DgError DgSerialiseWriteStream(DgStream * restrict stream, DgValue * restrict value) {
+	/**
+	 * Write the header and value to an open stream in the newest version of
+	 * the format.
+	 * 
+	 * @param stream Stream to write to
+	 * @param value Value to write
+	 * @return Error status
+	 */
+	
+	return DgSerialiseWriteStreamVersion(stream, value, DG_SERIALISE_VERSION_MAJOR, 0);
+}
+
+DgError DgSerialiseWriteFlags(DgStorage *storage, const char *path, DgValue * restrict value, DgSerialiseFlags flags) {
+	/**
+	 * Write the value to the given file path in the newest version of the
+	 * format.
+	 * 
+	 * @param storage Storage object to use
+	 * @param path Path to write to
+	 * @param value Value to write
+	 * @param flags Options for how to write the value
+	 * @return Error status
+	 */
+	
+	// Open stream
+	DgStream stream;
+	DgError status = DgStreamOpen(storage, &stream, path, DG_STREAM_WRITE | DG_STREAM_BUFFERED);
+	
+	if (status != DG_ERROR_SUCCESS) {
+		return status;
+	}
+	
+	status = DgSerialiseWriteStreamVersion(&stream, value, DG_SERIALISE_VERSION_MAJOR, flags);
+	
+	// Close stream
+	DgError close_status = DgStreamClose(&stream);
+	
+	return status ? status : close_status;
+}
+
+DgError DgSerialiseWrite(DgStorage *storage, const char *path, DgValue * restrict value) {
+	/**
+	 * Write the value to the given file path.
+	 * 
+	 * @param storage Storage object to use
+	 * @param path Path to write to
+	 * @param value Value to write
+	 * @return Error status
+	 */
+	
+	return DgSerialiseWriteFlags(storage, path, value, 0);
+}
+
+/**
+ * Reading
+ */
+
+struct DgSerialiseArenaBlock {
+	DgSerialiseArenaBlock *next;
+	size_t used;
+	size_t size;
+	max_align_t data[];
+};
+
+static void *DgSerialiseArenaAlloc(DgSerialiseArenaBlock **arena, size_t size) {
+	/**
+	 * Allocate memory that is freed all at once with the rest of the tree.
+	 * 
+	 * @param arena Arena to allocate from
+	 * @param size Number of bytes to allocate
+	 * @return Pointer to the memory, or NULL if it could not be allocated
+	 */
+	
+	if (size > SIZE_MAX - sizeof(max_align_t) - sizeof(DgSerialiseArenaBlock)) {
+		return NULL;
+	}
+	
+	size = (size + sizeof(max_align_t) - 1) & ~(sizeof(max_align_t) - 1);
+	
+	DgSerialiseArenaBlock *block = *arena;
+	
+	if (!block || block->size - block->used < size) {
+		// Large allocations get their own block so the current one can still
+		// be filled
+		bool own = size > DG_SERIALISE_ARENA_BLOCK / 4;
+		size_t block_size = own ? size : DG_SERIALISE_ARENA_BLOCK;
+		
+		block = DgAlloc(sizeof *block + block_size);
+		
+		if (!block) {
+			return NULL;
+		}
+		
+		block->used = 0;
+		block->size = block_size;
+		
+		if (own && *arena) {
+			block->next = (*arena)->next;
+			(*arena)->next = block;
+		}
+		else {
+			block->next = *arena;
+			*arena = block;
+		}
+	}
+	
+	void *memory = (uint8_t *) block->data + block->used;
+	
+	block->used += size;
+	
+	return memory;
+}
+
+static void DgSerialiseArenaFree(DgSerialiseArenaBlock *arena) {
+	while (arena) {
+		DgSerialiseArenaBlock *next = arena->next;
+		DgFree(arena);
+		arena = next;
+	}
+}
+
+static DgError DgSerialiseCheckRange(DgSerialiseSource *source, size_t offset, size_t size) {
+	/**
+	 * Check the blocks of a buffer that some bytes are in against their
+	 * checksums. Each block is only checked the first time it is used.
+	 */
+	
+	DgSerialiseChecks *checks = source->checks;
+	
+	if (!checks || !size) {
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	size_t last = (offset + size - 1) / checks->block_size;
+	
+	for (size_t i = offset / checks->block_size; i <= last; i++) {
+		if (checks->verified[i]) {
+			continue;
+		}
+		
+		size_t start = i * checks->block_size;
+		size_t length = (checks->length - start < checks->block_size) ? checks->length - start : checks->block_size;
+		
+		if (DgChecksumCRC32C(0, length, source->data + start) != checks->blocks[i]) {
+			DgLog(DG_LOG_ERROR, "Serialised data does not match its checksum");
+			return DG_ERROR_FAILED;
+		}
+		
+		checks->verified[i] = 1;
+	}
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgSerialiseCheckStream(DgSerialiseChecks *checks, size_t position, size_t size, const uint8_t *data) {
+	/**
+	 * Add bytes read from a stream at `position` to the checksum of the block
+	 * they are in, checking it when the end of the block is reached.
+	 */
+	
+	while (size) {
+		size_t block = position / checks->block_size;
+		size_t end = (block + 1) * checks->block_size;
+		
+		if (end > checks->length) {
+			end = checks->length;
+		}
+		
+		size_t part = (end - position < size) ? end - position : size;
+		
+		checks->crc = DgChecksumCRC32C(checks->crc, part, data);
+		position += part;
+		data += part;
+		size -= part;
+		
+		if (position == end) {
+			if (checks->crc != checks->blocks[block]) {
+				DgLog(DG_LOG_ERROR, "Serialised data does not match its checksum");
+				return DG_ERROR_FAILED;
+			}
+			
+			checks->crc = 0;
+		}
+	}
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgSerialiseTake(DgSerialiseSource *source, size_t size, void *output) {
+	/**
+	 * Copy the next `size` bytes of input to `output`.
+	 */
+	
+	if (size > source->size - source->position) {
+		return DG_ERROR_FAILED;
+	}
+	
+	DgError status;
+	
+	if (source->stream) {
+		status = DgStreamRead(source->stream, size, output);
+		
+		if (!status && source->checks) {
+			status = DgSerialiseCheckStream(source->checks, source->position, size, output);
+		}
+	}
+	else {
+		status = DgSerialiseCheckRange(source, source->position, size);
+		
+		if (!status) {
+			memcpy(output, source->data + source->position, size);
+		}
+	}
+	
+	if (status) {
+		return status;
+	}
+	
+	source->position += size;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgSerialiseSkipBytes(DgSerialiseSource *source, uint64_t size) {
+	/**
+	 * Move past the next `size` bytes of input without reading them. Streams
+	 * with checksums are read through instead so the blocks can be checked.
+	 */
+	
+	if (size > source->size - source->position) {
+		return DG_ERROR_FAILED;
+	}
+	
+	if (source->stream && source->checks) {
+		uint8_t buffer[1024];
+		
+		while (size) {
+			size_t part = (size < sizeof buffer) ? size : sizeof buffer;
+			DgError status = DgSerialiseTake(source, part, buffer);
+			
+			if (status) {
+				return status;
+			}
+			
+			size -= part;
+		}
+		
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	if (source->stream && size) {
+		DgError status = DgStreamSeek(source->stream, DG_STORAGE_SEEK_RELATIVE, size);
+		
+		if (status) {
+			return status;
+		}
+	}
+	
+	source->position += size;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgSerialiseTakeBlock(DgSerialiseSource *source, size_t size, const uint8_t **output) {
+	/**
+	 * Get a pointer to the next `size` bytes of input. This points into the
+	 * buffer when there is one. Otherwise the bytes are copied into the arena
+	 * or scratch buffer, or skipped and NULL is given if the source is
+	 * skipping.
+	 */
+	
+	if (size > source->size - source->position) {
+		return DG_ERROR_FAILED;
+	}
+	
+	if (!source->stream) {
+		DgError status = DgSerialiseCheckRange(source, source->position, size);
+		
+		if (status) {
+			return status;
+		}
+		
+		output[0] = source->data + source->position;
+		source->position += size;
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	if (source->skipping) {
+		output[0] = NULL;
+		return DgSerialiseSkipBytes(source, size);
+	}
+	
+	uint8_t *copy;
+	
+	if (source->arena) {
+		copy = DgSerialiseArenaAlloc(source->arena, size);
+	}
+	else {
+		if (size > source->scratch_size) {
+			DgFree(source->scratch);
+			source->scratch = DgAlloc(size);
+			source->scratch_size = source->scratch ? size : 0;
+		}
+		
+		copy = source->scratch;
+	}
+	
+	if (!copy && size) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	output[0] = copy;
+	
+	return DgSerialiseTake(source, size, copy);
+}
+
+static DgError DgSerialiseTakeVarint(DgSerialiseSource *source, uint64_t *number) {
+	/**
+	 * Read an unsigned LEB128 number.
+	 */
+	
+	uint64_t result = 0;
+	
+	for (size_t shift = 0; shift < 64; shift += 7) {
+		uint8_t byte;
+		DgError status = DgSerialiseTake(source, 1, &byte);
+		
+		if (status) {
+			return status;
+		}
+		
+		// The tenth byte can only hold the top bit
+		if (shift == 63 && byte > 1) {
+			return DG_ERROR_FAILED;
+		}
+		
+		result |= (uint64_t) (byte & 0x7f) << shift;
+		
+		if (!(byte & 0x80)) {
+			number[0] = result;
+			return DG_ERROR_SUCCESSFUL;
+		}
+	}
+	
+	return DG_ERROR_FAILED;
+}
+
+static DgError DgSerialiseSetInteger(DgValue *value, size_t index, uint64_t number, bool zigzag) {
+	/**
+	 * Store an integer read from version 2 data, checking that it fits.
+	 * 
+	 * @param value Value to store the integer in
+	 * @param index Index of the integer type (Int8, UInt8, Int16 ... UInt64)
+	 * @param number The number as it was read
+	 * @param zigzag If the number is zigzag encoded (when the type is signed)
+	 * @return Error code
+	 */
+	
+	size_t bits = 8 << (index / 2);
+	
+	value->type = DG_TYPE_INT8 + index;
+	
+	// Signed types
+	if (!(index & 1)) {
+		int64_t signed_number = zigzag ? (int64_t) ((number >> 1) ^ -(number & 1)) : (int64_t) number;
+		
+		if (bits < 64 && (signed_number < -((int64_t) 1 << (bits - 1)) || signed_number >= ((int64_t) 1 << (bits - 1)))) {
+			return DG_ERROR_FAILED;
+		}
+		
+		switch (bits) {
+			case 8: value->data.asInt8 = signed_number; break;
+			case 16: value->data.asInt16 = signed_number; break;
+			case 32: value->data.asInt32 = signed_number; break;
+			default: value->data.asInt64 = signed_number; break;
+		}
+	}
+	
+	// Unsigned types
+	else {
+		if (bits < 64 && number >> bits) {
+			return DG_ERROR_FAILED;
+		}
+		
+		switch (bits) {
+			case 8: value->data.asUInt8 = number; break;
+			case 16: value->data.asUInt16 = number; break;
+			case 32: value->data.asUInt32 = number; break;
+			default: value->data.asUInt64 = number; break;
+		}
+	}
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgSerialiseReadString(DgSerialiseSource *source, DgValue *value, uint64_t length) {
+	/**
+	 * Read the bytes and terminator of a string.
+	 */
+	
+	const uint8_t *data;
+	
+	if (length >= SIZE_MAX) {
+		return DG_ERROR_FAILED;
+	}
+	
+	DgError status = DgSerialiseTakeBlock(source, length + 1, &data);
+	
+	if (status) {
+		return status;
+	}
+	
+	// (Data is NULL when skipping a stream)
+	if (data && data[length] != 0) {
+		return DG_ERROR_FAILED;
+	}
+	
+	value->type = DG_TYPE_STRING;
+	value->data.asStaticString = (const char *) data;
+	value->flags = DG_VALUE_STATIC;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgSerialiseReadBytes(DgSerialiseSource *source, DgValue *value, uint64_t length) {
+	/**
+	 * Read the contents of a bytes value.
+	 */
+	
+	const uint8_t *data;
+	
+	if (length != (size_t) length) {
+		return DG_ERROR_FAILED;
+	}
+	
+	DgError status = DgSerialiseTakeBlock(source, length, &data);
+	
+	if (status) {
+		return status;
+	}
+	
+	DgBytes *bytes = source->arena ? DgSerialiseArenaAlloc(source->arena, sizeof *bytes) : &source->bytes;
+	
+	if (!bytes) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	bytes->length = length;
+	bytes->data = (DgByte *) data;
+	
+	value->type = DG_TYPE_BYTES;
+	value->data.asBytes = bytes;
+	value->flags = DG_VALUE_STATIC;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+
+static DgError DgSerialiseReadTableHead(DgSerialiseSource *source, DgValue *value, uint64_t count, uint64_t size, uint64_t *end) {
+	/**
+	 * Check the count of a table and find where it ends.
+	 * 
+	 * @param source Where the table is being read from
+	 * @param value Where to store the table type
+	 * @param count Number of pairs in the table
+	 * @param size Size of the table from just after its count, or UINT64_MAX
+	 * if it isn't known
+	 * @param end Where to store the position after the table, or UINT64_MAX
+	 * @return Error code
+	 */
+	
+	// Every pair takes at least two tags, so this also stops a bad count from
+	// making a huge allocation
+	uint64_t left = source->size - source->position;
+	
+	if (count > left / ((source->major == 1) ? 4 : 2)) {
+		return DG_ERROR_FAILED;
+	}
+	
+	if (size != UINT64_MAX && size > left) {
+		return DG_ERROR_FAILED;
+	}
+	
+	value->type = DG_TYPE_TABLE;
+	value->data.asTable = NULL;
+	end[0] = (size == UINT64_MAX) ? UINT64_MAX : source->position + size;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgSerialiseReadHeadV1(DgSerialiseSource *source, DgValue *value, uint64_t *count, uint64_t *end) {
+	/**
+	 * Read a version 1 value, or only the count of a table.
+	 */
+	
+	uint16_t type;
+	uint64_t length;
+	DgError status = DgSerialiseTake(source, sizeof type, &type);
+	
+	if (status) {
+		return status;
+	}
+	
+	value->type = type;
+	
+	switch (type) {
+		case DG_TYPE_NIL:
+		case DG_TYPE_NULL:
+			return DG_ERROR_SUCCESSFUL;
+		case DG_TYPE_BOOL: {
+			int8_t data;
+			status = DgSerialiseTake(source, sizeof data, &data);
+			value->data.asBool = !!data;
+			return status;
+		}
+		case DG_TYPE_INT8:
+		case DG_TYPE_UINT8:
+			return DgSerialiseTake(source, 1, &value->data);
+		case DG_TYPE_INT16:
+		case DG_TYPE_UINT16:
+			return DgSerialiseTake(source, 2, &value->data);
+		case DG_TYPE_INT32:
+		case DG_TYPE_UINT32:
+		case DG_TYPE_FLOAT32:
+			return DgSerialiseTake(source, 4, &value->data);
+		case DG_TYPE_INT64:
+		case DG_TYPE_UINT64:
+		case DG_TYPE_FLOAT64:
+			return DgSerialiseTake(source, 8, &value->data);
+		case DG_TYPE_STRING:
+		case DG_TYPE_BYTES:
+			if (source->minor < 1) {
+				return DG_ERROR_NOT_SUPPORTED;
+			}
+			
+			status = DgSerialiseTake(source, sizeof length, &length);
+			
+			if (status) {
+				return status;
+			}
+			
+			return (type == DG_TYPE_STRING) ? DgSerialiseReadString(source, value, length) : DgSerialiseReadBytes(source, value, length);
+		case DG_TYPE_TABLE:
+			status = DgSerialiseTake(source, sizeof *count, count);
+			return status ? status : DgSerialiseReadTableHead(source, value, *count, UINT64_MAX, end);
+		default:
+			DgLog(DG_LOG_ERROR, "Trying to deserialise unknown value type 0x%x", type);
+			return DG_ERROR_FAILED;
+	}
+}
+
+static DgError DgSerialiseReadHeadV2(DgSerialiseSource *source, DgValue *value, uint64_t *count, uint64_t *end) {
+	/**
+	 * Read a version 2 value, or only the count of a table.
+	 */
+	
+	uint8_t tag;
+	uint64_t number;
+	DgError status = DgSerialiseTake(source, 1, &tag);
+	
+	if (status) {
+		return status;
+	}
+	
+	if (tag >= DG_SERIALISE_TAG_SMALL_INTEGER) {
+		return DgSerialiseSetInteger(value, (tag >> 4) & 7, tag & 15, false);
+	}
+	
+	if (tag >= DG_SERIALISE_TAG_SHORT_TABLE) {
+		if (tag - DG_SERIALISE_TAG_SHORT_TABLE > DG_SERIALISE_SHORT_TABLE_MAX) {
+			return DG_ERROR_FAILED;
+		}
+		
+		count[0] = tag - DG_SERIALISE_TAG_SHORT_TABLE;
+		
+		return DgSerialiseReadTableHead(source, value, *count, UINT64_MAX, end);
+	}
+	
+	if (tag >= DG_SERIALISE_TAG_SHORT_STRING) {
+		return DgSerialiseReadString(source, value, tag - DG_SERIALISE_TAG_SHORT_STRING);
+	}
+	
+	if (tag >= DG_SERIALISE_TAG_INTEGER && tag < DG_SERIALISE_TAG_INTEGER + 8) {
+		status = DgSerialiseTakeVarint(source, &number);
+		
+		return status ? status : DgSerialiseSetInteger(value, tag - DG_SERIALISE_TAG_INTEGER, number, true);
+	}
+	
+	switch (tag) {
+		case DG_SERIALISE_TAG_NIL:
+			value->type = DG_TYPE_NIL;
+			return DG_ERROR_SUCCESSFUL;
+		case DG_SERIALISE_TAG_NULL:
+			value->type = DG_TYPE_NULL;
+			return DG_ERROR_SUCCESSFUL;
+		case DG_SERIALISE_TAG_FALSE:
+		case DG_SERIALISE_TAG_TRUE:
+			value->type = DG_TYPE_BOOL;
+			value->data.asBool = (tag == DG_SERIALISE_TAG_TRUE);
+			return DG_ERROR_SUCCESSFUL;
+		case DG_SERIALISE_TAG_FLOAT32:
+			value->type = DG_TYPE_FLOAT32;
+			status = DgSerialiseTake(source, 4, &value->data);
+			
+			if (!status && DG_BYTE_ORDER_NATIVE != DG_BYTE_ORDER_LITTLE) {
+				DgByteSwapArray(&value->data, 4, 1);
+			}
+			
+			return status;
+		case DG_SERIALISE_TAG_FLOAT64:
+			value->type = DG_TYPE_FLOAT64;
+			status = DgSerialiseTake(source, 8, &value->data);
+			
+			if (!status && DG_BYTE_ORDER_NATIVE != DG_BYTE_ORDER_LITTLE) {
+				DgByteSwapArray(&value->data, 8, 1);
+			}
+			
+			return status;
+		case DG_SERIALISE_TAG_STRING:
+			status = DgSerialiseTakeVarint(source, &number);
+			return status ? status : DgSerialiseReadString(source, value, number);
+		case DG_SERIALISE_TAG_BYTES:
+			status = DgSerialiseTakeVarint(source, &number);
+			return status ? status : DgSerialiseReadBytes(source, value, number);
+		case DG_SERIALISE_TAG_TABLE:
+			status = DgSerialiseTakeVarint(source, count);
+			return status ? status : DgSerialiseReadTableHead(source, value, *count, UINT64_MAX, end);
+		case DG_SERIALISE_TAG_SIZED_TABLE:
+		case DG_SERIALISE_TAG_INDEXED_TABLE: {
+			uint64_t size;
+			bool indexed = (tag == DG_SERIALISE_TAG_INDEXED_TABLE);
+			
+			if (source->minor < (indexed ? 2 : 1)) {
+				return DG_ERROR_FAILED;
+			}
+			
+			status = DgSerialiseTakeVarint(source, &size);
+			
+			if (status) {
+				return status;
+			}
+			
+			// The size counts from here, which is before the count
+			size_t start = source->position;
+			
+			status = DgSerialiseTakeVarint(source, count);
+			
+			if (status) {
+				return status;
+			}
+			
+			size_t used = source->position - start;
+			
+			if (size < used) {
+				return DG_ERROR_FAILED;
+			}
+			
+			// Move past the index, which is only needed for lookups
+			if (indexed) {
+				if (*count > (size - used) / DG_SERIALISE_INDEX_ENTRY) {
+					return DG_ERROR_FAILED;
+				}
+				
+				status = DgSerialiseSkipBytes(source, *count * DG_SERIALISE_INDEX_ENTRY);
+				
+				if (status) {
+					return status;
+				}
+				
+				used += *count * DG_SERIALISE_INDEX_ENTRY;
+			}
+			
+			return DgSerialiseReadTableHead(source, value, *count, size - used, end);
+		}
+		default:
+			DgLog(DG_LOG_ERROR, "Trying to deserialise unknown value tag 0x%x", tag);
+			return DG_ERROR_FAILED;
+	}
+}
+
+static DgError DgSerialiseReadHead(DgSerialiseSource *source, DgValue *value, uint64_t *count, uint64_t *end) {
+	/**
+	 * Read a value, except that only the count of a table is read and not its
+	 * pairs.
+	 * 
+	 * @param source Where to read from
+	 * @param value Where to store the value (tables are given a NULL table)
+	 * @param count Where to store the number of pairs if this is a table
+	 * @param end Where to store the position after the table if this is a
+	 * table, or UINT64_MAX if it isn't known
+	 * @return Error code
+	 */
+	
+	value->data.asUInt64 = 0;
+	value->type = DG_TYPE_NIL;
+	value->flags = 0;
+	
+	if (source->major == 1) {
+		return DgSerialiseReadHeadV1(source, value, count, end);
+	}
+	else {
+		return DgSerialiseReadHeadV2(source, value, count, end);
+	}
+}
+
+static DgError DgSerialiseReadValue(DgSerialiseSource *source, DgValue *value, size_t depth) {
+	/**
+	 * Read a value and everything in it.
+	 * 
+	 * @param source Where to read from
+	 * @param value Where to store the value
+	 * @param depth Number of tables this value is inside of
+	 * @return Error code
+	 */
+	
+	uint64_t count, end;
+	DgError status = DgSerialiseReadHead(source, value, &count, &end);
+	
+	if (status || value->type != DG_TYPE_TABLE) {
+		return status;
+	}
+	
+	if (depth >= DG_SERIALISE_MAX_DEPTH) {
+		return DG_ERROR_FAILED;
+	}
+	
+	DgTable *table = DgSerialiseArenaAlloc(source->arena, sizeof *table);
+	DgValue *pairs = DgSerialiseArenaAlloc(source->arena, 2 * count * sizeof *pairs);
+	
+	if (!table || !pairs) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	table->key = pairs;
+	table->value = pairs + count;
+	table->length = 0;
+	table->allocated = count;
+	
+	value->data.asTable = table;
+	
+	for (size_t i = 0; i < count; i++) {
+		status = DgSerialiseReadValue(source, &table->key[i], depth + 1);
+		
+		if (status) {
+			return status;
+		}
+		
+		status = DgSerialiseReadValue(source, &table->value[i], depth + 1);
+		
+		if (status) {
+			return status;
+		}
+		
+		table->length++;
+	}
+	
+	if (end != UINT64_MAX && source->position != end) {
+		return DG_ERROR_FAILED;
+	}
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgSerialiseSkipValue(DgSerialiseSource *source, size_t depth) {
+	/**
+	 * Move past a value and everything in it. Tables that have their size
+	 * written are skipped without looking at what is in them.
+	 * 
+	 * @param source Where to read from (which must be skipping)
+	 * @param depth Number of tables this value is inside of
+	 * @return Error code
+	 */
+	
+	DgValue value;
+	uint64_t count, end;
+	DgError status = DgSerialiseReadHead(source, &value, &count, &end);
+	
+	if (status || value.type != DG_TYPE_TABLE) {
+		return status;
+	}
+	
+	if (end != UINT64_MAX) {
+		return DgSerialiseSkipBytes(source, end - source->position);
+	}
+	
+	if (depth >= DG_SERIALISE_MAX_DEPTH) {
+		return DG_ERROR_FAILED;
+	}
+	
+	for (uint64_t i = 0; i < 2 * count && !status; i++) {
+		status = DgSerialiseSkipValue(source, depth + 1);
+	}
+	
+	return status;
+}
+
+static DgError DgSerialiseTakeAt(DgSerialiseSource *source, uint64_t offset, size_t size, void *output) {
+	/**
+	 * Copy `size` bytes from `offset` in the input without moving, or
+	 * checking them against any checksums.
+	 */
+	
+	if (!source->stream) {
+		memcpy(output, source->data + offset, size);
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	int64_t distance = offset - source->position;
+	DgError status = DgStreamSeek(source->stream, DG_STORAGE_SEEK_RELATIVE, distance);
+	
+	if (status) {
+		return status;
+	}
+	
+	status = DgStreamRead(source->stream, size, output);
+	
+	if (status) {
+		return status;
+	}
+	
+	return DgStreamSeek(source->stream, DG_STORAGE_SEEK_RELATIVE, -(distance + (int64_t) size));
+}
+
+static DgError DgSerialiseReadChecks(DgSerialiseSource *source, DgSerialiseChecks *checks) {
+	/**
+	 * If the tag right after the header marks the data as checksummed, load
+	 * the checksums from the end of it. After this only what the checksums
+	 * cover can be read.
+	 */
+	
+	uint8_t tag;
+	DgError status;
+	
+	if (source->position >= source->size) {
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	if (source->stream) {
+		status = DgSerialiseTake(source, 1, &tag);
+		
+		if (status) {
+			return status;
+		}
+		
+		if (tag != DG_SERIALISE_TAG_CHECKSUMMED) {
+			source->position--;
+			return DgStreamSeek(source->stream, DG_STORAGE_SEEK_RELATIVE, -1);
+		}
+	}
+	else {
+		tag = source->data[source->position];
+		
+		if (tag != DG_SERIALISE_TAG_CHECKSUMMED) {
+			return DG_ERROR_SUCCESSFUL;
+		}
+		
+		source->position++;
+	}
+	
+	uint8_t footer[DG_SERIALISE_FOOTER_SIZE];
+	
+	if (source->size - source->position < DG_SERIALISE_FOOTER_SIZE) {
+		return DG_ERROR_FAILED;
+	}
+	
+	status = DgSerialiseTakeAt(source, source->size - DG_SERIALISE_FOOTER_SIZE, DG_SERIALISE_FOOTER_SIZE, footer);
+	
+	if (status) {
+		return status;
+	}
+	
+	uint64_t length = DgSerialiseLoadUInt32(footer) | ((uint64_t) DgSerialiseLoadUInt32(footer + 4) << 32);
+	uint32_t block_size = DgSerialiseLoadUInt32(footer + 8);
+	
+	if (DgSerialiseLoadUInt32(footer + 16) != DG_SERIALISE_FOOTER_MAGIC || !block_size || length < source->position || length > source->size - DG_SERIALISE_FOOTER_SIZE) {
+		return DG_ERROR_FAILED;
+	}
+	
+	uint64_t count = length / block_size + !!(length % block_size);
+	
+	if (count * sizeof(uint32_t) != source->size - DG_SERIALISE_FOOTER_SIZE - length) {
+		return DG_ERROR_FAILED;
+	}
+	
+	// The checksums are read in as bytes and then decoded where they are,
+	// followed by a flag for each block
+	uint32_t *blocks = DgAlloc(count * (sizeof *blocks + 1));
+	
+	if (!blocks) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	status = DgSerialiseTakeAt(source, length, count * sizeof *blocks, blocks);
+	
+	if (status) {
+		DgFree(blocks);
+		return status;
+	}
+	
+	uint32_t crc = DgChecksumCRC32C(0, count * sizeof *blocks, blocks);
+	crc = DgChecksumCRC32C(crc, 12, footer);
+	
+	if (crc != DgSerialiseLoadUInt32(footer + 12)) {
+		DgLog(DG_LOG_ERROR, "Checksums of serialised data are damaged");
+		DgFree(blocks);
+		return DG_ERROR_FAILED;
+	}
+	
+	for (size_t i = 0; i < count; i++) {
+		blocks[i] = DgSerialiseLoadUInt32((uint8_t *) &blocks[i]);
+	}
+	
+	checks->blocks = blocks;
+	checks->verified = (uint8_t *) (blocks + count);
+	checks->count = count;
+	checks->length = length;
+	checks->block_size = block_size;
+	checks->crc = 0;
+	
+	memset(checks->verified, 0, count);
+	
+	source->size = length;
+	source->checks = checks;
+	
+	// What has been read from a stream so far is checked as well
+	if (source->stream) {
+		uint8_t head[DG_SERIALISE_HEADER_SIZE + 1];
+		
+		DgSerialisePutHeader(head, source->major, source->minor);
+		head[DG_SERIALISE_HEADER_SIZE] = tag;
+		
+		return DgSerialiseCheckStream(checks, 0, sizeof head, head);
+	}
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static void DgSerialiseChecksFree(DgSerialiseChecks *checks) {
+	DgFree(checks->blocks);
+	memset(checks, 0, sizeof *checks);
+}
+
+static DgError DgSerialiseFinish(DgSerialiseSource *source) {
+	/**
+	 * Check that everything the checksums cover was read once the root value
+	 * has been, and move a stream past the checksums.
+	 */
+	
+	DgSerialiseChecks *checks = source->checks;
+	
+	if (!checks) {
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	if (source->position != checks->length) {
+		return DG_ERROR_FAILED;
+	}
+	
+	if (source->stream) {
+		return DgStreamSeek(source->stream, DG_STORAGE_SEEK_RELATIVE, checks->count * sizeof(uint32_t) + DG_SERIALISE_FOOTER_SIZE);
+	}
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgSerialiseReadHeader(DgSerialiseSource *source, DgSerialiseChecks *checks) {
+	/**
+	 * Read and check the magic number and version, and load the checksums if
+	 * there are any.
+	 */
+	
+	uint32_t magic;
+	
+	DgError status = DgSerialiseTake(source, sizeof magic, &magic);
+	
+	if (!status) {
+		status = DgSerialiseTake(source, sizeof source->major, &source->major);
+	}
+	
+	if (!status) {
+		status = DgSerialiseTake(source, sizeof source->minor, &source->minor);
+	}
+	
+	if (status) {
+		return status;
+	}
+	
+	if (magic != DG_SERIALISE_MAGIC) {
+		return DG_ERROR_FAILED;
+	}
+	
+	switch (source->major) {
+		case 1: return (source->minor > DG_SERIALISE_V1_MINOR) ? DG_ERROR_NOT_SUPPORTED : DG_ERROR_SUCCESSFUL;
+		case 2: break;
+		default: return DG_ERROR_NOT_SUPPORTED;
+	}
+	
+	if (source->minor > DG_SERIALISE_VERSION_MINOR) {
+		return DG_ERROR_NOT_SUPPORTED;
+	}
+	
+	return (source->minor >= 3) ? DgSerialiseReadChecks(source, checks) : DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgSerialiseStreamSource(DgSerialiseSource *source, DgStream *stream) {
+	/**
+	 * Set up a source that reads the rest of a stream.
+	 */
+	
+	size_t position;
+	DgError status = DgStreamGetPosition(stream, &position);
+	
+	if (status) {
+		return status;
+	}
+	
+	size_t length = DgStreamLength(stream);
+	
+	source->stream = stream;
+	source->size = (length > position) ? length - position : 0;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgSerialiseReadDocument(DgSerialised *this, DgSerialiseSource *source) {
+	/**
+	 * Read the header and root value into a new tree.
+	 */
+	
+	DgSerialiseChecks checks = {0};
+	
+	this->arena = NULL;
+	source->arena = &this->arena;
+	
+	DgError status = DgSerialiseReadHeader(source, &checks);
+	
+	// A whole buffer is going to be read anyway, so check it all first
+	if (!status && !source->stream) {
+		status = DgSerialiseCheckRange(source, 0, source->size);
+	}
+	
+	if (!status) {
+		status = DgSerialiseReadValue(source, &this->root, 0);
+	}
+	
+	if (!status) {
+		status = DgSerialiseFinish(source);
+	}
+	
+	DgSerialiseChecksFree(&checks);
+	
+	if (status) {
+		DgSerialiseArenaFree(this->arena);
+		this->arena = NULL;
+		DgValueNil(&this->root);
+	}
+	
+	return status;
+}
+
+DgError DgSerialiseReadBuffer(DgSerialised *this, const void *data, size_t size) {
+	/**
+	 * Read a value tree from memory.
+	 * 
+	 * @note Strings and bytes in the tree point into `data`, so it must stay
+	 * around until the tree is freed.
+	 * 
+	 * @param this Where to store the tree
+	 * @param data Serialised data
+	 * @param size Size of the data in bytes
+	 * @return Error status
+	 */
+	
+	memset(this, 0, sizeof *this);
+	
+	DgSerialiseSource source = {
+		.data = data,
+		.size = size,
+	};
+	
+	return DgSerialiseReadDocument(this, &source);
+}
+
+DgError DgSerialiseReadStream(DgSerialised *this, DgStream *stream) {
+	/**
+	 * Read a value tree from the current position of a stream. Strings and
+	 * bytes are copied, so the stream can be closed afterwards.
+	 * 
+	 * @note This reads many small values, so the stream should be buffered.
+	 * 
+	 * @param this Where to store the tree
+	 * @param stream Stream to read from
+	 * @return Error status
+	 */
+	
+	memset(this, 0, sizeof *this);
+	
+	DgSerialiseSource source = {0};
+	DgError status = DgSerialiseStreamSource(&source, stream);
+	
+	if (status) {
+		return status;
+	}
+	
+	return DgSerialiseReadDocument(this, &source);
+}
+
+DgError DgSerialiseRead(DgSerialised *this, DgStorage *storage, const char *path) {
+	/**
+	 * Read a value tree from a file. The file is mapped and read in place.
+	 * 
+	 * @param this Where to store the tree
+	 * @param storage Storage object to use
+	 * @param path Path to read from
+	 * @return Error status
+	 */
+	
+	DgStorageMapping mapping;
+	DgStream stream;
+	DgError status = DgStreamOpen(storage, &stream, path, DG_STREAM_READ);
+	
+	if (status) {
+		memset(this, 0, sizeof *this);
+		return status;
+	}
+	
+	status = DgStreamMap(&stream, 0, 0, DG_STORAGE_MAP_SEQUENTIAL, &mapping);
+	
+	DgStreamClose(&stream);
+	
+	if (status) {
+		memset(this, 0, sizeof *this);
+		return status;
+	}
+	
+	status = DgSerialiseReadBuffer(this, mapping.data, mapping.length);
+	
+	if (status) {
+		DgStreamUnmap(&mapping);
+		return status;
+	}
+	
+	this->mapping = mapping;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+void DgSerialiseFree(DgSerialised *this) {
+	/**
+	 * Free a value tree that was read back.
+	 * 
+	 * @param this Tree to free
+	 */
+	
+	DgSerialiseArenaFree(this->arena);
+	DgStreamUnmap(&this->mapping);
+	
+	memset(this, 0, sizeof *this);
+}
+
+/**
+ * Pull reader
+ */
+
+static void DgSerialiseReaderInit(DgSerialiseReader *this) {
+	memset(&this->checks, 0, sizeof this->checks);
+	this->depth = 0;
+	this->started = false;
+	this->finished = false;
+}
+
+DgError DgSerialiseReaderInitBuffer(DgSerialiseReader *this, const void *data, size_t size) {
+	/**
+	 * Start reading serialised data from memory.
+	 * 
+	 * @param this Reader to set up
+	 * @param data Serialised data, which must stay around while reading
+	 * @param size Size of the data in bytes
+	 * @return Error status
+	 */
+	
+	memset(&this->source, 0, sizeof this->source);
+	
+	this->source.data = data;
+	this->source.size = size;
+	
+	DgSerialiseReaderInit(this);
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+DgError DgSerialiseReaderInitStream(DgSerialiseReader *this, DgStream *stream) {
+	/**
+	 * Start reading serialised data from the current position of a stream.
+	 * 
+	 * @note This reads many small values, so the stream should be buffered.
+	 * 
+	 * @param this Reader to set up
+	 * @param stream Stream to read from, which must stay open while reading
+	 * @return Error status
+	 */
+	
+	memset(&this->source, 0, sizeof this->source);
+	
+	DgError status = DgSerialiseStreamSource(&this->source, stream);
+	
+	if (status) {
+		return status;
+	}
+	
+	DgSerialiseReaderInit(this);
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgSerialiseReaderBegin(DgSerialiseReader *this) {
+	/**
+	 * Read the header if it hasn't been read yet.
+	 */
+	
+	if (this->started) {
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	DgError status = DgSerialiseReadHeader(&this->source, &this->checks);
+	
+	if (!status) {
+		this->started = true;
+	}
+	
+	return status;
+}
+
+static DgError DgSerialiseReaderClose(DgSerialiseReader *this) {
+	/**
+	 * Leave the innermost table, checking that it ended where it said it
+	 * would.
+	 */
+	
+	DgSerialiseLevel *level = &this->level[this->depth - 1];
+	
+	if (level->end != UINT64_MAX && this->source.position != level->end) {
+		return DG_ERROR_FAILED;
+	}
+	
+	this->depth--;
+	this->finished = (this->depth == 0);
+	
+	return this->finished ? DgSerialiseFinish(&this->source) : DG_ERROR_SUCCESSFUL;
+}
+
+DgError DgSerialiseReaderNext(DgSerialiseReader *this, DgSerialiseEvent *event, DgValue *value) {
+	/**
+	 * Read the next key or value. Tables are not read as a whole: instead a
+	 * table begin event is given with a value that has no table, then its
+	 * keys and values, then a table end event.
+	 * 
+	 * @param this Reader
+	 * @param event Where to store what was read
+	 * @param value Where to store the key or value that was read (nil for end
+	 * events)
+	 * @return Error status
+	 */
+	
+	DgError status = DgSerialiseReaderBegin(this);
+	
+	if (status) {
+		return status;
+	}
+	
+	DgValueNil(value);
+	
+	if (this->finished) {
+		event[0] = DG_SERIALISE_EVENT_END;
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	bool key = false;
+	
+	if (this->depth) {
+		DgSerialiseLevel *level = &this->level[this->depth - 1];
+		
+		if (!level->remaining) {
+			event[0] = DG_SERIALISE_EVENT_TABLE_END;
+			return DgSerialiseReaderClose(this);
+		}
+		
+		key = !(level->remaining & 1);
+		level->remaining--;
+	}
+	
+	uint64_t count, end;
+	
+	this->source.skipping = false;
+	
+	status = DgSerialiseReadHead(&this->source, value, &count, &end);
+	
+	if (status) {
+		return status;
+	}
+	
+	if (value->type == DG_TYPE_TABLE) {
+		if (this->depth >= DG_SERIALISE_MAX_DEPTH) {
+			return DG_ERROR_FAILED;
+		}
+		
+		this->level[this->depth].remaining = 2 * count;
+		this->level[this->depth].end = end;
+		this->depth++;
+		
+		event[0] = DG_SERIALISE_EVENT_TABLE_BEGIN;
+		
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	event[0] = key ? DG_SERIALISE_EVENT_KEY : DG_SERIALISE_EVENT_VALUE;
+	this->finished = (this->depth == 0);
+	
+	return this->finished ? DgSerialiseFinish(&this->source) : DG_ERROR_SUCCESSFUL;
+}
+
+DgError DgSerialiseReaderSkipValue(DgSerialiseReader *this) {
+	/**
+	 * Move past the key or value that would be read next, including
+	 * everything in it if it is a table.
+	 * 
+	 * @param this Reader
+	 * @return Error status, DG_ERROR_OUT_OF_RANGE if the innermost table has
+	 * nothing left in it
+	 */
+	
+	DgError status = DgSerialiseReaderBegin(this);
+	
+	if (status) {
+		return status;
+	}
+	
+	if (this->finished) {
+		return DG_ERROR_OUT_OF_RANGE;
+	}
+	
+	if (this->depth) {
+		DgSerialiseLevel *level = &this->level[this->depth - 1];
+		
+		if (!level->remaining) {
+			return DG_ERROR_OUT_OF_RANGE;
+		}
+		
+		level->remaining--;
+	}
+	
+	this->source.skipping = true;
+	
+	status = DgSerialiseSkipValue(&this->source, this->depth);
+	
+	this->source.skipping = false;
+	this->finished = (this->depth == 0);
+	
+	if (!status && this->finished) {
+		status = DgSerialiseFinish(&this->source);
+	}
+	
+	return status;
+}
+
+DgError DgSerialiseReaderSkip(DgSerialiseReader *this) {
+	/**
+	 * Move past the rest of the innermost table, including its end. Tables
+	 * that have their size written are skipped without reading them.
+	 * 
+	 * @param this Reader
+	 * @return Error status, DG_ERROR_OUT_OF_RANGE if no table is open
+	 */
+	
+	if (!this->depth) {
+		return DG_ERROR_OUT_OF_RANGE;
+	}
+	
+	DgSerialiseLevel *level = &this->level[this->depth - 1];
+	DgError status = DG_ERROR_SUCCESSFUL;
+	
+	this->source.skipping = true;
+	
+	if (level->end != UINT64_MAX) {
+		if (level->end < this->source.position) {
+			status = DG_ERROR_FAILED;
+		}
+		else {
+			status = DgSerialiseSkipBytes(&this->source, level->end - this->source.position);
+		}
+	}
+	else {
+		for (; level->remaining && !status; level->remaining--) {
+			status = DgSerialiseSkipValue(&this->source, this->depth);
+		}
+	}
+	
+	this->source.skipping = false;
+	
+	if (status) {
+		return status;
+	}
+	
+	level->remaining = 0;
+	
+	return DgSerialiseReaderClose(this);
+}
+
+void DgSerialiseReaderFree(DgSerialiseReader *this) {
+	/**
+	 * Free memory used by a reader. This does not close its stream.
+	 * 
+	 * @param this Reader to free
+	 */
+	
+	DgFree(this->source.scratch);
+	DgSerialiseChecksFree(&this->checks);
+	
+	this->source.scratch = NULL;
+	this->source.scratch_size = 0;
+	this->source.checks = NULL;
+}
+
+/**
+ * Documents
+ */
+
+DgError DgSerialiseOpenBuffer(DgSerialiseDocument *this, const void *data, size_t size) {
+	/**
+	 * Open serialised data in memory to look at in place.
+	 * 
+	 * @param this Document to open
+	 * @param data Serialised data, which must stay around until the document
+	 * is closed
+	 * @param size Size of the data in bytes
+	 * @return Error status
+	 */
+	
+	memset(this, 0, sizeof *this);
+	
+	DgSerialiseChecks checks = {0};
+	DgSerialiseSource source = {
+		.data = data,
+		.size = size,
+	};
+	
+	DgError status = DgSerialiseReadHeader(&source, &checks);
+	
+	if (status) {
+		return status;
+	}
+	
+	// Checksums are kept so that blocks can be checked as views use them
+	if (source.checks) {
+		this->checks = DgAlloc(sizeof *this->checks);
+		
+		if (!this->checks) {
+			DgSerialiseChecksFree(&checks);
+			return DG_ERROR_ALLOCATION_FAILED;
+		}
+		
+		this->checks[0] = checks;
+	}
+	
+	this->data = data;
+	this->size = source.size;
+	this->major = source.major;
+	this->minor = source.minor;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+DgError DgSerialiseOpen(DgSerialiseDocument *this, DgStorage *storage, const char *path) {
+	/**
+	 * Open a serialised file to look at in place. The file is mapped, so only
+	 * the parts of it that are looked at are read.
+	 * 
+	 * @param this Document to open
+	 * @param storage Storage object to use
+	 * @param path Path of the file
+	 * @return Error status
+	 */
+	
+	DgStorageMapping mapping;
+	DgStream stream;
+	DgError status = DgStreamOpen(storage, &stream, path, DG_STREAM_READ);
+	
+	if (status) {
+		memset(this, 0, sizeof *this);
+		return status;
+	}
+	
+	status = DgStreamMap(&stream, 0, 0, DG_STORAGE_MAP_RANDOM, &mapping);
+	
+	DgStreamClose(&stream);
+	
+	if (status) {
+		memset(this, 0, sizeof *this);
+		return status;
+	}
+	
+	status = DgSerialiseOpenBuffer(this, mapping.data, mapping.length);
+	
+	if (status) {
+		DgStreamUnmap(&mapping);
+		return status;
+	}
+	
+	this->mapping = mapping;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+void DgSerialiseClose(DgSerialiseDocument *this) {
+	/**
+	 * Close a document. Views of it can't be used after this.
+	 * 
+	 * @param this Document to close
+	 */
+	
+	if (this->checks) {
+		DgSerialiseChecksFree(this->checks);
+		DgFree(this->checks);
+	}
+	
+	DgStreamUnmap(&this->mapping);
+	
+	memset(this, 0, sizeof *this);
+}
+
+DgError DgSerialiseVerify(const DgSerialiseDocument *this) {
+	/**
+	 * Check all of a document against its checksums. This isn't needed to
+	 * use it, since views check each block the first time they read from it.
+	 * 
+	 * @param this Document to check
+	 * @return Error status, DG_ERROR_NOT_FOUND if the document doesn't have
+	 * checksums
+	 */
+	
+	if (!this->data) {
+		return DG_ERROR_NOT_INITIALISED;
+	}
+	
+	if (!this->checks) {
+		return DG_ERROR_NOT_FOUND;
+	}
+	
+	DgSerialiseSource source = {
+		.data = this->data,
+		.size = this->size,
+		.checks = this->checks,
+	};
+	
+	return DgSerialiseCheckRange(&source, 0, this->size);
+}
+
+static void DgSerialiseViewAt(DgSerialiseView *this, const DgSerialiseDocument *document, size_t offset) {
+	this->document = document;
+	this->offset = offset;
+	this->bytes.length = 0;
+	this->bytes.data = NULL;
+}
+
+static DgSerialiseSource DgSerialiseViewSource(const DgSerialiseView *this) {
+	/**
+	 * Get a source for reading from where a view is.
+	 */
+	
+	const DgSerialiseDocument *document = this->document;
+	
+	DgSerialiseSource source = {
+		.data = document->data,
+		.size = document->size,
+		.position = (this->offset < document->size) ? this->offset : document->size,
+		.major = document->major,
+		.minor = document->minor,
+		.skipping = true,
+		.checks = document->checks,
+	};
+	
+	return source;
+}
+
+static DgError DgSerialiseViewTable(const DgSerialiseView *this, DgSerialiseSource *source, uint64_t *count, uint64_t *end, size_t *index) {
+	/**
+	 * Start reading the table a view is of.
+	 * 
+	 * @param this View of a table
+	 * @param source Where to store a source at the first pair of the table
+	 * @param count Where to store the number of pairs
+	 * @param end Where to store the position after the table, or UINT64_MAX
+	 * @param index Where to store the position of the index, or SIZE_MAX if
+	 * the table doesn't have one
+	 * @return Error status
+	 */
+	
+	DgValue value;
+	
+	source[0] = DgSerialiseViewSource(this);
+	
+	bool indexed = source->major == 2 && source->position < source->size && source->data[source->position] == DG_SERIALISE_TAG_INDEXED_TABLE;
+	DgError status = DgSerialiseReadHead(source, &value, count, end);
+	
+	if (status) {
+		return status;
+	}
+	
+	if (value.type != DG_TYPE_TABLE) {
+		return DG_ERROR_FAILED;
+	}
+	
+	index[0] = indexed ? source->position - *count * DG_SERIALISE_INDEX_ENTRY : SIZE_MAX;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+DgError DgSerialiseViewRoot(const DgSerialiseDocument *this, DgSerialiseView *view) {
+	/**
+	 * Get a view of the root value of a document.
+	 * 
+	 * @param this Document
+	 * @param view Where to store the view
+	 * @return Error status
+	 */
+	
+	if (!this->data) {
+		return DG_ERROR_NOT_INITIALISED;
+	}
+	
+	// The root value comes after the tag marking a checksummed document
+	DgSerialiseViewAt(view, this, DG_SERIALISE_HEADER_SIZE + !!this->checks);
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+DgError DgSerialiseViewValue(DgSerialiseView *this, DgValue *value) {
+	/**
+	 * Decode the value a view is of. Tables are given with a NULL table, and
+	 * should be looked at using the other view functions instead.
+	 * 
+	 * @note Strings point into the document and bytes into the view, so they
+	 * must not be freed.
+	 * 
+	 * @param this View
+	 * @param value Where to store the value
+	 * @return Error status
+	 */
+	
+	DgSerialiseSource source = DgSerialiseViewSource(this);
+	uint64_t count, end;
+	
+	DgError status = DgSerialiseReadHead(&source, value, &count, &end);
+	
+	if (!status && value->type == DG_TYPE_BYTES) {
+		this->bytes = source.bytes;
+		value->data.asBytes = &this->bytes;
+	}
+	
+	return status;
+}
+
+DgError DgSerialiseViewLength(const DgSerialiseView *this, size_t *length) {
+	/**
+	 * Get the number of pairs in a table.
+	 * 
+	 * @param this View of a table
+	 * @param length Where to store the number of pairs
+	 * @return Error status
+	 */
+	
+	DgSerialiseSource source;
+	uint64_t count, end;
+	size_t index;
+	
+	DgError status = DgSerialiseViewTable(this, &source, &count, &end, &index);
+	
+	if (!status) {
+		length[0] = count;
+	}
+	
+	return status;
+}
+
+DgError DgSerialiseViewPair(const DgSerialiseView *this, size_t index, DgSerialiseView *key, DgSerialiseView *value) {
+	/**
+	 * Get the key and value of a pair in a table, in the order they were
+	 * written. This moves past every pair before it, so DgSerialiseViewGet
+	 * should be used to find keys.
+	 * 
+	 * @param this View of a table
+	 * @param index Index of the pair
+	 * @param key Where to store the key (can be NULL)
+	 * @param value Where to store the value (can be NULL)
+	 * @return Error status, DG_ERROR_OUT_OF_RANGE if there are not that many
+	 * pairs
+	 */
+	
+	DgSerialiseSource source;
+	uint64_t count, end;
+	size_t table_index;
+	const DgSerialiseDocument *document = this->document;
+	
+	DgError status = DgSerialiseViewTable(this, &source, &count, &end, &table_index);
+	
+	if (status) {
+		return status;
+	}
+	
+	if (index >= count) {
+		return DG_ERROR_OUT_OF_RANGE;
+	}
+	
+	for (size_t i = 0; i < 2 * index && !status; i++) {
+		status = DgSerialiseSkipValue(&source, 1);
+	}
+	
+	size_t key_offset = source.position;
+	
+	if (!status) {
+		status = DgSerialiseSkipValue(&source, 1);
+	}
+	
+	if (status) {
+		return status;
+	}
+	
+	if (key) {
+		DgSerialiseViewAt(key, document, key_offset);
+	}
+	
+	if (value) {
+		DgSerialiseViewAt(value, document, source.position);
+	}
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static bool DgSerialiseKeyNumber(const DgValue *key, uint64_t *number, bool *negative) {
+	/**
+	 * Get the number an integer key holds, if it is an integer.
+	 */
+	
+	int64_t signed_number;
+	
+	switch (key->type) {
+		case DG_TYPE_INT8: signed_number = key->data.asInt8; break;
+		case DG_TYPE_INT16: signed_number = key->data.asInt16; break;
+		case DG_TYPE_INT32: signed_number = key->data.asInt32; break;
+		case DG_TYPE_INT64: signed_number = key->data.asInt64; break;
+		case DG_TYPE_UINT8: number[0] = key->data.asUInt8; negative[0] = false; return true;
+		case DG_TYPE_UINT16: number[0] = key->data.asUInt16; negative[0] = false; return true;
+		case DG_TYPE_UINT32: number[0] = key->data.asUInt32; negative[0] = false; return true;
+		case DG_TYPE_UINT64: number[0] = key->data.asUInt64; negative[0] = false; return true;
+		default: return false;
+	}
+	
+	number[0] = signed_number;
+	negative[0] = signed_number < 0;
+	
+	return true;
+}
+
+static bool DgSerialiseKeyEqual(const DgValue *stored, const DgValue *key) {
+	/**
+	 * Check if a key in a document is the one being looked for. Unlike
+	 * DgValueEqual, integers are the same if they have the same number.
+	 */
+	
+	uint64_t number1, number2;
+	bool negative1, negative2;
+	
+	if (stored->type == DG_TYPE_TABLE) {
+		return false;
+	}
+	
+	if (DgSerialiseKeyNumber(stored, &number1, &negative1) && DgSerialiseKeyNumber(key, &number2, &negative2)) {
+		return number1 == number2 && negative1 == negative2;
+	}
+	
+	return DgValueEqual(stored, key);
+}
+
+DgError DgSerialiseViewGet(const DgSerialiseView *this, const DgValue *key, DgSerialiseView *value) {
+	/**
+	 * Find the value for a key in a table. Tables with an index are searched
+	 * using it, which only looks at a few of their pairs. Integer keys match
+	 * whatever their type.
+	 * 
+	 * @param this View of a table
+	 * @param key Key to find
+	 * @param value Where to store the view of the value (can be `this`)
+	 * @return Error status, DG_ERROR_NOT_FOUND if the key is not in the table
+	 */
+	
+	DgSerialiseSource source;
+	DgValue stored;
+	uint64_t count, end, stored_count, stored_end;
+	size_t index;
+	const DgSerialiseDocument *document = this->document;
+	
+	if (key->type == DG_TYPE_TABLE || key->type == DG_TYPE_POINTER) {
+		return DG_ERROR_NOT_SUPPORTED;
+	}
+	
+	DgError status = DgSerialiseViewTable(this, &source, &count, &end, &index);
+	
+	if (status) {
+		return status;
+	}
+	
+	if (index != SIZE_MAX) {
+		const uint8_t *entries = document->data + index;
+		
+		// The index was skipped over, so it hasn't been checked yet
+		status = DgSerialiseCheckRange(&source, index, count * DG_SERIALISE_INDEX_ENTRY);
+		
+		if (status) {
+			return status;
+		}
+		
+		uint32_t hash = DgSerialiseKeyHash(key);
+		size_t pairs = source.position;
+		size_t low = 0, high = count;
+		
+		// Find the first entry with this hash
+		while (low < high) {
+			size_t middle = low + (high - low) / 2;
+			
+			if (DgSerialiseLoadUInt32(entries + middle * DG_SERIALISE_INDEX_ENTRY) < hash) {
+				low = middle + 1;
+			}
+			else {
+				high = middle;
+			}
+		}
+		
+		for (size_t i = low; i < count && DgSerialiseLoadUInt32(entries + i * DG_SERIALISE_INDEX_ENTRY) == hash; i++) {
+			uint32_t offset = DgSerialiseLoadUInt32(entries + i * DG_SERIALISE_INDEX_ENTRY + 4);
+			
+			if (offset >= end - pairs) {
+				return DG_ERROR_FAILED;
+			}
+			
+			source.position = pairs + offset;
+			status = DgSerialiseReadHead(&source, &stored, &stored_count, &stored_end);
+			
+			if (status) {
+				return status;
+			}
+			
+			if (DgSerialiseKeyEqual(&stored, key)) {
+				DgSerialiseViewAt(value, document, source.position);
+				return DG_ERROR_SUCCESSFUL;
+			}
+		}
+		
+		return DG_ERROR_NOT_FOUND;
+	}
+	
+	for (uint64_t i = 0; i < count; i++) {
+		size_t key_offset = source.position;
+		
+		status = DgSerialiseReadHead(&source, &stored, &stored_count, &stored_end);
+		
+		if (status) {
+			return status;
+		}
+		
+		if (stored.type == DG_TYPE_TABLE) {
+			source.position = key_offset;
+			status = DgSerialiseSkipValue(&source, 1);
+		}
+		else if (DgSerialiseKeyEqual(&stored, key)) {
+			DgSerialiseViewAt(value, document, source.position);
+			return DG_ERROR_SUCCESSFUL;
+		}
+		
+		if (!status) {
+			status = DgSerialiseSkipValue(&source, 1);
+		}
+		
+		if (status) {
+			return status;
+		}
+	}
+	
+	return DG_ERROR_NOT_FOUND;
+}
+
+DgError DgSerialiseViewGetPath(const DgSerialiseView *this, const char *path, DgSerialiseView *value) {
+	/**
+	 * Find a value in nested tables, for example "world.regions[123].name".
+	 * Names are string keys and numbers in brackets are integer keys.
+	 * 
+	 * @param this View of a table
+	 * @param path Path to the value
+	 * @param value Where to store the view of the value (can be `this`)
+	 * @return Error status, DG_ERROR_NOT_FOUND if a key is missing
+	 */
+	
+	DgSerialiseView current = *this;
+	
+	while (*path) {
+		DgValue key;
+		DgError status;
+		
+		if (*path == '[') {
+			char *after;
+			int64_t number = strtoll(path + 1, &after, 10);
+			
+			if (after == path + 1 || *after != ']') {
+				return DG_ERROR_FAILED;
+			}
+			
+			key = DgMakeInt64(number);
+			status = DgSerialiseViewGet(&current, &key, &current);
+			path = after + 1;
+		}
+		else {
+			size_t length = strcspn(path, ".[");
+			
+			if (!length) {
+				return DG_ERROR_FAILED;
+			}
+			
+			char *name = DgStringDuplicateUntil(path, length);
+			
+			if (!name) {
+				return DG_ERROR_ALLOCATION_FAILED;
+			}
+			
+			key = DgMakeStaticString(name);
+			status = DgSerialiseViewGet(&current, &key, &current);
+			path += length;
+			
+			DgFree(name);
+		}
+		
+		if (status) {
+			return status;
+		}
+		
+		if (*path == '.') {
+			path++;
+		}
+	}
+	
+	DgSerialiseViewAt(value, current.document, current.offset);
+	
+	return DG_ERROR_SUCCESSFUL;
 }
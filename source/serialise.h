@@ -14,6 +14,162 @@
 
 #pragma once
 
+#include "storage.h"
 #include "table.h"
 
+#define DG_SERIALISE_MAGIC 0xFC991E51
+
+// Newest version, which is written by default
+#define DG_SERIALISE_VERSION_MAJOR 2
+#define DG_SERIALISE_VERSION_MINOR 3
+
+// Newest minor version of the original encoding
+#define DG_SERIALISE_V1_MINOR 1
+
+// Deepest nesting of tables that will be read
+#define DG_SERIALISE_MAX_DEPTH 256
+
+// Tables with at least this many bytes of contents have their size written
+#define DG_SERIALISE_SIZED_TABLE_MIN 256
+
+// Tables with at least this many pairs are given an index when writing with
+// DG_SERIALISE_INDEXED
+#define DG_SERIALISE_INDEXED_TABLE_MIN 8
+
+// Size of the blocks that are checksummed when writing with
+// DG_SERIALISE_CHECKSUM
+#define DG_SERIALISE_CHECK_BLOCK 4096
+
+// Smallest block of memory the reader allocates tables from
+#define DG_SERIALISE_ARENA_BLOCK 65536
+
+typedef struct DgSerialiseArenaBlock DgSerialiseArenaBlock;
+
+typedef enum DgSerialiseFlags {
+	DG_SERIALISE_INDEXED = (1 << 0),      // Give large tables an index of their keys
+	DG_SERIALISE_CHECKSUM = (1 << 1),     // Add a CRC32C of each block and of the whole file
+} DgSerialiseFlags;
+
+/**
+ * A value tree that has been read back. Its tables are allocated together and
+ * its strings and bytes point into the input where they can, so the tree is
+ * read-only and must be released with DgSerialiseFree, not DgValueFree.
+ */
+typedef struct DgSerialised {
+	DgValue root;
+	DgSerialiseArenaBlock *arena;    // Memory for tables and copied strings
+	DgStorageMapping mapping;        // File the tree points into (DgSerialiseRead only)
+} DgSerialised;
+
+/**
+ * Checksums from the end of a checksummed document.
+ */
+typedef struct DgSerialiseChecks {
+	uint32_t *blocks;                // CRC32C of each block
+	uint8_t *verified;               // If each block has been checked yet (buffers only)
+	size_t count;                    // Number of blocks
+	uint64_t length;                 // Number of bytes that are checksummed
+	uint32_t block_size;
+	uint32_t crc;                    // Checksum of the block being read so far (streams only)
+} DgSerialiseChecks;
+
+/**
+ * Where serialised data is read from.
+ */
+typedef struct DgSerialiseSource {
+	const uint8_t *data;             // Buffer being read, or NULL when reading a stream
+	DgStream *stream;                // Stream being read, or NULL when reading a buffer
+	size_t size;                     // Number of bytes that can be read in total
+	size_t position;                 // Number of bytes read so far
+	uint16_t major;                  // Version of the data
+	uint16_t minor;
+	DgSerialiseArenaBlock **arena;   // Where tables and copied strings go, if building a tree
+	uint8_t *scratch;                // Where strings from a stream go otherwise
+	size_t scratch_size;
+	DgBytes bytes;                   // Last bytes value given out when there is no arena
+	bool skipping;                   // If strings and bytes from a stream can be skipped
+	DgSerialiseChecks *checks;       // Checksums to verify what is read against, if any
+} DgSerialiseSource;
+
+typedef enum DgSerialiseEvent {
+	DG_SERIALISE_EVENT_END = 0,      // The root value has been read
+	DG_SERIALISE_EVENT_KEY,          // Key of a table pair
+	DG_SERIALISE_EVENT_VALUE,        // Value of a table pair, or the root value
+	DG_SERIALISE_EVENT_TABLE_BEGIN,  // Start of a table, given in place of a key or value
+	DG_SERIALISE_EVENT_TABLE_END,    // All pairs of the innermost table have been read
+} DgSerialiseEvent;
+
+typedef struct DgSerialiseLevel {
+	uint64_t remaining;              // Keys and values left to read
+	uint64_t end;                    // Position after the table, or UINT64_MAX if not known
+} DgSerialiseLevel;
+
+/**
+ * Reads serialised data one value at a time without building a tree.
+ * 
+ * Strings and bytes that are given out are only valid until the next call
+ * when reading a stream. When reading a buffer they point into it.
+ * 
+ * @note The reader points into itself once it has started, so it can't be
+ * moved while reading.
+ */
+typedef struct DgSerialiseReader {
+	DgSerialiseSource source;
+	DgSerialiseChecks checks;
+	DgSerialiseLevel level[DG_SERIALISE_MAX_DEPTH];
+	size_t depth;                    // Number of tables currently open
+	bool started;                    // If the header has been read
+	bool finished;                   // If the root value has been read
+} DgSerialiseReader;
+
+/**
+ * Serialised data that is looked at in place instead of being read.
+ */
+typedef struct DgSerialiseDocument {
+	const uint8_t *data;
+	size_t size;
+	uint16_t major;
+	uint16_t minor;
+	DgStorageMapping mapping;        // File the data is in (DgSerialiseOpen only)
+	DgSerialiseChecks *checks;       // Checksums of the data, or NULL if it has none
+} DgSerialiseDocument;
+
+/**
+ * A value in a document. Nothing in it is decoded until it is asked for.
+ */
+typedef struct DgSerialiseView {
+	const DgSerialiseDocument *document;
+	size_t offset;                   // Position of the value in the document
+	DgBytes bytes;                   // Bytes given out by DgSerialiseViewValue
+} DgSerialiseView;
+
+DgError DgSerialiseWriteValue(DgStream * restrict stream, const DgValue * restrict value);
+DgError DgSerialiseWriteValueV2(DgStream * restrict stream, const DgValue * restrict value, DgSerialiseFlags flags);
+DgError DgSerialiseWriteHeader(DgStream *stream, uint16_t major);
+DgError DgSerialiseWriteStreamVersion(DgStream * restrict stream, DgValue * restrict value, uint16_t major, DgSerialiseFlags flags);
+DgError DgSerialiseWriteStream(DgStream * restrict stream, DgValue * restrict value);
+DgError DgSerialiseWriteFlags(DgStorage *storage, const char *path, DgValue * restrict value, DgSerialiseFlags flags);
 DgError DgSerialiseWrite(DgStorage *storage, const char *path, DgValue * restrict value);
+
+DgError DgSerialiseReadBuffer(DgSerialised *this, const void *data, size_t size);
+DgError DgSerialiseReadStream(DgSerialised *this, DgStream *stream);
+DgError DgSerialiseRead(DgSerialised *this, DgStorage *storage, const char *path);
+void DgSerialiseFree(DgSerialised *this);
+
+DgError DgSerialiseReaderInitBuffer(DgSerialiseReader *this, const void *data, size_t size);
+DgError DgSerialiseReaderInitStream(DgSerialiseReader *this, DgStream *stream);
+DgError DgSerialiseReaderNext(DgSerialiseReader *this, DgSerialiseEvent *event, DgValue *value);
+DgError DgSerialiseReaderSkipValue(DgSerialiseReader *this);
+DgError DgSerialiseReaderSkip(DgSerialiseReader *this);
+void DgSerialiseReaderFree(DgSerialiseReader *this);
+
+DgError DgSerialiseOpenBuffer(DgSerialiseDocument *this, const void *data, size_t size);
+DgError DgSerialiseOpen(DgSerialiseDocument *this, DgStorage *storage, const char *path);
+void DgSerialiseClose(DgSerialiseDocument *this);
+DgError DgSerialiseVerify(const DgSerialiseDocument *this);
+DgError DgSerialiseViewRoot(const DgSerialiseDocument *this, DgSerialiseView *view);
+DgError DgSerialiseViewValue(DgSerialiseView *this, DgValue *value);
+DgError DgSerialiseViewLength(const DgSerialiseView *this, size_t *length);
+DgError DgSerialiseViewPair(const DgSerialiseView *this, size_t index, DgSerialiseView *key, DgSerialiseView *value);
+DgError DgSerialiseViewGet(const DgSerialiseView *this, const DgValue *key, DgSerialiseView *value);
+DgError DgSerialiseViewGetPath(const DgSerialiseView *this, const char *path, DgSerialiseView *value);
@@ -18,8 +18,10 @@
 #include "alloc.h"
 #include "string.h"
 #include "log.h"
+#include "checksum.h"
 
 #include "storage.h"
+#include "storage_metrics.h"
 
 /**
  * Default storage config
@@ -140,6 +142,10 @@ DgError DgStorageFree(DgStorage *this) {
 		DgFree(this->pool);
 	}
 	
+	if (this->pool_index) {
+		DgFree(this->pool_index);
+	}
+	
 	return DG_ERROR_SUCCESSFUL;
 }
 
@@ -147,6 +153,83 @@ DgError DgStorageFree(DgStorage *this) {
  * Pool manegement
  */
 
+static DgError DgStorageRebuildPoolIndex(DgStorage *this) {
+	/**
+	 * Rebuild the protocol hash table so that it holds every pool and is at
+	 * most half full.
+	 * 
+	 * @param this Storage configuration
+	 * @return Error code
+	 */
+	
+	size_t size = 8;
+	
+	while (size < this->pool_count * 2) {
+		size *= 2;
+	}
+	
+	DgStoragePoolSlot *index = DgAlloc(sizeof *index * size);
+	
+	if (!index) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	memset(index, 0, sizeof *index * size);
+	
+	for (size_t i = 0; i < this->pool_count; i++) {
+		uint32_t hash = DgChecksumFNV1a32(DgStringLength(this->pool[i].protocol), this->pool[i].protocol);
+		size_t slot = hash & (size - 1);
+		
+		while (index[slot].index) {
+			slot = (slot + 1) & (size - 1);
+		}
+		
+		index[slot].hash = hash;
+		index[slot].index = i + 1;
+	}
+	
+	if (this->pool_index) {
+		DgFree(this->pool_index);
+	}
+	
+	this->pool_index = index;
+	this->pool_index_size = size;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgStoragePool *DgStorageFindPool(DgStorage *this, const char *protocol, size_t length) {
+	/**
+	 * Find the pool with the given protocol name.
+	 * 
+	 * @param this Storage configuration
+	 * @param protocol Protocol name, does not need to be terminated
+	 * @param length Length of the protocol name
+	 * @return The pool, or NULL if there isn't one
+	 */
+	
+	if (!this->pool_index_size) {
+		return NULL;
+	}
+	
+	uint32_t hash = DgChecksumFNV1a32(length, protocol);
+	size_t mask = this->pool_index_size - 1;
+	
+	for (size_t slot = hash & mask; this->pool_index[slot].index; slot = (slot + 1) & mask) {
+		if (this->pool_index[slot].hash != hash) {
+			continue;
+		}
+		
+		DgStoragePool *candidate = &this->pool[this->pool_index[slot].index - 1];
+		
+		if (!strncmp(candidate->protocol, protocol, length) && candidate->protocol[length] == '\0') {
+			return candidate;
+		}
+	}
+	
+	return NULL;
+}
+
 DgError DgStorageAddPool(DgStorage *this, DgStoragePool *pool) {
 	/**
 	 * Add the given pool to the given storage configuration
@@ -175,15 +258,24 @@ DgError DgStorageAddPool(DgStorage *this, DgStoragePool *pool) {
 	}
 	
 	// Allocate the pool's memory
-	this->pool_count++;
-	this->pool = DgMemoryReallocate(this->pool, sizeof *this->pool * this->pool_count);
+	DgStoragePool *pools = DgMemoryReallocate(this->pool, sizeof *this->pool * (this->pool_count + 1));
 	
-	if (!this->pool) {
+	if (!pools) {
 		return DG_ERROR_ALLOCATION_FAILED;
 	}
 	
 	// Copy pool data
-	this->pool[this->pool_count - 1] = *pool;
+	this->pool = pools;
+	this->pool[this->pool_count] = *pool;
+	this->pool_count++;
+	
+	// Index the new pool
+	DgError status = DgStorageRebuildPoolIndex(this);
+	
+	if (status) {
+		this->pool_count--;
+		return status;
+	}
 	
 	// Clear temporary pool memory
 	DgFree(pool);
@@ -226,17 +318,17 @@ DgError DgStorageGetPool(DgStorage *this, DgStoragePath protocol, DgStoragePool
 	
 	DG_STORAGE_RESOLVE();
 	
-	for (size_t index = 0; index < this->pool_count; index++) {
-		if (DgStringEqual(this->pool[index].protocol, protocol)) {
-			if (pool) {
-				pool[0] = &this->pool[index];
-			}
-			
-			return DG_ERROR_SUCCESSFUL;
-		}
+	DgStoragePool *found = DgStorageFindPool(this, protocol, DgStringLength(protocol));
+	
+	if (!found) {
+		return DG_ERROR_NOT_FOUND;
+	}
+	
+	if (pool) {
+		pool[0] = found;
 	}
 	
-	return DG_ERROR_NOT_FOUND;
+	return DG_ERROR_SUCCESSFUL;
 }
 
 bool DgStorageHasPool(DgStorage *this, DgStoragePath protocol) {
@@ -311,6 +403,54 @@ DgError DgStorageSplitPathIntoParts(DgStoragePath path, char **protocol, char **
 	return DG_ERROR_SUCCESSFUL;
 }
 
+DgStoragePath DgStoragePathFilename(DgStoragePath path) {
+	/**
+	 * Get the part of a path after the protocol, without copying it.
+	 * 
+	 * @param path Path to the file
+	 * @return Pointer into `path` just after the "://", or NULL if there is no protocol
+	 */
+	
+	for (const char *p = path; *p; p++) {
+		if (p[0] == ':' && p[1] == '/' && p[2] == '/') {
+			return p + 3;
+		}
+	}
+	
+	return NULL;
+}
+
+void DgStoragePathLocal(DgStoragePath path, const char **key, size_t *length) {
+	/**
+	 * Get the part of a path that a pool uses to find the file, which is the
+	 * path without the protocol and without leading or trailing slashes. This
+	 * does not copy the path, so the key is not terminated.
+	 * 
+	 * @param path Path to the file
+	 * @param key Where to store the start of the key
+	 * @param length Where to store the length of the key
+	 */
+	
+	DgStoragePath filename = DgStoragePathFilename(path);
+	
+	if (filename) {
+		path = filename;
+	}
+	
+	while (path[0] == '/') {
+		path++;
+	}
+	
+	size_t path_length = DgStringLength(path);
+	
+	while (path_length && path[path_length - 1] == '/') {
+		path_length--;
+	}
+	
+	key[0] = path;
+	length[0] = path_length;
+}
+
 DgError DgStorageGetPoolFromPath(DgStorage *this, DgStoragePath path, DgStoragePool **pool) {
 	/**
 	 * Get the storage pool assocaited with the given path.
@@ -321,24 +461,22 @@ DgError DgStorageGetPoolFromPath(DgStorage *this, DgStoragePath path, DgStorageP
 	 * @return Error code
 	 */
 	
-	char *protocol;
+	DG_STORAGE_RESOLVE();
 	
-	// Get the protocol
-	DgError status = DgStorageSplitPathIntoParts(path, &protocol, NULL);
+	// The protocol is the part before "://", which we look up in place
+	DgStoragePath filename = DgStoragePathFilename(path);
 	
-	if (status) {
-		return status;
+	if (!filename) {
+		return DG_ERROR_FILE_NOT_FOUND;
 	}
 	
-	// Find the pool from the protocol
-	status = DgStorageGetPool(this, protocol, pool);
+	DgStoragePool *found = DgStorageFindPool(this, path, (filename - path) - 3);
 	
-	if (status) {
-		return status;
+	if (!found) {
+		return DG_ERROR_NOT_FOUND;
 	}
 	
-	// Free temporary memory
-	DgFree(protocol);
+	pool[0] = found;
 	
 	return DG_ERROR_SUCCESSFUL;
 }
@@ -368,7 +506,13 @@ DgError DgStorageDelete(DgStorage *this, DgStoragePath path) {
 	}
 	
 	// Call its function
-	return pool->functions->delete(this, pool, path);
+	uint64_t start = DgStorageMetricsBegin();
+	
+	status = pool->functions->delete(this, pool, path);
+	
+	DgStorageMetricsEnd(pool, DG_STORAGE_OP_CHANGE, start, 0, status);
+	
+	return status;
 }
 
 DgError DgStorageRename(DgStorage *this, DgStoragePath old_path, DgStoragePath new_path) {
@@ -401,7 +545,113 @@ DgError DgStorageRename(DgStorage *this, DgStoragePath old_path, DgStoragePath n
 	}
 	
 	// Call its function
-	return pool->functions->rename(this, pool, old_path, new_path);
+	uint64_t start = DgStorageMetricsBegin();
+	
+	status = pool->functions->rename(this, pool, old_path, new_path);
+	
+	DgStorageMetricsEnd(pool, DG_STORAGE_OP_CHANGE, start, 0, status);
+	
+	return status;
+}
+
+DgError DgStorageCopy(DgStorage *this, DgStoragePath source, DgStoragePath destination) {
+	/**
+	 * Copy the file at `source` to `destination`, overwriting it if it already
+	 * exists. The files can be in different pools.
+	 * 
+	 * @note If both files are in the same pool and it has a copy function, the
+	 * pool copies the file itself. Otherwise the data is streamed through a
+	 * buffer of DG_STORAGE_COPY_BUFFER_SIZE bytes, so the whole file is never
+	 * in memory at once.
+	 * 
+	 * @param this Storage configuration
+	 * @param source Path of the file to copy
+	 * @param destination Path to copy it to
+	 * @return Error code
+	 */
+	
+	DG_STORAGE_RESOLVE();
+	
+	DgStoragePool *source_pool, *destination_pool;
+	
+	DgError status = DgStorageGetPoolFromPath(this, source, &source_pool);
+	
+	if (status) {
+		return status;
+	}
+	
+	status = DgStorageGetPoolFromPath(this, destination, &destination_pool);
+	
+	if (status) {
+		return status;
+	}
+	
+	if (source_pool == destination_pool && source_pool->functions->copy) {
+		uint64_t start = DgStorageMetricsBegin();
+		
+		status = source_pool->functions->copy(this, source_pool, source, destination);
+		
+		DgStorageMetricsEnd(source_pool, DG_STORAGE_OP_CHANGE, start, 0, status);
+		
+		if (status != DG_ERROR_NOT_SUPPORTED) {
+			return status;
+		}
+	}
+	
+	// Copying a file onto itself would truncate it before it is read
+	if (DgStringEqual(source, destination)) {
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	DgStream input, output;
+	
+	status = DgStreamOpen(this, &input, source, DG_STREAM_READ);
+	
+	if (status) {
+		return status;
+	}
+	
+	status = DgStreamOpen(this, &output, destination, DG_STREAM_WRITE);
+	
+	if (status) {
+		DgStreamClose(&input);
+		return status;
+	}
+	
+	// An empty copy of a file whose length isn't known would look like success
+	size_t remaining = 0;
+	size_t buffer_size = 0;
+	void *buffer = NULL;
+	
+	status = DgStreamGetLength(&input, &remaining);
+	
+	if (!status) {
+		buffer_size = remaining < DG_STORAGE_COPY_BUFFER_SIZE ? remaining : DG_STORAGE_COPY_BUFFER_SIZE;
+		buffer = DgAlloc(buffer_size ? buffer_size : 1);
+		
+		if (!buffer) {
+			status = DG_ERROR_ALLOCATION_FAILED;
+		}
+	}
+	
+	while (remaining && !status) {
+		size_t count = remaining < buffer_size ? remaining : buffer_size;
+		
+		status = DgStreamRead(&input, count, buffer);
+		
+		if (!status) {
+			status = DgStreamWrite(&output, count, buffer);
+		}
+		
+		remaining -= count;
+	}
+	
+	DgMemoryFree(buffer);
+	DgStreamClose(&input);
+	
+	DgError close_status = DgStreamClose(&output);
+	
+	return status ? status : close_status;
 }
 
 DgError DgStorageCreateFile(DgStorage *this, DgStoragePath path) {
@@ -430,7 +680,13 @@ DgError DgStorageCreateFile(DgStorage *this, DgStoragePath path) {
 	}
 	
 	// Call its function
-	return pool->functions->create_file(this, pool, path);
+	uint64_t start = DgStorageMetricsBegin();
+	
+	status = pool->functions->create_file(this, pool, path);
+	
+	DgStorageMetricsEnd(pool, DG_STORAGE_OP_CHANGE, start, 0, status);
+	
+	return status;
 }
 
 DgError DgStorageCreateFolder(DgStorage *this, DgStoragePath path) {
@@ -457,7 +713,13 @@ DgError DgStorageCreateFolder(DgStorage *this, DgStoragePath path) {
 	}
 	
 	// Call its function
-	return pool->functions->create_folder(this, pool, path);
+	uint64_t start = DgStorageMetricsBegin();
+	
+	status = pool->functions->create_folder(this, pool, path);
+	
+	DgStorageMetricsEnd(pool, DG_STORAGE_OP_CHANGE, start, 0, status);
+	
+	return status;
 }
 
 DgStorageObjectType DgStorageType(DgStorage *this, DgStoragePath path, DgStorageObjectType *type) {
@@ -481,48 +743,93 @@ DgStorageObjectType DgStorageType(DgStorage *this, DgStoragePath path, DgStorage
 	}
 	
 	// Call its function
-	return pool->functions->type(this, pool, path, type);
+	uint64_t start = DgStorageMetricsBegin();
+	
+	status = pool->functions->type(this, pool, path, type);
+	
+	DgStorageMetricsEnd(pool, DG_STORAGE_OP_METADATA, start, 0, status);
+	
+	return status;
 }
 
-DgError DgStoragePoolFree(DgStoragePool *pool) {
+DgError DgStorageStat(DgStorage *this, DgStoragePath path, DgStorageInfo *info) {
 	/**
-	 * Release memory assocaited with a storage pool.
+	 * Find the type, size and modification time of the object at `path`.
 	 * 
-	 * @param pool The pool to free
-	 * @return Errors encountered freeing pool
+	 * @param this Storage configuration
+	 * @param path Path of the object (including protocol)
+	 * @param info Where to store the metadata
+	 * @return Error code
 	 */
 	
-	if (pool->protocol) {
-		DgFree((void *) pool->protocol);
+	DG_STORAGE_RESOLVE();
+	
+	DgStoragePool *pool;
+	
+	DgError status = DgStorageGetPoolFromPath(this, path, &pool);
+	
+	if (status) {
+		return status;
 	}
 	
-	if (pool == NULL) {
-		return DG_ERROR_NOT_SAFE;
+	if (pool->functions->stat) {
+		uint64_t start = DgStorageMetricsBegin();
+		
+		status = pool->functions->stat(this, pool, path, info);
+		
+		DgStorageMetricsEnd(pool, DG_STORAGE_OP_METADATA, start, 0, status);
+		
+		return status;
 	}
 	
-	if (!pool->functions->free_specific_config) {
+	// Pools without stat: find the type, then open files to get their length
+	memset(info, 0, sizeof *info);
+	
+	if (pool->functions->type(this, pool, path, &info->type)) {
+		info->type = DG_STORAGE_TYPE_NONE;
+	}
+	
+	if (info->type == DG_STORAGE_TYPE_FOLDER) {
 		return DG_ERROR_SUCCESSFUL;
 	}
 	
-	return pool->functions->free_specific_config(pool);
+	DgStream stream;
+	
+	if (DgStreamOpen(this, &stream, path, DG_STREAM_READ)) {
+		return (info->type == DG_STORAGE_TYPE_NONE) ? DG_ERROR_FILE_NOT_FOUND : DG_ERROR_SUCCESSFUL;
+	}
+	
+	info->size = DgStreamLength(&stream);
+	
+	if (info->type == DG_STORAGE_TYPE_NONE) {
+		info->type = DG_STORAGE_TYPE_FILE;
+	}
+	
+	DgStreamClose(&stream);
+	
+	return DG_ERROR_SUCCESSFUL;
 }
 
-/* Stream functions and similar */
+static int DgStorageEntryCompare(const void *a, const void *b) {
+	return strcmp(((const DgStorageEntry *) a)->name, ((const DgStorageEntry *) b)->name);
+}
 
-DgError DgStreamOpen(DgStorage *this, DgStream *context, DgStoragePath path, DgStorageFlags flags) {
+DgError DgStorageList(DgStorage *this, DgStoragePath path, DgStorageListFlags flags, DgStorageListing *listing) {
 	/**
-	 * Open a stream
+	 * List the contents of the folder at `path`. The listing does not include
+	 * "." or "..".
 	 * 
-	 * @param this Storage object to use
-	 * @param stream Where to store the resulting stream object
-	 * @param path Path to the stream source to open
-	 * @param flags Properties of the stream
+	 * @param this Storage configuration
+	 * @param path Path of the folder (including protocol)
+	 * @param flags What to find out about each entry
+	 * @param listing Where to store the listing, free with DgStorageListingFree
 	 * @return Error code
 	 */
 	
 	DG_STORAGE_RESOLVE();
 	
-	// Find the pool
+	memset(listing, 0, sizeof *listing);
+	
 	DgStoragePool *pool;
 	
 	DgError status = DgStorageGetPoolFromPath(this, path, &pool);
@@ -531,47 +838,289 @@ DgError DgStreamOpen(DgStorage *this, DgStream *context, DgStoragePath path, DgS
 		return status;
 	}
 	
-	// Pre-set the stream storage and pool
-	context->storage = this;
-	context->pool = pool;
+	if (!pool->functions->list) {
+		return DG_ERROR_NOT_SUPPORTED;
+	}
 	
-	// Call its function
-	return pool->functions->open(this, pool, context, path, flags);
+	uint64_t start = DgStorageMetricsBegin();
+	
+	status = pool->functions->list(this, pool, path, flags, listing);
+	
+	DgStorageMetricsEnd(pool, DG_STORAGE_OP_METADATA, start, 0, status);
+	
+	if (status) {
+		DgStorageListingFree(listing);
+		return status;
+	}
+	
+	// Entries hold offsets into the names buffer until now, since it can move
+	// while the listing is built
+	for (size_t i = 0; i < listing->entry_count; i++) {
+		listing->entry[i].name = listing->names + (uintptr_t) listing->entry[i].name;
+	}
+	
+	if (listing->entry_count > 1) {
+		qsort(listing->entry, listing->entry_count, sizeof *listing->entry, DgStorageEntryCompare);
+	}
+	
+	return DG_ERROR_SUCCESSFUL;
 }
 
-DgError DgStreamClose(DgStream *context) {
+DgError DgStorageListingAppend(DgStorageListing *listing, const char *name, size_t length, const DgStorageInfo *info) {
 	/**
-	 * Close the file stream
+	 * Add an entry to a listing. This is meant for pools implementing the
+	 * list function.
 	 * 
-	 * @param context Stream object
+	 * @param listing Listing to add to
+	 * @param name Name of the entry (does not need to end in a NUL)
+	 * @param length Length of the name
+	 * @param info Metadata for the entry
 	 * @return Error code
 	 */
 	
-	DgStorage *this = context->storage;
-	DgStoragePool *pool = context->pool;
+	if (listing->entry_count >= listing->entry_alloc) {
+		size_t alloc = listing->entry_alloc ? listing->entry_alloc * 2 : 16;
+		DgStorageEntry *entry = DgMemoryReallocate(listing->entry, sizeof *entry * alloc);
+		
+		if (!entry) {
+			return DG_ERROR_ALLOCATION_FAILED;
+		}
+		
+		listing->entry = entry;
+		listing->entry_alloc = alloc;
+	}
+	
+	if (listing->names_length + length + 1 > listing->names_alloc) {
+		size_t alloc = listing->names_alloc ? listing->names_alloc : 256;
+		
+		while (listing->names_length + length + 1 > alloc) {
+			alloc *= 2;
+		}
+		
+		char *names = DgMemoryReallocate(listing->names, alloc);
+		
+		if (!names) {
+			return DG_ERROR_ALLOCATION_FAILED;
+		}
+		
+		listing->names = names;
+		listing->names_alloc = alloc;
+	}
+	
+	DgStorageEntry *entry = &listing->entry[listing->entry_count++];
+	
+	entry->name = (const char *) (uintptr_t) listing->names_length;
+	entry->info = info[0];
+	
+	memcpy(listing->names + listing->names_length, name, length);
+	listing->names[listing->names_length + length] = '\0';
+	listing->names_length += length + 1;
 	
-	return pool->functions->close(this, pool, context);
+	return DG_ERROR_SUCCESSFUL;
 }
 
-DgError DgStreamRead(DgStream *context, size_t size, void *buffer) {
+void DgStorageListingFree(DgStorageListing *listing) {
 	/**
-	 * Read a buffer from the file stream
+	 * Release the memory used by a listing
 	 * 
-	 * @param context Stream object
-	 * @param size Size of the buffer
-	 * @param buffer Pointer to where to store the data
-	 * @return Error code
+	 * @param listing Listing to free
 	 */
 	
-	DgStorage *this = context->storage;
-	DgStoragePool *pool = context->pool;
+	DgMemoryFree(listing->entry);
+	DgMemoryFree(listing->names);
 	
-	return pool->functions->read(this, pool, context, size, buffer);
+	memset(listing, 0, sizeof *listing);
 }
 
-DgError DgStreamWrite(DgStream *context, size_t size, void *buffer) {
+DgError DgStoragePoolFree(DgStoragePool *pool) {
 	/**
-	 * Write a buffer to the file stream
+	 * Release memory assocaited with a storage pool.
+	 * 
+	 * @param pool The pool to free
+	 * @return Errors encountered freeing pool
+	 */
+	
+	if (pool->protocol) {
+		DgFree((void *) pool->protocol);
+	}
+	
+	if (pool == NULL) {
+		return DG_ERROR_NOT_SAFE;
+	}
+	
+	if (!pool->functions->free_specific_config) {
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	return pool->functions->free_specific_config(pool);
+}
+
+/* Stream functions and similar */
+
+DgError DgStreamOpen(DgStorage *this, DgStream *context, DgStoragePath path, DgStorageFlags flags) {
+	/**
+	 * Open a stream
+	 * 
+	 * @param this Storage object to use
+	 * @param stream Where to store the resulting stream object
+	 * @param path Path to the stream source to open
+	 * @param flags Properties of the stream
+	 * @return Error code
+	 */
+	
+	DG_STORAGE_RESOLVE();
+	
+	// Find the pool
+	DgStoragePool *pool;
+	
+	DgError status = DgStorageGetPoolFromPath(this, path, &pool);
+	
+	if (status) {
+		return status;
+	}
+	
+	// Pre-set the stream storage and pool
+	context->storage = this;
+	context->pool = pool;
+	
+	// Streams start unbuffered
+	context->buffer = NULL;
+	context->buffer_size = 0;
+	context->buffer_head = 0;
+	context->buffer_length = 0;
+	context->buffer_position = 0;
+	context->buffer_file_length = SIZE_MAX;
+	context->buffer_mode = DG_STREAM_BUFFER_NONE;
+	
+	// Call its function
+	uint64_t start = DgStorageMetricsBegin();
+	
+	status = pool->functions->open(this, pool, context, path, flags);
+	
+	DgStorageMetricsEnd(pool, DG_STORAGE_OP_OPEN, start, 0, status);
+	
+	if (status) {
+		return status;
+	}
+	
+	if (flags & DG_STREAM_BUFFERED) {
+		status = DgStreamSetBuffer(context, DG_STREAM_DEFAULT_BUFFER_SIZE);
+		
+		if (status) {
+			pool->functions->close(this, pool, context);
+			return status;
+		}
+	}
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+/**
+ * Stream buffering
+ * 
+ * When a stream has a buffer, small reads and writes are served from it and
+ * the pool is only called to refill or flush it. While the buffer is in use,
+ * the logical position of the stream is `buffer_position + buffer_head`, and
+ * the pool's own position is `buffer_position + buffer_length` when reading or
+ * `buffer_position` when writing.
+ */
+
+static DgError DgStreamPoolLength(DgStream *context, size_t *length) {
+	/**
+	 * Find the length of the stream using only pool functions, restoring the
+	 * pool's position afterwards.
+	 * 
+	 * @param context Stream object
+	 * @param length Where to store the length
+	 * @return Error code
+	 */
+	
+	DgStorage *this = context->storage;
+	DgStoragePool *pool = context->pool;
+	size_t old_pos;
+	DgError status;
+	
+	// We store the old position so we can later restore it
+	status = pool->functions->get_position(this, pool, context, &old_pos);
+	
+	if (status) {
+		return status;
+	}
+	
+	status = pool->functions->seek(this, pool, context, DG_STORAGE_SEEK_END, 0);
+	
+	if (status) {
+		return status;
+	}
+	
+	status = pool->functions->get_position(this, pool, context, length);
+	
+	if (status) {
+		return status;
+	}
+	
+	return pool->functions->set_position(this, pool, context, old_pos);
+}
+
+static DgError DgStreamBufferFlushWrite(DgStream *context) {
+	/**
+	 * Write out anything in the write buffer. The stream stays in write mode.
+	 * 
+	 * @param context Stream object
+	 * @return Error code
+	 */
+	
+	if (context->buffer_mode != DG_STREAM_BUFFER_WRITE || !context->buffer_head) {
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	uint64_t start = DgStorageMetricsBegin();
+	
+	DgError status = context->pool->functions->write(context->storage, context->pool, context, context->buffer_head, context->buffer);
+	
+	DgStorageMetricsEnd(context->pool, DG_STORAGE_OP_WRITE, start, context->buffer_head, status);
+	
+	if (status) {
+		context->buffer_mode = DG_STREAM_BUFFER_NONE;
+		return status;
+	}
+	
+	context->buffer_position += context->buffer_head;
+	context->buffer_head = 0;
+	context->buffer_file_length = SIZE_MAX;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgStreamBufferDrop(DgStream *context) {
+	/**
+	 * Empty the buffer so that the pool's position is the stream's logical
+	 * position again.
+	 * 
+	 * @param context Stream object
+	 * @return Error code
+	 */
+	
+	DgError status = DG_ERROR_SUCCESSFUL;
+	
+	if (context->buffer_mode == DG_STREAM_BUFFER_WRITE) {
+		status = DgStreamBufferFlushWrite(context);
+	}
+	else if (context->buffer_mode == DG_STREAM_BUFFER_READ && context->buffer_head != context->buffer_length) {
+		// The pool has read ahead of us
+		status = context->pool->functions->set_position(context->storage, context->pool, context, context->buffer_position + context->buffer_head);
+	}
+	
+	context->buffer_mode = DG_STREAM_BUFFER_NONE;
+	context->buffer_head = 0;
+	context->buffer_length = 0;
+	
+	return status;
+}
+
+static DgError DgStreamBufferedRead(DgStream *context, size_t size, uint8_t *buffer) {
+	/**
+	 * Read through the stream's buffer
 	 * 
 	 * @param context Stream object
 	 * @param size Size of the buffer
@@ -581,8 +1130,402 @@ DgError DgStreamWrite(DgStream *context, size_t size, void *buffer) {
 	
 	DgStorage *this = context->storage;
 	DgStoragePool *pool = context->pool;
+	DgError status;
+	
+	// Switch to reading
+	if (context->buffer_mode == DG_STREAM_BUFFER_WRITE) {
+		status = DgStreamBufferFlushWrite(context);
+		
+		if (status) {
+			return status;
+		}
+	}
+	else if (context->buffer_mode == DG_STREAM_BUFFER_NONE) {
+		status = pool->functions->get_position(this, pool, context, &context->buffer_position);
+		
+		if (status) {
+			return status;
+		}
+		
+		context->buffer_head = 0;
+	}
+	
+	if (context->buffer_mode != DG_STREAM_BUFFER_READ) {
+		context->buffer_mode = DG_STREAM_BUFFER_READ;
+		context->buffer_length = 0;
+	}
+	
+	// Serve as much as we can from the buffer
+	size_t available = context->buffer_length - context->buffer_head;
+	
+	if (available >= size) {
+		memcpy(buffer, &context->buffer[context->buffer_head], size);
+		context->buffer_head += size;
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	memcpy(buffer, &context->buffer[context->buffer_head], available);
+	buffer += available;
+	size -= available;
 	
-	return pool->functions->write(this, pool, context, size, buffer);
+	context->buffer_position += context->buffer_length;
+	context->buffer_head = 0;
+	context->buffer_length = 0;
+	
+	// Large reads go straight to the pool
+	if (size >= context->buffer_size) {
+		uint64_t start = DgStorageMetricsBegin();
+		
+		status = pool->functions->read(this, pool, context, size, buffer);
+		
+		DgStorageMetricsEnd(pool, DG_STORAGE_OP_READ, start, size, status);
+		
+		if (status) {
+			context->buffer_mode = DG_STREAM_BUFFER_NONE;
+			return status;
+		}
+		
+		context->buffer_position += size;
+		
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	// Refill, but not past the end of the stream since the pool would treat
+	// that as a failed read
+	size_t fill = 0;
+	
+	for (size_t attempt = 0; attempt < 2; attempt++) {
+		if (context->buffer_file_length == SIZE_MAX || attempt) {
+			status = DgStreamPoolLength(context, &context->buffer_file_length);
+			
+			if (status) {
+				context->buffer_mode = DG_STREAM_BUFFER_NONE;
+				return status;
+			}
+		}
+		
+		fill = (context->buffer_file_length > context->buffer_position) ? context->buffer_file_length - context->buffer_position : 0;
+		
+		if (fill > context->buffer_size) {
+			fill = context->buffer_size;
+		}
+		
+		if (fill >= size) {
+			break;
+		}
+	}
+	
+	if (fill < size) {
+		return DG_ERROR_FAILED;
+	}
+	
+	uint64_t start = DgStorageMetricsBegin();
+	
+	status = pool->functions->read(this, pool, context, fill, context->buffer);
+	
+	DgStorageMetricsEnd(pool, DG_STORAGE_OP_READ, start, fill, status);
+	
+	if (status) {
+		context->buffer_mode = DG_STREAM_BUFFER_NONE;
+		return status;
+	}
+	
+	context->buffer_length = fill;
+	
+	memcpy(buffer, context->buffer, size);
+	context->buffer_head = size;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgStreamBufferedWrite(DgStream *context, size_t size, const uint8_t *buffer) {
+	/**
+	 * Write through the stream's buffer
+	 * 
+	 * @param context Stream object
+	 * @param size Size of the buffer
+	 * @param buffer Pointer to the data to write
+	 * @return Error code
+	 */
+	
+	DgStorage *this = context->storage;
+	DgStoragePool *pool = context->pool;
+	DgError status;
+	
+	// Switch to writing
+	if (context->buffer_mode == DG_STREAM_BUFFER_READ) {
+		if (context->buffer_head != context->buffer_length) {
+			status = pool->functions->set_position(this, pool, context, context->buffer_position + context->buffer_head);
+			
+			if (status) {
+				context->buffer_mode = DG_STREAM_BUFFER_NONE;
+				return status;
+			}
+		}
+		
+		context->buffer_position += context->buffer_head;
+	}
+	else if (context->buffer_mode == DG_STREAM_BUFFER_NONE) {
+		status = pool->functions->get_position(this, pool, context, &context->buffer_position);
+		
+		if (status) {
+			return status;
+		}
+	}
+	
+	if (context->buffer_mode != DG_STREAM_BUFFER_WRITE) {
+		context->buffer_mode = DG_STREAM_BUFFER_WRITE;
+		context->buffer_head = 0;
+		context->buffer_length = 0;
+	}
+	
+	// Make space
+	if (context->buffer_head + size > context->buffer_size) {
+		status = DgStreamBufferFlushWrite(context);
+		
+		if (status) {
+			return status;
+		}
+	}
+	
+	// Large writes go straight to the pool
+	if (size >= context->buffer_size) {
+		uint64_t start = DgStorageMetricsBegin();
+		
+		status = pool->functions->write(this, pool, context, size, (void *) buffer);
+		
+		DgStorageMetricsEnd(pool, DG_STORAGE_OP_WRITE, start, size, status);
+		
+		if (status) {
+			context->buffer_mode = DG_STREAM_BUFFER_NONE;
+			return status;
+		}
+		
+		context->buffer_position += size;
+		context->buffer_file_length = SIZE_MAX;
+		
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	memcpy(&context->buffer[context->buffer_head], buffer, size);
+	context->buffer_head += size;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+DgError DgStreamSetBuffer(DgStream *context, size_t size) {
+	/**
+	 * Give the stream a library-owned buffer of `size` bytes, or remove the
+	 * buffer if `size` is zero. Anything already buffered is flushed first.
+	 * 
+	 * @note Buffering works with every pool. It is worth it when there are
+	 * many small reads or writes, like with DgStreamWriteUInt16 and friends.
+	 * 
+	 * @note Pending writes are only guaranteed to reach the pool after
+	 * DgStreamFlush, DgStreamClose or a seek.
+	 * 
+	 * @param context Stream object
+	 * @param size Size of the buffer in bytes
+	 * @return Error code
+	 */
+	
+	DgError status = DgStreamBufferDrop(context);
+	
+	if (status) {
+		return status;
+	}
+	
+	uint8_t *buffer = NULL;
+	
+	if (size) {
+		buffer = DgAlloc(size);
+		
+		if (!buffer) {
+			return DG_ERROR_ALLOCATION_FAILED;
+		}
+	}
+	
+	DgMemoryFree(context->buffer);
+	
+	context->buffer = buffer;
+	context->buffer_size = size;
+	context->buffer_file_length = SIZE_MAX;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+DgError DgStreamFlush(DgStream *context) {
+	/**
+	 * Write out any data in the stream's buffer to the pool.
+	 * 
+	 * @param context Stream object
+	 * @return Error code
+	 */
+	
+	return DgStreamBufferFlushWrite(context);
+}
+
+DgError DgStreamClose(DgStream *context) {
+	/**
+	 * Close the file stream
+	 * 
+	 * @param context Stream object
+	 * @return Error code
+	 */
+	
+	DgStorage *this = context->storage;
+	DgStoragePool *pool = context->pool;
+	
+	DgError flush_status = DgStreamBufferFlushWrite(context);
+	
+	if (context->buffer) {
+		DgFree(context->buffer);
+		context->buffer = NULL;
+		context->buffer_size = 0;
+		context->buffer_mode = DG_STREAM_BUFFER_NONE;
+	}
+	
+	uint64_t start = DgStorageMetricsBegin();
+	
+	DgError status = pool->functions->close(this, pool, context);
+	
+	DgStorageMetricsEnd(pool, DG_STORAGE_OP_CLOSE, start, 0, status);
+	
+	return flush_status ? flush_status : status;
+}
+
+DgError DgStreamRead(DgStream *context, size_t size, void *buffer) {
+	/**
+	 * Read a buffer from the file stream
+	 * 
+	 * @param context Stream object
+	 * @param size Size of the buffer
+	 * @param buffer Pointer to where to store the data
+	 * @return Error code
+	 */
+	
+	if (context->buffer_size) {
+		return DgStreamBufferedRead(context, size, buffer);
+	}
+	
+	DgStorage *this = context->storage;
+	DgStoragePool *pool = context->pool;
+	uint64_t start = DgStorageMetricsBegin();
+	
+	DgError status = pool->functions->read(this, pool, context, size, buffer);
+	
+	DgStorageMetricsEnd(pool, DG_STORAGE_OP_READ, start, size, status);
+	
+	return status;
+}
+
+DgError DgStreamWrite(DgStream *context, size_t size, void *buffer) {
+	/**
+	 * Write a buffer to the file stream
+	 * 
+	 * @param context Stream object
+	 * @param size Size of the buffer
+	 * @param buffer Pointer to where to store the data
+	 * @return Error code
+	 */
+	
+	if (context->buffer_size) {
+		return DgStreamBufferedWrite(context, size, buffer);
+	}
+	
+	DgStorage *this = context->storage;
+	DgStoragePool *pool = context->pool;
+	uint64_t start = DgStorageMetricsBegin();
+	
+	DgError status = pool->functions->write(this, pool, context, size, buffer);
+	
+	DgStorageMetricsEnd(pool, DG_STORAGE_OP_WRITE, start, size, status);
+	
+	return status;
+}
+
+DgError DgStreamReadv(DgStream *context, const DgStorageBuffer *buffers, size_t count) {
+	/**
+	 * Read into several buffers one after another with as few pool calls as
+	 * possible.
+	 * 
+	 * @param context Stream object
+	 * @param buffers Array of buffers to fill in order
+	 * @param count Number of buffers
+	 * @return Error code
+	 */
+	
+	DgStorage *this = context->storage;
+	DgStoragePool *pool = context->pool;
+	
+	// Buffered streams already batch small reads, and the pool's position
+	// might not be the stream's position
+	if (!context->buffer_size && pool->functions->readv) {
+		size_t size = 0;
+		
+		for (size_t i = 0; i < count; i++) {
+			size += buffers[i].size;
+		}
+		
+		uint64_t start = DgStorageMetricsBegin();
+		
+		DgError status = pool->functions->readv(this, pool, context, buffers, count);
+		
+		DgStorageMetricsEnd(pool, DG_STORAGE_OP_READ, start, size, status);
+		
+		return status;
+	}
+	
+	for (size_t i = 0; i < count; i++) {
+		DgError status = DgStreamRead(context, buffers[i].size, buffers[i].data);
+		
+		if (status) {
+			return status;
+		}
+	}
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+DgError DgStreamWritev(DgStream *context, const DgStorageBuffer *buffers, size_t count) {
+	/**
+	 * Write several buffers one after another with as few pool calls as
+	 * possible, for example a header, payload and trailer.
+	 * 
+	 * @param context Stream object
+	 * @param buffers Array of buffers to write in order
+	 * @param count Number of buffers
+	 * @return Error code
+	 */
+	
+	DgStorage *this = context->storage;
+	DgStoragePool *pool = context->pool;
+	
+	if (!context->buffer_size && pool->functions->writev) {
+		size_t size = 0;
+		
+		for (size_t i = 0; i < count; i++) {
+			size += buffers[i].size;
+		}
+		
+		uint64_t start = DgStorageMetricsBegin();
+		
+		DgError status = pool->functions->writev(this, pool, context, buffers, count);
+		
+		DgStorageMetricsEnd(pool, DG_STORAGE_OP_WRITE, start, size, status);
+		
+		return status;
+	}
+	
+	for (size_t i = 0; i < count; i++) {
+		DgError status = DgStreamWrite(context, buffers[i].size, buffers[i].data);
+		
+		if (status) {
+			return status;
+		}
+	}
+	
+	return DG_ERROR_SUCCESSFUL;
 }
 
 DgError DgStreamGetPosition(DgStream *context, size_t *position) {
@@ -594,6 +1537,11 @@ DgError DgStreamGetPosition(DgStream *context, size_t *position) {
 	 * @return Error code
 	 */
 	
+	if (context->buffer_mode != DG_STREAM_BUFFER_NONE) {
+		position[0] = context->buffer_position + context->buffer_head;
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
 	DgStorage *this = context->storage;
 	DgStoragePool *pool = context->pool;
 	
@@ -609,10 +1557,29 @@ DgError DgStreamSetPosition(DgStream *context, size_t position) {
 	 * @return Error code
 	 */
 	
+	// Moving around inside of the read buffer doesn't need the pool
+	if (context->buffer_mode == DG_STREAM_BUFFER_READ
+		&& position >= context->buffer_position
+		&& position <= context->buffer_position + context->buffer_length) {
+		context->buffer_head = position - context->buffer_position;
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	DgError status = DgStreamBufferDrop(context);
+	
+	if (status) {
+		return status;
+	}
+	
 	DgStorage *this = context->storage;
 	DgStoragePool *pool = context->pool;
+	uint64_t start = DgStorageMetricsBegin();
 	
-	return pool->functions->set_position(this, pool, context, position);
+	status = pool->functions->set_position(this, pool, context, position);
+	
+	DgStorageMetricsEnd(pool, DG_STORAGE_OP_SEEK, start, 0, status);
+	
+	return status;
 }
 
 DgError DgStreamSeek(DgStream *context, DgStorageSeekBase base, int64_t offset) {
@@ -625,10 +1592,136 @@ DgError DgStreamSeek(DgStream *context, DgStorageSeekBase base, int64_t offset)
 	 * @return Error code
 	 */
 	
+	if (context->buffer_mode != DG_STREAM_BUFFER_NONE) {
+		if (base == DG_STORAGE_SEEK_RELATIVE) {
+			int64_t position = (int64_t) (context->buffer_position + context->buffer_head) + offset;
+			
+			if (position < 0) {
+				return DG_ERROR_OUT_OF_RANGE;
+			}
+			
+			return DgStreamSetPosition(context, position);
+		}
+		
+		DgError status = DgStreamBufferDrop(context);
+		
+		if (status) {
+			return status;
+		}
+	}
+	
 	DgStorage *this = context->storage;
 	DgStoragePool *pool = context->pool;
+	uint64_t start = DgStorageMetricsBegin();
 	
-	return pool->functions->seek(this, pool, context, base, offset);
+	DgError status = pool->functions->seek(this, pool, context, base, offset);
+	
+	DgStorageMetricsEnd(pool, DG_STORAGE_OP_SEEK, start, 0, status);
+	
+	return status;
+}
+
+DgError DgStreamMap(DgStream *context, size_t offset, size_t length, DgStorageMapFlags flags, DgStorageMapping *mapping) {
+	/**
+	 * Get a read-only view of `length` bytes of the stream starting at `offset`
+	 * without reading them into a buffer first. If the pool cannot map files,
+	 * the range is read into a new buffer instead.
+	 * 
+	 * @note The mapping stays valid after the stream is closed, until it is
+	 * released with DgStreamUnmap.
+	 * 
+	 * @note This does not change the position of the stream if the pool
+	 * supports mapping.
+	 * 
+	 * @param context Stream object
+	 * @param offset Offset of the first byte to map
+	 * @param length Number of bytes to map, or zero to map until the end
+	 * @param flags Access pattern hints
+	 * @param mapping Where to store the mapping
+	 * @return Error code
+	 */
+	
+	DgStorage *this = context->storage;
+	DgStoragePool *pool = context->pool;
+	
+	memset(mapping, 0, sizeof *mapping);
+	
+	if (pool->functions->map) {
+		DgError status = DgStreamFlush(context);
+		
+		if (status) {
+			return status;
+		}
+		
+		uint64_t start = DgStorageMetricsBegin();
+		
+		status = pool->functions->map(this, pool, context, offset, length, flags, mapping);
+		
+		DgStorageMetricsEnd(pool, DG_STORAGE_OP_MAP, start, mapping->length, status);
+		
+		return status;
+	}
+	
+	// Fallback: copy the range into memory
+	if (!length) {
+		size_t total = DgStreamLength(context);
+		
+		if (offset > total) {
+			return DG_ERROR_OUT_OF_RANGE;
+		}
+		
+		length = total - offset;
+	}
+	
+	DgError status = DgStreamSetPosition(context, offset);
+	
+	if (status) {
+		return status;
+	}
+	
+	void *buffer = DgAlloc(length ? length : 1);
+	
+	if (!buffer) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	status = DgStreamRead(context, length, buffer);
+	
+	if (status) {
+		DgFree(buffer);
+		return status;
+	}
+	
+	mapping->data = buffer;
+	mapping->length = length;
+	mapping->base = buffer;
+	mapping->base_length = length;
+	mapping->storage = this;
+	mapping->functions = NULL;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+DgError DgStreamUnmap(DgStorageMapping *mapping) {
+	/**
+	 * Release a mapping made by DgStreamMap.
+	 * 
+	 * @param mapping Mapping to release
+	 * @return Error code
+	 */
+	
+	DgError status = DG_ERROR_SUCCESSFUL;
+	
+	if (mapping->functions) {
+		status = mapping->functions->unmap(mapping->storage, mapping);
+	}
+	else {
+		DgMemoryFree(mapping->base);
+	}
+	
+	memset(mapping, 0, sizeof *mapping);
+	
+	return status;
 }
 
 // Undefine resolve macro just to be clean
@@ -636,39 +1729,44 @@ DgError DgStreamSeek(DgStream *context, DgStorageSeekBase base, int64_t offset)
 
 /* Extra and conviecne functions */
 
-size_t DgStreamLength(DgStream *context) {
+DgError DgStreamGetLength(DgStream *context, size_t *length) {
 	/**
-	 * Get the length of a file.
+	 * Get the length of a file, failing if it can't be found.
 	 * 
 	 * @param context Stream object
-	 * @return Size of the file
+	 * @param length Where to put the length
+	 * @return Error code
 	 */
 	
-	size_t old_pos, length;
-	DgError status;
-	
-	// We store the old position so we can later restore it
-	status = DgStreamGetPosition(context, &old_pos);
+	// Anything still in the buffer is part of the file
+	DgError status = DgStreamBufferFlushWrite(context);
 	
 	if (status) {
-		return 0;
+		return status;
 	}
 	
-	status = DgStreamSeek(context, DG_STORAGE_SEEK_END, 0);
+	status = DgStreamPoolLength(context, length);
 	
 	if (status) {
-		return 0;
+		return status;
 	}
 	
-	status = DgStreamGetPosition(context, &length);
+	context->buffer_file_length = length[0];
 	
-	if (status) {
-		return 0;
-	}
+	return DG_ERROR_SUCCESSFUL;
+}
+
+size_t DgStreamLength(DgStream *context) {
+	/**
+	 * Get the length of a file.
+	 * 
+	 * @param context Stream object
+	 * @return Size of the file, or zero if it can't be found
+	 */
 	
-	status = DgStreamSetPosition(context, old_pos);
+	size_t length;
 	
-	if (status) {
+	if (DgStreamGetLength(context, &length)) {
 		return 0;
 	}
 	
@@ -18,6 +18,7 @@
 #include <stdlib.h>
 
 #include "error.h"
+#include "byteorder.h"
 
 // String type for the path
 typedef const char *DgStoragePath;
@@ -48,8 +49,89 @@ typedef enum DgStorageFlags {
 	DG_STREAM_WRITE = (1 << 1),
 	DG_STREAM_START_AT_END = (1 << 2),
 	DG_STREAM_DONT_OVERWRITE = (1 << 3),
+	DG_STREAM_BUFFERED = (1 << 4), // Use a library-owned buffer of DG_STREAM_DEFAULT_BUFFER_SIZE bytes
 } DgStorageFlags;
 
+// Buffer size used for DG_STREAM_BUFFERED
+#define DG_STREAM_DEFAULT_BUFFER_SIZE 65536
+
+// Buffer size used by DgStorageCopy when the data has to be streamed
+#define DG_STORAGE_COPY_BUFFER_SIZE 262144
+
+// What the data in a stream's buffer is
+typedef enum DgStreamBufferMode {
+	DG_STREAM_BUFFER_NONE = 0,   // Buffer is empty
+	DG_STREAM_BUFFER_READ = 1,   // Buffer holds data read ahead from the pool
+	DG_STREAM_BUFFER_WRITE = 2,  // Buffer holds data not yet written to the pool
+} DgStreamBufferMode;
+
+// Access pattern hints for mapped streams
+typedef enum DgStorageMapFlags {
+	DG_STORAGE_MAP_NORMAL = 0,
+	DG_STORAGE_MAP_SEQUENTIAL = (1 << 0), // Will be read mostly in order
+	DG_STORAGE_MAP_RANDOM = (1 << 1),     // Will be read in no particular order
+	DG_STORAGE_MAP_WILL_NEED = (1 << 2),  // Start reading in the pages now
+} DgStorageMapFlags;
+
+/**
+ * A read-only view of part of a stream. `data` and `length` are the requested
+ * range; the rest is private to the pool that created it.
+ */
+typedef struct DgStorageMapping {
+	const void *data;
+	size_t length;
+	
+	void *base;                  // Start of the real mapping
+	size_t base_length;          // Length of the real mapping
+	struct DgStorage *storage;   // Storage the mapping came from
+	struct DgStorageFunctions *functions; // Functions of the pool that made the mapping (or NULL if it is a copy)
+} DgStorageMapping;
+
+/**
+ * One buffer in a vectored read or write
+ */
+typedef struct DgStorageBuffer {
+	void *data;
+	size_t size;
+} DgStorageBuffer;
+
+/**
+ * Metadata for a file or folder
+ */
+typedef struct DgStorageInfo {
+	DgStorageObjectType type;
+	uint64_t size;               // Size in bytes (zero for folders)
+	int64_t modified;            // Last change in seconds since the Unix epoch, or zero if unknown
+} DgStorageInfo;
+
+// What to find out while listing a folder
+typedef enum DgStorageListFlags {
+	DG_STORAGE_LIST_NORMAL = 0,           // Names and types only, if the pool can do it cheaply
+	DG_STORAGE_LIST_INFO = (1 << 0),      // Also fill in the size and modification time
+} DgStorageListFlags;
+
+/**
+ * One file or folder in a listing
+ */
+typedef struct DgStorageEntry {
+	const char *name;            // Name without the folder, points into the listing
+	DgStorageInfo info;
+} DgStorageEntry;
+
+/**
+ * The contents of a folder, sorted by name. All of the names are kept in one
+ * buffer so a listing is only two allocations however big it is.
+ */
+typedef struct DgStorageListing {
+	DgStorageEntry *entry;
+	size_t entry_count;
+	size_t entry_alloc;
+	
+	char *names;
+	size_t names_length;
+	size_t names_alloc;
+} DgStorageListing;
+
 /** Function pointers for various storage and stream operations */
 /** @note Please update the wiki if any of these things change! */
 typedef struct DgStorage DgStorage;
@@ -66,6 +148,15 @@ typedef DgError (*DgStorageGetPositionFunction)(DgStorage *storage, DgStoragePoo
 typedef DgError (*DgStorageSetPositionFunction)(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t position);
 typedef DgError (*DgStorageSeekFunction)(DgStorage *storage, DgStoragePool *pool, DgStream *context, DgStorageSeekBase base, int64_t offset);
 
+// Vectored I/O (optional)
+typedef DgError (*DgStorageReadvFunction)(DgStorage *storage, DgStoragePool *pool, DgStream *context, const DgStorageBuffer *buffers, size_t count);
+typedef DgError (*DgStorageWritevFunction)(DgStorage *storage, DgStoragePool *pool, DgStream *context, const DgStorageBuffer *buffers, size_t count);
+
+// Mapping (optional)
+typedef DgError (*DgStorageMapFunction)(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t offset, size_t length, DgStorageMapFlags flags, DgStorageMapping *mapping);
+// The pool isn't given to unmap, since it can be freed before its mappings are
+typedef DgError (*DgStorageUnmapFunction)(DgStorage *storage, DgStorageMapping *mapping);
+
 // Filesystems
 typedef DgError (*DgStorageDeleteFunction)(DgStorage *storage, DgStoragePool *pool, DgStoragePath path);
 typedef DgError (*DgStorageRenameFunction)(DgStorage *storage, DgStoragePool *pool, DgStoragePath old_path, DgStoragePath new_path);
@@ -73,6 +164,13 @@ typedef DgError (*DgStorageCreateFileFunction)(DgStorage *storage, DgStoragePool
 typedef DgError (*DgStorageCreateFolderFunction)(DgStorage *storage, DgStoragePool *pool, DgStoragePath path);
 typedef DgError (*DgStorageTypeFunction)(DgStorage *storage, DgStoragePool *pool, DgStoragePath path, DgStorageObjectType *type);
 
+// Copying within a pool (optional)
+typedef DgError (*DgStorageCopyFunction)(DgStorage *storage, DgStoragePool *pool, DgStoragePath source, DgStoragePath destination);
+
+// Listing and metadata (optional)
+typedef DgError (*DgStorageListFunction)(DgStorage *storage, DgStoragePool *pool, DgStoragePath path, DgStorageListFlags flags, DgStorageListing *listing);
+typedef DgError (*DgStorageStatFunction)(DgStorage *storage, DgStoragePool *pool, DgStoragePath path, DgStorageInfo *info);
+
 // Specific config destruction
 typedef DgError (*DgStorageFreeSpecificConfigFunction)(DgStoragePool *pool);
 
@@ -87,6 +185,15 @@ typedef struct DgStorageFunctions {
 	DgStorageRenameFunction rename;
 	DgStorageDeleteFunction delete;
 	
+	// Listing and metadata functions (optional, listing isn't supported and
+	// stat opens the file to find its length if these are NULL)
+	DgStorageListFunction list;
+	DgStorageStatFunction stat;
+	
+	// Copy function (optional, the data is streamed through a buffer if this
+	// is NULL or returns DG_ERROR_NOT_SUPPORTED)
+	DgStorageCopyFunction copy;
+	
 	/// Stream functions (@todo rename to DgStream)
 	DgStorageOpenFunction open;
 	DgStorageCloseFunction close;
@@ -96,6 +203,15 @@ typedef struct DgStorageFunctions {
 	DgStorageSetPositionFunction set_position;
 	DgStorageSeekFunction seek;
 	
+	// Vectored stream functions (optional, read/write are called for each
+	// buffer if these are NULL)
+	DgStorageReadvFunction readv;
+	DgStorageWritevFunction writev;
+	
+	// Mapping functions (optional, a copy is made if these are NULL)
+	DgStorageMapFunction map;
+	DgStorageUnmapFunction unmap;
+	
 	// Specific config destruction
 	DgStorageFreeSpecificConfigFunction free_specific_config;
 } DgStorageFunctions;
@@ -117,12 +233,25 @@ typedef struct DgStoragePool {
 	void *specific_config;
 } DgStoragePool;
 
+/**
+ * Slot in the protocol hash table of a storage object
+ */
+typedef struct DgStoragePoolSlot {
+	uint32_t hash;   // Hash of the protocol
+	uint32_t index;  // Index of the pool plus one, or zero if empty
+} DgStoragePoolSlot;
+
 /**
  * Configuration for storage, which can contain many pools (protocols)
  */
 typedef struct DgStorage {
 	DgStoragePool *pool;
 	size_t         pool_count;
+	
+	// Open-addressed hash table from protocol to pool, so finding the pool for
+	// a path doesn't need to allocate or compare against every pool
+	DgStoragePoolSlot *pool_index;
+	size_t             pool_index_size;  // Always zero or a power of two
 } DgStorage;
 
 DgError DgStorageInit(DgStorage *this);
@@ -137,13 +266,23 @@ DgError DgStorageRenamePool(DgStorage *this, DgStoragePath old_protocol, DgStora
 
 // Utility functions
 DgError DgStorageSplitPathIntoParts(DgStoragePath path, char **protocol, char **filename);
+DgStoragePath DgStoragePathFilename(DgStoragePath path);
+void DgStoragePathLocal(DgStoragePath path, const char **key, size_t *length);
+DgError DgStorageGetPoolFromPath(DgStorage *this, DgStoragePath path, DgStoragePool **pool);
 
 // Standard filesystem functions
 DgError DgStorageDelete(DgStorage *this, DgStoragePath path);
 DgError DgStorageRename(DgStorage *this, DgStoragePath old_path, DgStoragePath new_path);
+DgError DgStorageCopy(DgStorage *this, DgStoragePath source, DgStoragePath destination);
 DgError DgStorageCreateFile(DgStorage *this, DgStoragePath path);
 DgError DgStorageCreateFolder(DgStorage *this, DgStoragePath path);
 DgStorageObjectType DgStorageType(DgStorage *this, DgStoragePath path, DgStorageObjectType *type);
+DgError DgStorageStat(DgStorage *this, DgStoragePath path, DgStorageInfo *info);
+
+// Folder listing
+DgError DgStorageList(DgStorage *this, DgStoragePath path, DgStorageListFlags flags, DgStorageListing *listing);
+DgError DgStorageListingAppend(DgStorageListing *listing, const char *name, size_t length, const DgStorageInfo *info);
+void DgStorageListingFree(DgStorageListing *listing);
 
 // Generic pool free function
 DgError DgStoragePoolFree(DgStoragePool *pool);
@@ -153,6 +292,15 @@ typedef struct DgStream {
 	DgStorage *storage;
 	DgStoragePool *pool;
 	void *context;
+	
+	// Buffering (see DgStreamSetBuffer)
+	uint8_t *buffer;
+	size_t buffer_size;                // Allocated size of the buffer (zero if unbuffered)
+	size_t buffer_head;                // Offset of the next byte to read or write in the buffer
+	size_t buffer_length;              // Number of valid bytes in the buffer when reading
+	size_t buffer_position;            // Position in the pool's stream of the first byte in the buffer
+	size_t buffer_file_length;         // Cached stream length for refills, or SIZE_MAX if unknown
+	DgStreamBufferMode buffer_mode;
 } DgStream;
 
 DgError DgStreamOpen(DgStorage *this, DgStream *context, DgStoragePath path, DgStorageFlags flags);
@@ -160,12 +308,23 @@ DgError DgStreamClose(DgStream *context);
 
 DgError DgStreamRead(DgStream *context, size_t size, void *buffer);
 DgError DgStreamWrite(DgStream *context, size_t size, void *buffer);
+DgError DgStreamReadv(DgStream *context, const DgStorageBuffer *buffers, size_t count);
+DgError DgStreamWritev(DgStream *context, const DgStorageBuffer *buffers, size_t count);
 
 DgError DgStreamGetPosition(DgStream *context, size_t *position);
 DgError DgStreamSetPosition(DgStream *context, size_t position);
 DgError DgStreamSeek(DgStream *context, DgStorageSeekBase base, int64_t offset);
 
+// Buffering
+DgError DgStreamSetBuffer(DgStream *context, size_t size);
+DgError DgStreamFlush(DgStream *context);
+
+// Mapping
+DgError DgStreamMap(DgStream *context, size_t offset, size_t length, DgStorageMapFlags flags, DgStorageMapping *mapping);
+DgError DgStreamUnmap(DgStorageMapping *mapping);
+
 // Extra functions
+DgError DgStreamGetLength(DgStream *context, size_t *length);
 size_t DgStreamLength(DgStream *context);
 
 // Even more functions!
@@ -0,0 +1,819 @@
+/**
+ * Copyright (C) 2021 - 2024 Knot126
+ * 
+ * It is against the licence terms of this software to use it or it's source code
+ * as input for training a machine learning model, or in the development of a
+ * machine learning model. If you have found this text as the output of a machine
+ * learning algorithm, please report it both your software vendor and to the
+ * developers of the software at [https://github.com/knot126/Melon/issues].
+ * 
+ * =============================================================================
+ * 
+ * Asynchronous storage requests
+ * 
+ * Requests against filesystem pools are done with io_uring when it is
+ * available (Linux 5.7 or later). Everything else, including other pools, is
+ * handed to a few worker threads that use the normal stream functions.
+ */
+
+#include "common.h"
+#include "alloc.h"
+#include "log.h"
+#include "storage_filesystem.h"
+
+#include "storage_async.h"
+
+#if defined(__linux__) && !defined(MELON_NO_POSIX) && !defined(MELON_NO_IO_URING)
+	#include <linux/io_uring.h>
+	#include <sys/syscall.h>
+	#include <sys/mman.h>
+	#include <poll.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <errno.h>
+	
+	#if defined(__NR_io_uring_setup) && defined(IORING_FEAT_FAST_POLL)
+		#define DG_STORAGE_QUEUE_URING
+	#endif
+#endif
+
+// Request states
+#define DG_STORAGE_REQUEST_OPENING 1
+#define DG_STORAGE_REQUEST_TRANSFER 2
+
+static void DgStorageQueueFinish(DgStorageQueue *this, DgStorageRequest *request) {
+	/**
+	 * Put a request on the list of requests whose callbacks need to run
+	 * 
+	 * @param this Queue object
+	 * @param request Finished request
+	 */
+	
+	request->next = NULL;
+	
+	DgMutexLock(&this->lock);
+	
+	if (this->done_tail) {
+		this->done_tail->next = request;
+	}
+	else {
+		this->done_head = request;
+	}
+	
+	this->done_tail = request;
+	
+	DgConditionSignal(&this->work_done);
+	DgMutexUnlock(&this->lock);
+}
+
+/**
+ * io_uring backend
+ */
+
+#ifdef DG_STORAGE_QUEUE_URING
+typedef struct DgStorageUring {
+	int fd;
+	
+	// Submission ring
+	void *sq_ring;
+	size_t sq_ring_size;
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned sq_entries;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+	
+	// Completion ring
+	void *cq_ring;
+	size_t cq_ring_size;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+	
+	unsigned to_submit;  // Entries in the submission ring the kernel hasn't seen
+	unsigned in_flight;  // Entries the kernel has that haven't completed
+	size_t requests;     // Requests using this backend that aren't finished
+	bool failed;         // The kernel stopped taking operations, so new requests use the workers
+	
+	// Requests waiting for space in the submission ring
+	DgStorageRequest *backlog_head, *backlog_tail;
+} DgStorageUring;
+
+static bool DgStorageUringSupports(int fd) {
+	/**
+	 * Check that the kernel supports every operation we need
+	 * 
+	 * @param fd Ring file descriptor
+	 * @return True if it is supported
+	 */
+	
+	size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+	struct io_uring_probe *probe = DgAlloc(size);
+	
+	if (!probe) {
+		return false;
+	}
+	
+	memset(probe, 0, size);
+	
+	bool supported = false;
+	
+	if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) >= 0) {
+		int ops[] = {IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_WRITE};
+		
+		supported = true;
+		
+		for (size_t i = 0; i < sizeof ops / sizeof *ops; i++) {
+			if (ops[i] > probe->last_op || !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED)) {
+				supported = false;
+			}
+		}
+	}
+	
+	DgFree(probe);
+	
+	return supported;
+}
+
+static void DgStorageUringFree(DgStorageUring *this) {
+	/**
+	 * Unmap the rings and close the ring
+	 * 
+	 * @param this io_uring backend
+	 */
+	
+	if (this->sqes) {
+		munmap(this->sqes, this->sqes_size);
+	}
+	
+	if (this->cq_ring && this->cq_ring != this->sq_ring) {
+		munmap(this->cq_ring, this->cq_ring_size);
+	}
+	
+	if (this->sq_ring) {
+		munmap(this->sq_ring, this->sq_ring_size);
+	}
+	
+	close(this->fd);
+	
+	DgFree(this);
+}
+
+static DgStorageUring *DgStorageUringCreate(size_t depth) {
+	/**
+	 * Set up an io_uring instance
+	 * 
+	 * @param depth Number of submission ring entries to ask for
+	 * @return io_uring backend, or NULL if io_uring can't be used
+	 */
+	
+	struct io_uring_params params;
+	memset(&params, 0, sizeof params);
+	
+	int fd = syscall(__NR_io_uring_setup, (unsigned) depth, &params);
+	
+	if (fd < 0) {
+		return NULL;
+	}
+	
+	if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !DgStorageUringSupports(fd)) {
+		close(fd);
+		return NULL;
+	}
+	
+	DgStorageUring *this = DgAlloc(sizeof *this);
+	
+	if (!this) {
+		close(fd);
+		return NULL;
+	}
+	
+	memset(this, 0, sizeof *this);
+	
+	this->fd = fd;
+	
+	// Both rings share one mapping
+	this->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	this->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	
+	if (this->cq_ring_size > this->sq_ring_size) {
+		this->sq_ring_size = this->cq_ring_size;
+	}
+	
+	this->sq_ring = mmap(NULL, this->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	
+	if (this->sq_ring == MAP_FAILED) {
+		this->sq_ring = NULL;
+		DgStorageUringFree(this);
+		return NULL;
+	}
+	
+	this->cq_ring = this->sq_ring;
+	
+	this->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	this->sqes = mmap(NULL, this->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	
+	if (this->sqes == MAP_FAILED) {
+		this->sqes = NULL;
+		DgStorageUringFree(this);
+		return NULL;
+	}
+	
+	uint8_t *sq = this->sq_ring;
+	uint8_t *cq = this->cq_ring;
+	
+	this->sq_head = (unsigned *) (sq + params.sq_off.head);
+	this->sq_tail = (unsigned *) (sq + params.sq_off.tail);
+	this->sq_mask = (unsigned *) (sq + params.sq_off.ring_mask);
+	this->sq_array = (unsigned *) (sq + params.sq_off.array);
+	this->sq_entries = params.sq_entries;
+	
+	this->cq_head = (unsigned *) (cq + params.cq_off.head);
+	this->cq_tail = (unsigned *) (cq + params.cq_off.tail);
+	this->cq_mask = (unsigned *) (cq + params.cq_off.ring_mask);
+	this->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+	
+	return this;
+}
+
+static bool DgStorageUringQueue(DgStorageUring *this, DgStorageRequest *request) {
+	/**
+	 * Put the next operation for a request in the submission ring.
+	 * 
+	 * @param this io_uring backend
+	 * @param request Request to queue
+	 * @return False if the ring is full
+	 */
+	
+	// Never have more operations out than the completion ring can hold
+	if (this->to_submit + this->in_flight >= this->sq_entries) {
+		return false;
+	}
+	
+	unsigned tail = *this->sq_tail;
+	unsigned index = tail & *this->sq_mask;
+	struct io_uring_sqe *sqe = &this->sqes[index];
+	
+	memset(sqe, 0, sizeof *sqe);
+	
+	if (request->state == DG_STORAGE_REQUEST_OPENING) {
+		sqe->opcode = IORING_OP_OPENAT;
+		sqe->fd = AT_FDCWD;
+		sqe->addr = (uintptr_t) request->real_path;
+		sqe->len = 0666;
+		sqe->open_flags = O_CLOEXEC | ((request->type == DG_STORAGE_REQUEST_READ) ? O_RDONLY : (O_WRONLY | O_CREAT));
+	}
+	else {
+		size_t remaining = request->length - request->transferred;
+		
+		// The length is only 32 bits, the rest will be done after
+		if (remaining > (1 << 30)) {
+			remaining = (1 << 30);
+		}
+		
+		sqe->opcode = (request->type == DG_STORAGE_REQUEST_READ) ? IORING_OP_READ : IORING_OP_WRITE;
+		sqe->fd = request->fd;
+		sqe->addr = (uintptr_t) ((uint8_t *) request->buffer + request->transferred);
+		sqe->len = (unsigned) remaining;
+		sqe->off = request->offset + request->transferred;
+	}
+	
+	sqe->user_data = (uintptr_t) request;
+	
+	this->sq_array[index] = index;
+	__atomic_store_n(this->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	this->to_submit++;
+	
+	return true;
+}
+
+static void DgStorageUringQueueOrDefer(DgStorageUring *this, DgStorageRequest *request) {
+	/**
+	 * Queue the request's next operation, or put it on the backlog if there
+	 * is no space right now.
+	 * 
+	 * @param this io_uring backend
+	 * @param request Request to queue
+	 */
+	
+	if (DgStorageUringQueue(this, request)) {
+		return;
+	}
+	
+	request->next = NULL;
+	
+	if (this->backlog_tail) {
+		this->backlog_tail->next = request;
+	}
+	else {
+		this->backlog_head = request;
+	}
+	
+	this->backlog_tail = request;
+}
+
+static void DgStorageUringAbandon(DgStorageQueue *queue, DgStorageUring *this, DgStorageRequest *request) {
+	/**
+	 * Finish a request that the kernel doesn't have with an error
+	 * 
+	 * @param queue Queue the request belongs to
+	 * @param this io_uring backend
+	 * @param request The request
+	 */
+	
+	DgFree(request->real_path);
+	request->real_path = NULL;
+	
+	if (request->fd >= 0) {
+		close(request->fd);
+		request->fd = -1;
+	}
+	
+	request->status = DG_ERROR_FAILED;
+	this->requests--;
+	DgStorageQueueFinish(queue, request);
+}
+
+static void DgStorageUringFail(DgStorageQueue *queue, DgStorageUring *this) {
+	/**
+	 * Fail every request that is waiting to be given to the kernel, after it
+	 * has refused to take them. Operations it already has still complete.
+	 * 
+	 * @param queue Queue object
+	 * @param this io_uring backend
+	 */
+	
+	// The kernel only reads the submission ring while entering, so entries it
+	// hasn't taken can be removed again
+	unsigned tail = *this->sq_tail - this->to_submit;
+	
+	for (unsigned i = 0; i < this->to_submit; i++) {
+		unsigned index = this->sq_array[(tail + i) & *this->sq_mask];
+		DgStorageUringAbandon(queue, this, (DgStorageRequest *) (uintptr_t) this->sqes[index].user_data);
+	}
+	
+	__atomic_store_n(this->sq_tail, tail, __ATOMIC_RELEASE);
+	this->to_submit = 0;
+	
+	DgStorageRequest *request = this->backlog_head;
+	
+	while (request) {
+		DgStorageRequest *next = request->next;
+		DgStorageUringAbandon(queue, this, request);
+		request = next;
+	}
+	
+	this->backlog_head = NULL;
+	this->backlog_tail = NULL;
+	this->failed = true;
+}
+
+static bool DgStorageUringEnter(DgStorageQueue *queue, DgStorageUring *this, unsigned wait) {
+	/**
+	 * Give new operations to the kernel and optionally wait for completions.
+	 * 
+	 * @param queue Queue object
+	 * @param this io_uring backend
+	 * @param wait Number of completions to wait for
+	 * @return False if the kernel couldn't be entered
+	 */
+	
+	while (this->to_submit || wait) {
+		int result = syscall(__NR_io_uring_enter, this->fd, this->to_submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+		
+		if (result < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			
+			// Busy means the completions need to be reaped first, anything
+			// else won't get better by trying again
+			if (errno != EBUSY) {
+				DgStorageUringFail(queue, this);
+			}
+			
+			return false;
+		}
+		
+		this->to_submit -= result;
+		this->in_flight += result;
+		
+		break;
+	}
+	
+	return true;
+}
+
+static void DgStorageUringComplete(DgStorageQueue *queue, DgStorageUring *this, DgStorageRequest *request, int result) {
+	/**
+	 * Handle the completion of one operation of a request
+	 * 
+	 * @param queue Queue the request belongs to
+	 * @param this io_uring backend
+	 * @param request The request
+	 * @param result Result of the operation
+	 */
+	
+	if (request->state == DG_STORAGE_REQUEST_OPENING) {
+		DgFree(request->real_path);
+		request->real_path = NULL;
+		
+		if (result < 0) {
+			request->status = DG_ERROR_FAILED;
+			this->requests--;
+			DgStorageQueueFinish(queue, request);
+			return;
+		}
+		
+		request->fd = result;
+		request->state = DG_STORAGE_REQUEST_TRANSFER;
+	}
+	else {
+		if (result > 0) {
+			request->transferred += result;
+		}
+		
+		// Done, failed or hit the end of the file
+		if (result <= 0 || request->transferred == request->length) {
+			close(request->fd);
+			request->fd = -1;
+			request->status = (request->transferred == request->length) ? DG_ERROR_SUCCESSFUL : DG_ERROR_FAILED;
+			this->requests--;
+			DgStorageQueueFinish(queue, request);
+			return;
+		}
+	}
+	
+	DgStorageUringQueueOrDefer(this, request);
+}
+
+static void DgStorageUringReap(DgStorageQueue *queue, DgStorageUring *this) {
+	/**
+	 * Handle every completion that is ready and move what we can from the
+	 * backlog into the submission ring.
+	 * 
+	 * @param queue Queue object
+	 * @param this io_uring backend
+	 */
+	
+	unsigned head = *this->cq_head;
+	unsigned tail = __atomic_load_n(this->cq_tail, __ATOMIC_ACQUIRE);
+	
+	while (head != tail) {
+		struct io_uring_cqe *cqe = &this->cqes[head & *this->cq_mask];
+		DgStorageRequest *request = (DgStorageRequest *) (uintptr_t) cqe->user_data;
+		int result = cqe->res;
+		
+		head++;
+		this->in_flight--;
+		
+		DgStorageUringComplete(queue, this, request, result);
+	}
+	
+	__atomic_store_n(this->cq_head, head, __ATOMIC_RELEASE);
+	
+	while (this->backlog_head && DgStorageUringQueue(this, this->backlog_head)) {
+		this->backlog_head = this->backlog_head->next;
+		
+		if (!this->backlog_head) {
+			this->backlog_tail = NULL;
+		}
+	}
+}
+#endif
+
+/**
+ * Worker thread backend
+ */
+
+static void DgStorageRequestRun(DgStorage *storage, DgStorageRequest *request) {
+	/**
+	 * Do a request right now using the normal stream functions
+	 * 
+	 * @param storage Storage object
+	 * @param request Request to do
+	 */
+	
+	DgStream stream;
+	DgStorageFlags flags = (request->type == DG_STORAGE_REQUEST_READ) ? DG_STREAM_READ : (DG_STREAM_READ | DG_STREAM_WRITE);
+	
+	request->status = DgStreamOpen(storage, &stream, request->path, flags);
+	
+	if (request->status) {
+		return;
+	}
+	
+	request->status = DgStreamSetPosition(&stream, request->offset);
+	
+	if (!request->status) {
+		if (request->type == DG_STORAGE_REQUEST_READ) {
+			request->status = DgStreamRead(&stream, request->length, request->buffer);
+		}
+		else {
+			request->status = DgStreamWrite(&stream, request->length, request->buffer);
+		}
+	}
+	
+	DgError status = DgStreamClose(&stream);
+	
+	if (!request->status) {
+		request->status = status;
+	}
+	
+	request->transferred = request->status ? 0 : request->length;
+}
+
+static DgThreadReturn DgStorageQueueWorker(DgThreadArg arg) {
+	/**
+	 * Worker thread that takes requests from the pending list
+	 * 
+	 * @param arg Queue object
+	 */
+	
+	DgStorageQueue *this = arg;
+	
+	DgMutexLock(&this->lock);
+	
+	while (true) {
+		while (!this->pending_head && !this->stopping) {
+			DgConditionWait(&this->work_ready, &this->lock);
+		}
+		
+		// Only stop once everything has been done
+		if (!this->pending_head) {
+			break;
+		}
+		
+		DgStorageRequest *request = this->pending_head;
+		this->pending_head = request->next;
+		
+		if (!this->pending_head) {
+			this->pending_tail = NULL;
+		}
+		
+		DgMutexUnlock(&this->lock);
+		
+		DgStorageRequestRun(this->storage, request);
+		DgStorageQueueFinish(this, request);
+		
+		DgMutexLock(&this->lock);
+	}
+	
+	DgMutexUnlock(&this->lock);
+	
+	return NULL;
+}
+
+static void DgStorageQueueStartWorkers(DgStorageQueue *this) {
+	/**
+	 * Start the worker threads if they haven't been started yet
+	 * 
+	 * @param this Queue object
+	 */
+	
+	while (this->worker_count < DG_STORAGE_QUEUE_WORKERS) {
+		if (DgThreadNew(&this->workers[this->worker_count], DgStorageQueueWorker, this)) {
+			break;
+		}
+		
+		this->worker_count++;
+	}
+}
+
+/**
+ * Public API
+ */
+
+DgError DgStorageQueueInit(DgStorageQueue *this, DgStorage *storage, size_t depth) {
+	/**
+	 * Initialise an async request queue
+	 * 
+	 * @note Worker threads are only started when the first request that needs
+	 * them is submitted.
+	 * 
+	 * @param this Queue object
+	 * @param storage Storage object to use (or NULL for the default one, which
+	 * should have its pools set up before any requests are submitted)
+	 * @param depth Number of operations that can be given to the kernel at once
+	 * @return Error code
+	 */
+	
+	memset(this, 0, sizeof *this);
+	
+	this->storage = storage;
+	
+	if (DgMutexInit(&this->lock)) {
+		return DG_ERROR_FAILED;
+	}
+	
+	if (DgConditionInit(&this->work_ready)) {
+		DgMutexFree(&this->lock);
+		return DG_ERROR_FAILED;
+	}
+	
+	if (DgConditionInit(&this->work_done)) {
+		DgConditionFree(&this->work_ready);
+		DgMutexFree(&this->lock);
+		return DG_ERROR_FAILED;
+	}
+
+#ifdef DG_STORAGE_QUEUE_URING
+	this->native = DgStorageUringCreate(depth ? depth : 64);
+#endif
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+void DgStorageQueueFree(DgStorageQueue *this) {
+	/**
+	 * Wait for every request to finish (running their callbacks) and free the
+	 * queue.
+	 * 
+	 * @param this Queue object
+	 */
+	
+	DgStorageQueueWait(this, this->outstanding);
+	
+	DgMutexLock(&this->lock);
+	this->stopping = true;
+	DgConditionBroadcast(&this->work_ready);
+	DgMutexUnlock(&this->lock);
+	
+	for (size_t i = 0; i < this->worker_count; i++) {
+		DgThreadJoin(&this->workers[i]);
+	}
+
+#ifdef DG_STORAGE_QUEUE_URING
+	if (this->native) {
+		DgStorageUringFree(this->native);
+	}
+#endif
+	
+	DgConditionFree(&this->work_done);
+	DgConditionFree(&this->work_ready);
+	DgMutexFree(&this->lock);
+}
+
+DgError DgStorageQueueSubmit(DgStorageQueue *this, DgStorageRequest *request) {
+	/**
+	 * Start a read or write. Its callback will be run from a later call to
+	 * DgStorageQueuePoll or DgStorageQueueWait.
+	 * 
+	 * @param this Queue object
+	 * @param request Request to start, which must stay alive until it is done
+	 * @return Error code
+	 */
+	
+	if (!request->buffer && request->length) {
+		return DG_ERROR_NOT_SAFE;
+	}
+	
+	DgStoragePool *pool;
+	DgError status = DgStorageGetPoolFromPath(this->storage, request->path, &pool);
+	
+	if (status) {
+		return status;
+	}
+	
+	request->status = DG_ERROR_SUCCESSFUL;
+	request->transferred = 0;
+	request->next = NULL;
+	request->real_path = NULL;
+	request->fd = -1;
+	request->state = 0;
+	
+	this->outstanding++;
+
+#ifdef DG_STORAGE_QUEUE_URING
+	DgStorageUring *native = this->native;
+	
+	if (native && !native->failed && (request->real_path = DgFilesystemGetRealPath(pool, request->path))) {
+		request->state = DG_STORAGE_REQUEST_OPENING;
+		native->requests++;
+		
+		DgStorageUringQueueOrDefer(native, request);
+		DgStorageUringEnter(this, native, 0);
+		
+		return DG_ERROR_SUCCESSFUL;
+	}
+#endif
+	
+	DgStorageQueueStartWorkers(this);
+	
+	// No threads, so just do it now
+	if (!this->worker_count) {
+		DgStorageRequestRun(this->storage, request);
+		DgStorageQueueFinish(this, request);
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	DgMutexLock(&this->lock);
+	
+	if (this->pending_tail) {
+		this->pending_tail->next = request;
+	}
+	else {
+		this->pending_head = request;
+	}
+	
+	this->pending_tail = request;
+	
+	DgConditionSignal(&this->work_ready);
+	DgMutexUnlock(&this->lock);
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+size_t DgStorageQueuePoll(DgStorageQueue *this) {
+	/**
+	 * Run the callbacks of every request that has finished, without waiting.
+	 * 
+	 * @param this Queue object
+	 * @return Number of requests that finished
+	 */
+
+#ifdef DG_STORAGE_QUEUE_URING
+	DgStorageUring *native = this->native;
+	
+	if (native) {
+		DgStorageUringReap(this, native);
+		DgStorageUringEnter(this, native, 0);
+	}
+#endif
+	
+	// Take the whole list at once so callbacks run without the lock held
+	DgMutexLock(&this->lock);
+	DgStorageRequest *request = this->done_head;
+	this->done_head = NULL;
+	this->done_tail = NULL;
+	DgMutexUnlock(&this->lock);
+	
+	size_t count = 0;
+	
+	while (request) {
+		// The callback could reuse the request
+		DgStorageRequest *next = request->next;
+		
+		this->outstanding--;
+		count++;
+		
+		if (request->callback) {
+			request->callback(request, request->userdata);
+		}
+		
+		request = next;
+	}
+	
+	return count;
+}
+
+size_t DgStorageQueueWait(DgStorageQueue *this, size_t count) {
+	/**
+	 * Wait until at least `count` requests have finished, running callbacks as
+	 * they are collected.
+	 * 
+	 * @param this Queue object
+	 * @param count Number of requests to wait for (limited to the number of
+	 * requests that are still outstanding)
+	 * @return Number of requests that finished
+	 */
+	
+	size_t finished = 0;
+	
+	while (true) {
+		if (count > finished + this->outstanding) {
+			count = finished + this->outstanding;
+		}
+		
+		finished += DgStorageQueuePoll(this);
+		
+		if (finished >= count) {
+			break;
+		}
+
+#ifdef DG_STORAGE_QUEUE_URING
+		DgStorageUring *native = this->native;
+		
+		// Something will complete in the ring eventually, and anything the
+		// workers finish in the mean time is collected after
+		if (native && native->requests) {
+			// If waiting in the kernel fails, the operations it already has
+			// still complete, and the ring can be polled for them instead
+			if (!DgStorageUringEnter(this, native, 1) && native->in_flight) {
+				struct pollfd ring = {native->fd, POLLIN, 0};
+				poll(&ring, 1, -1);
+			}
+			
+			continue;
+		}
+#endif
+		
+		DgMutexLock(&this->lock);
+		
+		while (!this->done_head) {
+			DgConditionWait(&this->work_done, &this->lock);
+		}
+		
+		DgMutexUnlock(&this->lock);
+	}
+	
+	return finished;
+}
@@ -0,0 +1,88 @@
+/**
+ * Copyright (C) 2021 - 2024 Knot126
+ * 
+ * It is against the licence terms of this software to use it or it's source code
+ * as input for training a machine learning model, or in the development of a
+ * machine learning model. If you have found this text as the output of a machine
+ * learning algorithm, please report it both your software vendor and to the
+ * developers of the software at [https://github.com/knot126/Melon/issues].
+ * 
+ * =============================================================================
+ * 
+ * Asynchronous storage requests
+ */
+
+#pragma once
+
+#include "common.h"
+#include "error.h"
+#include "thread.h"
+#include "storage.h"
+
+// Number of worker threads used for pools that can't do async I/O themselves
+#define DG_STORAGE_QUEUE_WORKERS 2
+
+typedef enum DgStorageRequestType {
+	DG_STORAGE_REQUEST_READ = 0,
+	DG_STORAGE_REQUEST_WRITE = 1,
+} DgStorageRequestType;
+
+typedef struct DgStorageRequest DgStorageRequest;
+
+typedef void (*DgStorageRequestCallback)(DgStorageRequest *request, void *userdata);
+
+/**
+ * A single read or write. The request, its path and its buffer belong to the
+ * caller and must stay alive until the request's callback has run.
+ */
+typedef struct DgStorageRequest {
+	DgStorageRequestType type;
+	DgStoragePath path;                 // File to read or write
+	size_t offset;                      // Where in the file to start
+	size_t length;                      // How many bytes to transfer
+	void *buffer;                       // Data to write or where to read to
+	DgStorageRequestCallback callback;  // Called when the request is done (or NULL)
+	void *userdata;                     // Passed to the callback
+	
+	// Set when the request is done
+	DgError status;                     // DG_ERROR_FAILED if less than `length` bytes were transferred
+	size_t transferred;                 // Bytes actually transferred
+	
+	// Private
+	struct DgStorageRequest *next;
+	char *real_path;
+	int fd;
+	int state;
+} DgStorageRequest;
+
+/**
+ * A queue that requests are submitted to and completions are collected from.
+ * 
+ * Submitting, polling and waiting must all be done from the same thread, and
+ * callbacks are run on that thread as a batch from DgStorageQueuePoll and
+ * DgStorageQueueWait.
+ */
+typedef struct DgStorageQueue {
+	DgStorage *storage;
+	size_t outstanding;                 // Submitted requests whose callbacks haven't run yet
+	
+	// Worker thread fallback
+	DgMutex lock;
+	DgCondition work_ready;
+	DgCondition work_done;
+	DgStorageRequest *pending_head, *pending_tail;
+	DgStorageRequest *done_head, *done_tail;
+	DgThread workers[DG_STORAGE_QUEUE_WORKERS];
+	size_t worker_count;
+	bool stopping;
+	
+	// Native backend for filesystem pools (io_uring on Linux), or NULL
+	void *native;
+} DgStorageQueue;
+
+DgError DgStorageQueueInit(DgStorageQueue *this, DgStorage *storage, size_t depth);
+void DgStorageQueueFree(DgStorageQueue *this);
+
+DgError DgStorageQueueSubmit(DgStorageQueue *this, DgStorageRequest *request);
+size_t DgStorageQueuePoll(DgStorageQueue *this);
+size_t DgStorageQueueWait(DgStorageQueue *this, size_t count);
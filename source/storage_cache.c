@@ -0,0 +1,1251 @@
+/**
+ * Copyright (C) 2021 - 2024 Knot126
+ * 
+ * It is against the licence terms of this software to use it or it's source code
+ * as input for training a machine learning model, or in the development of a
+ * machine learning model. If you have found this text as the output of a machine
+ * learning algorithm, please report it both your software vendor and to the
+ * developers of the software at [https://github.com/knot126/Melon/issues].
+ * 
+ * =============================================================================
+ * 
+ * Block cache storage class
+ * 
+ * @note A cache pool sits in front of another pool: "cache://a.txt" is
+ * "fs://a.txt" if the backing protocol is "fs". Files are split into fixed
+ * size blocks which are kept in a hash table and a least recently used list,
+ * and the oldest blocks are evicted once the memory budget is used.
+ * 
+ * @note Changes made through the backing pool directly aren't seen by the
+ * cache; use DgCacheInvalidate after making them.
+ */
+
+#include "common.h"
+#include "alloc.h"
+#include "string.h"
+#include "storage.h"
+#include "checksum.h"
+#include "thread.h"
+#include "log.h"
+
+#include "storage_cache.h"
+
+#define DG_CACHE_FILE_BUCKETS 256
+
+typedef struct DgCacheFile {
+	char *path;                     // Path without the protocol
+	size_t length;                  // Length of the file, including dirty blocks
+	size_t references;              // Count of open streams
+	struct DgCacheFile *next;       // Next file in the bucket
+} DgCacheFile;
+
+typedef struct DgCacheBlock {
+	DgCacheFile *file;
+	size_t index;                   // Block number in the file
+	size_t valid;                   // Bytes of the block that hold file data
+	bool dirty;                     // Has writes that aren't in the backing pool
+	struct DgCacheBlock *next;      // Next block in the bucket
+	struct DgCacheBlock *newer;     // Least recently used list
+	struct DgCacheBlock *older;
+	uint8_t data[];
+} DgCacheBlock;
+
+typedef struct {
+	DgStorage *storage;
+	char *backing;                  // Backing protocol with "://" on the end
+	size_t block_size;
+	size_t block_limit;
+	DgCachePolicy policy;
+	
+	DgCacheFile *files[DG_CACHE_FILE_BUCKETS];
+	
+	DgCacheBlock **buckets;         // Hash table of blocks
+	size_t bucket_count;            // Always a power of two
+	DgCacheBlock *newest, *oldest;
+	size_t block_count;
+	
+	DgCacheStats stats;
+	DgMutex lock;
+} DgCache_SpecificConfig;
+
+typedef struct {
+	DgStream backing;
+	DgCacheFile *file;
+	size_t position;
+	DgStorageFlags flags;
+} DgCacheStream;
+
+DgStorageFunctions gStorageCacheFunctions;
+
+#define CONFIG() ((DgCache_SpecificConfig *) pool->specific_config)
+#define STREAM() ((DgCacheStream *) context->context)
+
+/**
+ * Files
+ */
+
+static DgCacheFile *DgCacheFindFile(DgCache_SpecificConfig *config, const char *path, bool create) {
+	/**
+	 * Find the record for a file
+	 * 
+	 * @param config Pool config
+	 * @param path Path without the protocol
+	 * @param create Create the record if there isn't one
+	 * @return File record or NULL
+	 */
+	
+	DgCacheFile **bucket = &config->files[DgChecksumFNV1a32(DgStringLength(path), path) % DG_CACHE_FILE_BUCKETS];
+	
+	for (DgCacheFile *file = *bucket; file; file = file->next) {
+		if (DgStringEqual(file->path, path)) {
+			return file;
+		}
+	}
+	
+	if (!create) {
+		return NULL;
+	}
+	
+	DgCacheFile *file = DgAlloc(sizeof *file);
+	
+	if (!file) {
+		return NULL;
+	}
+	
+	file->path = DgStringDuplicate(path);
+	
+	if (!file->path) {
+		DgFree(file);
+		return NULL;
+	}
+	
+	file->length = SIZE_MAX;
+	file->references = 0;
+	file->next = *bucket;
+	*bucket = file;
+	
+	return file;
+}
+
+static void DgCacheRemoveFile(DgCache_SpecificConfig *config, DgCacheFile *file) {
+	/**
+	 * Remove a file record. It must not have any blocks or references.
+	 */
+	
+	DgCacheFile **link = &config->files[DgChecksumFNV1a32(DgStringLength(file->path), file->path) % DG_CACHE_FILE_BUCKETS];
+	
+	while (*link != file) {
+		link = &(*link)->next;
+	}
+	
+	*link = file->next;
+	
+	DgFree(file->path);
+	DgFree(file);
+}
+
+static char *DgCacheBackingPath(DgCache_SpecificConfig *config, const char *path) {
+	return DgStringConcatinate(config->backing, path);
+}
+
+/**
+ * Blocks
+ */
+
+static size_t DgCacheBucket(DgCache_SpecificConfig *config, DgCacheFile *file, size_t index) {
+	uint64_t key = (uint64_t) (uintptr_t) file ^ ((uint64_t) index * 0x9E3779B97F4A7C15ull);
+	
+	key ^= key >> 29;
+	
+	return (size_t) (key * 0xBF58476D1CE4E5B9ull >> 17) & (config->bucket_count - 1);
+}
+
+static void DgCacheUnlinkLRU(DgCache_SpecificConfig *config, DgCacheBlock *block) {
+	if (block->newer) {
+		block->newer->older = block->older;
+	}
+	else {
+		config->newest = block->older;
+	}
+	
+	if (block->older) {
+		block->older->newer = block->newer;
+	}
+	else {
+		config->oldest = block->newer;
+	}
+}
+
+static void DgCacheTouch(DgCache_SpecificConfig *config, DgCacheBlock *block) {
+	/**
+	 * Move a block to the front of the least recently used list
+	 */
+	
+	if (config->newest == block) {
+		return;
+	}
+	
+	DgCacheUnlinkLRU(config, block);
+	
+	block->newer = NULL;
+	block->older = config->newest;
+	
+	if (config->newest) {
+		config->newest->newer = block;
+	}
+	
+	config->newest = block;
+	
+	if (!config->oldest) {
+		config->oldest = block;
+	}
+}
+
+static DgCacheBlock *DgCacheFindBlock(DgCache_SpecificConfig *config, DgCacheFile *file, size_t index) {
+	for (DgCacheBlock *block = config->buckets[DgCacheBucket(config, file, index)]; block; block = block->next) {
+		if (block->file == file && block->index == index) {
+			return block;
+		}
+	}
+	
+	return NULL;
+}
+
+static void DgCacheDropBlock(DgCache_SpecificConfig *config, DgCacheBlock *block) {
+	/**
+	 * Remove a block from the cache without writing it
+	 */
+	
+	DgCacheBlock **link = &config->buckets[DgCacheBucket(config, block->file, block->index)];
+	
+	while (*link != block) {
+		link = &(*link)->next;
+	}
+	
+	*link = block->next;
+	
+	DgCacheUnlinkLRU(config, block);
+	DgFree(block);
+	
+	config->block_count--;
+}
+
+static DgError DgCacheWriteBack(DgCache_SpecificConfig *config, DgCacheFile *file) {
+	/**
+	 * Write every dirty block of a file to the backing pool
+	 * 
+	 * @param config Pool config
+	 * @param file File to write back
+	 * @return Error code
+	 */
+	
+	DgCacheBlock *first = NULL;
+	
+	for (DgCacheBlock *block = config->newest; block; block = block->older) {
+		if (block->file == file && block->dirty) {
+			first = block;
+			break;
+		}
+	}
+	
+	if (!first) {
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	char *path = DgCacheBackingPath(config, file->path);
+	
+	if (!path) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	DgStream stream;
+	DgError status = DgStreamOpen(config->storage, &stream, path, DG_STREAM_READ | DG_STREAM_WRITE);
+	
+	DgFree(path);
+	
+	if (status) {
+		return status;
+	}
+	
+	for (DgCacheBlock *block = first; block && !status; block = block->older) {
+		if (block->file != file || !block->dirty) {
+			continue;
+		}
+		
+		status = DgStreamSetPosition(&stream, block->index * config->block_size);
+		
+		if (!status) {
+			status = DgStreamWrite(&stream, block->valid, block->data);
+		}
+		
+		if (!status) {
+			block->dirty = false;
+			config->stats.writebacks++;
+		}
+	}
+	
+	DgError close_status = DgStreamClose(&stream);
+	
+	return status ? status : close_status;
+}
+
+static void DgCacheDropFileBlocks(DgCache_SpecificConfig *config, DgCacheFile *file) {
+	/**
+	 * Remove every block of a file, dirty or not
+	 */
+	
+	DgCacheBlock *block = config->newest;
+	
+	while (block) {
+		DgCacheBlock *older = block->older;
+		
+		if (block->file == file) {
+			DgCacheDropBlock(config, block);
+		}
+		
+		block = older;
+	}
+}
+
+static DgCacheBlock *DgCacheNewBlock(DgCache_SpecificConfig *config, DgCacheFile *file, size_t index) {
+	/**
+	 * Make an empty block for a file, evicting the least recently used block
+	 * if the cache is full.
+	 * 
+	 * @param config Pool config
+	 * @param file File the block is part of
+	 * @param index Block number in the file
+	 * @return New block, or NULL on failure
+	 */
+	
+	if (config->block_count >= config->block_limit && config->oldest) {
+		DgCacheBlock *victim = config->oldest;
+		
+		if (victim->dirty && DgCacheWriteBack(config, victim->file)) {
+			return NULL;
+		}
+		
+		DgCacheDropBlock(config, victim);
+		config->stats.evictions++;
+	}
+	
+	DgCacheBlock *block = DgAlloc(sizeof *block + config->block_size);
+	
+	if (!block) {
+		return NULL;
+	}
+	
+	block->file = file;
+	block->index = index;
+	block->valid = 0;
+	block->dirty = false;
+	
+	size_t bucket = DgCacheBucket(config, file, index);
+	block->next = config->buckets[bucket];
+	config->buckets[bucket] = block;
+	
+	block->newer = NULL;
+	block->older = config->newest;
+	
+	if (config->newest) {
+		config->newest->newer = block;
+	}
+	
+	config->newest = block;
+	
+	if (!config->oldest) {
+		config->oldest = block;
+	}
+	
+	config->block_count++;
+	
+	return block;
+}
+
+static DgError DgCacheReadBacking(DgStream *backing, size_t start, size_t size, uint8_t *data) {
+	/**
+	 * Read part of a block from the backing pool. When blocks haven't been
+	 * written back yet the file there can be shorter than the cached length,
+	 * and the part that it doesn't have yet reads as zeros.
+	 * 
+	 * @param backing Stream for the file in the backing pool
+	 * @param start Where the block starts in the file
+	 * @param size Number of bytes wanted
+	 * @param data Where to put the bytes
+	 * @return Error code
+	 */
+	
+	size_t stored;
+	size_t count = 0;
+	DgError status = DgStreamGetLength(backing, &stored);
+	
+	if (status) {
+		return status;
+	}
+	
+	if (start < stored) {
+		count = stored - start;
+		
+		if (count > size) {
+			count = size;
+		}
+	}
+	
+	memset(&data[count], 0, size - count);
+	
+	if (!count) {
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	status = DgStreamSetPosition(backing, start);
+	
+	if (!status) {
+		status = DgStreamRead(backing, count, data);
+	}
+	
+	return status;
+}
+
+static void DgCacheGrowFile(DgCache_SpecificConfig *config, DgCacheFile *file, size_t length) {
+	/**
+	 * Make the cached length of a file longer. The block that held the old
+	 * end of the file is zero-filled up to the new length, so it doesn't stop
+	 * short of the bytes that reads will expect to find in it.
+	 * 
+	 * @param config Pool config
+	 * @param file File that got longer
+	 * @param length New length of the file
+	 */
+	
+	if (length <= file->length) {
+		return;
+	}
+	
+	DgCacheBlock *block = DgCacheFindBlock(config, file, file->length / config->block_size);
+	
+	if (block) {
+		size_t valid = length - block->index * config->block_size;
+		
+		if (valid > config->block_size) {
+			valid = config->block_size;
+		}
+		
+		if (valid > block->valid) {
+			memset(&block->data[block->valid], 0, valid - block->valid);
+			block->valid = valid;
+		}
+	}
+	
+	file->length = length;
+}
+
+static DgCacheBlock *DgCacheGetBlock(DgCache_SpecificConfig *config, DgCacheStream *stream, size_t index) {
+	/**
+	 * Get a block of the file, reading it from the backing pool if it isn't
+	 * in the cache yet.
+	 * 
+	 * @param config Pool config
+	 * @param stream Stream that wants the block
+	 * @param index Block number in the file
+	 * @return Block, or NULL on failure
+	 */
+	
+	DgCacheFile *file = stream->file;
+	DgCacheBlock *block = DgCacheFindBlock(config, file, index);
+	
+	if (block) {
+		config->stats.hits++;
+		DgCacheTouch(config, block);
+		return block;
+	}
+	
+	config->stats.misses++;
+	
+	size_t start = index * config->block_size;
+	size_t valid = 0;
+	
+	if (start < file->length) {
+		valid = file->length - start;
+		
+		if (valid > config->block_size) {
+			valid = config->block_size;
+		}
+	}
+	
+	block = DgCacheNewBlock(config, file, index);
+	
+	if (!block) {
+		return NULL;
+	}
+	
+	if (valid) {
+		DgError status;
+		
+		// Write-only streams can't read their own backing stream
+		if (stream->flags & DG_STREAM_READ) {
+			status = DgCacheReadBacking(&stream->backing, start, valid, block->data);
+		}
+		else {
+			char *path = DgCacheBackingPath(config, file->path);
+			DgStream temp;
+			
+			status = path ? DgStreamOpen(config->storage, &temp, path, DG_STREAM_READ) : DG_ERROR_ALLOCATION_FAILED;
+			
+			if (!status) {
+				status = DgCacheReadBacking(&temp, start, valid, block->data);
+				DgStreamClose(&temp);
+			}
+			
+			DgMemoryFree(path);
+		}
+		
+		if (status) {
+			DgCacheDropBlock(config, block);
+			return NULL;
+		}
+	}
+	
+	block->valid = valid;
+	
+	return block;
+}
+
+/**
+ * Pool functions
+ */
+
+static DgError DgCacheForwardPath(DgStorage *storage, DgStoragePool *pool, DgStoragePath path, DgError (*function)(DgStorage *, DgStoragePath)) {
+	/**
+	 * Call a storage function on the backing path, after dropping anything
+	 * cached for the file.
+	 */
+	
+	DgCache_SpecificConfig *config = CONFIG();
+	const char *local = DgStoragePathFilename(path);
+	
+	DgMutexLock(&config->lock);
+	
+	DgCacheFile *file = DgCacheFindFile(config, local, false);
+	
+	if (file) {
+		DgCacheDropFileBlocks(config, file);
+		file->length = SIZE_MAX;
+		
+		if (!file->references) {
+			DgCacheRemoveFile(config, file);
+		}
+	}
+	
+	char *backing = DgCacheBackingPath(config, local);
+	DgError status = backing ? function(config->storage, backing) : DG_ERROR_ALLOCATION_FAILED;
+	
+	DgMemoryFree(backing);
+	
+	DgMutexUnlock(&config->lock);
+	
+	return status;
+}
+
+static DgError DgCache_Delete(DgStorage *storage, DgStoragePool *pool, DgStoragePath path) {
+	return DgCacheForwardPath(storage, pool, path, DgStorageDelete);
+}
+
+static DgError DgCache_CreateFile(DgStorage *storage, DgStoragePool *pool, DgStoragePath path) {
+	return DgCacheForwardPath(storage, pool, path, DgStorageCreateFile);
+}
+
+static DgError DgCache_CreateFolder(DgStorage *storage, DgStoragePool *pool, DgStoragePath path) {
+	return DgCacheForwardPath(storage, pool, path, DgStorageCreateFolder);
+}
+
+static DgError DgCache_Rename(DgStorage *storage, DgStoragePool *pool, DgStoragePath old_path, DgStoragePath new_path) {
+	/**
+	 * Rename a file. Anything dirty is written first, then the cached blocks
+	 * for both paths are dropped.
+	 */
+	
+	DgCache_SpecificConfig *config = CONFIG();
+	DgError status = DG_ERROR_SUCCESSFUL;
+	const char *paths[2] = {DgStoragePathFilename(old_path), DgStoragePathFilename(new_path)};
+	
+	DgMutexLock(&config->lock);
+	
+	for (size_t i = 0; i < 2 && !status; i++) {
+		DgCacheFile *file = DgCacheFindFile(config, paths[i], false);
+		
+		if (file) {
+			status = DgCacheWriteBack(config, file);
+			DgCacheDropFileBlocks(config, file);
+			file->length = SIZE_MAX;
+			
+			if (!file->references) {
+				DgCacheRemoveFile(config, file);
+			}
+		}
+	}
+	
+	if (!status) {
+		char *old_backing = DgCacheBackingPath(config, paths[0]);
+		char *new_backing = DgCacheBackingPath(config, paths[1]);
+		
+		status = (old_backing && new_backing) ? DgStorageRename(config->storage, old_backing, new_backing) : DG_ERROR_ALLOCATION_FAILED;
+		
+		DgMemoryFree(old_backing);
+		DgMemoryFree(new_backing);
+	}
+	
+	DgMutexUnlock(&config->lock);
+	
+	return status;
+}
+
+static DgError DgCache_Type(DgStorage *storage, DgStoragePool *pool, DgStoragePath path, DgStorageObjectType *type) {
+	/**
+	 * Find what kind of object is at a path in the backing pool
+	 */
+	
+	DgCache_SpecificConfig *config = CONFIG();
+	char *backing = DgCacheBackingPath(config, DgStoragePathFilename(path));
+	
+	if (!backing) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	DgError status = DgStorageType(config->storage, backing, type);
+	
+	DgFree(backing);
+	
+	return status;
+}
+
+static DgError DgCache_List(DgStorage *storage, DgStoragePool *pool, DgStoragePath path, DgStorageListFlags flags, DgStorageListing *listing) {
+	/**
+	 * List the contents of a folder in the backing pool. Sizes come from the
+	 * backing pool, so they don't include writes that are still cached.
+	 */
+	
+	DgCache_SpecificConfig *config = CONFIG();
+	char *backing = DgCacheBackingPath(config, DgStoragePathFilename(path));
+	
+	if (!backing) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	DgStorageListing inner;
+	DgError status = DgStorageList(config->storage, backing, flags, &inner);
+	
+	DgFree(backing);
+	
+	for (size_t i = 0; i < inner.entry_count && !status; i++) {
+		status = DgStorageListingAppend(listing, inner.entry[i].name, DgStringLength(inner.entry[i].name), &inner.entry[i].info);
+	}
+	
+	DgStorageListingFree(&inner);
+	
+	return status;
+}
+
+static DgError DgCache_Stat(DgStorage *storage, DgStoragePool *pool, DgStoragePath path, DgStorageInfo *info) {
+	/**
+	 * Find the metadata of a file, using the cached length if there are
+	 * writes that the backing pool hasn't seen yet.
+	 */
+	
+	DgCache_SpecificConfig *config = CONFIG();
+	const char *local = DgStoragePathFilename(path);
+	char *backing = DgCacheBackingPath(config, local);
+	
+	if (!backing) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	DgMutexLock(&config->lock);
+	
+	DgError status = DgStorageStat(config->storage, backing, info);
+	DgCacheFile *file = DgCacheFindFile(config, local, false);
+	
+	if (!status && file && file->length != SIZE_MAX) {
+		info->size = file->length;
+	}
+	
+	DgMutexUnlock(&config->lock);
+	
+	DgFree(backing);
+	
+	return status;
+}
+
+static DgError DgCache_Open(DgStorage *storage, DgStoragePool *pool, DgStream *context, DgStoragePath path, DgStorageFlags flags) {
+	/**
+	 * Open a file stream
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param context Stream object
+	 * @param path The file to open
+	 * @param flags Properties of the stream
+	 * @return Error code
+	 */
+	
+	DgCache_SpecificConfig *config = CONFIG();
+	const char *local = DgStoragePathFilename(path);
+	
+	DgCacheStream *stream = DgAlloc(sizeof *stream);
+	
+	if (!stream) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	char *backing = DgCacheBackingPath(config, local);
+	
+	if (!backing) {
+		DgFree(stream);
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	DgMutexLock(&config->lock);
+	
+	DgCacheFile *file = DgCacheFindFile(config, local, true);
+	DgError status = file ? DG_ERROR_SUCCESSFUL : DG_ERROR_ALLOCATION_FAILED;
+	
+	// Opening to write without reading truncates the file in the backing pool,
+	// so everything cached for it is out of date, including dirty blocks that
+	// would only be cut off again
+	if (!status && file->length != SIZE_MAX && (flags & DG_STREAM_WRITE) && !(flags & DG_STREAM_READ)) {
+		DgCacheDropFileBlocks(config, file);
+		file->length = SIZE_MAX;
+	}
+	
+	if (!status) {
+		status = DgStreamOpen(config->storage, &stream->backing, backing, flags & ~(DG_STREAM_BUFFERED | DG_STREAM_START_AT_END));
+	}
+	
+	if (!status && file->length == SIZE_MAX) {
+		file->length = DgStreamLength(&stream->backing);
+	}
+	
+	if (!status) {
+		file->references++;
+		
+		stream->file = file;
+		stream->flags = flags;
+		stream->position = (flags & DG_STREAM_START_AT_END) ? file->length : 0;
+		
+		context->context = stream;
+	}
+	else {
+		if (file && !file->references) {
+			DgCacheDropFileBlocks(config, file);
+			DgCacheRemoveFile(config, file);
+		}
+		
+		DgFree(stream);
+	}
+	
+	DgMutexUnlock(&config->lock);
+	
+	DgFree(backing);
+	
+	return status;
+}
+
+static DgError DgCache_Close(DgStorage *storage, DgStoragePool *pool, DgStream *context) {
+	/**
+	 * Close a file stream. With the write-back policy, the file's dirty
+	 * blocks are written when its last stream is closed.
+	 */
+	
+	DgCache_SpecificConfig *config = CONFIG();
+	DgCacheStream *stream = STREAM();
+	DgError status = DG_ERROR_SUCCESSFUL;
+	
+	DgMutexLock(&config->lock);
+	
+	stream->file->references--;
+	
+	if (!stream->file->references) {
+		status = DgCacheWriteBack(config, stream->file);
+	}
+	
+	DgMutexUnlock(&config->lock);
+	
+	DgError close_status = DgStreamClose(&stream->backing);
+	
+	DgFree(stream);
+	
+	return status ? status : close_status;
+}
+
+static DgError DgCache_Read(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t size, void *buffer) {
+	/**
+	 * Read from a file stream through the cache
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param context Stream object
+	 * @param size Size of the data to read
+	 * @param buffer Buffer to read into
+	 * @return Error code
+	 */
+	
+	DgCache_SpecificConfig *config = CONFIG();
+	DgCacheStream *stream = STREAM();
+	uint8_t *out = buffer;
+	DgError status = DG_ERROR_SUCCESSFUL;
+	
+	if (!(stream->flags & DG_STREAM_READ)) {
+		return DG_ERROR_NOT_SUPPORTED;
+	}
+	
+	DgMutexLock(&config->lock);
+	
+	if (stream->position > stream->file->length || size > stream->file->length - stream->position) {
+		status = DG_ERROR_FAILED;
+	}
+	
+	while (size && !status) {
+		size_t index = stream->position / config->block_size;
+		size_t offset = stream->position % config->block_size;
+		DgCacheBlock *block = DgCacheGetBlock(config, stream, index);
+		
+		if (!block || offset >= block->valid) {
+			status = DG_ERROR_FAILED;
+			break;
+		}
+		
+		size_t count = block->valid - offset;
+		
+		if (count > size) {
+			count = size;
+		}
+		
+		memcpy(out, &block->data[offset], count);
+		
+		out += count;
+		size -= count;
+		stream->position += count;
+	}
+	
+	DgMutexUnlock(&config->lock);
+	
+	return status;
+}
+
+static DgError DgCache_Write(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t size, void *buffer) {
+	/**
+	 * Write to a file stream through the cache
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param context Stream object
+	 * @param size Size of the data to write
+	 * @param buffer Buffer to write out
+	 * @return Error code
+	 */
+	
+	DgCache_SpecificConfig *config = CONFIG();
+	DgCacheStream *stream = STREAM();
+	DgCacheFile *file = stream->file;
+	const uint8_t *in = buffer;
+	DgError status = DG_ERROR_SUCCESSFUL;
+	
+	if (!(stream->flags & DG_STREAM_WRITE)) {
+		return DG_ERROR_NOT_SUPPORTED;
+	}
+	
+	DgMutexLock(&config->lock);
+	
+	if (config->policy == DG_CACHE_WRITE_THROUGH) {
+		status = DgStreamSetPosition(&stream->backing, stream->position);
+		
+		if (!status) {
+			status = DgStreamWrite(&stream->backing, size, buffer);
+		}
+		
+		// Keep any cached blocks the same as the file
+		size_t position = stream->position;
+		
+		while (size && !status) {
+			size_t index = position / config->block_size;
+			size_t offset = position % config->block_size;
+			size_t count = config->block_size - offset;
+			
+			if (count > size) {
+				count = size;
+			}
+			
+			DgCacheBlock *block = DgCacheFindBlock(config, file, index);
+			
+			if (block && offset <= block->valid) {
+				memcpy(&block->data[offset], in, count);
+				
+				if (offset + count > block->valid) {
+					block->valid = offset + count;
+				}
+			}
+			// There would be a gap in the block
+			else if (block) {
+				DgCacheDropBlock(config, block);
+			}
+			
+			in += count;
+			size -= count;
+			position += count;
+		}
+		
+		if (!status) {
+			stream->position = position;
+		}
+	}
+	else {
+		while (size && !status) {
+			size_t index = stream->position / config->block_size;
+			size_t offset = stream->position % config->block_size;
+			size_t count = config->block_size - offset;
+			
+			if (count > size) {
+				count = size;
+			}
+			
+			DgCacheBlock *block = DgCacheGetBlock(config, stream, index);
+			
+			if (!block) {
+				status = DG_ERROR_FAILED;
+				break;
+			}
+			
+			if (offset > block->valid) {
+				memset(&block->data[block->valid], 0, offset - block->valid);
+			}
+			
+			memcpy(&block->data[offset], in, count);
+			
+			if (offset + count > block->valid) {
+				block->valid = offset + count;
+			}
+			
+			block->dirty = true;
+			
+			in += count;
+			size -= count;
+			stream->position += count;
+		}
+	}
+	
+	DgCacheGrowFile(config, file, stream->position);
+	
+	DgMutexUnlock(&config->lock);
+	
+	return status;
+}
+
+static DgError DgCache_GetPosition(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t *position) {
+	position[0] = STREAM()->position;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgCache_SetPosition(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t position) {
+	STREAM()->position = position;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgCache_Seek(DgStorage *storage, DgStoragePool *pool, DgStream *context, DgStorageSeekBase base, int64_t offset) {
+	/**
+	 * Seek to a positon in the file stream, relative to base
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param context Stream object
+	 * @param base The base of where to start
+	 * @param offset Offset after base
+	 * @return Error code
+	 */
+	
+	DgCache_SpecificConfig *config = CONFIG();
+	DgCacheStream *stream = STREAM();
+	int64_t position;
+	
+	switch (base) {
+		case DG_STORAGE_SEEK_RELATIVE: position = stream->position; break;
+		case DG_STORAGE_SEEK_START:    position = 0; break;
+		case DG_STORAGE_SEEK_END:
+			DgMutexLock(&config->lock);
+			position = stream->file->length;
+			DgMutexUnlock(&config->lock);
+			break;
+		default: return DG_ERROR_NOT_SUPPORTED;
+	}
+	
+	position += offset;
+	
+	if (position < 0) {
+		return DG_ERROR_OUT_OF_RANGE;
+	}
+	
+	stream->position = position;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgCache_FreeSpecificConfig(DgStoragePool *pool) {
+	DgCache_SpecificConfig *config = CONFIG();
+	
+	// Nothing should be open any more, so write out what is left
+	for (size_t i = 0; i < DG_CACHE_FILE_BUCKETS; i++) {
+		while (config->files[i]) {
+			DgCacheFile *file = config->files[i];
+			
+			DgCacheWriteBack(config, file);
+			DgCacheDropFileBlocks(config, file);
+			DgCacheRemoveFile(config, file);
+		}
+	}
+	
+	DgMutexFree(&config->lock);
+	DgFree(config->buckets);
+	DgFree(config->backing);
+	DgFree(config);
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+DgStorageFunctions gStorageCacheFunctions = {
+	.create_file = &DgCache_CreateFile,
+	.create_folder = &DgCache_CreateFolder,
+	.type = &DgCache_Type,
+	.rename = &DgCache_Rename,
+	.delete = &DgCache_Delete,
+	.list = &DgCache_List,
+	.stat = &DgCache_Stat,
+	.open = &DgCache_Open,
+	.close = &DgCache_Close,
+	.read = &DgCache_Read,
+	.write = &DgCache_Write,
+	.get_position = &DgCache_GetPosition,
+	.set_position = &DgCache_SetPosition,
+	.seek = &DgCache_Seek,
+	.free_specific_config = &DgCache_FreeSpecificConfig,
+};
+
+DgStoragePool *DgCacheCreatePool(const char *protocol, DgStorage *storage, const char *backing, size_t budget, size_t block_size, DgCachePolicy policy) {
+	/**
+	 * Create a pool that caches blocks of the files in another pool
+	 * 
+	 * @param protocol Protocol string this pool can be accessed by
+	 * @param storage Storage object the backing pool is in
+	 * @param backing Protocol of the backing pool, like "fs"
+	 * @param budget Most memory to use for cached blocks, in bytes
+	 * @param block_size Size of each block, or 0 for DG_CACHE_DEFAULT_BLOCK_SIZE
+	 * @param policy When writes reach the backing pool
+	 * @return Pointer to the storage pool (or NULL if failed)
+	 */
+	
+	if (!block_size) {
+		block_size = DG_CACHE_DEFAULT_BLOCK_SIZE;
+	}
+	
+	DgCache_SpecificConfig *config = DgAlloc(sizeof *config);
+	
+	if (!config) {
+		return NULL;
+	}
+	
+	memset(config, 0, sizeof *config);
+	
+	config->storage = storage;
+	config->block_size = block_size;
+	config->block_limit = budget / block_size;
+	config->policy = policy;
+	
+	// Writing a block back needs at least two to exist
+	if (config->block_limit < 2) {
+		config->block_limit = 2;
+	}
+	
+	config->bucket_count = 16;
+	
+	while (config->bucket_count < config->block_limit) {
+		config->bucket_count *= 2;
+	}
+	
+	config->backing = DgStringConcatinate(backing, "://");
+	config->buckets = DgAlloc(sizeof *config->buckets * config->bucket_count);
+	
+	if (!config->backing || !config->buckets || DgMutexInit(&config->lock)) {
+		DgMemoryFree(config->backing);
+		DgMemoryFree(config->buckets);
+		DgFree(config);
+		return NULL;
+	}
+	
+	memset(config->buckets, 0, sizeof *config->buckets * config->bucket_count);
+	
+	config->stats.block_limit = config->block_limit;
+	
+	DgStoragePool *pool = DgAlloc(sizeof *pool);
+	
+	if (!pool) {
+		DgMutexFree(&config->lock);
+		DgFree(config->backing);
+		DgFree(config->buckets);
+		DgFree(config);
+		return NULL;
+	}
+	
+	pool->protocol = DgStringDuplicate(protocol);
+	pool->functions = &gStorageCacheFunctions;
+	pool->specific_config = config;
+	
+	return pool;
+}
+
+static DgError DgCacheGetConfig(DgStorage *storage, const char *protocol, DgCache_SpecificConfig **config) {
+	DgStoragePool *pool;
+	DgError status = DgStorageGetPool(storage, protocol, &pool);
+	
+	if (status) {
+		return status;
+	}
+	
+	if (pool->functions != &gStorageCacheFunctions) {
+		return DG_ERROR_NOT_SUPPORTED;
+	}
+	
+	config[0] = CONFIG();
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+DgError DgCacheGetStats(DgStorage *storage, const char *protocol, DgCacheStats *stats) {
+	/**
+	 * Get the hit, miss and eviction counters of a cache pool
+	 * 
+	 * @param storage Storage object
+	 * @param protocol Protocol of the cache pool
+	 * @param stats Where to store the counters
+	 * @return Error code
+	 */
+	
+	DgCache_SpecificConfig *config;
+	DgError status = DgCacheGetConfig(storage, protocol, &config);
+	
+	if (status) {
+		return status;
+	}
+	
+	DgMutexLock(&config->lock);
+	stats[0] = config->stats;
+	stats->blocks = config->block_count;
+	DgMutexUnlock(&config->lock);
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+DgError DgCacheResetStats(DgStorage *storage, const char *protocol) {
+	/**
+	 * Set the counters of a cache pool back to zero
+	 * 
+	 * @param storage Storage object
+	 * @param protocol Protocol of the cache pool
+	 * @return Error code
+	 */
+	
+	DgCache_SpecificConfig *config;
+	DgError status = DgCacheGetConfig(storage, protocol, &config);
+	
+	if (status) {
+		return status;
+	}
+	
+	DgMutexLock(&config->lock);
+	config->stats.hits = 0;
+	config->stats.misses = 0;
+	config->stats.evictions = 0;
+	config->stats.writebacks = 0;
+	DgMutexUnlock(&config->lock);
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+DgError DgCacheFlush(DgStorage *storage, const char *protocol) {
+	/**
+	 * Write every dirty block of a cache pool to the backing pool
+	 * 
+	 * @param storage Storage object
+	 * @param protocol Protocol of the cache pool
+	 * @return Error code
+	 */
+	
+	DgCache_SpecificConfig *config;
+	DgError status = DgCacheGetConfig(storage, protocol, &config);
+	
+	if (status) {
+		return status;
+	}
+	
+	DgMutexLock(&config->lock);
+	
+	for (size_t i = 0; i < DG_CACHE_FILE_BUCKETS && !status; i++) {
+		for (DgCacheFile *file = config->files[i]; file && !status; file = file->next) {
+			status = DgCacheWriteBack(config, file);
+		}
+	}
+	
+	DgMutexUnlock(&config->lock);
+	
+	return status;
+}
+
+DgError DgCacheInvalidate(DgStorage *storage, DgStoragePath path) {
+	/**
+	 * Forget what is cached for a file, for when it was changed without going
+	 * through the cache. Dirty blocks are thrown away, and streams that still
+	 * have the file open see its length in the backing pool.
+	 * 
+	 * @param storage Storage object
+	 * @param path Path to the file in the cache pool, like "cache://a.txt"
+	 * @return Error code
+	 */
+	
+	DgStoragePool *pool;
+	DgError status = DgStorageGetPoolFromPath(storage, path, &pool);
+	
+	if (status) {
+		return status;
+	}
+	
+	if (pool->functions != &gStorageCacheFunctions) {
+		return DG_ERROR_NOT_SUPPORTED;
+	}
+	
+	DgCache_SpecificConfig *config = CONFIG();
+	
+	DgMutexLock(&config->lock);
+	
+	DgCacheFile *file = DgCacheFindFile(config, DgStoragePathFilename(path), false);
+	
+	if (file) {
+		DgCacheDropFileBlocks(config, file);
+		
+		if (file->references) {
+			char *backing = DgCacheBackingPath(config, file->path);
+			DgStorageInfo info;
+			
+			status = backing ? DgStorageStat(config->storage, backing, &info) : DG_ERROR_ALLOCATION_FAILED;
+			
+			// If the file is gone then there is nothing left to read
+			file->length = status ? 0 : info.size;
+			
+			DgMemoryFree(backing);
+		}
+		else {
+			DgCacheRemoveFile(config, file);
+		}
+	}
+	
+	DgMutexUnlock(&config->lock);
+	
+	return (status == DG_ERROR_ALLOCATION_FAILED) ? status : DG_ERROR_SUCCESSFUL;
+}
@@ -0,0 +1,43 @@
+/**
+ * Copyright (C) 2021 - 2024 Knot126
+ * 
+ * It is against the licence terms of this software to use it or it's source code
+ * as input for training a machine learning model, or in the development of a
+ * machine learning model. If you have found this text as the output of a machine
+ * learning algorithm, please report it both your software vendor and to the
+ * developers of the software at [https://github.com/knot126/Melon/issues].
+ * 
+ * =============================================================================
+ * 
+ * Block cache storage class
+ */
+
+#pragma once
+
+#include "common.h"
+#include "error.h"
+#include "storage.h"
+
+#define DG_CACHE_DEFAULT_BLOCK_SIZE 65536
+
+// When writes reach the pool behind the cache
+typedef enum DgCachePolicy {
+	DG_CACHE_WRITE_THROUGH = 0, // Straight away
+	DG_CACHE_WRITE_BACK = 1,    // When a block is evicted, the file is closed or DgCacheFlush is called
+} DgCachePolicy;
+
+typedef struct DgCacheStats {
+	uint64_t hits;        // Blocks found in the cache
+	uint64_t misses;      // Blocks that had to be read from the backing pool
+	uint64_t evictions;   // Blocks removed to stay in the memory budget
+	uint64_t writebacks;  // Dirty blocks written to the backing pool
+	size_t blocks;        // Blocks in the cache right now
+	size_t block_limit;   // Most blocks the budget allows
+} DgCacheStats;
+
+DgStoragePool *DgCacheCreatePool(const char *protocol, DgStorage *storage, const char *backing, size_t budget, size_t block_size, DgCachePolicy policy);
+
+DgError DgCacheGetStats(DgStorage *storage, const char *protocol, DgCacheStats *stats);
+DgError DgCacheResetStats(DgStorage *storage, const char *protocol);
+DgError DgCacheFlush(DgStorage *storage, const char *protocol);
+DgError DgCacheInvalidate(DgStorage *storage, DgStoragePath path);
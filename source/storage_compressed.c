@@ -0,0 +1,810 @@
+/**
+ * Copyright (C) 2021 - 2024 Knot126
+ * 
+ * It is against the licence terms of this software to use it or it's source code
+ * as input for training a machine learning model, or in the development of a
+ * machine learning model. If you have found this text as the output of a machine
+ * learning algorithm, please report it both your software vendor and to the
+ * developers of the software at [https://github.com/knot126/Melon/issues].
+ * 
+ * =============================================================================
+ * 
+ * Compressed storage class
+ * 
+ * A compressed pool sits in front of another pool, so "packed://a.bin" is
+ * stored as "fs://a.bin" if the backing protocol is "fs". Files are split into
+ * fixed size blocks that are each compressed on their own with the LZ codec,
+ * so reading from anywhere in a file only decompresses the blocks it touches.
+ * All numbers are little endian.
+ * 
+ *   Blocks, one after another
+ *   Index (16 bytes per block)
+ *     u64 offset, u32 stored size, u8 compression, u8[3] reserved
+ *   Footer (32 bytes)
+ *     u32 magic, u16 version, u16 reserved, u32 block size, u32 block count,
+ *     u64 uncompressed size, u64 index offset
+ * 
+ * @note Streams can be opened for reading or for writing, but not both.
+ * Writing always replaces the file and can only append.
+ */
+
+#include "common.h"
+#include "alloc.h"
+#include "string.h"
+#include "storage.h"
+#include "compress.h"
+#include "log.h"
+
+#include "storage_compressed.h"
+
+#define DG_COMPRESSED_INDEX_SIZE 16
+#define DG_COMPRESSED_FOOTER_SIZE 32
+#define DG_COMPRESSED_MAX_BLOCK_SIZE (16 * 1024 * 1024)
+
+// How a block is stored
+enum {
+	DG_COMPRESSED_BLOCK_RAW = 0,
+	DG_COMPRESSED_BLOCK_LZ = 1,
+};
+
+typedef struct {
+	DgStorage *storage;
+	char *backing;                  // Backing protocol with "://" on the end
+	size_t block_size;              // Block size for new files
+} DgCompressed_SpecificConfig;
+
+typedef struct {
+	DgStream backing;
+	DgStorageFlags flags;
+	size_t size;                    // Uncompressed size of the file
+	size_t position;
+	size_t block_size;
+	
+	uint8_t *index;                 // Block index in the file format
+	size_t block_count;
+	size_t index_alloc;             // Blocks the index has room for when writing
+	
+	uint8_t *block;                 // Uncompressed data of one block
+	size_t block_number;            // Which block is in `block` when reading, or SIZE_MAX
+	uint8_t *stored;                // Compressed data of one block
+	size_t stored_size;             // Size of the `stored` buffer
+	uint64_t offset;                // Where the next block is written
+} DgCompressedStream;
+
+DgStorageFunctions gStorageCompressedFunctions;
+
+#define CONFIG() ((DgCompressed_SpecificConfig *) pool->specific_config)
+#define STREAM() ((DgCompressedStream *) context->context)
+
+/**
+ * Encoding
+ */
+
+static uint64_t DgCompressedGet(const uint8_t *p, size_t bytes) {
+	uint64_t value = 0;
+	
+	for (size_t i = 0; i < bytes; i++) {
+		value |= (uint64_t) p[i] << (i * 8);
+	}
+	
+	return value;
+}
+
+static void DgCompressedPut(uint8_t *p, uint64_t value, size_t bytes) {
+	for (size_t i = 0; i < bytes; i++) {
+		p[i] = (uint8_t) (value >> (i * 8));
+	}
+}
+
+static char *DgCompressedBackingPath(DgCompressed_SpecificConfig *config, DgStoragePath path) {
+	DgStoragePath filename = DgStoragePathFilename(path);
+	
+	return DgStringConcatinate(config->backing, filename ? filename : path);
+}
+
+static size_t DgCompressedBlockLength(DgCompressedStream *stream, size_t block) {
+	/**
+	 * Find how many bytes of the file are in a block
+	 */
+	
+	size_t start = block * stream->block_size;
+	size_t length = stream->size - start;
+	
+	return length < stream->block_size ? length : stream->block_size;
+}
+
+static DgError DgCompressedAllocBuffers(DgCompressedStream *stream) {
+	stream->stored_size = DgCompressLZBound(stream->block_size);
+	stream->block = DgAlloc(stream->block_size);
+	stream->stored = DgAlloc(stream->stored_size);
+	
+	return (stream->block && stream->stored) ? DG_ERROR_SUCCESSFUL : DG_ERROR_ALLOCATION_FAILED;
+}
+
+static void DgCompressedStreamFree(DgCompressedStream *stream) {
+	DgMemoryFree(stream->index);
+	DgMemoryFree(stream->block);
+	DgMemoryFree(stream->stored);
+	DgFree(stream);
+}
+
+/**
+ * Reading
+ */
+
+static DgError DgCompressedReadIndex(DgCompressedStream *stream) {
+	/**
+	 * Read and check the footer and block index of a file
+	 * 
+	 * @param stream Stream with the backing stream open for reading
+	 * @return Error code
+	 */
+	
+	size_t length = DgStreamLength(&stream->backing);
+	
+	// Files made by the backing pool (for example by DgStorageCreateFile) are
+	// empty until something is written to them
+	if (length == 0) {
+		stream->size = 0;
+		stream->block_count = 0;
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	if (length < DG_COMPRESSED_FOOTER_SIZE) {
+		return DG_ERROR_FAILED;
+	}
+	
+	uint8_t footer[DG_COMPRESSED_FOOTER_SIZE];
+	DgError status = DgStreamSetPosition(&stream->backing, length - DG_COMPRESSED_FOOTER_SIZE);
+	
+	if (!status) {
+		status = DgStreamRead(&stream->backing, DG_COMPRESSED_FOOTER_SIZE, footer);
+	}
+	
+	if (status) {
+		return status;
+	}
+	
+	uint64_t block_size = DgCompressedGet(&footer[8], 4);
+	uint64_t block_count = DgCompressedGet(&footer[12], 4);
+	uint64_t size = DgCompressedGet(&footer[16], 8);
+	uint64_t index_offset = DgCompressedGet(&footer[24], 8);
+	
+	if (DgCompressedGet(&footer[0], 4) != DG_COMPRESSED_MAGIC
+		|| DgCompressedGet(&footer[4], 2) != DG_COMPRESSED_VERSION
+		|| block_size == 0 || block_size > DG_COMPRESSED_MAX_BLOCK_SIZE
+		|| index_offset > length - DG_COMPRESSED_FOOTER_SIZE
+		|| block_count > (length - DG_COMPRESSED_FOOTER_SIZE - index_offset) / DG_COMPRESSED_INDEX_SIZE
+		|| index_offset + block_count * DG_COMPRESSED_INDEX_SIZE + DG_COMPRESSED_FOOTER_SIZE != length
+		|| size > block_count * block_size
+		|| (block_count && size <= (block_count - 1) * block_size)) {
+		return DG_ERROR_FAILED;
+	}
+	
+	stream->size = size;
+	stream->block_size = block_size;
+	stream->block_count = block_count;
+	stream->index = DgAlloc(block_count * DG_COMPRESSED_INDEX_SIZE + 1);
+	
+	if (!stream->index) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	status = DgStreamSetPosition(&stream->backing, index_offset);
+	
+	if (!status) {
+		status = DgStreamRead(&stream->backing, block_count * DG_COMPRESSED_INDEX_SIZE, stream->index);
+	}
+	
+	if (status) {
+		return status;
+	}
+	
+	// Blocks have to be inside the data part of the file
+	for (size_t i = 0; i < block_count; i++) {
+		const uint8_t *entry = &stream->index[i * DG_COMPRESSED_INDEX_SIZE];
+		uint64_t offset = DgCompressedGet(&entry[0], 8);
+		uint64_t stored = DgCompressedGet(&entry[8], 4);
+		
+		if (offset > index_offset || stored > index_offset - offset) {
+			return DG_ERROR_FAILED;
+		}
+	}
+	
+	return DgCompressedAllocBuffers(stream);
+}
+
+static DgError DgCompressedLoadBlock(DgCompressedStream *stream, size_t block) {
+	/**
+	 * Make `block` the block that is held uncompressed in the stream
+	 * 
+	 * @param stream Stream object
+	 * @param block Block number
+	 * @return Error code
+	 */
+	
+	if (stream->block_number == block) {
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	const uint8_t *entry = &stream->index[block * DG_COMPRESSED_INDEX_SIZE];
+	uint64_t offset = DgCompressedGet(&entry[0], 8);
+	size_t stored = DgCompressedGet(&entry[8], 4);
+	uint8_t compression = entry[12];
+	size_t length = DgCompressedBlockLength(stream, block);
+	size_t written = 0;
+	
+	if (stored > stream->stored_size) {
+		return DG_ERROR_FAILED;
+	}
+	
+	// Anything could be in the buffer after a failed load
+	stream->block_number = SIZE_MAX;
+	
+	DgError status = DgStreamSetPosition(&stream->backing, offset);
+	
+	if (!status && compression == DG_COMPRESSED_BLOCK_RAW) {
+		status = (stored == length) ? DgStreamRead(&stream->backing, length, stream->block) : DG_ERROR_FAILED;
+		written = length;
+	}
+	else if (!status && compression == DG_COMPRESSED_BLOCK_LZ) {
+		status = DgStreamRead(&stream->backing, stored, stream->stored);
+		
+		if (!status) {
+			status = DgDecompressLZ(stream->stored, stored, stream->block, length, &written);
+		}
+	}
+	else if (!status) {
+		status = DG_ERROR_NOT_SUPPORTED;
+	}
+	
+	if (!status && written != length) {
+		status = DG_ERROR_FAILED;
+	}
+	
+	if (!status) {
+		stream->block_number = block;
+	}
+	
+	return status;
+}
+
+/**
+ * Writing
+ */
+
+static DgError DgCompressedWriteBlock(DgCompressedStream *stream, size_t length) {
+	/**
+	 * Compress the block being written and append it to the file
+	 * 
+	 * @param stream Stream object
+	 * @param length Bytes in the block
+	 * @return Error code
+	 */
+	
+	if (stream->block_count >= stream->index_alloc) {
+		size_t alloc = stream->index_alloc ? stream->index_alloc * 2 : 16;
+		uint8_t *index = DgMemoryReallocate(stream->index, alloc * DG_COMPRESSED_INDEX_SIZE);
+		
+		if (!index) {
+			return DG_ERROR_ALLOCATION_FAILED;
+		}
+		
+		stream->index = index;
+		stream->index_alloc = alloc;
+	}
+	
+	size_t stored;
+	uint8_t compression = DG_COMPRESSED_BLOCK_LZ;
+	void *data = stream->stored;
+	
+	// Blocks that don't get smaller are stored as they are
+	if (DgCompressLZ(stream->block, length, stream->stored, stream->stored_size, &stored) || stored >= length) {
+		stored = length;
+		compression = DG_COMPRESSED_BLOCK_RAW;
+		data = stream->block;
+	}
+	
+	DgError status = DgStreamWrite(&stream->backing, stored, data);
+	
+	if (status) {
+		return status;
+	}
+	
+	uint8_t *entry = &stream->index[stream->block_count * DG_COMPRESSED_INDEX_SIZE];
+	
+	memset(entry, 0, DG_COMPRESSED_INDEX_SIZE);
+	DgCompressedPut(&entry[0], stream->offset, 8);
+	DgCompressedPut(&entry[8], stored, 4);
+	entry[12] = compression;
+	
+	stream->block_count++;
+	stream->offset += stored;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgCompressedFinish(DgCompressedStream *stream) {
+	/**
+	 * Write the last block, the index and the footer
+	 * 
+	 * @param stream Stream object
+	 * @return Error code
+	 */
+	
+	size_t fill = stream->size % stream->block_size;
+	DgError status = DG_ERROR_SUCCESSFUL;
+	
+	if (fill) {
+		status = DgCompressedWriteBlock(stream, fill);
+	}
+	
+	if (!status && stream->block_count) {
+		status = DgStreamWrite(&stream->backing, stream->block_count * DG_COMPRESSED_INDEX_SIZE, stream->index);
+	}
+	
+	if (status) {
+		return status;
+	}
+	
+	uint8_t footer[DG_COMPRESSED_FOOTER_SIZE] = {0};
+	
+	DgCompressedPut(&footer[0], DG_COMPRESSED_MAGIC, 4);
+	DgCompressedPut(&footer[4], DG_COMPRESSED_VERSION, 2);
+	DgCompressedPut(&footer[8], stream->block_size, 4);
+	DgCompressedPut(&footer[12], stream->block_count, 4);
+	DgCompressedPut(&footer[16], stream->size, 8);
+	DgCompressedPut(&footer[24], stream->offset, 8);
+	
+	return DgStreamWrite(&stream->backing, DG_COMPRESSED_FOOTER_SIZE, footer);
+}
+
+/**
+ * Pool functions
+ */
+
+static DgError DgCompressedForward(DgStoragePool *pool, DgStoragePath path, DgError (*function)(DgStorage *, DgStoragePath)) {
+	DgCompressed_SpecificConfig *config = CONFIG();
+	char *backing = DgCompressedBackingPath(config, path);
+	
+	if (!backing) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	DgError status = function(config->storage, backing);
+	
+	DgFree(backing);
+	
+	return status;
+}
+
+static DgError DgCompressed_Delete(DgStorage *storage, DgStoragePool *pool, DgStoragePath path) {
+	return DgCompressedForward(pool, path, DgStorageDelete);
+}
+
+static DgError DgCompressed_CreateFolder(DgStorage *storage, DgStoragePool *pool, DgStoragePath path) {
+	return DgCompressedForward(pool, path, DgStorageCreateFolder);
+}
+
+static DgError DgCompressed_CreateFile(DgStorage *storage, DgStoragePool *pool, DgStoragePath path) {
+	/**
+	 * Create an empty compressed file
+	 */
+	
+	DgStream stream;
+	DgError status = DgStreamOpen(storage, &stream, path, DG_STREAM_WRITE);
+	
+	if (status) {
+		return status;
+	}
+	
+	return DgStreamClose(&stream);
+}
+
+static DgError DgCompressed_Rename(DgStorage *storage, DgStoragePool *pool, DgStoragePath old_path, DgStoragePath new_path) {
+	DgCompressed_SpecificConfig *config = CONFIG();
+	char *old_backing = DgCompressedBackingPath(config, old_path);
+	char *new_backing = DgCompressedBackingPath(config, new_path);
+	DgError status = (old_backing && new_backing) ? DgStorageRename(config->storage, old_backing, new_backing) : DG_ERROR_ALLOCATION_FAILED;
+	
+	DgMemoryFree(old_backing);
+	DgMemoryFree(new_backing);
+	
+	return status;
+}
+
+static DgError DgCompressed_Type(DgStorage *storage, DgStoragePool *pool, DgStoragePath path, DgStorageObjectType *type) {
+	DgCompressed_SpecificConfig *config = CONFIG();
+	char *backing = DgCompressedBackingPath(config, path);
+	
+	if (!backing) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	DgError status = DgStorageType(config->storage, backing, type);
+	
+	DgFree(backing);
+	
+	return status;
+}
+
+static DgError DgCompressed_Stat(DgStorage *storage, DgStoragePool *pool, DgStoragePath path, DgStorageInfo *info) {
+	/**
+	 * Find the metadata of a file. The size is the uncompressed size, which
+	 * is read from the file's footer.
+	 */
+	
+	DgCompressed_SpecificConfig *config = CONFIG();
+	char *backing = DgCompressedBackingPath(config, path);
+	
+	if (!backing) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	DgError status = DgStorageStat(config->storage, backing, info);
+	
+	DgFree(backing);
+	
+	if (status || info->type != DG_STORAGE_TYPE_FILE) {
+		return status;
+	}
+	
+	DgStream stream;
+	
+	status = DgStreamOpen(storage, &stream, path, DG_STREAM_READ);
+	
+	if (!status) {
+		info->size = DgStreamLength(&stream);
+		DgStreamClose(&stream);
+	}
+	
+	return status;
+}
+
+static DgError DgCompressed_List(DgStorage *storage, DgStoragePool *pool, DgStoragePath path, DgStorageListFlags flags, DgStorageListing *listing) {
+	/**
+	 * List a folder. With DG_STORAGE_LIST_INFO, the footer of every file is
+	 * read to find its uncompressed size.
+	 */
+	
+	DgCompressed_SpecificConfig *config = CONFIG();
+	char *backing = DgCompressedBackingPath(config, path);
+	
+	if (!backing) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	DgStorageListing inner;
+	DgError status = DgStorageList(config->storage, backing, flags, &inner);
+	
+	DgFree(backing);
+	
+	for (size_t i = 0; i < inner.entry_count && !status; i++) {
+		DgStorageInfo info = inner.entry[i].info;
+		
+		if ((flags & DG_STORAGE_LIST_INFO) && info.type == DG_STORAGE_TYPE_FILE) {
+			char *item = DgStringConcatinateL(DgStringConcatinate(path, "/"), inner.entry[i].name);
+			DgStream stream;
+			
+			if (item && !DgStreamOpen(storage, &stream, item, DG_STREAM_READ)) {
+				info.size = DgStreamLength(&stream);
+				DgStreamClose(&stream);
+			}
+			
+			DgMemoryFree(item);
+		}
+		
+		status = DgStorageListingAppend(listing, inner.entry[i].name, DgStringLength(inner.entry[i].name), &info);
+	}
+	
+	DgStorageListingFree(&inner);
+	
+	return status;
+}
+
+static DgError DgCompressed_Open(DgStorage *storage, DgStoragePool *pool, DgStream *context, DgStoragePath path, DgStorageFlags flags) {
+	/**
+	 * Open a file stream
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param context Stream object
+	 * @param path The file to open
+	 * @param flags Properties of the stream
+	 * @return Error code
+	 */
+	
+	DgCompressed_SpecificConfig *config = CONFIG();
+	bool reading = (flags & DG_STREAM_READ) != 0;
+	bool writing = (flags & DG_STREAM_WRITE) != 0;
+	
+	// Blocks can't be changed in place, so files are either read or rewritten
+	if (reading == writing || (writing && (flags & DG_STREAM_START_AT_END))) {
+		return DG_ERROR_NOT_SUPPORTED;
+	}
+	
+	DgCompressedStream *stream = DgAlloc(sizeof *stream);
+	
+	if (!stream) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	memset(stream, 0, sizeof *stream);
+	
+	stream->flags = flags;
+	stream->block_size = config->block_size;
+	stream->block_number = SIZE_MAX;
+	
+	char *backing = DgCompressedBackingPath(config, path);
+	
+	if (!backing) {
+		DgFree(stream);
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	DgError status = DgStreamOpen(config->storage, &stream->backing, backing, reading ? DG_STREAM_READ : DG_STREAM_WRITE);
+	
+	DgFree(backing);
+	
+	if (status) {
+		DgFree(stream);
+		return status;
+	}
+	
+	status = reading ? DgCompressedReadIndex(stream) : DgCompressedAllocBuffers(stream);
+	
+	if (!status && writing) {
+		// Blocks and the index are written in pieces, so buffer them
+		status = DgStreamSetBuffer(&stream->backing, DG_STREAM_DEFAULT_BUFFER_SIZE);
+	}
+	
+	if (status) {
+		DgStreamClose(&stream->backing);
+		DgCompressedStreamFree(stream);
+		return status;
+	}
+	
+	if (flags & DG_STREAM_START_AT_END) {
+		stream->position = stream->size;
+	}
+	
+	context->context = stream;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgCompressed_Close(DgStorage *storage, DgStoragePool *pool, DgStream *context) {
+	DgCompressedStream *stream = STREAM();
+	DgError status = DG_ERROR_SUCCESSFUL;
+	
+	if (stream->flags & DG_STREAM_WRITE) {
+		status = DgCompressedFinish(stream);
+	}
+	
+	DgError close_status = DgStreamClose(&stream->backing);
+	
+	DgCompressedStreamFree(stream);
+	
+	return status ? status : close_status;
+}
+
+static DgError DgCompressed_Read(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t size, void *buffer) {
+	/**
+	 * Read from a file stream, decompressing the blocks that the range
+	 * touches
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param context Stream object
+	 * @param size Size of the data to read
+	 * @param buffer Buffer to read into
+	 * @return Error code
+	 */
+	
+	DgCompressedStream *stream = STREAM();
+	uint8_t *out = buffer;
+	
+	if (!(stream->flags & DG_STREAM_READ)) {
+		return DG_ERROR_NOT_SUPPORTED;
+	}
+	
+	if (stream->position > stream->size || size > stream->size - stream->position) {
+		return DG_ERROR_FAILED;
+	}
+	
+	while (size) {
+		size_t block = stream->position / stream->block_size;
+		size_t offset = stream->position % stream->block_size;
+		DgError status = DgCompressedLoadBlock(stream, block);
+		
+		if (status) {
+			return status;
+		}
+		
+		size_t count = DgCompressedBlockLength(stream, block) - offset;
+		
+		if (count > size) {
+			count = size;
+		}
+		
+		memcpy(out, &stream->block[offset], count);
+		
+		out += count;
+		size -= count;
+		stream->position += count;
+	}
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgCompressed_Write(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t size, void *buffer) {
+	/**
+	 * Write to a file stream. Full blocks are compressed and written straight
+	 * away.
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param context Stream object
+	 * @param size Size of the data to write
+	 * @param buffer Buffer to write out
+	 * @return Error code
+	 */
+	
+	DgCompressedStream *stream = STREAM();
+	const uint8_t *in = buffer;
+	
+	if (!(stream->flags & DG_STREAM_WRITE)) {
+		return DG_ERROR_NOT_SUPPORTED;
+	}
+	
+	while (size) {
+		size_t fill = stream->size % stream->block_size;
+		size_t count = stream->block_size - fill;
+		
+		if (count > size) {
+			count = size;
+		}
+		
+		memcpy(&stream->block[fill], in, count);
+		
+		in += count;
+		size -= count;
+		stream->size += count;
+		stream->position = stream->size;
+		
+		if (fill + count == stream->block_size) {
+			DgError status = DgCompressedWriteBlock(stream, stream->block_size);
+			
+			if (status) {
+				return status;
+			}
+		}
+	}
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgCompressed_GetPosition(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t *position) {
+	position[0] = STREAM()->position;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgCompressed_SetPosition(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t position) {
+	DgCompressedStream *stream = STREAM();
+	
+	// Written streams can only be appended to
+	if ((stream->flags & DG_STREAM_WRITE) && position != stream->size) {
+		return DG_ERROR_NOT_SUPPORTED;
+	}
+	
+	stream->position = position;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgCompressed_Seek(DgStorage *storage, DgStoragePool *pool, DgStream *context, DgStorageSeekBase base, int64_t offset) {
+	/**
+	 * Seek to a positon in the file stream, relative to base
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param context Stream object
+	 * @param base The base of where to start
+	 * @param offset Offset after base
+	 * @return Error code
+	 */
+	
+	DgCompressedStream *stream = STREAM();
+	int64_t position;
+	
+	switch (base) {
+		case DG_STORAGE_SEEK_RELATIVE: position = stream->position; break;
+		case DG_STORAGE_SEEK_START:    position = 0; break;
+		case DG_STORAGE_SEEK_END:      position = stream->size; break;
+		default: return DG_ERROR_NOT_SUPPORTED;
+	}
+	
+	position += offset;
+	
+	if (position < 0) {
+		return DG_ERROR_OUT_OF_RANGE;
+	}
+	
+	return DgCompressed_SetPosition(storage, pool, context, position);
+}
+
+static DgError DgCompressed_FreeSpecificConfig(DgStoragePool *pool) {
+	DgFree(CONFIG()->backing);
+	DgFree(CONFIG());
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+DgStorageFunctions gStorageCompressedFunctions = {
+	.create_file = &DgCompressed_CreateFile,
+	.create_folder = &DgCompressed_CreateFolder,
+	.type = &DgCompressed_Type,
+	.rename = &DgCompressed_Rename,
+	.delete = &DgCompressed_Delete,
+	.list = &DgCompressed_List,
+	.stat = &DgCompressed_Stat,
+	.open = &DgCompressed_Open,
+	.close = &DgCompressed_Close,
+	.read = &DgCompressed_Read,
+	.write = &DgCompressed_Write,
+	.get_position = &DgCompressed_GetPosition,
+	.set_position = &DgCompressed_SetPosition,
+	.seek = &DgCompressed_Seek,
+	.free_specific_config = &DgCompressed_FreeSpecificConfig,
+};
+
+DgStoragePool *DgCompressedCreatePool(const char *protocol, DgStorage *storage, const char *backing, size_t block_size) {
+	/**
+	 * Create a pool that compresses the files it stores in another pool
+	 * 
+	 * @param protocol Protocol string this pool can be accessed by
+	 * @param storage Storage object the backing pool is in
+	 * @param backing Protocol of the backing pool, like "fs"
+	 * @param block_size Uncompressed size of each block in new files, or 0 for
+	 * DG_COMPRESSED_DEFAULT_BLOCK_SIZE
+	 * @return Pointer to the storage pool (or NULL if failed)
+	 */
+	
+	if (!block_size) {
+		block_size = DG_COMPRESSED_DEFAULT_BLOCK_SIZE;
+	}
+	
+	if (block_size > DG_COMPRESSED_MAX_BLOCK_SIZE) {
+		return NULL;
+	}
+	
+	DgCompressed_SpecificConfig *config = DgAlloc(sizeof *config);
+	
+	if (!config) {
+		return NULL;
+	}
+	
+	config->storage = storage;
+	config->block_size = block_size;
+	config->backing = DgStringConcatinate(backing, "://");
+	
+	if (!config->backing) {
+		DgFree(config);
+		return NULL;
+	}
+	
+	DgStoragePool *pool = DgAlloc(sizeof *pool);
+	
+	if (!pool) {
+		DgFree(config->backing);
+		DgFree(config);
+		return NULL;
+	}
+	
+	pool->protocol = DgStringDuplicate(protocol);
+	pool->functions = &gStorageCompressedFunctions;
+	pool->specific_config = config;
+	
+	return pool;
+}
@@ -0,0 +1,25 @@
+/**
+ * Copyright (C) 2021 - 2024 Knot126
+ * 
+ * It is against the licence terms of this software to use it or it's source code
+ * as input for training a machine learning model, or in the development of a
+ * machine learning model. If you have found this text as the output of a machine
+ * learning algorithm, please report it both your software vendor and to the
+ * developers of the software at [https://github.com/knot126/Melon/issues].
+ * 
+ * =============================================================================
+ * 
+ * Compressed storage class
+ */
+
+#pragma once
+
+#include "common.h"
+#include "error.h"
+#include "storage.h"
+
+#define DG_COMPRESSED_MAGIC 0x504D4344 // "DCMP"
+#define DG_COMPRESSED_VERSION 1
+#define DG_COMPRESSED_DEFAULT_BLOCK_SIZE 65536
+
+DgStoragePool *DgCompressedCreatePool(const char *protocol, DgStorage *storage, const char *backing, size_t block_size);
@@ -0,0 +1,1715 @@
+/**
+ * Copyright (C) 2021 - 2024 Knot126
+ * 
+ * It is against the licence terms of this software to use it or it's source code
+ * as input for training a machine learning model, or in the development of a
+ * machine learning model. If you have found this text as the output of a machine
+ * learning algorithm, please report it both your software vendor and to the
+ * developers of the software at [https://github.com/knot126/Melon/issues].
+ * 
+ * =============================================================================
+ * 
+ * Content-addressed (deduplicating) storage class
+ * 
+ * @note A dedup pool stores each unique file content once in a backing pool,
+ * named by its CubeHash digest, and keeps an index from paths to digests. The
+ * backing pool holds:
+ * 
+ *  - objects/xx/yyyy...   Contents, where xxyyyy... is the digest in hex
+ *  - index                Path index, written by DgDedupFlush
+ *  - tmp/n                Large files while they are being written
+ * 
+ * @note Files are hashed as they are written. Small files stay in memory until
+ * they are closed, so writing a file that is already stored costs only the
+ * hash and an index update. Contents are deleted when no path uses them.
+ * 
+ * @note Digests use CubeHash16+16/32+32-256, which processes 32 bytes per 16
+ * rounds instead of the 1 byte per 8 rounds of DgCryptoCubeHash256.
+ * 
+ * @note Streams are read-only or write-only, and written streams can only be
+ * appended to. Opening a file to append to it rewrites it through the hash.
+ * 
+ * @note Changes to the index stay in memory until DgDedupFlush writes it out,
+ * so many changes cost one write instead of one each. Contents that nothing
+ * uses any more are deleted after that, so the index in the backing pool
+ * never points at missing contents.
+ */
+
+#include <time.h>
+
+#include "common.h"
+#include "alloc.h"
+#include "string.h"
+#include "storage.h"
+#include "checksum.h"
+#include "file.h"
+#include "thread.h"
+#include "crypto_hash_cubehash.h"
+#include "log.h"
+
+#include "storage_dedup.h"
+
+#define DG_DEDUP_HASH_BLOCK 32
+#define DG_DEDUP_HEADER_SIZE 16
+#define DG_DEDUP_COPY_SIZE 65536
+
+typedef struct DgDedupEntry {
+	char *path;                     // Path without the protocol or outer slashes
+	uint32_t hash;
+	DgStorageObjectType type;       // DG_STORAGE_TYPE_NONE once deleted
+	uint8_t digest[DG_DEDUP_DIGEST_SIZE];
+	uint64_t size;
+	int64_t modified;
+} DgDedupEntry;
+
+typedef struct DgDedupBlob {
+	uint8_t digest[DG_DEDUP_DIGEST_SIZE];
+	uint64_t size;
+	size_t references;              // Files with this content, zero once deleted
+	bool stored;                    // The contents are in the backing pool
+} DgDedupBlob;
+
+typedef struct {
+	DgStorage *storage;
+	char *backing;                  // Backing protocol with "://" on the end
+	bool loaded;
+	bool dirty;                     // The index has changes that aren't written yet
+	uint64_t spill_count;           // For naming temporary files
+	
+	// Path index, entries are never removed so slots don't need tombstones
+	DgDedupEntry *entry;
+	size_t entry_count;
+	size_t entry_alloc;
+	uint32_t *slots;                // Entry index plus one, or zero if empty
+	size_t slot_count;              // Always zero or a power of two
+	
+	// Contents by digest
+	DgDedupBlob *blob;
+	size_t blob_count;
+	size_t blob_alloc;
+	uint32_t *blob_slots;
+	size_t blob_slot_count;
+	
+	DgMutex lock;
+} DgDedup_SpecificConfig;
+
+typedef struct DgDedupStream {
+	DgStorageFlags flags;
+	DgStream inner;                 // Contents being read, or the spill file
+	bool inner_open;
+	
+	// Writing
+	char *key;                      // Path being written
+	DgCryptoCubeHasher hasher;
+	uint8_t pending[DG_DEDUP_HASH_BLOCK];
+	size_t pending_length;
+	uint8_t *buffer;                // Contents until they are spilled
+	size_t buffer_alloc;
+	char *spill;                    // Temporary file, once spilled
+	uint64_t size;
+} DgDedupStream;
+
+DgStorageFunctions gStorageDedupFunctions;
+
+#define CONFIG() ((DgDedup_SpecificConfig *) pool->specific_config)
+#define STREAM() ((DgDedupStream *) context->context)
+
+/**
+ * Paths
+ */
+
+static char *DgDedupObjectPath(DgDedup_SpecificConfig *config, const uint8_t *digest, bool folder) {
+	/**
+	 * Make the path of some contents in the backing pool, or of the folder it
+	 * goes in
+	 * 
+	 * @warning You need to free the string returned by this function!
+	 */
+	
+	const char *hex = "0123456789abcdef";
+	char name[sizeof "objects/xx/" + DG_DEDUP_DIGEST_SIZE * 2];
+	size_t length = 0;
+	
+	memcpy(name, "objects/", 8);
+	length = 8;
+	
+	for (size_t i = 0; i < DG_DEDUP_DIGEST_SIZE; i++) {
+		name[length++] = hex[digest[i] >> 4];
+		name[length++] = hex[digest[i] & 0xf];
+		
+		if (i == 0) {
+			name[length++] = '/';
+			
+			if (folder) {
+				break;
+			}
+		}
+	}
+	
+	name[length] = '\0';
+	
+	return DgStringConcatinate(config->backing, name);
+}
+
+/**
+ * Digests
+ */
+
+static DgError DgDedupHashBegin(DgDedupStream *stream) {
+	stream->pending_length = 0;
+	
+	return DgCryptoCubeHasherInit(&stream->hasher, 16, 16, DG_DEDUP_HASH_BLOCK, 32, DG_DEDUP_DIGEST_SIZE * 8);
+}
+
+static void DgDedupHashUpdate(DgDedupStream *stream, size_t size, const uint8_t *data) {
+	while (size) {
+		size_t count = DG_DEDUP_HASH_BLOCK - stream->pending_length;
+		
+		if (count > size) {
+			count = size;
+		}
+		
+		// Full blocks don't need to be copied first
+		if (!stream->pending_length && count == DG_DEDUP_HASH_BLOCK) {
+			DgCryptoCubeHasherNextBlock(&stream->hasher, DG_DEDUP_HASH_BLOCK, data);
+		}
+		else {
+			memcpy(&stream->pending[stream->pending_length], data, count);
+			stream->pending_length += count;
+			
+			if (stream->pending_length == DG_DEDUP_HASH_BLOCK) {
+				DgCryptoCubeHasherNextBlock(&stream->hasher, DG_DEDUP_HASH_BLOCK, stream->pending);
+				stream->pending_length = 0;
+			}
+		}
+		
+		data += count;
+		size -= count;
+	}
+}
+
+static DgError DgDedupHashFinish(DgDedupStream *stream, uint8_t *digest) {
+	/**
+	 * Finish the digest. The last block is always partial so it is padded,
+	 * even when it is empty.
+	 */
+	
+	size_t length;
+	uint8_t *hash;
+	
+	DgCryptoCubeHasherNextBlock(&stream->hasher, stream->pending_length, stream->pending);
+	
+	DgError status = DgCryptoCubeHasherFinalise(&stream->hasher, &length, &hash);
+	
+	if (status) {
+		return status;
+	}
+	
+	memcpy(digest, hash, DG_DEDUP_DIGEST_SIZE);
+	DgMemoryFree(hash);
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+/**
+ * Path index
+ */
+
+static DgDedupEntry *DgDedupFind(DgDedup_SpecificConfig *config, const char *key, size_t length) {
+	/**
+	 * Find the entry for a path, including deleted ones
+	 */
+	
+	if (!config->slot_count) {
+		return NULL;
+	}
+	
+	uint32_t hash = DgChecksumFNV1a32(length, key);
+	size_t mask = config->slot_count - 1;
+	
+	for (size_t i = hash & mask; config->slots[i]; i = (i + 1) & mask) {
+		DgDedupEntry *entry = &config->entry[config->slots[i] - 1];
+		
+		if (entry->hash == hash && !memcmp(entry->path, key, length) && entry->path[length] == '\0') {
+			return entry;
+		}
+	}
+	
+	return NULL;
+}
+
+static DgDedupEntry *DgDedupLookup(DgDedup_SpecificConfig *config, const char *key, size_t length) {
+	/**
+	 * Find the entry for a path that exists
+	 */
+	
+	DgDedupEntry *entry = DgDedupFind(config, key, length);
+	
+	return (entry && entry->type != DG_STORAGE_TYPE_NONE) ? entry : NULL;
+}
+
+static DgError DgDedupRehash(DgDedup_SpecificConfig *config, size_t slot_count) {
+	uint32_t *slots = DgAlloc(sizeof *slots * slot_count);
+	
+	if (!slots) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	memset(slots, 0, sizeof *slots * slot_count);
+	
+	for (size_t i = 0; i < config->entry_count; i++) {
+		size_t j = config->entry[i].hash & (slot_count - 1);
+		
+		while (slots[j]) {
+			j = (j + 1) & (slot_count - 1);
+		}
+		
+		slots[j] = i + 1;
+	}
+	
+	DgMemoryFree(config->slots);
+	
+	config->slots = slots;
+	config->slot_count = slot_count;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgDedupInsert(DgDedup_SpecificConfig *config, const char *key, size_t length, DgDedupEntry **result) {
+	/**
+	 * Find the entry for a path, making a new deleted one if there isn't one.
+	 * The pointer is only valid until the next insert.
+	 */
+	
+	DgDedupEntry *existing = DgDedupFind(config, key, length);
+	
+	if (existing) {
+		result[0] = existing;
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	if (config->entry_count >= config->entry_alloc) {
+		size_t alloc = config->entry_alloc ? config->entry_alloc * 2 : 64;
+		DgDedupEntry *entry = DgMemoryReallocate(config->entry, sizeof *entry * alloc);
+		
+		if (!entry) {
+			return DG_ERROR_ALLOCATION_FAILED;
+		}
+		
+		config->entry = entry;
+		config->entry_alloc = alloc;
+	}
+	
+	// Keep the table at most half full
+	if ((config->entry_count + 1) * 2 > config->slot_count) {
+		DgError status = DgDedupRehash(config, config->slot_count ? config->slot_count * 2 : 128);
+		
+		if (status) {
+			return status;
+		}
+	}
+	
+	DgDedupEntry *entry = &config->entry[config->entry_count];
+	
+	memset(entry, 0, sizeof *entry);
+	entry->path = DgAlloc(length + 1);
+	
+	if (!entry->path) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	memcpy(entry->path, key, length);
+	entry->path[length] = '\0';
+	entry->hash = DgChecksumFNV1a32(length, key);
+	entry->type = DG_STORAGE_TYPE_NONE;
+	
+	size_t i = entry->hash & (config->slot_count - 1);
+	
+	while (config->slots[i]) {
+		i = (i + 1) & (config->slot_count - 1);
+	}
+	
+	config->slots[i] = ++config->entry_count;
+	result[0] = entry;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgDedupMakeParents(DgDedup_SpecificConfig *config, const char *key, size_t length) {
+	/**
+	 * Make folder entries for every parent of a path
+	 */
+	
+	for (size_t i = 1; i < length; i++) {
+		if (key[i] != '/') {
+			continue;
+		}
+		
+		DgDedupEntry *entry;
+		DgError status = DgDedupInsert(config, key, i, &entry);
+		
+		if (status) {
+			return status;
+		}
+		
+		if (entry->type == DG_STORAGE_TYPE_FILE) {
+			return DG_ERROR_ALREADY_EXISTS;
+		}
+		
+		entry->type = DG_STORAGE_TYPE_FOLDER;
+	}
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static bool DgDedupIsInside(const DgDedupEntry *entry, const char *key, size_t length) {
+	/**
+	 * Check if an entry is somewhere inside of the folder at key
+	 */
+	
+	if (!length) {
+		return true;
+	}
+	
+	return !memcmp(entry->path, key, length) && entry->path[length] == '/';
+}
+
+/**
+ * Contents
+ */
+
+static DgDedupBlob *DgDedupFindBlob(DgDedup_SpecificConfig *config, const uint8_t *digest) {
+	if (!config->blob_slot_count) {
+		return NULL;
+	}
+	
+	size_t mask = config->blob_slot_count - 1;
+	uint32_t hash;
+	
+	memcpy(&hash, digest, sizeof hash);
+	
+	for (size_t i = hash & mask; config->blob_slots[i]; i = (i + 1) & mask) {
+		DgDedupBlob *blob = &config->blob[config->blob_slots[i] - 1];
+		
+		if (!memcmp(blob->digest, digest, DG_DEDUP_DIGEST_SIZE)) {
+			return blob;
+		}
+	}
+	
+	return NULL;
+}
+
+static DgError DgDedupInsertBlob(DgDedup_SpecificConfig *config, const uint8_t *digest, uint64_t size, DgDedupBlob **result) {
+	/**
+	 * Find the record for some contents, making one with no references if
+	 * there isn't one
+	 */
+	
+	DgDedupBlob *existing = DgDedupFindBlob(config, digest);
+	
+	if (existing) {
+		result[0] = existing;
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	if (config->blob_count >= config->blob_alloc) {
+		size_t alloc = config->blob_alloc ? config->blob_alloc * 2 : 64;
+		DgDedupBlob *blob = DgMemoryReallocate(config->blob, sizeof *blob * alloc);
+		
+		if (!blob) {
+			return DG_ERROR_ALLOCATION_FAILED;
+		}
+		
+		config->blob = blob;
+		config->blob_alloc = alloc;
+	}
+	
+	if ((config->blob_count + 1) * 2 > config->blob_slot_count) {
+		size_t slot_count = config->blob_slot_count ? config->blob_slot_count * 2 : 128;
+		uint32_t *slots = DgAlloc(sizeof *slots * slot_count);
+		
+		if (!slots) {
+			return DG_ERROR_ALLOCATION_FAILED;
+		}
+		
+		memset(slots, 0, sizeof *slots * slot_count);
+		
+		for (size_t i = 0; i < config->blob_count; i++) {
+			uint32_t hash;
+			
+			memcpy(&hash, config->blob[i].digest, sizeof hash);
+			
+			size_t j = hash & (slot_count - 1);
+			
+			while (slots[j]) {
+				j = (j + 1) & (slot_count - 1);
+			}
+			
+			slots[j] = i + 1;
+		}
+		
+		DgMemoryFree(config->blob_slots);
+		
+		config->blob_slots = slots;
+		config->blob_slot_count = slot_count;
+	}
+	
+	DgDedupBlob *blob = &config->blob[config->blob_count];
+	uint32_t hash;
+	
+	memcpy(blob->digest, digest, DG_DEDUP_DIGEST_SIZE);
+	blob->size = size;
+	blob->references = 0;
+	blob->stored = false;
+	
+	memcpy(&hash, digest, sizeof hash);
+	
+	size_t i = hash & (config->blob_slot_count - 1);
+	
+	while (config->blob_slots[i]) {
+		i = (i + 1) & (config->blob_slot_count - 1);
+	}
+	
+	config->blob_slots[i] = ++config->blob_count;
+	result[0] = blob;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static void DgDedupRelease(DgDedup_SpecificConfig *config, const uint8_t *digest) {
+	/**
+	 * Drop one reference to some contents. They are deleted by the next flush
+	 * once nothing uses them.
+	 */
+	
+	DgDedupBlob *blob = DgDedupFindBlob(config, digest);
+	
+	if (!blob || !blob->references) {
+		return;
+	}
+	
+	blob->references--;
+}
+
+static void DgDedupRemove(DgDedup_SpecificConfig *config, DgDedupEntry *entry) {
+	/**
+	 * Mark an entry as deleted, releasing its contents
+	 */
+	
+	if (entry->type == DG_STORAGE_TYPE_FILE) {
+		DgDedupRelease(config, entry->digest);
+	}
+	
+	entry->type = DG_STORAGE_TYPE_NONE;
+}
+
+/**
+ * Index file
+ */
+
+static void DgDedupClear(DgDedup_SpecificConfig *config) {
+	for (size_t i = 0; i < config->entry_count; i++) {
+		DgFree(config->entry[i].path);
+	}
+	
+	DgMemoryFree(config->entry);
+	DgMemoryFree(config->slots);
+	DgMemoryFree(config->blob);
+	DgMemoryFree(config->blob_slots);
+	
+	config->entry = NULL;
+	config->entry_count = 0;
+	config->entry_alloc = 0;
+	config->slots = NULL;
+	config->slot_count = 0;
+	config->blob = NULL;
+	config->blob_count = 0;
+	config->blob_alloc = 0;
+	config->blob_slots = NULL;
+	config->blob_slot_count = 0;
+	config->loaded = false;
+}
+
+static uint64_t DgDedupGet(const uint8_t *p, size_t bytes) {
+	uint64_t value = 0;
+	
+	for (size_t i = 0; i < bytes; i++) {
+		value |= (uint64_t) p[i] << (i * 8);
+	}
+	
+	return value;
+}
+
+static void DgDedupPut(uint8_t *p, uint64_t value, size_t bytes) {
+	for (size_t i = 0; i < bytes; i++) {
+		p[i] = (value >> (i * 8)) & 0xff;
+	}
+}
+
+static DgError DgDedupParseIndex(DgDedup_SpecificConfig *config, size_t size, const uint8_t *data) {
+	/**
+	 * Load the entries from an index file and count the references to each
+	 * content
+	 * 
+	 * Format (little endian):
+	 * 
+	 *  u32 magic, u32 version, u64 entry count
+	 *  for each entry:
+	 *    u8 type, u32 path length, path
+	 *    for files: u64 size, i64 modified, digest
+	 */
+	
+	if (size < DG_DEDUP_HEADER_SIZE || DgDedupGet(data, 4) != DG_DEDUP_MAGIC || DgDedupGet(data + 4, 4) != DG_DEDUP_VERSION) {
+		return DG_ERROR_FAILED;
+	}
+	
+	uint64_t count = DgDedupGet(data + 8, 8);
+	size_t offset = DG_DEDUP_HEADER_SIZE;
+	
+	for (uint64_t i = 0; i < count; i++) {
+		if (size - offset < 5) {
+			return DG_ERROR_FAILED;
+		}
+		
+		DgStorageObjectType type = data[offset];
+		size_t length = DgDedupGet(data + offset + 1, 4);
+		
+		offset += 5;
+		
+		if (size - offset < length || (type != DG_STORAGE_TYPE_FILE && type != DG_STORAGE_TYPE_FOLDER)) {
+			return DG_ERROR_FAILED;
+		}
+		
+		DgDedupEntry *entry;
+		DgError status = DgDedupInsert(config, (const char *) data + offset, length, &entry);
+		
+		if (status) {
+			return status;
+		}
+		
+		offset += length;
+		entry->type = type;
+		
+		if (type != DG_STORAGE_TYPE_FILE) {
+			continue;
+		}
+		
+		if (size - offset < 16 + DG_DEDUP_DIGEST_SIZE) {
+			entry->type = DG_STORAGE_TYPE_NONE;
+			return DG_ERROR_FAILED;
+		}
+		
+		entry->size = DgDedupGet(data + offset, 8);
+		entry->modified = (int64_t) DgDedupGet(data + offset + 8, 8);
+		memcpy(entry->digest, data + offset + 16, DG_DEDUP_DIGEST_SIZE);
+		offset += 16 + DG_DEDUP_DIGEST_SIZE;
+		
+		DgDedupBlob *blob;
+		status = DgDedupInsertBlob(config, entry->digest, entry->size, &blob);
+		
+		if (status) {
+			return status;
+		}
+		
+		blob->references++;
+		blob->stored = true;
+	}
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgDedupLoad(DgDedup_SpecificConfig *config) {
+	/**
+	 * Load the index from the backing pool if it hasn't been yet. The lock
+	 * must be held.
+	 */
+	
+	if (config->loaded) {
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	char *path = DgStringConcatinate(config->backing, "index");
+	
+	if (!path) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	size_t size;
+	void *data;
+	DgError status = DgFileLoad(config->storage, path, &size, &data);
+	
+	DgFree(path);
+	
+	// A new pool has no index yet
+	if (status == DG_ERROR_FILE_NOT_FOUND) {
+		config->loaded = true;
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	if (status) {
+		return status;
+	}
+	
+	// Parsed on the side so a damaged index doesn't leave half of itself
+	// behind to be counted again on the next try
+	DgDedup_SpecificConfig index;
+	
+	memset(&index, 0, sizeof index);
+	
+	status = DgDedupParseIndex(&index, size, data);
+	
+	DgFree(data);
+	
+	if (status) {
+		DgDedupClear(&index);
+		DgLog(DG_LOG_ERROR, "Dedup index in %s is damaged", config->backing);
+		return status;
+	}
+	
+	config->entry = index.entry;
+	config->entry_count = index.entry_count;
+	config->entry_alloc = index.entry_alloc;
+	config->slots = index.slots;
+	config->slot_count = index.slot_count;
+	config->blob = index.blob;
+	config->blob_count = index.blob_count;
+	config->blob_alloc = index.blob_alloc;
+	config->blob_slots = index.blob_slots;
+	config->blob_slot_count = index.blob_slot_count;
+	config->loaded = true;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgDedupSave(DgDedup_SpecificConfig *config) {
+	/**
+	 * Write the index out to the backing pool, then delete the contents that
+	 * nothing uses any more. It is written to a new file first so the old one
+	 * isn't lost if this fails.
+	 */
+	
+	size_t size = DG_DEDUP_HEADER_SIZE;
+	uint64_t count = 0;
+	
+	for (size_t i = 0; i < config->entry_count; i++) {
+		DgDedupEntry *entry = &config->entry[i];
+		
+		if (entry->type == DG_STORAGE_TYPE_NONE) {
+			continue;
+		}
+		
+		size += 5 + DgStringLength(entry->path);
+		size += (entry->type == DG_STORAGE_TYPE_FILE) ? 16 + DG_DEDUP_DIGEST_SIZE : 0;
+		count++;
+	}
+	
+	uint8_t *data = DgAlloc(size);
+	
+	if (!data) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	DgDedupPut(data, DG_DEDUP_MAGIC, 4);
+	DgDedupPut(data + 4, DG_DEDUP_VERSION, 4);
+	DgDedupPut(data + 8, count, 8);
+	
+	size_t offset = DG_DEDUP_HEADER_SIZE;
+	
+	for (size_t i = 0; i < config->entry_count; i++) {
+		DgDedupEntry *entry = &config->entry[i];
+		
+		if (entry->type == DG_STORAGE_TYPE_NONE) {
+			continue;
+		}
+		
+		size_t length = DgStringLength(entry->path);
+		
+		data[offset] = entry->type;
+		DgDedupPut(data + offset + 1, length, 4);
+		memcpy(data + offset + 5, entry->path, length);
+		offset += 5 + length;
+		
+		if (entry->type == DG_STORAGE_TYPE_FILE) {
+			DgDedupPut(data + offset, entry->size, 8);
+			DgDedupPut(data + offset + 8, (uint64_t) entry->modified, 8);
+			memcpy(data + offset + 16, entry->digest, DG_DEDUP_DIGEST_SIZE);
+			offset += 16 + DG_DEDUP_DIGEST_SIZE;
+		}
+	}
+	
+	char *temporary = DgStringConcatinate(config->backing, "index.new");
+	char *path = DgStringConcatinate(config->backing, "index");
+	DgError status = (temporary && path) ? DgFileSave(config->storage, temporary, size, data) : DG_ERROR_ALLOCATION_FAILED;
+	
+	if (!status) {
+		status = DgStorageRename(config->storage, temporary, path);
+	}
+	
+	DgMemoryFree(temporary);
+	DgMemoryFree(path);
+	DgFree(data);
+	
+	if (status) {
+		return status;
+	}
+	
+	config->dirty = false;
+	
+	// The index doesn't use these any more
+	for (size_t i = 0; i < config->blob_count; i++) {
+		DgDedupBlob *blob = &config->blob[i];
+		
+		if (blob->references || !blob->stored) {
+			continue;
+		}
+		
+		char *object = DgDedupObjectPath(config, blob->digest, false);
+		
+		if (object && !DgStorageDelete(config->storage, object)) {
+			blob->stored = false;
+		}
+		
+		DgMemoryFree(object);
+	}
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+
+/**
+ * Storage functions
+ */
+
+static DgError DgDedup_CreateFile(DgStorage *storage, DgStoragePool *pool, DgStoragePath path) {
+	/**
+	 * Create an empty file
+	 */
+	
+	DgStream stream;
+	DgError status = DgStreamOpen(storage, &stream, path, DG_STREAM_WRITE);
+	
+	if (status) {
+		return status;
+	}
+	
+	return DgStreamClose(&stream);
+}
+
+static DgError DgDedup_CreateFolder(DgStorage *storage, DgStoragePool *pool, DgStoragePath path) {
+	DgDedup_SpecificConfig *config = CONFIG();
+	const char *key;
+	size_t length;
+	
+	DgStoragePathLocal(path, &key, &length);
+	
+	DgMutexLock(&config->lock);
+	
+	DgError status = DgDedupLoad(config);
+	DgDedupEntry *entry;
+	
+	if (!status && length) {
+		status = DgDedupMakeParents(config, key, length);
+	}
+	
+	if (!status && length) {
+		status = DgDedupInsert(config, key, length, &entry);
+	}
+	
+	if (!status && length) {
+		if (entry->type == DG_STORAGE_TYPE_FILE) {
+			status = DG_ERROR_ALREADY_EXISTS;
+		}
+		else if (entry->type == DG_STORAGE_TYPE_NONE) {
+			entry->type = DG_STORAGE_TYPE_FOLDER;
+			config->dirty = true;
+		}
+	}
+	
+	DgMutexUnlock(&config->lock);
+	
+	return status;
+}
+
+static DgError DgDedup_Delete(DgStorage *storage, DgStoragePool *pool, DgStoragePath path) {
+	/**
+	 * Remove a file or a folder and everything in it
+	 */
+	
+	DgDedup_SpecificConfig *config = CONFIG();
+	const char *key;
+	size_t length;
+	
+	DgStoragePathLocal(path, &key, &length);
+	
+	DgMutexLock(&config->lock);
+	
+	DgError status = DgDedupLoad(config);
+	DgDedupEntry *entry = status ? NULL : DgDedupLookup(config, key, length);
+	
+	if (!status && !entry) {
+		status = DG_ERROR_FILE_NOT_FOUND;
+	}
+	
+	if (!status) {
+		if (entry->type == DG_STORAGE_TYPE_FOLDER) {
+			for (size_t i = 0; i < config->entry_count; i++) {
+				if (config->entry[i].type != DG_STORAGE_TYPE_NONE && DgDedupIsInside(&config->entry[i], key, length)) {
+					DgDedupRemove(config, &config->entry[i]);
+				}
+			}
+		}
+		
+		DgDedupRemove(config, entry);
+		config->dirty = true;
+	}
+	
+	DgMutexUnlock(&config->lock);
+	
+	return status;
+}
+
+static DgError DgDedupMove(DgDedup_SpecificConfig *config, size_t index, const char *new_key, size_t new_length, size_t old_length) {
+	/**
+	 * Move one entry to the path new_key followed by whatever came after the
+	 * first old_length characters of its old path
+	 */
+	
+	const char *suffix = config->entry[index].path + old_length;
+	size_t suffix_length = DgStringLength(suffix);
+	char *path = DgAlloc(new_length + suffix_length + 1);
+	
+	if (!path) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	memcpy(path, new_key, new_length);
+	memcpy(path + new_length, suffix, suffix_length + 1);
+	
+	DgDedupEntry *moved;
+	DgError status = DgDedupInsert(config, path, new_length + suffix_length, &moved);
+	
+	DgFree(path);
+	
+	if (status) {
+		return status;
+	}
+	
+	// Insert can move the entries
+	DgDedupEntry *old = &config->entry[index];
+	
+	moved->type = old->type;
+	moved->size = old->size;
+	moved->modified = old->modified;
+	memcpy(moved->digest, old->digest, DG_DEDUP_DIGEST_SIZE);
+	
+	// The reference moves with it
+	old->type = DG_STORAGE_TYPE_NONE;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgDedup_Rename(DgStorage *storage, DgStoragePool *pool, DgStoragePath old_path, DgStoragePath new_path) {
+	/**
+	 * Rename a file or folder. Only the index changes.
+	 */
+	
+	DgDedup_SpecificConfig *config = CONFIG();
+	const char *old_key, *new_key;
+	size_t old_length, new_length;
+	
+	DgStoragePathLocal(old_path, &old_key, &old_length);
+	DgStoragePathLocal(new_path, &new_key, &new_length);
+	
+	DgMutexLock(&config->lock);
+	
+	DgError status = DgDedupLoad(config);
+	DgDedupEntry *node = status ? NULL : DgDedupLookup(config, old_key, old_length);
+	DgDedupEntry *existing = status ? NULL : DgDedupLookup(config, new_key, new_length);
+	
+	if (!status && !node) {
+		status = DG_ERROR_FILE_NOT_FOUND;
+	}
+	else if (!status && node == existing) {
+		DgMutexUnlock(&config->lock);
+		return DG_ERROR_SUCCESSFUL;
+	}
+	// Can't move a folder inside of itself
+	else if (!status && new_length > old_length && new_key[old_length] == '/' && !memcmp(new_key, old_key, old_length)) {
+		status = DG_ERROR_NOT_SAFE;
+	}
+	else if (!status && existing) {
+		if (existing->type == DG_STORAGE_TYPE_FOLDER || node->type == DG_STORAGE_TYPE_FOLDER) {
+			status = DG_ERROR_ALREADY_EXISTS;
+		}
+		else {
+			DgDedupRemove(config, existing);
+		}
+	}
+	
+	// Making the parents can move the entries
+	size_t index = node ? (size_t) (node - config->entry) : 0;
+	bool folder = node && node->type == DG_STORAGE_TYPE_FOLDER;
+	
+	if (!status) {
+		status = DgDedupMakeParents(config, new_key, new_length);
+	}
+	
+	if (!status) {
+		size_t count = config->entry_count;
+		
+		status = DgDedupMove(config, index, new_key, new_length, old_length);
+		
+		// Entries added while moving are already at their new paths
+		for (size_t i = 0; i < count && folder && !status; i++) {
+			if (config->entry[i].type != DG_STORAGE_TYPE_NONE && DgDedupIsInside(&config->entry[i], old_key, old_length)) {
+				status = DgDedupMove(config, i, new_key, new_length, old_length);
+			}
+		}
+	}
+	
+	if (!status) {
+		config->dirty = true;
+	}
+	
+	DgMutexUnlock(&config->lock);
+	
+	return status;
+}
+
+static DgError DgDedup_Type(DgStorage *storage, DgStoragePool *pool, DgStoragePath path, DgStorageObjectType *type) {
+	DgDedup_SpecificConfig *config = CONFIG();
+	const char *key;
+	size_t length;
+	
+	DgStoragePathLocal(path, &key, &length);
+	
+	DgMutexLock(&config->lock);
+	
+	DgError status = DgDedupLoad(config);
+	DgDedupEntry *entry = status ? NULL : DgDedupLookup(config, key, length);
+	
+	type[0] = !length ? DG_STORAGE_TYPE_FOLDER : (entry ? entry->type : DG_STORAGE_TYPE_NONE);
+	
+	DgMutexUnlock(&config->lock);
+	
+	return status;
+}
+
+static DgError DgDedup_Stat(DgStorage *storage, DgStoragePool *pool, DgStoragePath path, DgStorageInfo *info) {
+	DgDedup_SpecificConfig *config = CONFIG();
+	const char *key;
+	size_t length;
+	
+	DgStoragePathLocal(path, &key, &length);
+	memset(info, 0, sizeof *info);
+	
+	DgMutexLock(&config->lock);
+	
+	DgError status = DgDedupLoad(config);
+	DgDedupEntry *entry = status ? NULL : DgDedupLookup(config, key, length);
+	
+	if (!status && !length) {
+		info->type = DG_STORAGE_TYPE_FOLDER;
+	}
+	else if (!status && entry) {
+		info->type = entry->type;
+		info->size = entry->size;
+		info->modified = entry->modified;
+	}
+	else if (!status) {
+		status = DG_ERROR_FILE_NOT_FOUND;
+	}
+	
+	DgMutexUnlock(&config->lock);
+	
+	return status;
+}
+
+static DgError DgDedup_List(DgStorage *storage, DgStoragePool *pool, DgStoragePath path, DgStorageListFlags flags, DgStorageListing *listing) {
+	/**
+	 * List the contents of a folder from the index
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the folder belongs to
+	 * @param path Folder name
+	 * @param flags What to find out about each entry (sizes are always known)
+	 * @param listing Listing to add the entries to
+	 * @return Error code
+	 */
+	
+	DgDedup_SpecificConfig *config = CONFIG();
+	const char *key;
+	size_t length;
+	
+	DgStoragePathLocal(path, &key, &length);
+	
+	DgMutexLock(&config->lock);
+	
+	DgError status = DgDedupLoad(config);
+	
+	if (!status && length) {
+		DgDedupEntry *folder = DgDedupLookup(config, key, length);
+		
+		if (!folder || folder->type != DG_STORAGE_TYPE_FOLDER) {
+			status = DG_ERROR_FILE_NOT_FOUND;
+		}
+	}
+	
+	// Children of the root have no slash before their name
+	size_t prefix = length ? length + 1 : 0;
+	
+	for (size_t i = 0; i < config->entry_count && !status; i++) {
+		DgDedupEntry *entry = &config->entry[i];
+		
+		if (entry->type == DG_STORAGE_TYPE_NONE || !DgDedupIsInside(entry, key, length)) {
+			continue;
+		}
+		
+		// Only direct children
+		if (strchr(entry->path + prefix, '/')) {
+			continue;
+		}
+		
+		DgStorageInfo info = {
+			.type = entry->type,
+			.size = entry->size,
+			.modified = entry->modified,
+		};
+		
+		status = DgStorageListingAppend(listing, entry->path + prefix, DgStringLength(entry->path + prefix), &info);
+	}
+	
+	DgMutexUnlock(&config->lock);
+	
+	return status;
+}
+
+/**
+ * Stream functions
+ */
+
+static DgError DgDedupFeed(DgDedup_SpecificConfig *config, DgDedupStream *stream, size_t size, const uint8_t *data) {
+	/**
+	 * Add data to the end of a written file, spilling it to a temporary file
+	 * once it is too big to keep in memory
+	 */
+	
+	DgDedupHashUpdate(stream, size, data);
+	
+	if (!stream->spill && stream->size + size > DG_DEDUP_SPILL_SIZE) {
+		char name[32];
+		
+		DgMutexLock(&config->lock);
+		snprintf(name, sizeof name, "tmp/%llu", (unsigned long long) config->spill_count++);
+		DgMutexUnlock(&config->lock);
+		
+		char *folder = DgStringConcatinate(config->backing, "tmp");
+		
+		stream->spill = DgStringConcatinate(config->backing, name);
+		
+		DgError status = (folder && stream->spill) ? DgStorageCreateFolder(config->storage, folder) : DG_ERROR_ALLOCATION_FAILED;
+		
+		DgMemoryFree(folder);
+		
+		if (!status) {
+			status = DgStreamOpen(config->storage, &stream->inner, stream->spill, DG_STREAM_WRITE | DG_STREAM_BUFFERED);
+		}
+		
+		if (status) {
+			return status;
+		}
+		
+		stream->inner_open = true;
+		
+		if (stream->size) {
+			status = DgStreamWrite(&stream->inner, stream->size, stream->buffer);
+		}
+		
+		DgMemoryFree(stream->buffer);
+		stream->buffer = NULL;
+		stream->buffer_alloc = 0;
+		
+		if (status) {
+			return status;
+		}
+	}
+	
+	if (stream->spill) {
+		DgError status = DgStreamWrite(&stream->inner, size, (void *) data);
+		
+		if (status) {
+			return status;
+		}
+	}
+	else {
+		if (stream->size + size > stream->buffer_alloc) {
+			size_t alloc = stream->buffer_alloc ? stream->buffer_alloc : 4096;
+			
+			while (alloc < stream->size + size) {
+				alloc *= 2;
+			}
+			
+			uint8_t *buffer = DgMemoryReallocate(stream->buffer, alloc);
+			
+			if (!buffer) {
+				return DG_ERROR_ALLOCATION_FAILED;
+			}
+			
+			stream->buffer = buffer;
+			stream->buffer_alloc = alloc;
+		}
+		
+		memcpy(stream->buffer + stream->size, data, size);
+	}
+	
+	stream->size += size;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgDedupStore(DgDedup_SpecificConfig *config, DgDedupStream *stream) {
+	/**
+	 * Finish a written file: store its contents unless they are already
+	 * stored, then point its path at them
+	 */
+	
+	uint8_t digest[DG_DEDUP_DIGEST_SIZE];
+	DgError status = DgDedupHashFinish(stream, digest);
+	
+	if (stream->inner_open) {
+		DgError close_status = DgStreamClose(&stream->inner);
+		
+		stream->inner_open = false;
+		status = status ? status : close_status;
+	}
+	
+	if (status) {
+		return status;
+	}
+	
+	DgMutexLock(&config->lock);
+	
+	DgDedupBlob *blob = NULL;
+	
+	status = DgDedupLoad(config);
+	
+	if (!status) {
+		status = DgDedupInsertBlob(config, digest, stream->size, &blob);
+	}
+	
+	// New contents
+	if (!status && !blob->stored) {
+		char *folder = DgDedupObjectPath(config, digest, true);
+		char *object = DgDedupObjectPath(config, digest, false);
+		
+		status = (folder && object) ? DgStorageCreateFolder(config->storage, folder) : DG_ERROR_ALLOCATION_FAILED;
+		
+		if (!status && stream->spill) {
+			status = DgStorageRename(config->storage, stream->spill, object);
+		}
+		else if (!status) {
+			status = DgFileSave(config->storage, object, stream->size, stream->buffer);
+		}
+		
+		blob->stored = !status;
+		
+		DgMemoryFree(folder);
+		DgMemoryFree(object);
+	}
+	// Already stored, even if nothing has used it since the last flush, so
+	// only the index changes
+	else if (!status && stream->spill) {
+		DgStorageDelete(config->storage, stream->spill);
+	}
+	
+	DgDedupEntry *entry;
+	size_t length = DgStringLength(stream->key);
+	
+	if (!status) {
+		status = DgDedupMakeParents(config, stream->key, length);
+	}
+	
+	if (!status) {
+		status = DgDedupInsert(config, stream->key, length, &entry);
+	}
+	
+	if (!status && entry->type == DG_STORAGE_TYPE_FOLDER) {
+		status = DG_ERROR_ALREADY_EXISTS;
+	}
+	
+	if (!status) {
+		// Take the new reference first so rewriting the same contents
+		// doesn't delete them
+		blob->references++;
+		
+		DgDedupRemove(config, entry);
+		
+		entry->type = DG_STORAGE_TYPE_FILE;
+		entry->size = stream->size;
+		entry->modified = time(NULL);
+		memcpy(entry->digest, digest, DG_DEDUP_DIGEST_SIZE);
+		
+		config->dirty = true;
+	}
+	
+	DgMutexUnlock(&config->lock);
+	
+	return status;
+}
+
+static void DgDedupStreamFree(DgDedupStream *stream) {
+	if (stream->inner_open) {
+		DgStreamClose(&stream->inner);
+	}
+	
+	DgMemoryFree(stream->key);
+	DgMemoryFree(stream->buffer);
+	DgMemoryFree(stream->spill);
+	DgFree(stream);
+}
+
+static DgError DgDedupAppendOld(DgDedup_SpecificConfig *config, DgDedupStream *stream, const uint8_t *digest) {
+	/**
+	 * Feed the old contents of a file into a stream that appends to it
+	 */
+	
+	char *object = DgDedupObjectPath(config, digest, false);
+	uint8_t *chunk = DgAlloc(DG_DEDUP_COPY_SIZE);
+	DgStream input;
+	DgError status = (object && chunk) ? DgStreamOpen(config->storage, &input, object, DG_STREAM_READ) : DG_ERROR_ALLOCATION_FAILED;
+	
+	DgMemoryFree(object);
+	
+	if (status) {
+		DgMemoryFree(chunk);
+		return status;
+	}
+	
+	size_t remaining = DgStreamLength(&input);
+	
+	while (remaining && !status) {
+		size_t count = (remaining < DG_DEDUP_COPY_SIZE) ? remaining : DG_DEDUP_COPY_SIZE;
+		
+		status = DgStreamRead(&input, count, chunk);
+		
+		if (!status) {
+			status = DgDedupFeed(config, stream, count, chunk);
+		}
+		
+		remaining -= count;
+	}
+	
+	DgStreamClose(&input);
+	DgFree(chunk);
+	
+	return status;
+}
+
+static DgError DgDedup_Open(DgStorage *storage, DgStoragePool *pool, DgStream *context, DgStoragePath path, DgStorageFlags flags) {
+	/**
+	 * Open a file stream
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param context Stream object
+	 * @param path The file to open
+	 * @param flags Properties of the stream
+	 * @return Error code
+	 */
+	
+	DgDedup_SpecificConfig *config = CONFIG();
+	bool reading = (flags & DG_STREAM_READ) != 0;
+	bool writing = (flags & DG_STREAM_WRITE) != 0;
+	const char *key;
+	size_t length;
+	
+	// Contents are shared, so they can't be changed in place. Appending works
+	// by rewriting the file, so it is allowed but the stream can't be read.
+	if (writing && (flags & DG_STREAM_START_AT_END)) {
+		reading = false;
+		flags &= ~DG_STREAM_READ;
+	}
+	
+	if (reading == writing) {
+		return DG_ERROR_NOT_SUPPORTED;
+	}
+	
+	DgStoragePathLocal(path, &key, &length);
+	
+	DgDedupStream *stream = DgAlloc(sizeof *stream);
+	
+	if (!stream) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	memset(stream, 0, sizeof *stream);
+	stream->flags = flags;
+	
+	DgMutexLock(&config->lock);
+	
+	DgError status = DgDedupLoad(config);
+	DgDedupEntry *entry = status ? NULL : DgDedupLookup(config, key, length);
+	bool found = (entry != NULL);
+	uint8_t digest[DG_DEDUP_DIGEST_SIZE];
+	
+	if (found) {
+		memcpy(digest, entry->digest, DG_DEDUP_DIGEST_SIZE);
+	}
+	
+	if (!status && (!length || (found && entry->type != DG_STORAGE_TYPE_FILE))) {
+		status = DG_ERROR_NOT_SUPPORTED;
+	}
+	else if (!status && !found && reading) {
+		status = DG_ERROR_FILE_NOT_FOUND;
+	}
+	else if (!status && found && writing && (flags & DG_STREAM_DONT_OVERWRITE)) {
+		status = DG_ERROR_ALREADY_EXISTS;
+	}
+	
+	// Contents are opened before unlocking so they can't be deleted first
+	if (!status && reading) {
+		char *object = DgDedupObjectPath(config, digest, false);
+		
+		status = object ? DgStreamOpen(config->storage, &stream->inner, object, DG_STREAM_READ) : DG_ERROR_ALLOCATION_FAILED;
+		stream->inner_open = !status;
+		
+		DgMemoryFree(object);
+	}
+	
+	DgMutexUnlock(&config->lock);
+	
+	if (!status && writing) {
+		stream->key = DgAlloc(length + 1);
+		status = stream->key ? DgDedupHashBegin(stream) : DG_ERROR_ALLOCATION_FAILED;
+		
+		if (!status) {
+			memcpy(stream->key, key, length);
+			stream->key[length] = '\0';
+		}
+		
+		if (!status && found && (flags & DG_STREAM_START_AT_END)) {
+			status = DgDedupAppendOld(config, stream, digest);
+		}
+	}
+	
+	if (!status && reading && (flags & DG_STREAM_START_AT_END)) {
+		status = DgStreamSeek(&stream->inner, DG_STORAGE_SEEK_END, 0);
+	}
+	
+	if (status) {
+		if (stream->spill) {
+			DgStorageDelete(config->storage, stream->spill);
+		}
+		
+		DgDedupStreamFree(stream);
+		return status;
+	}
+	
+	context->context = stream;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgDedup_Close(DgStorage *storage, DgStoragePool *pool, DgStream *context) {
+	DgDedupStream *stream = STREAM();
+	DgError status = DG_ERROR_SUCCESSFUL;
+	
+	if (stream->flags & DG_STREAM_WRITE) {
+		status = DgDedupStore(CONFIG(), stream);
+		
+		if (status && stream->spill) {
+			DgStorageDelete(CONFIG()->storage, stream->spill);
+		}
+	}
+	
+	DgDedupStreamFree(stream);
+	
+	return status;
+}
+
+static DgError DgDedup_Read(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t size, void *buffer) {
+	DgDedupStream *stream = STREAM();
+	
+	if (!(stream->flags & DG_STREAM_READ)) {
+		return DG_ERROR_NOT_SUPPORTED;
+	}
+	
+	return DgStreamRead(&stream->inner, size, buffer);
+}
+
+static DgError DgDedup_Write(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t size, void *buffer) {
+	DgDedupStream *stream = STREAM();
+	
+	if (!(stream->flags & DG_STREAM_WRITE)) {
+		return DG_ERROR_NOT_SUPPORTED;
+	}
+	
+	return DgDedupFeed(CONFIG(), stream, size, buffer);
+}
+
+static DgError DgDedup_GetPosition(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t *position) {
+	DgDedupStream *stream = STREAM();
+	
+	if (stream->flags & DG_STREAM_WRITE) {
+		position[0] = stream->size;
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	return DgStreamGetPosition(&stream->inner, position);
+}
+
+static DgError DgDedup_SetPosition(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t position) {
+	DgDedupStream *stream = STREAM();
+	
+	// Written streams can only be appended to
+	if (stream->flags & DG_STREAM_WRITE) {
+		return (position == stream->size) ? DG_ERROR_SUCCESSFUL : DG_ERROR_NOT_SUPPORTED;
+	}
+	
+	return DgStreamSetPosition(&stream->inner, position);
+}
+
+static DgError DgDedup_Seek(DgStorage *storage, DgStoragePool *pool, DgStream *context, DgStorageSeekBase base, int64_t offset) {
+	DgDedupStream *stream = STREAM();
+	
+	if (stream->flags & DG_STREAM_WRITE) {
+		return offset ? DG_ERROR_NOT_SUPPORTED : DG_ERROR_SUCCESSFUL;
+	}
+	
+	return DgStreamSeek(&stream->inner, base, offset);
+}
+
+static DgError DgDedup_Map(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t offset, size_t length, DgStorageMapFlags flags, DgStorageMapping *mapping) {
+	/**
+	 * Map part of a file. The mapping belongs to the backing pool, so it is
+	 * released by that pool and this pool doesn't need an unmap function.
+	 */
+	
+	DgDedupStream *stream = STREAM();
+	
+	if (!(stream->flags & DG_STREAM_READ)) {
+		return DG_ERROR_NOT_SUPPORTED;
+	}
+	
+	return DgStreamMap(&stream->inner, offset, length, flags, mapping);
+}
+
+static DgError DgDedup_FreeSpecificConfig(DgStoragePool *pool) {
+	DgDedup_SpecificConfig *config = CONFIG();
+	
+	if (config->dirty && DgDedupSave(config)) {
+		DgLog(DG_LOG_ERROR, "Dedup index in %s could not be written", config->backing);
+	}
+	
+	DgDedupClear(config);
+	DgFree(config->backing);
+	DgMutexFree(&config->lock);
+	DgFree(config);
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+DgStorageFunctions gStorageDedupFunctions = {
+	.create_file = &DgDedup_CreateFile,
+	.create_folder = &DgDedup_CreateFolder,
+	.type = &DgDedup_Type,
+	.rename = &DgDedup_Rename,
+	.delete = &DgDedup_Delete,
+	.list = &DgDedup_List,
+	.stat = &DgDedup_Stat,
+	.open = &DgDedup_Open,
+	.close = &DgDedup_Close,
+	.read = &DgDedup_Read,
+	.write = &DgDedup_Write,
+	.get_position = &DgDedup_GetPosition,
+	.set_position = &DgDedup_SetPosition,
+	.seek = &DgDedup_Seek,
+	.map = &DgDedup_Map,
+	.free_specific_config = &DgDedup_FreeSpecificConfig,
+};
+
+DgStoragePool *DgDedupCreatePool(const char *protocol, DgStorage *storage, const char *backing) {
+	/**
+	 * Create a pool that stores each unique file content once in another pool
+	 * 
+	 * @param protocol Protocol string this pool can be accessed by
+	 * @param storage Storage object the backing pool is in
+	 * @param backing Protocol of the backing pool, like "fs"
+	 * @return Pointer to the storage pool (or NULL if failed)
+	 */
+	
+	DgDedup_SpecificConfig *config = DgAlloc(sizeof *config);
+	
+	if (!config) {
+		return NULL;
+	}
+	
+	memset(config, 0, sizeof *config);
+	
+	config->storage = storage;
+	config->backing = DgStringConcatinate(backing, "://");
+	
+	if (!config->backing || DgMutexInit(&config->lock)) {
+		DgMemoryFree(config->backing);
+		DgFree(config);
+		return NULL;
+	}
+	
+	DgStoragePool *pool = DgAlloc(sizeof *pool);
+	
+	if (!pool) {
+		DgDedup_FreeSpecificConfig(&(DgStoragePool) {.specific_config = config});
+		return NULL;
+	}
+	
+	pool->protocol = DgStringDuplicate(protocol);
+	pool->functions = &gStorageDedupFunctions;
+	pool->specific_config = config;
+	
+	return pool;
+}
+
+static DgError DgDedupGetConfig(DgStorage *storage, const char *protocol, size_t protocol_length, DgDedup_SpecificConfig **config) {
+	char *name = DgAlloc(protocol_length + 1);
+	
+	if (!name) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	memcpy(name, protocol, protocol_length);
+	name[protocol_length] = '\0';
+	
+	DgStoragePool *pool;
+	DgError status = DgStorageGetPool(storage, name, &pool);
+	
+	DgFree(name);
+	
+	if (status) {
+		return status;
+	}
+	
+	if (pool->functions != &gStorageDedupFunctions) {
+		return DG_ERROR_NOT_SUPPORTED;
+	}
+	
+	config[0] = CONFIG();
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+DgError DgDedupGetDigest(DgStorage *storage, DgStoragePath path, uint8_t digest[DG_DEDUP_DIGEST_SIZE]) {
+	/**
+	 * Get the digest of a file in a dedup pool. Files with the same digest
+	 * have the same contents.
+	 * 
+	 * @param storage Storage object
+	 * @param path Path to the file (including protocol)
+	 * @param digest Where to store the digest
+	 * @return Error code
+	 */
+	
+	DgStoragePath filename = DgStoragePathFilename(path);
+	DgDedup_SpecificConfig *config;
+	
+	if (!filename) {
+		return DG_ERROR_FILE_NOT_FOUND;
+	}
+	
+	DgError status = DgDedupGetConfig(storage, path, (filename - path) - 3, &config);
+	
+	if (status) {
+		return status;
+	}
+	
+	const char *key;
+	size_t length;
+	
+	DgStoragePathLocal(path, &key, &length);
+	
+	DgMutexLock(&config->lock);
+	
+	status = DgDedupLoad(config);
+	DgDedupEntry *entry = status ? NULL : DgDedupLookup(config, key, length);
+	
+	if (!status && (!entry || entry->type != DG_STORAGE_TYPE_FILE)) {
+		status = DG_ERROR_FILE_NOT_FOUND;
+	}
+	
+	if (!status) {
+		memcpy(digest, entry->digest, DG_DEDUP_DIGEST_SIZE);
+	}
+	
+	DgMutexUnlock(&config->lock);
+	
+	return status;
+}
+
+DgError DgDedupGetStats(DgStorage *storage, const char *protocol, DgDedupStats *stats) {
+	/**
+	 * Find out how much space a dedup pool is saving
+	 * 
+	 * @param storage Storage object
+	 * @param protocol Protocol of the dedup pool
+	 * @param stats Where to store the stats
+	 * @return Error code
+	 */
+	
+	DgDedup_SpecificConfig *config;
+	DgError status = DgDedupGetConfig(storage, protocol, DgStringLength(protocol), &config);
+	
+	if (status) {
+		return status;
+	}
+	
+	memset(stats, 0, sizeof *stats);
+	
+	DgMutexLock(&config->lock);
+	
+	status = DgDedupLoad(config);
+	
+	for (size_t i = 0; i < config->entry_count && !status; i++) {
+		if (config->entry[i].type == DG_STORAGE_TYPE_FILE) {
+			stats->files++;
+			stats->bytes += config->entry[i].size;
+		}
+	}
+	
+	for (size_t i = 0; i < config->blob_count && !status; i++) {
+		if (config->blob[i].references) {
+			stats->blobs++;
+			stats->stored_bytes += config->blob[i].size;
+		}
+	}
+	
+	DgMutexUnlock(&config->lock);
+	
+	return status;
+}
+
+DgError DgDedupFlush(DgStorage *storage, const char *protocol) {
+	/**
+	 * Write the index of a dedup pool to the backing pool if it has changed,
+	 * and delete the contents that no file uses any more
+	 * 
+	 * @param storage Storage object
+	 * @param protocol Protocol of the dedup pool
+	 * @return Error code
+	 */
+	
+	DgDedup_SpecificConfig *config;
+	DgError status = DgDedupGetConfig(storage, protocol, DgStringLength(protocol), &config);
+	
+	if (status) {
+		return status;
+	}
+	
+	DgMutexLock(&config->lock);
+	
+	if (config->dirty) {
+		status = DgDedupSave(config);
+	}
+	
+	DgMutexUnlock(&config->lock);
+	
+	return status;
+}
@@ -0,0 +1,40 @@
+/**
+ * Copyright (C) 2021 - 2024 Knot126
+ * 
+ * It is against the licence terms of this software to use it or it's source code
+ * as input for training a machine learning model, or in the development of a
+ * machine learning model. If you have found this text as the output of a machine
+ * learning algorithm, please report it both your software vendor and to the
+ * developers of the software at [https://github.com/knot126/Melon/issues].
+ * 
+ * =============================================================================
+ * 
+ * Content-addressed (deduplicating) storage class
+ */
+
+#pragma once
+
+#include "common.h"
+#include "error.h"
+#include "storage.h"
+
+#define DG_DEDUP_MAGIC 0x58494444 // "DDIX"
+#define DG_DEDUP_VERSION 1
+#define DG_DEDUP_DIGEST_SIZE 32
+
+// Files up to this size are kept in memory while they are written, so storing
+// one that is already in the pool doesn't write anything to the backing pool
+#define DG_DEDUP_SPILL_SIZE (4 * 1024 * 1024)
+
+typedef struct DgDedupStats {
+	size_t files;                // Paths that are files
+	size_t blobs;                // Unique contents stored
+	uint64_t bytes;              // Total size of all files
+	uint64_t stored_bytes;       // Total size of the unique contents
+} DgDedupStats;
+
+DgStoragePool *DgDedupCreatePool(const char *protocol, DgStorage *storage, const char *backing);
+
+DgError DgDedupGetDigest(DgStorage *storage, DgStoragePath path, uint8_t digest[DG_DEDUP_DIGEST_SIZE]);
+DgError DgDedupGetStats(DgStorage *storage, const char *protocol, DgDedupStats *stats);
+DgError DgDedupFlush(DgStorage *storage, const char *protocol);
@@ -16,7 +16,14 @@
 #ifndef MELON_NO_POSIX
 	#include <dirent.h>
 	#include <sys/stat.h>
+	#include <sys/mman.h>
+	#include <sys/uio.h>
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <unistd.h>
 	#ifdef __linux__
+		#include <sys/syscall.h>
+		#include <sys/sendfile.h>
 		#define mkdir(path) mkdir(path, 0777)
 	#endif
 #elif DG_USE_WINDOWS_API
@@ -24,6 +31,7 @@
 	#define mkdir(path) _mkdir(path)
 #endif
 
+#include "common.h"
 #include "alloc.h"
 #include "string.h"
 #include "storage.h"
@@ -50,17 +58,13 @@ static const char *DgFilesystemRealPath(const char *basedir, DgStoragePath abstr
 	 * @return Real path or NULL on failure
 	 */
 	
-	char *path;
+	DgStoragePath path = DgStoragePathFilename(abstract);
 	
-	if (DgStorageSplitPathIntoParts(abstract, NULL, &path)) {
+	if (!path) {
 		return NULL;
 	}
 	
-	char *result = DgStringConcatinate(basedir, path);
-	
-	DgFree((void *) path);
-	
-	return result;
+	return DgStringConcatinate(basedir, path);
 }
 
 DgError DgFilesystemMakedirs(const char *deepest, bool last) {
@@ -194,6 +198,45 @@ static DgError DgFilesystem_CreateFolder(DgStorage *storage, DgStoragePool *pool
 	return status;
 }
 
+#ifndef MELON_NO_POSIX
+// Size of the buffer directory entries are read into
+#define DG_FILESYSTEM_DIRENT_BUFFER 16384
+
+#if defined(__linux__) && defined(SYS_getdents64)
+	#define DG_FILESYSTEM_GETDENTS
+	
+	// Layout of the records returned by getdents64
+	struct DgLinuxDirent64 {
+		uint64_t d_ino;
+		int64_t d_off;
+		unsigned short d_reclen;
+		unsigned char d_type;
+		char d_name[];
+	};
+#endif
+
+static DgStorageObjectType DgFilesystemTypeFromMode(mode_t mode) {
+	if (S_ISREG(mode)) {
+		return DG_STORAGE_TYPE_FILE;
+	}
+	else if (S_ISDIR(mode)) {
+		return DG_STORAGE_TYPE_FOLDER;
+	}
+	else if (S_ISLNK(mode)) {
+		return DG_STORAGE_TYPE_LINK;
+	}
+	else {
+		return DG_STORAGE_TYPE_OTHER;
+	}
+}
+
+static void DgFilesystemInfoFromStat(const struct stat *st, DgStorageInfo *info) {
+	info->type = DgFilesystemTypeFromMode(st->st_mode);
+	info->size = S_ISREG(st->st_mode) ? (uint64_t) st->st_size : 0;
+	info->modified = (int64_t) st->st_mtime;
+}
+#endif
+
 static DgError DgFilesystem_Type(DgStorage *storage, DgStoragePool *pool, DgStoragePath path, DgStorageObjectType *type) {
 	/**
 	 * Find the type of file at path
@@ -205,10 +248,291 @@ static DgError DgFilesystem_Type(DgStorage *storage, DgStoragePool *pool, DgStor
 	 * @return Error code
 	 */
 	
+#ifndef MELON_NO_POSIX
+	path = REAL_PATH(path);
+	
+	if (!path) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	struct stat info;
+	
+	type[0] = DG_STORAGE_TYPE_NONE;
+	
+	if (!lstat(path, &info)) {
+		type[0] = DgFilesystemTypeFromMode(info.st_mode);
+	}
+	
+	DgFree((void *) path);
+	
+	return DG_ERROR_SUCCESSFUL;
+#else
 	DgLog(DG_LOG_ERROR, "DgFilesystem_Type() is not implemented", path);
 	
 	return DG_ERROR_NOT_IMPLEMENTED;
+#endif
+}
+
+#ifndef MELON_NO_POSIX
+static DgError DgFilesystemListEntry(int folder, const char *name, unsigned char d_type, DgStorageListFlags flags, DgStorageListing *listing) {
+	/**
+	 * Add one directory entry to a listing, only calling fstatat when the
+	 * entry's type isn't enough.
+	 * 
+	 * @param folder File descriptor of the folder
+	 * @param name Name of the entry
+	 * @param d_type Type from the directory entry (DT_*)
+	 * @param flags What to find out about the entry
+	 * @param listing Listing to add to
+	 * @return Error code
+	 */
+	
+	if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	DgStorageInfo info = {0};
+	
+	switch (d_type) {
+		case DT_REG: info.type = DG_STORAGE_TYPE_FILE; break;
+		case DT_DIR: info.type = DG_STORAGE_TYPE_FOLDER; break;
+		case DT_LNK: info.type = DG_STORAGE_TYPE_LINK; break;
+		case DT_UNKNOWN: break;
+		default: info.type = DG_STORAGE_TYPE_OTHER; break;
+	}
+	
+	if ((flags & DG_STORAGE_LIST_INFO) || d_type == DT_UNKNOWN) {
+		struct stat st;
+		
+		// The entry could have been removed since it was read, so just leave
+		// it out in that case
+		if (fstatat(folder, name, &st, AT_SYMLINK_NOFOLLOW)) {
+			return DG_ERROR_SUCCESSFUL;
+		}
+		
+		DgFilesystemInfoFromStat(&st, &info);
+	}
+	
+	return DgStorageListingAppend(listing, name, DgStringLength(name), &info);
+}
+
+static DgError DgFilesystem_List(DgStorage *storage, DgStoragePool *pool, DgStoragePath path, DgStorageListFlags flags, DgStorageListing *listing) {
+	/**
+	 * List the contents of a folder
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the folder belongs to
+	 * @param path Folder name
+	 * @param flags What to find out about each entry
+	 * @param listing Listing to add the entries to
+	 * @return Error code
+	 */
+	
+	path = REAL_PATH(path);
+	
+	if (!path) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	int folder = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	
+	DgFree((void *) path);
+	
+	if (folder < 0) {
+		return (errno == ENOENT || errno == ENOTDIR) ? DG_ERROR_FILE_NOT_FOUND : DG_ERROR_FAILED;
+	}
+	
+	DgError status = DG_ERROR_SUCCESSFUL;
+	
+#ifdef DG_FILESYSTEM_GETDENTS
+	// Read entries in large batches straight from the kernel
+	_Alignas(struct DgLinuxDirent64) char buffer[DG_FILESYSTEM_DIRENT_BUFFER];
+	
+	while (!status) {
+		long count = syscall(SYS_getdents64, folder, buffer, sizeof buffer);
+		
+		if (count < 0 && errno == EINTR) {
+			continue;
+		}
+		else if (count < 0) {
+			status = DG_ERROR_FAILED;
+		}
+		else if (count == 0) {
+			break;
+		}
+		
+		for (long offset = 0; offset < count && !status;) {
+			struct DgLinuxDirent64 *entry = (struct DgLinuxDirent64 *) (buffer + offset);
+			
+			status = DgFilesystemListEntry(folder, entry->d_name, entry->d_type, flags, listing);
+			offset += entry->d_reclen;
+		}
+	}
+	
+	close(folder);
+#else
+	DIR *dir = fdopendir(folder);
+	
+	if (!dir) {
+		close(folder);
+		return DG_ERROR_FAILED;
+	}
+	
+	struct dirent *entry;
+	
+	while (!status && (entry = readdir(dir))) {
+		status = DgFilesystemListEntry(folder, entry->d_name, entry->d_type, flags, listing);
+	}
+	
+	closedir(dir);
+#endif
+	
+	return status;
+}
+
+static DgError DgFilesystem_Stat(DgStorage *storage, DgStoragePool *pool, DgStoragePath path, DgStorageInfo *info) {
+	/**
+	 * Find the metadata of the file at path. Links are followed.
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param path File name
+	 * @param info Where to put the result
+	 * @return Error code
+	 */
+	
+	path = REAL_PATH(path);
+	
+	if (!path) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	struct stat st;
+	int result = stat(path, &st);
+	
+	DgFree((void *) path);
+	
+	if (result) {
+		memset(info, 0, sizeof *info);
+		return (errno == ENOENT || errno == ENOTDIR) ? DG_ERROR_FILE_NOT_FOUND : DG_ERROR_FAILED;
+	}
+	
+	DgFilesystemInfoFromStat(&st, info);
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgFilesystemCopyRange(int input, int output, size_t length) {
+	/**
+	 * Copy `length` bytes between two file descriptors without them passing
+	 * through user space, using copy_file_range (which can share the blocks
+	 * on filesystems with reflinks) and then sendfile.
+	 * 
+	 * @return Error code, DG_ERROR_NOT_SUPPORTED if nothing could be copied
+	 * this way
+	 */
+	
+#ifdef __linux__
+	size_t done = 0;
+	
+#ifdef SYS_copy_file_range
+	while (done < length) {
+		long count = syscall(SYS_copy_file_range, input, NULL, output, NULL, length - done, 0);
+		
+		if (count < 0 && errno == EINTR) {
+			continue;
+		}
+		else if (count <= 0) {
+			break;
+		}
+		
+		done += count;
+	}
+#endif
+	
+	// sendfile works between more kinds of files, for example across
+	// filesystems on older kernels
+	while (done < length) {
+		ssize_t count = sendfile(output, input, NULL, length - done);
+		
+		if (count < 0 && errno == EINTR) {
+			continue;
+		}
+		else if (count < 0 && done == 0) {
+			return DG_ERROR_NOT_SUPPORTED;
+		}
+		else if (count <= 0) {
+			return DG_ERROR_FAILED;
+		}
+		
+		done += count;
+	}
+	
+	return DG_ERROR_SUCCESSFUL;
+#else
+	return DG_ERROR_NOT_SUPPORTED;
+#endif
+}
+
+static DgError DgFilesystem_Copy(DgStorage *storage, DgStoragePool *pool, DgStoragePath source, DgStoragePath destination) {
+	/**
+	 * Copy a file in this pool
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the files belong to
+	 * @param source File to copy
+	 * @param destination Where to copy it to
+	 * @return Error code
+	 */
+	
+	source = REAL_PATH(source);
+	destination = REAL_PATH(destination);
+	
+	DgError status = (source && destination) ? DG_ERROR_SUCCESSFUL : DG_ERROR_ALLOCATION_FAILED;
+	int input = -1, output = -1;
+	struct stat input_info, output_info;
+	
+	if (!status) {
+		input = open(source, O_RDONLY | O_CLOEXEC);
+		
+		if (input < 0 || fstat(input, &input_info)) {
+			status = DG_ERROR_FILE_NOT_FOUND;
+		}
+		else if (!S_ISREG(input_info.st_mode)) {
+			status = DG_ERROR_NOT_SUPPORTED;
+		}
+	}
+	
+	if (!status) {
+		DgFilesystemMakedirs(destination, false);
+		
+		// Not truncated until we know it isn't the source file
+		output = open(destination, O_WRONLY | O_CREAT | O_CLOEXEC, 0666);
+		
+		if (output < 0 || fstat(output, &output_info)) {
+			status = DG_ERROR_FAILED;
+		}
+	}
+	
+	// Copying a file onto itself leaves it as it is
+	if (!status && (input_info.st_dev != output_info.st_dev || input_info.st_ino != output_info.st_ino)) {
+		status = ftruncate(output, 0) ? DG_ERROR_FAILED : DgFilesystemCopyRange(input, output, input_info.st_size);
+	}
+	
+	if (input >= 0) {
+		close(input);
+	}
+	
+	if (output >= 0) {
+		close(output);
+	}
+	
+	DgMemoryFree((void *) source);
+	DgMemoryFree((void *) destination);
+	
+	return status;
 }
+#endif
 
 static DgError DgFilesystem_Open(DgStorage *storage, DgStoragePool *pool, DgStream *context, DgStoragePath path, DgStorageFlags flags) {
 	/**
@@ -390,6 +714,230 @@ static DgError DgFilesystem_Seek(DgStorage *storage, DgStoragePool *pool, DgStre
 	return DG_ERROR_SUCCESSFUL;
 }
 
+#ifndef MELON_NO_POSIX
+#define DG_FILESYSTEM_IOV_BATCH 16
+
+static DgError DgFilesystemTransferv(FILE *file, const DgStorageBuffer *buffers, size_t count, bool write) {
+	/**
+	 * Read or write several buffers at the stream's position using preadv or
+	 * pwritev, then move the stream past them.
+	 * 
+	 * @param file File to use
+	 * @param buffers Array of buffers
+	 * @param count Number of buffers
+	 * @param write True to write the buffers, false to read into them
+	 * @return Error code
+	 */
+	
+	// The FILE might have its own buffered data, so get it out of the way
+	// and find the real position
+	if (fflush(file)) {
+		return DG_ERROR_FAILED;
+	}
+	
+	off_t position = ftello(file);
+	
+	if (position < 0) {
+		return DG_ERROR_FAILED;
+	}
+	
+	int fd = fileno(file);
+	struct iovec iov[DG_FILESYSTEM_IOV_BATCH];
+	size_t next = 0; // Next buffer that isn't finished
+	size_t skip = 0; // Bytes of that buffer that are already done
+	DgError status = DG_ERROR_SUCCESSFUL;
+	
+	while (true) {
+		// Skip over finished and empty buffers
+		while (next < count && skip == buffers[next].size) {
+			next++;
+			skip = 0;
+		}
+		
+		if (next == count) {
+			break;
+		}
+		
+		int n = 0;
+		
+		for (size_t i = next; i < count && n < DG_FILESYSTEM_IOV_BATCH; i++) {
+			size_t offset = (i == next) ? skip : 0;
+			iov[n].iov_base = (uint8_t *) buffers[i].data + offset;
+			iov[n].iov_len = buffers[i].size - offset;
+			n++;
+		}
+		
+		ssize_t done = write ? pwritev(fd, iov, n, position) : preadv(fd, iov, n, position);
+		
+		if (done < 0 && errno == EINTR) {
+			continue;
+		}
+		
+		// Error, or end of file while reading
+		if (done <= 0) {
+			status = DG_ERROR_FAILED;
+			break;
+		}
+		
+		position += done;
+		
+		// Account for what was transferred
+		while (done) {
+			size_t remaining = buffers[next].size - skip;
+			
+			if ((size_t) done >= remaining) {
+				done -= remaining;
+				next++;
+				skip = 0;
+			}
+			else {
+				skip += done;
+				done = 0;
+			}
+		}
+	}
+	
+	if (fseeko(file, position, SEEK_SET)) {
+		return DG_ERROR_FAILED;
+	}
+	
+	return status;
+}
+
+static DgError DgFilesystem_Readv(DgStorage *storage, DgStoragePool *pool, DgStream *context, const DgStorageBuffer *buffers, size_t count) {
+	/**
+	 * Read from a file stream into several buffers
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param context Stream object
+	 * @param buffers Buffers to read into
+	 * @param count Number of buffers
+	 * @return Error code
+	 */
+	
+	return DgFilesystemTransferv((FILE *) context->context, buffers, count, false);
+}
+
+static DgError DgFilesystem_Writev(DgStorage *storage, DgStoragePool *pool, DgStream *context, const DgStorageBuffer *buffers, size_t count) {
+	/**
+	 * Write several buffers to a file stream
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param context Stream object
+	 * @param buffers Buffers to write out
+	 * @param count Number of buffers
+	 * @return Error code
+	 */
+	
+	return DgFilesystemTransferv((FILE *) context->context, buffers, count, true);
+}
+
+static DgError DgFilesystem_Map(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t offset, size_t length, DgStorageMapFlags flags, DgStorageMapping *mapping) {
+	/**
+	 * Map part of a file stream into memory
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param context Stream object
+	 * @param offset Offset of the first byte to map
+	 * @param length Number of bytes to map, or zero for the rest of the file
+	 * @param flags Access pattern hints
+	 * @param mapping Where to store the mapping
+	 * @return Error code
+	 */
+	
+	FILE *file = (FILE *) context->context;
+	
+	// Anything still buffered needs to be in the file before we map it
+	fflush(file);
+	
+	int fd = fileno(file);
+	struct stat info;
+	
+	if (fstat(fd, &info)) {
+		return DG_ERROR_FAILED;
+	}
+	
+	size_t size = (size_t) info.st_size;
+	
+	if (offset > size) {
+		return DG_ERROR_OUT_OF_RANGE;
+	}
+	
+	if (!length) {
+		length = size - offset;
+	}
+	else if (length > size - offset) {
+		return DG_ERROR_OUT_OF_RANGE;
+	}
+	
+	mapping->storage = storage;
+	mapping->functions = pool->functions;
+	mapping->length = length;
+	
+	// Mapping zero bytes is an error for mmap, but not for us
+	if (!length) {
+		mapping->data = NULL;
+		mapping->base = NULL;
+		mapping->base_length = 0;
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	// The offset passed to mmap must be page aligned
+	size_t page = (size_t) sysconf(_SC_PAGESIZE);
+	size_t aligned = offset - (offset % page);
+	size_t base_length = length + (offset - aligned);
+	
+	void *base = mmap(NULL, base_length, PROT_READ, MAP_PRIVATE, fd, (off_t) aligned);
+	
+	if (base == MAP_FAILED) {
+		mapping->functions = NULL;
+		return DG_ERROR_FAILED;
+	}
+	
+	int advice = MADV_NORMAL;
+	
+	if (flags & DG_STORAGE_MAP_SEQUENTIAL) {
+		advice = MADV_SEQUENTIAL;
+	}
+	else if (flags & DG_STORAGE_MAP_RANDOM) {
+		advice = MADV_RANDOM;
+	}
+	
+	if (advice != MADV_NORMAL) {
+		madvise(base, base_length, advice);
+	}
+	
+	if (flags & DG_STORAGE_MAP_WILL_NEED) {
+		madvise(base, base_length, MADV_WILLNEED);
+	}
+	
+	mapping->base = base;
+	mapping->base_length = base_length;
+	mapping->data = (const uint8_t *) base + (offset - aligned);
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgFilesystem_Unmap(DgStorage *storage, DgStorageMapping *mapping) {
+	/**
+	 * Release a mapping made by DgFilesystem_Map
+	 * 
+	 * @param storage Storage object
+	 * @param mapping The mapping to release
+	 * @return Error code
+	 */
+	
+	if (mapping->base && munmap(mapping->base, mapping->base_length)) {
+		return DG_ERROR_FAILED;
+	}
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+#endif
+
 static DgError DgFilesystem_FreeSpecificConfig(DgStoragePool *pool) {
 	DgFree((void *) ((DgFilesytem_SpecificConfig *) pool->specific_config)->basedir);
 	DgFree(pool->specific_config);
@@ -412,9 +960,37 @@ DgStorageFunctions gStorageFilesystemFunctions = {
 	.get_position = &DgFilesystem_GetPosition,
 	.set_position = &DgFilesystem_SetPosition,
 	.seek = &DgFilesystem_Seek,
+#ifndef MELON_NO_POSIX
+	.list = &DgFilesystem_List,
+	.stat = &DgFilesystem_Stat,
+	.copy = &DgFilesystem_Copy,
+	.readv = &DgFilesystem_Readv,
+	.writev = &DgFilesystem_Writev,
+	.map = &DgFilesystem_Map,
+	.unmap = &DgFilesystem_Unmap,
+#endif
 	.free_specific_config = &DgFilesystem_FreeSpecificConfig,
 };
 
+char *DgFilesystemGetRealPath(DgStoragePool *pool, DgStoragePath path) {
+	/**
+	 * Find the path on the real filesystem that `path` refers to, for code
+	 * that wants to bypass streams (like the async queue).
+	 * 
+	 * @warning You need to free the string returned by this function!
+	 * 
+	 * @param pool Pool that the file belongs to
+	 * @param path Full path to the file (including protocol)
+	 * @return Real path, or NULL if the pool isn't a filesystem pool or on failure
+	 */
+	
+	if (pool->functions != &gStorageFilesystemFunctions) {
+		return NULL;
+	}
+	
+	return (char *) DgFilesystemRealPath(((DgFilesytem_SpecificConfig *) pool->specific_config)->basedir, path);
+}
+
 DgStoragePool *DgFilesystemCreatePool(const char *protocol, const char *basedir) {
 	/**
 	 * Create a filesystem-based pool
@@ -432,7 +1008,7 @@ DgStoragePool *DgFilesystemCreatePool(const char *protocol, const char *basedir)
 	
 	pool->protocol = DgStringDuplicate(protocol);
 	pool->functions = &gStorageFilesystemFunctions;
-	pool->specific_config = DgAlloc(sizeof *pool->specific_config);
+	pool->specific_config = DgAlloc(sizeof(DgFilesytem_SpecificConfig));
 	
 	if (!pool->specific_config) {
 		DgFree(pool);
@@ -17,3 +17,4 @@
 #include "storage.h"
 
 DgStoragePool *DgFilesystemCreatePool(const char *protocol, const char *basedir);
+char *DgFilesystemGetRealPath(DgStoragePool *pool, DgStoragePath path);
@@ -21,3 +21,25 @@ DgError DgStreamWriteInt64(DgStream *context, int64_t data);
 DgError DgStreamWriteUInt64(DgStream *context, uint64_t data);
 DgError DgStreamWriteFloat32(DgStream *context, float data);
 DgError DgStreamWriteFloat64(DgStream *context, double data);
+// Array reads
+DgError DgStreamReadArrayInt8(DgStream *context, size_t count, int8_t* data, DgByteOrder order);
+DgError DgStreamReadArrayUInt8(DgStream *context, size_t count, uint8_t* data, DgByteOrder order);
+DgError DgStreamReadArrayInt16(DgStream *context, size_t count, int16_t* data, DgByteOrder order);
+DgError DgStreamReadArrayUInt16(DgStream *context, size_t count, uint16_t* data, DgByteOrder order);
+DgError DgStreamReadArrayInt32(DgStream *context, size_t count, int32_t* data, DgByteOrder order);
+DgError DgStreamReadArrayUInt32(DgStream *context, size_t count, uint32_t* data, DgByteOrder order);
+DgError DgStreamReadArrayInt64(DgStream *context, size_t count, int64_t* data, DgByteOrder order);
+DgError DgStreamReadArrayUInt64(DgStream *context, size_t count, uint64_t* data, DgByteOrder order);
+DgError DgStreamReadArrayFloat32(DgStream *context, size_t count, float* data, DgByteOrder order);
+DgError DgStreamReadArrayFloat64(DgStream *context, size_t count, double* data, DgByteOrder order);
+// Array writes
+DgError DgStreamWriteArrayInt8(DgStream *context, size_t count, const int8_t* data, DgByteOrder order);
+DgError DgStreamWriteArrayUInt8(DgStream *context, size_t count, const uint8_t* data, DgByteOrder order);
+DgError DgStreamWriteArrayInt16(DgStream *context, size_t count, const int16_t* data, DgByteOrder order);
+DgError DgStreamWriteArrayUInt16(DgStream *context, size_t count, const uint16_t* data, DgByteOrder order);
+DgError DgStreamWriteArrayInt32(DgStream *context, size_t count, const int32_t* data, DgByteOrder order);
+DgError DgStreamWriteArrayUInt32(DgStream *context, size_t count, const uint32_t* data, DgByteOrder order);
+DgError DgStreamWriteArrayInt64(DgStream *context, size_t count, const int64_t* data, DgByteOrder order);
+DgError DgStreamWriteArrayUInt64(DgStream *context, size_t count, const uint64_t* data, DgByteOrder order);
+DgError DgStreamWriteArrayFloat32(DgStream *context, size_t count, const float* data, DgByteOrder order);
+DgError DgStreamWriteArrayFloat64(DgStream *context, size_t count, const double* data, DgByteOrder order);
@@ -0,0 +1,365 @@
+/**
+ * Copyright (C) 2021 - 2024 Knot126
+ * 
+ * It is against the licence terms of this software to use it or it's source code
+ * as input for training a machine learning model, or in the development of a
+ * machine learning model. If you have found this text as the output of a machine
+ * learning algorithm, please report it both your software vendor and to the
+ * developers of the software at [https://github.com/knot126/Melon/issues].
+ * 
+ * =============================================================================
+ * 
+ * Streams over memory
+ * 
+ * @note These make a DgStream that reads and writes a DgMemoryStream or a
+ * buffer owned by the caller, so that everything which takes a DgStream (like
+ * serialisation) can work in memory. They don't go through a DgStorage, so
+ * they are opened directly instead of with a path, and belong to pools that
+ * are never added to a storage object.
+ */
+
+#include "common.h"
+#include "alloc.h"
+#include "log.h"
+
+#include "storage_memory.h"
+
+typedef struct DgBufferStream {
+	uint8_t *data;
+	size_t capacity;                // Size of the caller's buffer
+	size_t length;                  // Bytes of the buffer that hold data
+	size_t position;
+	DgStorageFlags flags;
+} DgBufferStream;
+
+DgStorageFunctions gStorageMemoryFunctions;
+DgStorageFunctions gStorageBufferFunctions;
+
+static DgStoragePool gStorageMemoryPool = {
+	.protocol = "memory",
+	.functions = &gStorageMemoryFunctions,
+};
+
+static DgStoragePool gStorageBufferPool = {
+	.protocol = "buffer",
+	.functions = &gStorageBufferFunctions,
+};
+
+#define MEMORY() ((DgMemoryStream *) context->context)
+#define STREAM() ((DgBufferStream *) context->context)
+
+static void DgStreamOpenDirect(DgStream *context, DgStoragePool *pool, void *data) {
+	/**
+	 * Set up a stream that doesn't come from a storage object, the same way
+	 * DgStreamOpen would
+	 */
+	
+	context->storage = NULL;
+	context->pool = pool;
+	context->context = data;
+	
+	context->buffer = NULL;
+	context->buffer_size = 0;
+	context->buffer_head = 0;
+	context->buffer_length = 0;
+	context->buffer_position = 0;
+	context->buffer_file_length = SIZE_MAX;
+	context->buffer_mode = DG_STREAM_BUFFER_NONE;
+}
+
+static DgError DgMemoryStreamStatus(DgMemoryStream *memory) {
+	switch (DgMemoryStreamError(memory)) {
+		case DG_MEMORY_STREAM_OKAY: return DG_ERROR_SUCCESSFUL;
+		case DG_MEMORY_STREAM_ALLOC_ERROR: return DG_ERROR_ALLOCATION_FAILED;
+		case DG_MEMORY_STREAM_RANGE: return DG_ERROR_OUT_OF_RANGE;
+		default: return DG_ERROR_FAILED;
+	}
+}
+
+/**
+ * Memory stream functions
+ */
+
+static DgError DgMemory_Close(DgStorage *storage, DgStoragePool *pool, DgStream *context) {
+	// The memory stream belongs to the caller
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgMemory_Read(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t size, void *buffer) {
+	DgMemoryStream *memory = MEMORY();
+	
+	if (!size) {
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	// Reading past the end fails like it does for files
+	if (size > DgMemoryStreamLength(memory) - DgMemoryStreamGetpos(memory)) {
+		return DG_ERROR_FAILED;
+	}
+	
+	DgMemoryStreamRead(memory, size, buffer);
+	
+	return DgMemoryStreamStatus(memory);
+}
+
+static DgError DgMemory_Write(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t size, void *buffer) {
+	DgMemoryStream *memory = MEMORY();
+	
+	DgMemoryStreamWrite(memory, size, buffer);
+	
+	return DgMemoryStreamStatus(memory);
+}
+
+static DgError DgMemory_GetPosition(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t *position) {
+	position[0] = DgMemoryStreamGetpos(MEMORY());
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgMemory_SetPosition(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t position) {
+	DgMemoryStream *memory = MEMORY();
+	
+	DgMemoryStreamSetpos(memory, DG_MEMORY_STREAM_SET, position);
+	
+	return DgMemoryStreamStatus(memory);
+}
+
+static DgError DgMemory_Seek(DgStorage *storage, DgStoragePool *pool, DgStream *context, DgStorageSeekBase base, int64_t offset) {
+	DgMemoryStream *memory = MEMORY();
+	DgMemoryStreamEnum from;
+	
+	switch (base) {
+		case DG_STORAGE_SEEK_RELATIVE: from = DG_MEMORY_STREAM_CUR; break;
+		case DG_STORAGE_SEEK_START:    from = DG_MEMORY_STREAM_SET; break;
+		case DG_STORAGE_SEEK_END:      from = DG_MEMORY_STREAM_END; break;
+		default: return DG_ERROR_NOT_SUPPORTED;
+	}
+	
+	DgMemoryStreamSetpos(memory, from, offset);
+	
+	return DgMemoryStreamStatus(memory);
+}
+
+static DgError DgMemory_Writev(DgStorage *storage, DgStoragePool *pool, DgStream *context, const DgStorageBuffer *buffers, size_t count) {
+	DgMemoryStream *memory = MEMORY();
+	
+	for (size_t i = 0; i < count; i++) {
+		DgMemoryStreamWrite(memory, buffers[i].size, buffers[i].data);
+	}
+	
+	return DgMemoryStreamStatus(memory);
+}
+
+static DgError DgMemory_Map(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t offset, size_t length, DgStorageMapFlags flags, DgStorageMapping *mapping) {
+	/**
+	 * Get a pointer into the memory stream. Chunked streams are flattened
+	 * first. The mapping is only valid until the memory stream is changed.
+	 */
+	
+	DgMemoryStream *memory = MEMORY();
+	size_t size;
+	void *data;
+	
+	DgMemoryStreamGetPointersAndSize(memory, &size, &data);
+	
+	DgError status = DgMemoryStreamStatus(memory);
+	
+	if (status) {
+		return status;
+	}
+	
+	if (offset > size || length > size - offset) {
+		return DG_ERROR_OUT_OF_RANGE;
+	}
+	
+	mapping->data = (uint8_t *) data + offset;
+	mapping->length = length ? length : size - offset;
+	mapping->functions = pool->functions;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgMemory_Unmap(DgStorage *storage, DgStorageMapping *mapping) {
+	return DG_ERROR_SUCCESSFUL;
+}
+
+DgStorageFunctions gStorageMemoryFunctions = {
+	.close = &DgMemory_Close,
+	.read = &DgMemory_Read,
+	.write = &DgMemory_Write,
+	.get_position = &DgMemory_GetPosition,
+	.set_position = &DgMemory_SetPosition,
+	.seek = &DgMemory_Seek,
+	.writev = &DgMemory_Writev,
+	.map = &DgMemory_Map,
+	.unmap = &DgMemory_Unmap,
+};
+
+DgError DgStreamOpenMemory(DgStream *context, DgMemoryStream *memory) {
+	/**
+	 * Open a stream that reads and writes a memory stream, starting at the
+	 * memory stream's current position. The memory stream is not freed when
+	 * the stream is closed.
+	 * 
+	 * @param context Stream object
+	 * @param memory Memory stream to use
+	 * @return Error code
+	 */
+	
+	if (!memory) {
+		return DG_ERROR_NOT_SAFE;
+	}
+	
+	DgStreamOpenDirect(context, &gStorageMemoryPool, memory);
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+/**
+ * Buffer stream functions
+ */
+
+static DgError DgBuffer_Close(DgStorage *storage, DgStoragePool *pool, DgStream *context) {
+	DgFree(STREAM());
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgBuffer_Read(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t size, void *buffer) {
+	DgBufferStream *stream = STREAM();
+	
+	if (!(stream->flags & DG_STREAM_READ)) {
+		return DG_ERROR_NOT_SUPPORTED;
+	}
+	
+	if (stream->position > stream->length || size > stream->length - stream->position) {
+		return DG_ERROR_FAILED;
+	}
+	
+	memcpy(buffer, stream->data + stream->position, size);
+	stream->position += size;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgBuffer_Write(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t size, void *buffer) {
+	DgBufferStream *stream = STREAM();
+	
+	if (!(stream->flags & DG_STREAM_WRITE)) {
+		return DG_ERROR_READ_ONLY;
+	}
+	
+	// The buffer can't grow
+	if (stream->position > stream->capacity || size > stream->capacity - stream->position) {
+		return DG_ERROR_OUT_OF_RANGE;
+	}
+	
+	memcpy(stream->data + stream->position, buffer, size);
+	stream->position += size;
+	
+	if (stream->position > stream->length) {
+		stream->length = stream->position;
+	}
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgBuffer_GetPosition(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t *position) {
+	position[0] = STREAM()->position;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgBuffer_SetPosition(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t position) {
+	DgBufferStream *stream = STREAM();
+	
+	if (position > stream->length) {
+		return DG_ERROR_OUT_OF_RANGE;
+	}
+	
+	stream->position = position;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgBuffer_Seek(DgStorage *storage, DgStoragePool *pool, DgStream *context, DgStorageSeekBase base, int64_t offset) {
+	DgBufferStream *stream = STREAM();
+	int64_t position;
+	
+	switch (base) {
+		case DG_STORAGE_SEEK_RELATIVE: position = stream->position; break;
+		case DG_STORAGE_SEEK_START:    position = 0; break;
+		case DG_STORAGE_SEEK_END:      position = stream->length; break;
+		default: return DG_ERROR_NOT_SUPPORTED;
+	}
+	
+	position += offset;
+	
+	if (position < 0) {
+		return DG_ERROR_OUT_OF_RANGE;
+	}
+	
+	return DgBuffer_SetPosition(storage, pool, context, position);
+}
+
+static DgError DgBuffer_Map(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t offset, size_t length, DgStorageMapFlags flags, DgStorageMapping *mapping) {
+	DgBufferStream *stream = STREAM();
+	
+	if (offset > stream->length || length > stream->length - offset) {
+		return DG_ERROR_OUT_OF_RANGE;
+	}
+	
+	mapping->data = stream->data + offset;
+	mapping->length = length ? length : stream->length - offset;
+	mapping->functions = pool->functions;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+DgStorageFunctions gStorageBufferFunctions = {
+	.close = &DgBuffer_Close,
+	.read = &DgBuffer_Read,
+	.write = &DgBuffer_Write,
+	.get_position = &DgBuffer_GetPosition,
+	.set_position = &DgBuffer_SetPosition,
+	.seek = &DgBuffer_Seek,
+	.map = &DgBuffer_Map,
+	.unmap = &DgMemory_Unmap,
+};
+
+DgError DgStreamOpenBuffer(DgStream *context, void *buffer, size_t size, DgStorageFlags flags) {
+	/**
+	 * Open a stream over a buffer that belongs to the caller. The buffer never
+	 * grows, so writing past its end fails with DG_ERROR_OUT_OF_RANGE.
+	 * 
+	 * @note Like files, a stream opened only for writing starts empty and
+	 * DgStreamLength gives how much has been written, while a stream opened
+	 * for reading starts with all `size` bytes.
+	 * 
+	 * @param context Stream object
+	 * @param buffer Buffer to read and write, which must outlive the stream
+	 * @param size Size of the buffer in bytes
+	 * @param flags DG_STREAM_READ, DG_STREAM_WRITE and DG_STREAM_START_AT_END
+	 * @return Error code
+	 */
+	
+	if (!buffer && size) {
+		return DG_ERROR_NOT_SAFE;
+	}
+	
+	DgBufferStream *stream = DgAlloc(sizeof *stream);
+	
+	if (!stream) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	stream->data = buffer;
+	stream->capacity = size;
+	stream->length = (flags & DG_STREAM_READ) ? size : 0;
+	stream->position = (flags & DG_STREAM_START_AT_END) ? stream->length : 0;
+	stream->flags = flags;
+	
+	DgStreamOpenDirect(context, &gStorageBufferPool, stream);
+	
+	return DG_ERROR_SUCCESSFUL;
+}
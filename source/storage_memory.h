@@ -0,0 +1,23 @@
+/**
+ * Copyright (C) 2021 - 2024 Knot126
+ * 
+ * It is against the licence terms of this software to use it or it's source code
+ * as input for training a machine learning model, or in the development of a
+ * machine learning model. If you have found this text as the output of a machine
+ * learning algorithm, please report it both your software vendor and to the
+ * developers of the software at [https://github.com/knot126/Melon/issues].
+ * 
+ * =============================================================================
+ * 
+ * Streams over memory
+ */
+
+#pragma once
+
+#include "common.h"
+#include "error.h"
+#include "storage.h"
+#include "stream.h"
+
+DgError DgStreamOpenMemory(DgStream *context, DgMemoryStream *memory);
+DgError DgStreamOpenBuffer(DgStream *context, void *buffer, size_t size, DgStorageFlags flags);
@@ -0,0 +1,426 @@
+/**
+ * Copyright (C) 2021 - 2024 Knot126
+ * 
+ * It is against the licence terms of this software to use it or it's source code
+ * as input for training a machine learning model, or in the development of a
+ * machine learning model. If you have found this text as the output of a machine
+ * learning algorithm, please report it both your software vendor and to the
+ * developers of the software at [https://github.com/knot126/Melon/issues].
+ * 
+ * =============================================================================
+ * 
+ * Storage I/O metrics
+ * 
+ * @note When metrics are enabled, every call that storage.c makes into a pool
+ * is timed with the monotonic clock and counted. Each thread counts into its
+ * own records so recording never takes a lock; the lock is only taken the
+ * first time a thread records something and when the records are read.
+ * 
+ * @note When a thread exits its records are added into the retired records
+ * and freed, so programs that make many short lived threads don't keep their
+ * records forever.
+ * 
+ * @note Snapshots are taken while other threads may still be counting, so a
+ * snapshot can be a little behind but never blocks the threads doing I/O.
+ */
+
+#ifndef _WIN32
+	#include <pthread.h>
+#else
+	#include <windows.h>
+#endif
+
+#include "common.h"
+#include "alloc.h"
+#include "string.h"
+#include "thread.h"
+#include "time.h"
+#include "value.h"
+#include "log.h"
+
+#include "storage_metrics.h"
+
+typedef struct DgStorageMetricsRecord {
+	char *protocol;
+	uint64_t calls[DG_STORAGE_OP_COUNT];
+	uint64_t errors[DG_STORAGE_OP_COUNT];
+	uint64_t bytes[DG_STORAGE_OP_COUNT];
+	uint64_t time[DG_STORAGE_OP_COUNT];        // Total nanoseconds
+	uint64_t latency[DG_STORAGE_OP_COUNT][DG_STORAGE_METRICS_BUCKETS];
+} DgStorageMetricsRecord;
+
+typedef struct DgStorageMetricsThread {
+	// Records never move once they are made, and the count is only increased
+	// after the record is ready, so they can be read from other threads
+	DgStorageMetricsRecord *record[DG_STORAGE_METRICS_MAX_POOLS];
+	size_t record_count;
+	DgStorageMetricsRecord *last;              // Last record used
+	struct DgStorageMetricsThread *next;
+} DgStorageMetricsThread;
+
+static const char *gStorageOperationNames[DG_STORAGE_OP_COUNT] = {
+	"open", "close", "read", "write", "seek", "map", "metadata", "change",
+};
+
+static bool gStorageMetricsEnabled;
+static bool gStorageMetricsLockReady;
+static DgMutex gStorageMetricsLock;
+static _Thread_local DgStorageMetricsThread *gStorageMetricsThread;
+
+// Records of threads that have exited. This is always the last in the list of
+// threads, since new threads are added to the front.
+static DgStorageMetricsThread gStorageMetricsRetired;
+static DgStorageMetricsThread *gStorageMetricsThreads = &gStorageMetricsRetired;
+
+// Used to find out when a thread that has records exits
+#ifndef _WIN32
+static pthread_key_t gStorageMetricsExitKey;
+#else
+static DWORD gStorageMetricsExitKey;
+#endif
+
+static void DgStorageMetricsAddRecord(DgStorageMetricsRecord *total, const DgStorageMetricsRecord *record) {
+	for (size_t op = 0; op < DG_STORAGE_OP_COUNT; op++) {
+		total->calls[op] += record->calls[op];
+		total->errors[op] += record->errors[op];
+		total->bytes[op] += record->bytes[op];
+		total->time[op] += record->time[op];
+		
+		for (size_t b = 0; b < DG_STORAGE_METRICS_BUCKETS; b++) {
+			total->latency[op][b] += record->latency[op][b];
+		}
+	}
+}
+
+static void DgStorageMetricsRetireThread(DgStorageMetricsThread *thread) {
+	/**
+	 * Add the records of a thread that is exiting into the retired records and
+	 * free them. If there are too many protocols for the retired records to
+	 * hold, the ones that don't fit are kept with the thread.
+	 * 
+	 * @param thread Records of the exiting thread
+	 */
+	
+	DgStorageMetricsThread *retired = &gStorageMetricsRetired;
+	size_t kept = 0;
+	
+	DgMutexLock(&gStorageMetricsLock);
+	
+	for (size_t i = 0; i < thread->record_count; i++) {
+		DgStorageMetricsRecord *record = thread->record[i];
+		size_t j = 0;
+		
+		while (j < retired->record_count && !DgStringEqual(retired->record[j]->protocol, record->protocol)) {
+			j++;
+		}
+		
+		if (j < retired->record_count) {
+			DgStorageMetricsAddRecord(retired->record[j], record);
+			DgFree(record->protocol);
+			DgFree(record);
+		}
+		else if (retired->record_count < DG_STORAGE_METRICS_MAX_POOLS) {
+			retired->record[retired->record_count] = record;
+			retired->record_count++;
+		}
+		else {
+			thread->record[kept] = record;
+			kept++;
+		}
+	}
+	
+	thread->record_count = kept;
+	thread->last = NULL;
+	
+	if (!kept) {
+		DgStorageMetricsThread **link = &gStorageMetricsThreads;
+		
+		while (*link != thread) {
+			link = &(*link)->next;
+		}
+		
+		*link = thread->next;
+		
+		DgFree(thread);
+	}
+	
+	DgMutexUnlock(&gStorageMetricsLock);
+}
+
+#ifndef _WIN32
+static void DgStorageMetricsThreadExit(void *thread) {
+	DgStorageMetricsRetireThread(thread);
+}
+#else
+static void WINAPI DgStorageMetricsThreadExit(void *thread) {
+	if (thread) {
+		DgStorageMetricsRetireThread(thread);
+	}
+}
+#endif
+
+void DgStorageMetricsEnable(bool enabled) {
+	/**
+	 * Turn recording metrics on or off. This is off by default.
+	 * 
+	 * @note The first call should be made before other threads use storage.
+	 * 
+	 * @param enabled If metrics should be recorded
+	 */
+	
+	if (!gStorageMetricsLockReady) {
+		DgMutexInit(&gStorageMetricsLock);
+#ifndef _WIN32
+		pthread_key_create(&gStorageMetricsExitKey, DgStorageMetricsThreadExit);
+#else
+		gStorageMetricsExitKey = FlsAlloc(DgStorageMetricsThreadExit);
+#endif
+		gStorageMetricsLockReady = true;
+	}
+	
+	gStorageMetricsEnabled = enabled;
+}
+
+uint64_t DgStorageMetricsBegin(void) {
+	/**
+	 * Start timing a call into a pool
+	 * 
+	 * @return Start time to pass to DgStorageMetricsEnd, or zero if metrics
+	 * are off
+	 */
+	
+	return gStorageMetricsEnabled ? DgMonotonicTime() : 0;
+}
+
+static DgStorageMetricsRecord *DgStorageMetricsFindRecord(DgStoragePool *pool) {
+	/**
+	 * Find the calling thread's record for a pool, making it if needed
+	 * 
+	 * @param pool Pool to find the record for
+	 * @return Record, or NULL if it could not be made
+	 */
+	
+	DgStorageMetricsThread *thread = gStorageMetricsThread;
+	
+	if (thread && thread->last && (thread->last->protocol == pool->protocol || DgStringEqual(thread->last->protocol, pool->protocol))) {
+		return thread->last;
+	}
+	
+	if (!thread) {
+		thread = DgAlloc(sizeof *thread);
+		
+		if (!thread) {
+			return NULL;
+		}
+		
+		memset(thread, 0, sizeof *thread);
+		
+		DgMutexLock(&gStorageMetricsLock);
+		thread->next = gStorageMetricsThreads;
+		gStorageMetricsThreads = thread;
+		DgMutexUnlock(&gStorageMetricsLock);
+		
+		gStorageMetricsThread = thread;
+		
+#ifndef _WIN32
+		pthread_setspecific(gStorageMetricsExitKey, thread);
+#else
+		FlsSetValue(gStorageMetricsExitKey, thread);
+#endif
+	}
+	
+	for (size_t i = 0; i < thread->record_count; i++) {
+		if (DgStringEqual(thread->record[i]->protocol, pool->protocol)) {
+			thread->last = thread->record[i];
+			return thread->last;
+		}
+	}
+	
+	if (thread->record_count >= DG_STORAGE_METRICS_MAX_POOLS) {
+		return NULL;
+	}
+	
+	DgStorageMetricsRecord *record = DgAlloc(sizeof *record);
+	
+	if (!record) {
+		return NULL;
+	}
+	
+	memset(record, 0, sizeof *record);
+	record->protocol = DgStringDuplicate(pool->protocol);
+	
+	if (!record->protocol) {
+		DgFree(record);
+		return NULL;
+	}
+	
+	DgMutexLock(&gStorageMetricsLock);
+	thread->record[thread->record_count] = record;
+	thread->record_count++;
+	DgMutexUnlock(&gStorageMetricsLock);
+	
+	thread->last = record;
+	
+	return record;
+}
+
+void DgStorageMetricsEnd(DgStoragePool *pool, DgStorageOperation operation, uint64_t start, uint64_t bytes, DgError status) {
+	/**
+	 * Finish timing a call into a pool and count it
+	 * 
+	 * @param pool Pool that was called
+	 * @param operation Kind of call
+	 * @param start Time from DgStorageMetricsBegin
+	 * @param bytes Bytes that the call moved
+	 * @param status What the call returned
+	 */
+	
+	if (!start) {
+		return;
+	}
+	
+	uint64_t elapsed = DgMonotonicTime() - start;
+	DgStorageMetricsRecord *record = DgStorageMetricsFindRecord(pool);
+	
+	if (!record) {
+		return;
+	}
+	
+	// Bucket is the position of the highest set bit
+	size_t bucket = 0;
+	
+	while (bucket + 1 < DG_STORAGE_METRICS_BUCKETS && (elapsed >> (bucket + 1))) {
+		bucket++;
+	}
+	
+	record->calls[operation]++;
+	record->time[operation] += elapsed;
+	record->latency[operation][bucket]++;
+	
+	if (status) {
+		record->errors[operation]++;
+	}
+	else {
+		record->bytes[operation] += bytes;
+	}
+}
+
+static void DgStorageMetricsSet(DgTable *table, const char *protocol, const char *operation, const char *name, uint64_t value) {
+	char key[160];
+	
+	snprintf(key, sizeof key, "%s.%s.%s", protocol, operation, name);
+	
+	DgValue k = DgMakeString(key);
+	DgValue v = DgMakeUInt64(value);
+	
+	DgTableSet(table, &k, &v);
+}
+
+DgError DgStorageMetricsSnapshot(DgTable *table) {
+	/**
+	 * Make a table of the metrics recorded so far, added up over every thread.
+	 * Keys are "<protocol>.<operation>.<name>" and values are UInt64s, where
+	 * the names are "calls", "errors", "bytes", "time_ns" and "latency.<n>" for
+	 * the count of calls that took from 2^n up to 2^(n+1) nanoseconds. Only
+	 * operations and buckets that have been used are included.
+	 * 
+	 * @param table Table to initialise and fill, free with DgTableFree
+	 * @return Error code
+	 */
+	
+	DgError status = DgTableInit(table);
+	
+	if (status || !gStorageMetricsLockReady) {
+		return status;
+	}
+	
+	DgStorageMetricsRecord *total = NULL;
+	size_t total_count = 0;
+	
+	DgMutexLock(&gStorageMetricsLock);
+	
+	for (DgStorageMetricsThread *thread = gStorageMetricsThreads; thread && !status; thread = thread->next) {
+		for (size_t i = 0; i < thread->record_count && !status; i++) {
+			DgStorageMetricsRecord *record = thread->record[i];
+			size_t j = 0;
+			
+			while (j < total_count && !DgStringEqual(total[j].protocol, record->protocol)) {
+				j++;
+			}
+			
+			if (j == total_count) {
+				DgStorageMetricsRecord *array = DgMemoryReallocate(total, sizeof *total * (total_count + 1));
+				
+				if (!array) {
+					status = DG_ERROR_ALLOCATION_FAILED;
+					break;
+				}
+				
+				total = array;
+				memset(&total[j], 0, sizeof *total);
+				total[j].protocol = record->protocol;
+				total_count++;
+			}
+			
+			DgStorageMetricsAddRecord(&total[j], record);
+		}
+	}
+	
+	// Protocol strings belong to the records, which can be freed when a thread
+	// exits, so the lock is held until the table is made
+	for (size_t j = 0; j < total_count && !status; j++) {
+		for (size_t op = 0; op < DG_STORAGE_OP_COUNT; op++) {
+			if (!total[j].calls[op]) {
+				continue;
+			}
+			
+			const char *name = gStorageOperationNames[op];
+			
+			DgStorageMetricsSet(table, total[j].protocol, name, "calls", total[j].calls[op]);
+			DgStorageMetricsSet(table, total[j].protocol, name, "errors", total[j].errors[op]);
+			DgStorageMetricsSet(table, total[j].protocol, name, "bytes", total[j].bytes[op]);
+			DgStorageMetricsSet(table, total[j].protocol, name, "time_ns", total[j].time[op]);
+			
+			for (size_t b = 0; b < DG_STORAGE_METRICS_BUCKETS; b++) {
+				if (total[j].latency[op][b]) {
+					char bucket[16];
+					
+					snprintf(bucket, sizeof bucket, "latency.%zu", b);
+					DgStorageMetricsSet(table, total[j].protocol, name, bucket, total[j].latency[op][b]);
+				}
+			}
+		}
+	}
+	
+	DgMutexUnlock(&gStorageMetricsLock);
+	
+	DgMemoryFree(total);
+	
+	return status;
+}
+
+void DgStorageMetricsReset(void) {
+	/**
+	 * Set every recorded metric back to zero
+	 */
+	
+	if (!gStorageMetricsLockReady) {
+		return;
+	}
+	
+	DgMutexLock(&gStorageMetricsLock);
+	
+	for (DgStorageMetricsThread *thread = gStorageMetricsThreads; thread; thread = thread->next) {
+		for (size_t i = 0; i < thread->record_count; i++) {
+			DgStorageMetricsRecord *record = thread->record[i];
+			
+			memset(record->calls, 0, sizeof record->calls);
+			memset(record->errors, 0, sizeof record->errors);
+			memset(record->bytes, 0, sizeof record->bytes);
+			memset(record->time, 0, sizeof record->time);
+			memset(record->latency, 0, sizeof record->latency);
+		}
+	}
+	
+	DgMutexUnlock(&gStorageMetricsLock);
+}
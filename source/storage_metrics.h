@@ -0,0 +1,48 @@
+/**
+ * Copyright (C) 2021 - 2024 Knot126
+ * 
+ * It is against the licence terms of this software to use it or it's source code
+ * as input for training a machine learning model, or in the development of a
+ * machine learning model. If you have found this text as the output of a machine
+ * learning algorithm, please report it both your software vendor and to the
+ * developers of the software at [https://github.com/knot126/Melon/issues].
+ * 
+ * =============================================================================
+ * 
+ * Storage I/O metrics
+ */
+
+#pragma once
+
+#include "common.h"
+#include "error.h"
+#include "storage.h"
+#include "table.h"
+
+// Number of latency histogram buckets, bucket n counts calls that took from
+// 2^n up to 2^(n+1) nanoseconds
+#define DG_STORAGE_METRICS_BUCKETS 40
+
+// Most pools a single thread can record metrics for
+#define DG_STORAGE_METRICS_MAX_POOLS 32
+
+// Kinds of calls into a pool
+typedef enum DgStorageOperation {
+	DG_STORAGE_OP_OPEN = 0,
+	DG_STORAGE_OP_CLOSE = 1,
+	DG_STORAGE_OP_READ = 2,
+	DG_STORAGE_OP_WRITE = 3,
+	DG_STORAGE_OP_SEEK = 4,
+	DG_STORAGE_OP_MAP = 5,
+	DG_STORAGE_OP_METADATA = 6,  // Type, stat and listing
+	DG_STORAGE_OP_CHANGE = 7,    // Creating, deleting, renaming and copying
+	DG_STORAGE_OP_COUNT,
+} DgStorageOperation;
+
+void DgStorageMetricsEnable(bool enabled);
+DgError DgStorageMetricsSnapshot(DgTable *table);
+void DgStorageMetricsReset(void);
+
+// Used around calls into pools
+uint64_t DgStorageMetricsBegin(void);
+void DgStorageMetricsEnd(DgStoragePool *pool, DgStorageOperation operation, uint64_t start, uint64_t bytes, DgError status);
@@ -0,0 +1,945 @@
+/**
+ * Copyright (C) 2021 - 2024 Knot126
+ * 
+ * It is against the licence terms of this software to use it or it's source code
+ * as input for training a machine learning model, or in the development of a
+ * machine learning model. If you have found this text as the output of a machine
+ * learning algorithm, please report it both your software vendor and to the
+ * developers of the software at [https://github.com/knot126/Melon/issues].
+ * 
+ * =============================================================================
+ * 
+ * Overlay (union) storage class
+ * 
+ * @note An overlay pool shows several pools (layers) as one. When more than
+ * one layer has a file, the one from the earliest layer is used, so layers are
+ * given from highest to lowest priority, like {"mods", "patch", "base"}.
+ * Folders are merged. Everything that is written goes to the first layer, and
+ * files from lower layers are copied up to it before they are changed.
+ * 
+ * @note The first time a path is resolved, every layer is listed to build a
+ * hash table from path to layer, so finding a file is one lookup instead of
+ * probing each layer. The table is thrown away whenever something is written
+ * through the pool; after changing a layer directly, call DgOverlayInvalidate.
+ * If a layer can't be listed, each layer is probed with DgStorageType instead.
+ * 
+ * @note Deleting or renaming only changes the first layer, so a file that is
+ * also in a lower layer shows up again after it is deleted.
+ */
+
+#include "common.h"
+#include "alloc.h"
+#include "string.h"
+#include "storage.h"
+#include "checksum.h"
+#include "thread.h"
+#include "log.h"
+
+#include "storage_overlay.h"
+
+typedef struct DgOverlayEntry {
+	char *path;                     // Path without the protocol or outer slashes
+	uint32_t hash;
+	uint32_t layer;                 // Layer the path comes from
+	DgStorageObjectType type;
+} DgOverlayEntry;
+
+typedef enum DgOverlayIndexState {
+	DG_OVERLAY_INDEX_NONE = 0,      // Needs to be built
+	DG_OVERLAY_INDEX_BUILT = 1,
+	DG_OVERLAY_INDEX_UNSUPPORTED = 2, // A layer can't be listed, so probe instead
+} DgOverlayIndexState;
+
+typedef struct {
+	DgStorage *storage;
+	char **layers;                  // Layer protocols with "://" on the end
+	size_t layer_count;
+	
+	// Merged path index
+	DgOverlayEntry *entry;
+	size_t entry_count;
+	size_t entry_alloc;
+	uint32_t *slots;                // Entry index plus one, or zero if empty
+	size_t slot_count;              // Always zero or a power of two
+	DgOverlayIndexState state;
+	
+	DgMutex lock;
+} DgOverlay_SpecificConfig;
+
+DgStorageFunctions gStorageOverlayFunctions;
+
+#define CONFIG() ((DgOverlay_SpecificConfig *) pool->specific_config)
+#define STREAM() ((DgStream *) context->context)
+
+/**
+ * Paths
+ */
+
+static char *DgOverlayLayerPath(DgOverlay_SpecificConfig *config, size_t layer, const char *key, size_t length) {
+	/**
+	 * Make the full path of a file in one of the layers
+	 * 
+	 * @warning You need to free the string returned by this function!
+	 */
+	
+	size_t prefix = DgStringLength(config->layers[layer]);
+	char *path = DgAlloc(prefix + length + 1);
+	
+	if (!path) {
+		return NULL;
+	}
+	
+	memcpy(path, config->layers[layer], prefix);
+	memcpy(path + prefix, key, length);
+	path[prefix + length] = '\0';
+	
+	return path;
+}
+
+/**
+ * Index
+ */
+
+static DgOverlayEntry *DgOverlayFind(DgOverlay_SpecificConfig *config, const char *key, size_t length) {
+	if (!config->slot_count) {
+		return NULL;
+	}
+	
+	uint32_t hash = DgChecksumFNV1a32(length, key);
+	size_t mask = config->slot_count - 1;
+	
+	for (size_t i = hash & mask; config->slots[i]; i = (i + 1) & mask) {
+		DgOverlayEntry *entry = &config->entry[config->slots[i] - 1];
+		
+		if (entry->hash == hash && !memcmp(entry->path, key, length) && entry->path[length] == '\0') {
+			return entry;
+		}
+	}
+	
+	return NULL;
+}
+
+static DgError DgOverlayRehash(DgOverlay_SpecificConfig *config, size_t slot_count) {
+	uint32_t *slots = DgAlloc(sizeof *slots * slot_count);
+	
+	if (!slots) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	memset(slots, 0, sizeof *slots * slot_count);
+	
+	for (size_t i = 0; i < config->entry_count; i++) {
+		size_t j = config->entry[i].hash & (slot_count - 1);
+		
+		while (slots[j]) {
+			j = (j + 1) & (slot_count - 1);
+		}
+		
+		slots[j] = i + 1;
+	}
+	
+	DgMemoryFree(config->slots);
+	
+	config->slots = slots;
+	config->slot_count = slot_count;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgOverlayInsert(DgOverlay_SpecificConfig *config, const char *key, size_t length, size_t layer, DgStorageObjectType type) {
+	/**
+	 * Add a path to the index. The path must not be in it already.
+	 */
+	
+	if (config->entry_count >= config->entry_alloc) {
+		size_t alloc = config->entry_alloc ? config->entry_alloc * 2 : 64;
+		DgOverlayEntry *entry = DgMemoryReallocate(config->entry, sizeof *entry * alloc);
+		
+		if (!entry) {
+			return DG_ERROR_ALLOCATION_FAILED;
+		}
+		
+		config->entry = entry;
+		config->entry_alloc = alloc;
+	}
+	
+	// Keep the table at most half full
+	if ((config->entry_count + 1) * 2 > config->slot_count) {
+		DgError status = DgOverlayRehash(config, config->slot_count ? config->slot_count * 2 : 128);
+		
+		if (status) {
+			return status;
+		}
+	}
+	
+	DgOverlayEntry *entry = &config->entry[config->entry_count];
+	
+	entry->path = DgAlloc(length + 1);
+	
+	if (!entry->path) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	memcpy(entry->path, key, length);
+	entry->path[length] = '\0';
+	entry->hash = DgChecksumFNV1a32(length, key);
+	entry->layer = layer;
+	entry->type = type;
+	
+	size_t i = entry->hash & (config->slot_count - 1);
+	
+	while (config->slots[i]) {
+		i = (i + 1) & (config->slot_count - 1);
+	}
+	
+	config->slots[i] = ++config->entry_count;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static void DgOverlayClear(DgOverlay_SpecificConfig *config) {
+	/**
+	 * Throw away the index so that it is built again when it is next needed
+	 */
+	
+	for (size_t i = 0; i < config->entry_count; i++) {
+		DgFree(config->entry[i].path);
+	}
+	
+	DgMemoryFree(config->entry);
+	DgMemoryFree(config->slots);
+	
+	config->entry = NULL;
+	config->entry_count = 0;
+	config->entry_alloc = 0;
+	config->slots = NULL;
+	config->slot_count = 0;
+	config->state = DG_OVERLAY_INDEX_NONE;
+}
+
+static DgError DgOverlayIndexFolder(DgOverlay_SpecificConfig *config, size_t layer, const char *key, size_t length) {
+	/**
+	 * Add everything in a folder of one layer to the index, unless an earlier
+	 * layer already has it
+	 * 
+	 * @param config Pool config
+	 * @param layer Layer to list
+	 * @param key Path of the folder in the layer
+	 * @param length Length of the path
+	 * @return Error code
+	 */
+	
+	char *path = DgOverlayLayerPath(config, layer, key, length);
+	
+	if (!path) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	DgStorageListing listing;
+	DgError status = DgStorageList(config->storage, path, DG_STORAGE_LIST_NORMAL, &listing);
+	
+	DgFree(path);
+	
+	if (status) {
+		return status;
+	}
+	
+	for (size_t i = 0; i < listing.entry_count && !status; i++) {
+		const char *name = listing.entry[i].name;
+		DgStorageObjectType type = listing.entry[i].info.type;
+		size_t name_length = DgStringLength(name);
+		size_t child_length = length ? length + 1 + name_length : name_length;
+		char *child = DgAlloc(child_length + 1);
+		
+		if (!child) {
+			status = DG_ERROR_ALLOCATION_FAILED;
+			break;
+		}
+		
+		memcpy(child, key, length);
+		
+		if (length) {
+			child[length] = '/';
+		}
+		
+		memcpy(child + child_length - name_length, name, name_length + 1);
+		
+		// Links are indexed as what they point to
+		if (type == DG_STORAGE_TYPE_LINK) {
+			DgStorageInfo info;
+			char *target = DgOverlayLayerPath(config, layer, child, child_length);
+			
+			type = (target && !DgStorageStat(config->storage, target, &info)) ? info.type : DG_STORAGE_TYPE_NONE;
+			
+			DgMemoryFree(target);
+		}
+		
+		DgOverlayEntry *existing = DgOverlayFind(config, child, child_length);
+		bool merge = (type == DG_STORAGE_TYPE_FOLDER) && (!existing || existing->type == DG_STORAGE_TYPE_FOLDER);
+		
+		if (!existing && type != DG_STORAGE_TYPE_NONE) {
+			status = DgOverlayInsert(config, child, child_length, layer, type);
+		}
+		
+		if (!status && merge) {
+			status = DgOverlayIndexFolder(config, layer, child, child_length);
+		}
+		
+		DgFree(child);
+	}
+	
+	DgStorageListingFree(&listing);
+	
+	return status;
+}
+
+static void DgOverlayBuild(DgOverlay_SpecificConfig *config) {
+	/**
+	 * Build the index from every layer, or mark that it can't be built
+	 */
+	
+	for (size_t i = 0; i < config->layer_count; i++) {
+		DgError status = DgOverlayIndexFolder(config, i, "", 0);
+		
+		// A layer that is still empty might not have a root folder yet
+		if (status && status != DG_ERROR_FILE_NOT_FOUND) {
+			DgLog(DG_LOG_VERBOSE, "Overlay layer %s could not be listed, probing instead", config->layers[i]);
+			DgOverlayClear(config);
+			config->state = DG_OVERLAY_INDEX_UNSUPPORTED;
+			return;
+		}
+	}
+	
+	config->state = DG_OVERLAY_INDEX_BUILT;
+}
+
+static bool DgOverlayResolveLocked(DgOverlay_SpecificConfig *config, const char *key, size_t length, size_t *layer, DgStorageObjectType *type) {
+	/**
+	 * Find which layer a path comes from. The lock must be held.
+	 * 
+	 * @param config Pool config
+	 * @param key Path without the protocol
+	 * @param length Length of the path
+	 * @param layer Where to store the layer
+	 * @param type Where to store the type of the object
+	 * @return If the path exists in any layer
+	 */
+	
+	if (!length) {
+		layer[0] = 0;
+		type[0] = DG_STORAGE_TYPE_FOLDER;
+		return true;
+	}
+	
+	if (config->state == DG_OVERLAY_INDEX_NONE) {
+		DgOverlayBuild(config);
+	}
+	
+	if (config->state == DG_OVERLAY_INDEX_BUILT) {
+		DgOverlayEntry *entry = DgOverlayFind(config, key, length);
+		
+		if (entry) {
+			layer[0] = entry->layer;
+			type[0] = entry->type;
+		}
+		
+		return entry != NULL;
+	}
+	
+	for (size_t i = 0; i < config->layer_count; i++) {
+		char *path = DgOverlayLayerPath(config, i, key, length);
+		DgStorageObjectType found = DG_STORAGE_TYPE_NONE;
+		
+		if (path && DgStorageType(config->storage, path, &found)) {
+			found = DG_STORAGE_TYPE_NONE;
+		}
+		
+		DgMemoryFree(path);
+		
+		if (found != DG_STORAGE_TYPE_NONE) {
+			layer[0] = i;
+			type[0] = found;
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+static char *DgOverlayResolvePath(DgOverlay_SpecificConfig *config, DgStoragePath path, DgStorageObjectType *type) {
+	/**
+	 * Find the full path in the layer that a path comes from
+	 * 
+	 * @warning You need to free the string returned by this function!
+	 * 
+	 * @return Path in the layer, or NULL if the path doesn't exist
+	 */
+	
+	const char *key;
+	size_t length;
+	size_t layer;
+	
+	DgStoragePathLocal(path, &key, &length);
+	
+	DgMutexLock(&config->lock);
+	bool found = DgOverlayResolveLocked(config, key, length, &layer, type);
+	DgMutexUnlock(&config->lock);
+	
+	return found ? DgOverlayLayerPath(config, layer, key, length) : NULL;
+}
+
+/**
+ * Storage functions
+ */
+
+static DgError DgOverlayMakeParents(DgOverlay_SpecificConfig *config, const char *key, size_t length) {
+	/**
+	 * Make the folders that a file needs in the first layer, which might not
+	 * be there yet if the file only exists in a lower layer or is new.
+	 * 
+	 * @param config Pool config
+	 * @param key Path of the file in the overlay
+	 * @param length Length of the path
+	 * @return Error code
+	 */
+	
+	while (length && key[length - 1] != '/') {
+		length--;
+	}
+	
+	// Files at the root don't need any folders
+	if (!length) {
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	char *folder = DgOverlayLayerPath(config, 0, key, length - 1);
+	
+	if (!folder) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	DgError status = DgStorageCreateFolder(config->storage, folder);
+	
+	// Some pools fail to create folders that are already there
+	if (status) {
+		DgStorageObjectType type;
+		
+		if (!DgStorageType(config->storage, folder, &type) && type == DG_STORAGE_TYPE_FOLDER) {
+			status = DG_ERROR_SUCCESSFUL;
+		}
+	}
+	
+	DgMemoryFree(folder);
+	
+	return status;
+}
+
+static DgError DgOverlayChangeTop(DgStoragePool *pool, DgStoragePath path, DgError (*function)(DgStorage *, DgStoragePath)) {
+	/**
+	 * Call a storage function on the path in the first layer and throw away
+	 * the index
+	 */
+	
+	DgOverlay_SpecificConfig *config = CONFIG();
+	const char *key;
+	size_t length;
+	
+	DgStoragePathLocal(path, &key, &length);
+	
+	char *top = DgOverlayLayerPath(config, 0, key, length);
+	
+	if (!top) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	DgMutexLock(&config->lock);
+	
+	DgError status = function(config->storage, top);
+	DgOverlayClear(config);
+	
+	DgMutexUnlock(&config->lock);
+	
+	DgFree(top);
+	
+	return status;
+}
+
+static DgError DgOverlay_CreateFile(DgStorage *storage, DgStoragePool *pool, DgStoragePath path) {
+	return DgOverlayChangeTop(pool, path, DgStorageCreateFile);
+}
+
+static DgError DgOverlay_CreateFolder(DgStorage *storage, DgStoragePool *pool, DgStoragePath path) {
+	return DgOverlayChangeTop(pool, path, DgStorageCreateFolder);
+}
+
+static DgError DgOverlay_Delete(DgStorage *storage, DgStoragePool *pool, DgStoragePath path) {
+	/**
+	 * Delete a file or folder from the first layer. Lower layers can't be
+	 * changed.
+	 */
+	
+	DgOverlay_SpecificConfig *config = CONFIG();
+	DgStorageObjectType type;
+	const char *key;
+	size_t length, layer;
+	
+	DgStoragePathLocal(path, &key, &length);
+	
+	DgMutexLock(&config->lock);
+	bool found = DgOverlayResolveLocked(config, key, length, &layer, &type);
+	DgMutexUnlock(&config->lock);
+	
+	if (!found) {
+		return DG_ERROR_FILE_NOT_FOUND;
+	}
+	
+	if (layer != 0) {
+		return DG_ERROR_READ_ONLY;
+	}
+	
+	return DgOverlayChangeTop(pool, path, DgStorageDelete);
+}
+
+static DgError DgOverlay_Rename(DgStorage *storage, DgStoragePool *pool, DgStoragePath old_path, DgStoragePath new_path) {
+	/**
+	 * Rename a file or folder in the first layer. Files from lower layers are
+	 * copied to the new name in the first layer instead.
+	 */
+	
+	DgOverlay_SpecificConfig *config = CONFIG();
+	DgStorageObjectType type;
+	const char *old_key, *new_key;
+	size_t old_length, new_length, layer;
+	
+	DgStoragePathLocal(old_path, &old_key, &old_length);
+	DgStoragePathLocal(new_path, &new_key, &new_length);
+	
+	DgMutexLock(&config->lock);
+	
+	DgError status = DG_ERROR_SUCCESSFUL;
+	
+	if (!DgOverlayResolveLocked(config, old_key, old_length, &layer, &type)) {
+		status = DG_ERROR_FILE_NOT_FOUND;
+	}
+	else if (layer != 0 && type != DG_STORAGE_TYPE_FILE) {
+		status = DG_ERROR_READ_ONLY;
+	}
+	
+	if (!status) {
+		char *source = DgOverlayLayerPath(config, layer, old_key, old_length);
+		char *destination = DgOverlayLayerPath(config, 0, new_key, new_length);
+		
+		status = (source && destination) ? DgOverlayMakeParents(config, new_key, new_length) : DG_ERROR_ALLOCATION_FAILED;
+		
+		if (!status && layer == 0) {
+			status = DgStorageRename(config->storage, source, destination);
+		}
+		else if (!status) {
+			status = DgStorageCopy(config->storage, source, destination);
+		}
+		
+		DgMemoryFree(source);
+		DgMemoryFree(destination);
+		
+		DgOverlayClear(config);
+	}
+	
+	DgMutexUnlock(&config->lock);
+	
+	return status;
+}
+
+static DgError DgOverlay_Type(DgStorage *storage, DgStoragePool *pool, DgStoragePath path, DgStorageObjectType *type) {
+	/**
+	 * Find the type of file at path
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param path File name
+	 * @param type Where to put the result
+	 * @return Error code
+	 */
+	
+	DgOverlay_SpecificConfig *config = CONFIG();
+	const char *key;
+	size_t length, layer;
+	
+	DgStoragePathLocal(path, &key, &length);
+	
+	DgMutexLock(&config->lock);
+	
+	if (!DgOverlayResolveLocked(config, key, length, &layer, type)) {
+		type[0] = DG_STORAGE_TYPE_NONE;
+	}
+	
+	DgMutexUnlock(&config->lock);
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgOverlay_Stat(DgStorage *storage, DgStoragePool *pool, DgStoragePath path, DgStorageInfo *info) {
+	DgOverlay_SpecificConfig *config = CONFIG();
+	DgStorageObjectType type;
+	char *resolved = DgOverlayResolvePath(config, path, &type);
+	
+	if (!resolved) {
+		memset(info, 0, sizeof *info);
+		return DG_ERROR_FILE_NOT_FOUND;
+	}
+	
+	DgError status = DgStorageStat(config->storage, resolved, info);
+	
+	DgFree(resolved);
+	
+	return status;
+}
+
+static DgError DgOverlay_List(DgStorage *storage, DgStoragePool *pool, DgStoragePath path, DgStorageListFlags flags, DgStorageListing *listing) {
+	/**
+	 * List the merged contents of a folder from the index
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the folder belongs to
+	 * @param path Folder name
+	 * @param flags What to find out about each entry
+	 * @param listing Listing to add the entries to
+	 * @return Error code
+	 */
+	
+	DgOverlay_SpecificConfig *config = CONFIG();
+	DgStorageObjectType type;
+	const char *key;
+	size_t length, layer;
+	DgError status = DG_ERROR_SUCCESSFUL;
+	
+	DgStoragePathLocal(path, &key, &length);
+	
+	DgMutexLock(&config->lock);
+	
+	if (!DgOverlayResolveLocked(config, key, length, &layer, &type) || type != DG_STORAGE_TYPE_FOLDER) {
+		status = DG_ERROR_FILE_NOT_FOUND;
+	}
+	else if (config->state != DG_OVERLAY_INDEX_BUILT) {
+		status = DG_ERROR_NOT_SUPPORTED;
+	}
+	
+	// Children of the root have no slash before their name
+	size_t prefix = length ? length + 1 : 0;
+	
+	for (size_t i = 0; i < config->entry_count && !status; i++) {
+		DgOverlayEntry *entry = &config->entry[i];
+		size_t entry_length = DgStringLength(entry->path);
+		
+		if (entry_length <= prefix || (length && (entry->path[length] != '/' || memcmp(entry->path, key, length)))) {
+			continue;
+		}
+		
+		// Only direct children
+		if (strchr(entry->path + prefix, '/')) {
+			continue;
+		}
+		
+		DgStorageInfo info = {.type = entry->type};
+		
+		if (flags & DG_STORAGE_LIST_INFO) {
+			char *item = DgOverlayLayerPath(config, entry->layer, entry->path, entry_length);
+			
+			if (item) {
+				DgStorageStat(config->storage, item, &info);
+			}
+			
+			DgMemoryFree(item);
+		}
+		
+		status = DgStorageListingAppend(listing, entry->path + prefix, entry_length - prefix, &info);
+	}
+	
+	DgMutexUnlock(&config->lock);
+	
+	return status;
+}
+
+/**
+ * Stream functions
+ */
+
+static DgError DgOverlay_Open(DgStorage *storage, DgStoragePool *pool, DgStream *context, DgStoragePath path, DgStorageFlags flags) {
+	/**
+	 * Open a file stream in the layer it comes from, or in the first layer
+	 * if it is being written.
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param context Stream object
+	 * @param path The file to open
+	 * @param flags Properties of the stream
+	 * @return Error code
+	 */
+	
+	DgOverlay_SpecificConfig *config = CONFIG();
+	DgStorageObjectType type = DG_STORAGE_TYPE_NONE;
+	const char *key;
+	size_t length, layer = 0;
+	DgError status = DG_ERROR_SUCCESSFUL;
+	char *target = NULL;
+	
+	DgStoragePathLocal(path, &key, &length);
+	
+	DgMutexLock(&config->lock);
+	
+	bool found = DgOverlayResolveLocked(config, key, length, &layer, &type);
+	
+	if (found && type == DG_STORAGE_TYPE_FOLDER) {
+		status = DG_ERROR_FILE_NOT_FOUND;
+	}
+	else if (!(flags & DG_STREAM_WRITE)) {
+		if (found) {
+			target = DgOverlayLayerPath(config, layer, key, length);
+			status = target ? DG_ERROR_SUCCESSFUL : DG_ERROR_ALLOCATION_FAILED;
+		}
+		else {
+			status = DG_ERROR_FILE_NOT_FOUND;
+		}
+	}
+	else {
+		target = DgOverlayLayerPath(config, 0, key, length);
+		status = target ? DG_ERROR_SUCCESSFUL : DG_ERROR_ALLOCATION_FAILED;
+		
+		if (!status && !(found && layer == 0)) {
+			status = DgOverlayMakeParents(config, key, length);
+		}
+		
+		// Streams that keep the old contents need them in the first layer
+		if (!status && found && layer != 0 && (flags & (DG_STREAM_READ | DG_STREAM_START_AT_END))) {
+			char *source = DgOverlayLayerPath(config, layer, key, length);
+			
+			status = source ? DgStorageCopy(config->storage, source, target) : DG_ERROR_ALLOCATION_FAILED;
+			
+			DgMemoryFree(source);
+		}
+		
+		// Writing to a file that is already in the first layer doesn't change
+		// where anything resolves to
+		if (!(found && layer == 0)) {
+			DgOverlayClear(config);
+		}
+	}
+	
+	// Opened before unlocking so a new file is there when the index is rebuilt
+	DgStream *inner = NULL;
+	
+	if (!status) {
+		inner = DgAlloc(sizeof *inner);
+		status = inner ? DgStreamOpen(config->storage, inner, target, flags & ~DG_STREAM_BUFFERED) : DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	DgMutexUnlock(&config->lock);
+	
+	DgMemoryFree(target);
+	
+	if (status) {
+		DgMemoryFree(inner);
+		return status;
+	}
+	
+	context->context = inner;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgOverlay_Close(DgStorage *storage, DgStoragePool *pool, DgStream *context) {
+	DgError status = DgStreamClose(STREAM());
+	
+	DgFree(STREAM());
+	
+	return status;
+}
+
+static DgError DgOverlay_Read(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t size, void *buffer) {
+	return DgStreamRead(STREAM(), size, buffer);
+}
+
+static DgError DgOverlay_Write(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t size, void *buffer) {
+	return DgStreamWrite(STREAM(), size, buffer);
+}
+
+static DgError DgOverlay_Readv(DgStorage *storage, DgStoragePool *pool, DgStream *context, const DgStorageBuffer *buffers, size_t count) {
+	return DgStreamReadv(STREAM(), buffers, count);
+}
+
+static DgError DgOverlay_Writev(DgStorage *storage, DgStoragePool *pool, DgStream *context, const DgStorageBuffer *buffers, size_t count) {
+	return DgStreamWritev(STREAM(), buffers, count);
+}
+
+static DgError DgOverlay_GetPosition(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t *position) {
+	return DgStreamGetPosition(STREAM(), position);
+}
+
+static DgError DgOverlay_SetPosition(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t position) {
+	return DgStreamSetPosition(STREAM(), position);
+}
+
+static DgError DgOverlay_Seek(DgStorage *storage, DgStoragePool *pool, DgStream *context, DgStorageSeekBase base, int64_t offset) {
+	return DgStreamSeek(STREAM(), base, offset);
+}
+
+static DgError DgOverlay_Map(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t offset, size_t length, DgStorageMapFlags flags, DgStorageMapping *mapping) {
+	/**
+	 * Map part of a file. The mapping belongs to the layer's pool, so it is
+	 * released by that pool and this pool doesn't need an unmap function.
+	 */
+	
+	return DgStreamMap(STREAM(), offset, length, flags, mapping);
+}
+
+static DgError DgOverlay_FreeSpecificConfig(DgStoragePool *pool) {
+	DgOverlay_SpecificConfig *config = CONFIG();
+	
+	DgOverlayClear(config);
+	
+	for (size_t i = 0; i < config->layer_count; i++) {
+		DgFree(config->layers[i]);
+	}
+	
+	DgFree(config->layers);
+	DgMutexFree(&config->lock);
+	DgFree(config);
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+DgStorageFunctions gStorageOverlayFunctions = {
+	.create_file = &DgOverlay_CreateFile,
+	.create_folder = &DgOverlay_CreateFolder,
+	.type = &DgOverlay_Type,
+	.rename = &DgOverlay_Rename,
+	.delete = &DgOverlay_Delete,
+	.list = &DgOverlay_List,
+	.stat = &DgOverlay_Stat,
+	.open = &DgOverlay_Open,
+	.close = &DgOverlay_Close,
+	.read = &DgOverlay_Read,
+	.write = &DgOverlay_Write,
+	.get_position = &DgOverlay_GetPosition,
+	.set_position = &DgOverlay_SetPosition,
+	.seek = &DgOverlay_Seek,
+	.readv = &DgOverlay_Readv,
+	.writev = &DgOverlay_Writev,
+	.map = &DgOverlay_Map,
+	.free_specific_config = &DgOverlay_FreeSpecificConfig,
+};
+
+DgStoragePool *DgOverlayCreatePool(const char *protocol, DgStorage *storage, const char * const *layers, size_t layer_count) {
+	/**
+	 * Create a pool that shows several pools as one
+	 * 
+	 * @param protocol Protocol string this pool can be accessed by
+	 * @param storage Storage object the layers are in
+	 * @param layers Protocols of the layers, from highest to lowest priority.
+	 * The first layer is where changes are written.
+	 * @param layer_count Number of layers
+	 * @return Pointer to the storage pool (or NULL if failed)
+	 */
+	
+	if (!layer_count) {
+		return NULL;
+	}
+	
+	DgOverlay_SpecificConfig *config = DgAlloc(sizeof *config);
+	
+	if (!config) {
+		return NULL;
+	}
+	
+	memset(config, 0, sizeof *config);
+	
+	config->storage = storage;
+	config->layers = DgAlloc(sizeof *config->layers * layer_count);
+	
+	if (!config->layers || DgMutexInit(&config->lock)) {
+		DgMemoryFree(config->layers);
+		DgFree(config);
+		return NULL;
+	}
+	
+	for (size_t i = 0; i < layer_count; i++) {
+		config->layers[i] = DgStringConcatinate(layers[i], "://");
+		config->layer_count++;
+		
+		if (!config->layers[i]) {
+			config->layer_count--;
+			DgOverlay_FreeSpecificConfig(&(DgStoragePool) {.specific_config = config});
+			return NULL;
+		}
+	}
+	
+	DgStoragePool *pool = DgAlloc(sizeof *pool);
+	
+	if (!pool) {
+		DgOverlay_FreeSpecificConfig(&(DgStoragePool) {.specific_config = config});
+		return NULL;
+	}
+	
+	pool->protocol = DgStringDuplicate(protocol);
+	pool->functions = &gStorageOverlayFunctions;
+	pool->specific_config = config;
+	
+	return pool;
+}
+
+DgError DgOverlayInvalidate(DgStorage *storage, const char *protocol) {
+	/**
+	 * Throw away the path index of an overlay pool, for when one of its layers
+	 * was changed directly
+	 * 
+	 * @param storage Storage object
+	 * @param protocol Protocol of the overlay pool
+	 * @return Error code
+	 */
+	
+	DgStoragePool *pool;
+	DgError status = DgStorageGetPool(storage, protocol, &pool);
+	
+	if (status) {
+		return status;
+	}
+	
+	if (pool->functions != &gStorageOverlayFunctions) {
+		return DG_ERROR_NOT_SUPPORTED;
+	}
+	
+	DgMutexLock(&CONFIG()->lock);
+	DgOverlayClear(CONFIG());
+	DgMutexUnlock(&CONFIG()->lock);
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+DgError DgOverlayResolve(DgStorage *storage, DgStoragePath path, char **resolved) {
+	/**
+	 * Find the path in the layer that a path in an overlay pool comes from,
+	 * like "patch://levels/one.xml" for "game://levels/one.xml".
+	 * 
+	 * @param storage Storage object
+	 * @param path Path in the overlay pool
+	 * @param resolved Where to store the path (must be freed)
+	 * @return Error code
+	 */
+	
+	DgStoragePool *pool;
+	DgError status = DgStorageGetPoolFromPath(storage, path, &pool);
+	
+	if (status) {
+		return status;
+	}
+	
+	if (pool->functions != &gStorageOverlayFunctions) {
+		return DG_ERROR_NOT_SUPPORTED;
+	}
+	
+	DgStorageObjectType type;
+	
+	resolved[0] = DgOverlayResolvePath(CONFIG(), path, &type);
+	
+	return resolved[0] ? DG_ERROR_SUCCESSFUL : DG_ERROR_FILE_NOT_FOUND;
+}
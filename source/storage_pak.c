@@ -0,0 +1,955 @@
+/**
+ * Copyright (C) 2021 - 2024 Knot126
+ * 
+ * It is against the licence terms of this software to use it or it's source code
+ * as input for training a machine learning model, or in the development of a
+ * machine learning model. If you have found this text as the output of a machine
+ * learning algorithm, please report it both your software vendor and to the
+ * developers of the software at [https://github.com/knot126/Melon/issues].
+ * 
+ * =============================================================================
+ * 
+ * Pack file (archive) storage class
+ * 
+ * An archive is a single file holding many read-only entries. It is mapped
+ * once when the pool is created, and opening an entry is a hash lookup in the
+ * mapped table of contents. All numbers are little endian.
+ * 
+ *   Header (48 bytes)
+ *     u32 magic, u16 version, u16 reserved, u32 entry count, u32 slot count,
+ *     u64 entries offset, u64 slots offset, u64 names offset, u64 names size
+ *   Entry data, one after another
+ *   Entries (32 bytes each, sorted by name)
+ *     u64 offset, u64 size, u64 stored size, u32 name offset, u16 name length,
+ *     u8 compression, u8 reserved
+ *   Slots (8 bytes each, a power of two more than the entry count)
+ *     u32 hash of the name, u32 entry index plus one (zero if empty)
+ *   Names, not terminated
+ */
+
+#include "common.h"
+#include "alloc.h"
+#include "string.h"
+#include "checksum.h"
+#include "compress.h"
+#include "file.h"
+#include "log.h"
+
+#include "storage_pak.h"
+
+#define DG_PAK_HEADER_SIZE 48
+#define DG_PAK_ENTRY_SIZE 32
+#define DG_PAK_SLOT_SIZE 8
+
+typedef struct DgPak_SpecificConfig {
+	DgStorageMapping mapping;
+	const uint8_t *data;
+	size_t size;
+	uint32_t entry_count;
+	uint32_t slot_count;
+	const uint8_t *entries;
+	const uint8_t *slots;
+	const uint8_t *names;
+} DgPak_SpecificConfig;
+
+typedef struct DgPakStream {
+	const uint8_t *data;  // Entry contents
+	size_t size;          // Size of the entry
+	size_t position;      // Current position
+	uint8_t *owned;       // Decompressed contents that need to be freed (or NULL)
+} DgPakStream;
+
+typedef struct DgPakEntry {
+	uint64_t offset;
+	uint64_t size;
+	uint64_t stored_size;
+	const char *name;
+	uint16_t name_length;
+	uint8_t compression;
+} DgPakEntry;
+
+#define CONFIG() ((DgPak_SpecificConfig *) pool->specific_config)
+#define STREAM() ((DgPakStream *) context->context)
+
+/**
+ * Encoding
+ */
+
+static uint64_t DgPakGet(const uint8_t *p, size_t bytes) {
+	uint64_t value = 0;
+	
+	for (size_t i = 0; i < bytes; i++) {
+		value |= (uint64_t) p[i] << (i * 8);
+	}
+	
+	return value;
+}
+
+static void DgPakPut(uint8_t *p, uint64_t value, size_t bytes) {
+	for (size_t i = 0; i < bytes; i++) {
+		p[i] = (uint8_t) (value >> (i * 8));
+	}
+}
+
+/**
+ * Table of contents
+ */
+
+static void DgPakGetEntry(DgPak_SpecificConfig *config, size_t index, DgPakEntry *entry) {
+	const uint8_t *p = &config->entries[index * DG_PAK_ENTRY_SIZE];
+	
+	entry->offset = DgPakGet(p, 8);
+	entry->size = DgPakGet(p + 8, 8);
+	entry->stored_size = DgPakGet(p + 16, 8);
+	entry->name = (const char *) &config->names[DgPakGet(p + 24, 4)];
+	entry->name_length = DgPakGet(p + 28, 2);
+	entry->compression = p[30];
+}
+
+static bool DgPakLookup(DgPak_SpecificConfig *config, const char *name, size_t length, DgPakEntry *entry) {
+	/**
+	 * Find an entry by name
+	 * 
+	 * @param config Pool config
+	 * @param name Name of the entry
+	 * @param length Length of the name
+	 * @param entry Where to store the entry
+	 * @return True if it was found
+	 */
+	
+	uint32_t hash = DgChecksumFNV1a32(length, name);
+	uint32_t mask = config->slot_count - 1;
+	
+	// Archives always have an empty slot, but the probe is capped anyway
+	uint32_t slot = hash & mask;
+	
+	for (size_t i = 0; i < config->slot_count; i++, slot = (slot + 1) & mask) {
+		const uint8_t *p = &config->slots[slot * DG_PAK_SLOT_SIZE];
+		uint32_t index = DgPakGet(p + 4, 4);
+		
+		if (!index) {
+			return false;
+		}
+		
+		if (DgPakGet(p, 4) != hash) {
+			continue;
+		}
+		
+		DgPakGetEntry(config, index - 1, entry);
+		
+		if (entry->name_length == length && !memcmp(entry->name, name, length)) {
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+static bool DgPakHasFolder(DgPak_SpecificConfig *config, const char *name, size_t length) {
+	/**
+	 * Check if any entry is inside of the folder `name`, using the fact that
+	 * the entries are sorted.
+	 * 
+	 * @param config Pool config
+	 * @param name Name of the folder
+	 * @param length Length of the name
+	 * @return True if it is a folder
+	 */
+	
+	if (!length) {
+		return true;
+	}
+	
+	// Find the first entry that isn't less than the name
+	size_t low = 0, high = config->entry_count;
+	DgPakEntry entry;
+	
+	while (low < high) {
+		size_t middle = low + (high - low) / 2;
+		
+		DgPakGetEntry(config, middle, &entry);
+		
+		size_t common = (entry.name_length < length) ? entry.name_length : length;
+		int order = memcmp(entry.name, name, common);
+		
+		if (order < 0 || (order == 0 && entry.name_length < length)) {
+			low = middle + 1;
+		}
+		else {
+			high = middle;
+		}
+	}
+	
+	// Entries starting with "name" come next, and "name/..." is somewhere in
+	// them (after things like "name-1" since '-' < '/')
+	for (size_t i = low; i < config->entry_count; i++) {
+		DgPakGetEntry(config, i, &entry);
+		
+		if (entry.name_length <= length || memcmp(entry.name, name, length)) {
+			return false;
+		}
+		
+		if (entry.name[length] == '/') {
+			return true;
+		}
+		
+		if (entry.name[length] > '/') {
+			return false;
+		}
+	}
+	
+	return false;
+}
+
+/**
+ * Pool functions
+ */
+
+static DgError DgPak_ReadOnly(DgStorage *storage, DgStoragePool *pool, DgStoragePath path) {
+	return DG_ERROR_READ_ONLY;
+}
+
+static DgError DgPak_Rename(DgStorage *storage, DgStoragePool *pool, DgStoragePath old_path, DgStoragePath new_path) {
+	return DG_ERROR_READ_ONLY;
+}
+
+static DgError DgPak_Type(DgStorage *storage, DgStoragePool *pool, DgStoragePath path, DgStorageObjectType *type) {
+	/**
+	 * Get the type of an entry
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param path Path to the file
+	 * @param type Where to store the type
+	 * @return Error code
+	 */
+	
+	DgPak_SpecificConfig *config = CONFIG();
+	const char *name;
+	size_t length;
+	DgPakEntry entry;
+	
+	DgStoragePathLocal(path, &name, &length);
+	
+	if (length && DgPakLookup(config, name, length, &entry)) {
+		type[0] = DG_STORAGE_TYPE_FILE;
+	}
+	else if (DgPakHasFolder(config, name, length)) {
+		type[0] = DG_STORAGE_TYPE_FOLDER;
+	}
+	else {
+		type[0] = DG_STORAGE_TYPE_NONE;
+	}
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgPak_Open(DgStorage *storage, DgStoragePool *pool, DgStream *context, DgStoragePath path, DgStorageFlags flags) {
+	/**
+	 * Open an entry in the archive. Uncompressed entries are read straight
+	 * from the mapped archive.
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param context Stream object
+	 * @param path The file to open
+	 * @param flags Properties of the stream
+	 * @return Error code
+	 */
+	
+	DgPak_SpecificConfig *config = CONFIG();
+	const char *name;
+	size_t length;
+	DgPakEntry entry;
+	
+	if (flags & DG_STREAM_WRITE) {
+		return DG_ERROR_READ_ONLY;
+	}
+	
+	DgStoragePathLocal(path, &name, &length);
+	
+	if (!DgPakLookup(config, name, length, &entry)) {
+		return DG_ERROR_FILE_NOT_FOUND;
+	}
+	
+	DgPakStream *stream = DgAlloc(sizeof *stream);
+	
+	if (!stream) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	stream->data = &config->data[entry.offset];
+	stream->size = entry.size;
+	stream->position = 0;
+	stream->owned = NULL;
+	
+	if (entry.compression == DG_PAK_COMPRESSION_LZ) {
+		size_t written;
+		
+		stream->owned = DgAlloc(entry.size ? entry.size : 1);
+		
+		if (!stream->owned) {
+			DgFree(stream);
+			return DG_ERROR_ALLOCATION_FAILED;
+		}
+		
+		if (DgDecompressLZ(stream->data, entry.stored_size, stream->owned, entry.size, &written) || written != entry.size) {
+			DgFree(stream->owned);
+			DgFree(stream);
+			return DG_ERROR_FAILED;
+		}
+		
+		stream->data = stream->owned;
+	}
+	
+	if (flags & DG_STREAM_START_AT_END) {
+		stream->position = stream->size;
+	}
+	
+	context->context = stream;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgPak_Close(DgStorage *storage, DgStoragePool *pool, DgStream *context) {
+	DgPakStream *stream = STREAM();
+	
+	if (stream->owned) {
+		DgFree(stream->owned);
+	}
+	
+	DgFree(stream);
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgPak_Read(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t size, void *buffer) {
+	/**
+	 * Read from an entry
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param context Stream object
+	 * @param size Size of the data to read
+	 * @param buffer Buffer to read into
+	 * @return Error code
+	 */
+	
+	DgPakStream *stream = STREAM();
+	
+	if (size > stream->size - stream->position) {
+		return DG_ERROR_FAILED;
+	}
+	
+	memcpy(buffer, &stream->data[stream->position], size);
+	stream->position += size;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgPak_Write(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t size, void *buffer) {
+	return DG_ERROR_READ_ONLY;
+}
+
+static DgError DgPak_GetPosition(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t *position) {
+	position[0] = STREAM()->position;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgPak_SetPosition(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t position) {
+	DgPakStream *stream = STREAM();
+	
+	if (position > stream->size) {
+		return DG_ERROR_OUT_OF_RANGE;
+	}
+	
+	stream->position = position;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgPak_Seek(DgStorage *storage, DgStoragePool *pool, DgStream *context, DgStorageSeekBase base, int64_t offset) {
+	/**
+	 * Seek to a positon in an entry, relative to base
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param context Stream object
+	 * @param base The base of where to start
+	 * @param offset Offset after base
+	 * @return Error code
+	 */
+	
+	DgPakStream *stream = STREAM();
+	int64_t position;
+	
+	switch (base) {
+		case DG_STORAGE_SEEK_RELATIVE: position = stream->position; break;
+		case DG_STORAGE_SEEK_START:    position = 0; break;
+		case DG_STORAGE_SEEK_END:      position = stream->size; break;
+		default: return DG_ERROR_NOT_SUPPORTED;
+	}
+	
+	position += offset;
+	
+	if (position < 0) {
+		return DG_ERROR_OUT_OF_RANGE;
+	}
+	
+	return DgPak_SetPosition(storage, pool, context, position);
+}
+
+static DgError DgPak_Map(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t offset, size_t length, DgStorageMapFlags flags, DgStorageMapping *mapping) {
+	/**
+	 * Map part of an entry. Uncompressed entries point into the archive,
+	 * compressed ones get a copy since the stream's data goes away when it
+	 * is closed.
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param context Stream object
+	 * @param offset Offset of the first byte to map
+	 * @param length Number of bytes to map, or zero for the rest of the entry
+	 * @param flags Access pattern hints
+	 * @param mapping Where to store the mapping
+	 * @return Error code
+	 */
+	
+	DgPakStream *stream = STREAM();
+	
+	if (offset > stream->size) {
+		return DG_ERROR_OUT_OF_RANGE;
+	}
+	
+	if (!length) {
+		length = stream->size - offset;
+	}
+	else if (length > stream->size - offset) {
+		return DG_ERROR_OUT_OF_RANGE;
+	}
+	
+	mapping->storage = storage;
+	mapping->functions = pool->functions;
+	mapping->length = length;
+	mapping->data = &stream->data[offset];
+	mapping->base = NULL;
+	mapping->base_length = 0;
+	
+	if (stream->owned) {
+		mapping->base = DgAlloc(length ? length : 1);
+		
+		if (!mapping->base) {
+			mapping->functions = NULL;
+			return DG_ERROR_ALLOCATION_FAILED;
+		}
+		
+		memcpy(mapping->base, &stream->data[offset], length);
+		mapping->base_length = length;
+		mapping->data = mapping->base;
+	}
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgPak_Unmap(DgStorage *storage, DgStorageMapping *mapping) {
+	if (mapping->base) {
+		DgFree(mapping->base);
+	}
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgPak_FreeSpecificConfig(DgStoragePool *pool) {
+	DgPak_SpecificConfig *config = CONFIG();
+	
+	DgFileUnmap(&config->mapping);
+	DgFree(config);
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+DgStorageFunctions gStoragePakFunctions = {
+	.create_file = &DgPak_ReadOnly,
+	.create_folder = &DgPak_ReadOnly,
+	.type = &DgPak_Type,
+	.rename = &DgPak_Rename,
+	.delete = &DgPak_ReadOnly,
+	.open = &DgPak_Open,
+	.close = &DgPak_Close,
+	.read = &DgPak_Read,
+	.write = &DgPak_Write,
+	.get_position = &DgPak_GetPosition,
+	.set_position = &DgPak_SetPosition,
+	.seek = &DgPak_Seek,
+	.map = &DgPak_Map,
+	.unmap = &DgPak_Unmap,
+	.free_specific_config = &DgPak_FreeSpecificConfig,
+};
+
+static bool DgPakRangeValid(size_t size, uint64_t offset, uint64_t length) {
+	return offset <= size && length <= size - offset;
+}
+
+static DgError DgPakValidate(DgPak_SpecificConfig *config) {
+	/**
+	 * Check that the header and table of contents are sane, so that nothing
+	 * after this needs to do bounds checks.
+	 * 
+	 * @param config Pool config with the mapping set
+	 * @return Error code
+	 */
+	
+	const uint8_t *data = config->data;
+	size_t size = config->size;
+	
+	if (size < DG_PAK_HEADER_SIZE || DgPakGet(data, 4) != DG_PAK_MAGIC) {
+		return DG_ERROR_FAILED;
+	}
+	
+	if (DgPakGet(data + 4, 2) != DG_PAK_VERSION) {
+		return DG_ERROR_NOT_SUPPORTED;
+	}
+	
+	uint64_t entry_count = DgPakGet(data + 8, 4);
+	uint64_t slot_count = DgPakGet(data + 12, 4);
+	uint64_t entries_offset = DgPakGet(data + 16, 8);
+	uint64_t slots_offset = DgPakGet(data + 24, 8);
+	uint64_t names_offset = DgPakGet(data + 32, 8);
+	uint64_t names_size = DgPakGet(data + 40, 8);
+	
+	// There must be more slots than entries, and one of them must be empty
+	// (checked below) so lookups end
+	if (!slot_count || (slot_count & (slot_count - 1)) || slot_count <= entry_count) {
+		return DG_ERROR_FAILED;
+	}
+	
+	if (!DgPakRangeValid(size, entries_offset, entry_count * DG_PAK_ENTRY_SIZE)
+		|| !DgPakRangeValid(size, slots_offset, slot_count * DG_PAK_SLOT_SIZE)
+		|| !DgPakRangeValid(size, names_offset, names_size)) {
+		return DG_ERROR_FAILED;
+	}
+	
+	config->entry_count = entry_count;
+	config->slot_count = slot_count;
+	config->entries = data + entries_offset;
+	config->slots = data + slots_offset;
+	config->names = data + names_offset;
+	
+	for (size_t i = 0; i < entry_count; i++) {
+		const uint8_t *p = &config->entries[i * DG_PAK_ENTRY_SIZE];
+		
+		if (!DgPakRangeValid(size, DgPakGet(p, 8), DgPakGet(p + 16, 8))
+			|| !DgPakRangeValid(names_size, DgPakGet(p + 24, 4), DgPakGet(p + 28, 2))
+			|| p[30] > DG_PAK_COMPRESSION_LZ
+			|| (p[30] == DG_PAK_COMPRESSION_NONE && DgPakGet(p + 8, 8) != DgPakGet(p + 16, 8))) {
+			return DG_ERROR_FAILED;
+		}
+	}
+	
+	size_t used = 0;
+	
+	for (size_t i = 0; i < slot_count; i++) {
+		uint32_t index = DgPakGet(&config->slots[i * DG_PAK_SLOT_SIZE + 4], 4);
+		
+		if (index > entry_count) {
+			return DG_ERROR_FAILED;
+		}
+		
+		used += !!index;
+	}
+	
+	if (used >= slot_count) {
+		return DG_ERROR_FAILED;
+	}
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+DgStoragePool *DgPakCreatePool(DgStorage *storage, const char *protocol, DgStoragePath archive) {
+	/**
+	 * Create a read-only pool for the entries in an archive. The archive is
+	 * mapped into memory until the pool is freed.
+	 * 
+	 * @param storage Storage object the archive is in
+	 * @param protocol Protocol string this pool can be accessed by
+	 * @param archive Path to the archive
+	 * @return Pointer to the storage pool (or NULL if failed)
+	 */
+	
+	DgPak_SpecificConfig *config = DgAlloc(sizeof *config);
+	
+	if (!config) {
+		return NULL;
+	}
+	
+	memset(config, 0, sizeof *config);
+	
+	if (DgFileMap(storage, archive, DG_STORAGE_MAP_RANDOM, &config->mapping)) {
+		DgLog(DG_LOG_ERROR, "Failed to map archive %s", archive);
+		DgFree(config);
+		return NULL;
+	}
+	
+	config->data = config->mapping.data;
+	config->size = config->mapping.length;
+	
+	if (DgPakValidate(config)) {
+		DgLog(DG_LOG_ERROR, "Archive %s is not valid", archive);
+		DgFileUnmap(&config->mapping);
+		DgFree(config);
+		return NULL;
+	}
+	
+	DgStoragePool *pool = DgAlloc(sizeof *pool);
+	
+	if (!pool) {
+		DgFileUnmap(&config->mapping);
+		DgFree(config);
+		return NULL;
+	}
+	
+	pool->protocol = DgStringDuplicate(protocol);
+	pool->functions = &gStoragePakFunctions;
+	pool->specific_config = config;
+	
+	return pool;
+}
+
+/**
+ * Writing archives
+ */
+
+DgError DgPakWriterInit(DgPakWriter *this, DgStorage *storage, DgStoragePath archive) {
+	/**
+	 * Start writing a new archive, replacing any that already exists.
+	 * 
+	 * @param this Writer object
+	 * @param storage Storage object
+	 * @param archive Path to write the archive to
+	 * @return Error code
+	 */
+	
+	memset(this, 0, sizeof *this);
+	
+	DgError status = DgStreamOpen(storage, &this->stream, archive, DG_STREAM_WRITE | DG_STREAM_BUFFERED);
+	
+	if (status) {
+		return status;
+	}
+	
+	// Space for the header, which is written at the end
+	uint8_t header[DG_PAK_HEADER_SIZE];
+	memset(header, 0, sizeof header);
+	
+	status = DgStreamWrite(&this->stream, sizeof header, header);
+	
+	if (status) {
+		DgStreamClose(&this->stream);
+		return status;
+	}
+	
+	this->position = DG_PAK_HEADER_SIZE;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static void DgPakWriterFree(DgPakWriter *this) {
+	for (size_t i = 0; i < this->entry_count; i++) {
+		DgFree(this->entry[i].name);
+	}
+	
+	DgMemoryFree(this->entry);
+	
+	this->entry = NULL;
+	this->entry_count = 0;
+	this->entry_alloc = 0;
+}
+
+DgError DgPakWriterAdd(DgPakWriter *this, const char *name, const void *data, size_t size, DgPakFlags flags) {
+	/**
+	 * Add an entry to the archive
+	 * 
+	 * @param this Writer object
+	 * @param name Name of the entry, like "stages/canyon.xml"
+	 * @param data Contents of the entry
+	 * @param size Size of the contents
+	 * @param flags Options, like if the entry should be compressed
+	 * @return Error code
+	 */
+	
+	while (name[0] == '/') {
+		name++;
+	}
+	
+	if (DgStringLength(name) > UINT16_MAX) {
+		return DG_ERROR_OUT_OF_RANGE;
+	}
+	
+	if (this->entry_count == this->entry_alloc) {
+		size_t alloc = this->entry_alloc ? this->entry_alloc * 2 : 64;
+		DgPakWriterEntry *entry = DgRealloc(this->entry, sizeof *entry * alloc);
+		
+		if (!entry) {
+			return DG_ERROR_ALLOCATION_FAILED;
+		}
+		
+		this->entry = entry;
+		this->entry_alloc = alloc;
+	}
+	
+	DgPakWriterEntry *entry = &this->entry[this->entry_count];
+	
+	entry->name = DgStringDuplicate(name);
+	
+	if (!entry->name) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	entry->offset = this->position;
+	entry->size = size;
+	entry->stored_size = size;
+	entry->compression = DG_PAK_COMPRESSION_NONE;
+	
+	const void *stored = data;
+	uint8_t *compressed = NULL;
+	
+	// Only keep the compressed version if it is smaller
+	if ((flags & DG_PAK_COMPRESS) && size) {
+		size_t bound = DgCompressLZBound(size);
+		size_t written;
+		
+		compressed = DgAlloc(bound);
+		
+		if (compressed && !DgCompressLZ(data, size, compressed, bound, &written) && written < size) {
+			stored = compressed;
+			entry->stored_size = written;
+			entry->compression = DG_PAK_COMPRESSION_LZ;
+		}
+	}
+	
+	DgError status = DgStreamWrite(&this->stream, entry->stored_size, (void *) stored);
+	
+	DgMemoryFree(compressed);
+	
+	if (status) {
+		DgFree(entry->name);
+		return status;
+	}
+	
+	this->position += entry->stored_size;
+	this->entry_count++;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static int DgPakWriterCompare(const void *a, const void *b) {
+	return strcmp(((const DgPakWriterEntry *) a)->name, ((const DgPakWriterEntry *) b)->name);
+}
+
+DgError DgPakWriterFinish(DgPakWriter *this) {
+	/**
+	 * Write the table of contents and close the archive. The writer is freed
+	 * whether or not this works.
+	 * 
+	 * @param this Writer object
+	 * @return Error code, DG_ERROR_ALREADY_EXISTS if two entries have the same name
+	 */
+	
+	DgError status = DG_ERROR_SUCCESSFUL;
+	uint8_t *table = NULL;
+	
+	qsort(this->entry, this->entry_count, sizeof *this->entry, DgPakWriterCompare);
+	
+	for (size_t i = 1; i < this->entry_count; i++) {
+		if (DgStringEqual(this->entry[i - 1].name, this->entry[i].name)) {
+			status = DG_ERROR_ALREADY_EXISTS;
+			goto done;
+		}
+	}
+	
+	// Keep the slots at most half full
+	size_t slot_count = 8;
+	
+	while (slot_count < this->entry_count * 2) {
+		slot_count *= 2;
+	}
+	
+	size_t names_size = 0;
+	
+	for (size_t i = 0; i < this->entry_count; i++) {
+		names_size += DgStringLength(this->entry[i].name);
+	}
+	
+	if (this->entry_count > UINT32_MAX / 2 || names_size > UINT32_MAX) {
+		status = DG_ERROR_OUT_OF_RANGE;
+		goto done;
+	}
+	
+	size_t entries_size = this->entry_count * DG_PAK_ENTRY_SIZE;
+	size_t slots_size = slot_count * DG_PAK_SLOT_SIZE;
+	size_t table_size = entries_size + slots_size + names_size;
+	
+	table = DgAlloc(table_size ? table_size : 1);
+	
+	if (!table) {
+		status = DG_ERROR_ALLOCATION_FAILED;
+		goto done;
+	}
+	
+	memset(table, 0, table_size);
+	
+	uint8_t *entries = table;
+	uint8_t *slots = table + entries_size;
+	uint8_t *names = slots + slots_size;
+	size_t name_offset = 0;
+	
+	for (size_t i = 0; i < this->entry_count; i++) {
+		DgPakWriterEntry *entry = &this->entry[i];
+		uint8_t *p = &entries[i * DG_PAK_ENTRY_SIZE];
+		size_t length = DgStringLength(entry->name);
+		
+		DgPakPut(p, entry->offset, 8);
+		DgPakPut(p + 8, entry->size, 8);
+		DgPakPut(p + 16, entry->stored_size, 8);
+		DgPakPut(p + 24, name_offset, 4);
+		DgPakPut(p + 28, length, 2);
+		p[30] = entry->compression;
+		
+		memcpy(&names[name_offset], entry->name, length);
+		name_offset += length;
+		
+		uint32_t hash = DgChecksumFNV1a32(length, entry->name);
+		size_t slot = hash & (slot_count - 1);
+		
+		while (DgPakGet(&slots[slot * DG_PAK_SLOT_SIZE + 4], 4)) {
+			slot = (slot + 1) & (slot_count - 1);
+		}
+		
+		DgPakPut(&slots[slot * DG_PAK_SLOT_SIZE], hash, 4);
+		DgPakPut(&slots[slot * DG_PAK_SLOT_SIZE + 4], i + 1, 4);
+	}
+	
+	status = DgStreamWrite(&this->stream, table_size, table);
+	
+	if (status) {
+		goto done;
+	}
+	
+	uint8_t header[DG_PAK_HEADER_SIZE];
+	
+	DgPakPut(header, DG_PAK_MAGIC, 4);
+	DgPakPut(header + 4, DG_PAK_VERSION, 2);
+	DgPakPut(header + 6, 0, 2);
+	DgPakPut(header + 8, this->entry_count, 4);
+	DgPakPut(header + 12, slot_count, 4);
+	DgPakPut(header + 16, this->position, 8);
+	DgPakPut(header + 24, this->position + entries_size, 8);
+	DgPakPut(header + 32, this->position + entries_size + slots_size, 8);
+	DgPakPut(header + 40, names_size, 8);
+	
+	status = DgStreamSetPosition(&this->stream, 0);
+	
+	if (!status) {
+		status = DgStreamWrite(&this->stream, sizeof header, header);
+	}
+
+done:
+	DgMemoryFree(table);
+	DgPakWriterFree(this);
+	
+	DgError close_status = DgStreamClose(&this->stream);
+	
+	return status ? status : close_status;
+}
+
+static DgError DgPakAddFolder(DgPakWriter *writer, DgStorage *storage, DgStoragePath folder, const char *prefix, DgPakFlags flags) {
+	/**
+	 * Add everything in a folder to an archive
+	 * 
+	 * @param writer Writer object
+	 * @param storage Storage object
+	 * @param folder Storage path of the folder
+	 * @param prefix Name prefix for the entries ("" or ending in '/')
+	 * @param flags Options for the entries
+	 * @return Error code
+	 */
+	
+	DgStorageListing listing;
+	DgError status = DgStorageList(storage, folder, DG_STORAGE_LIST_NORMAL, &listing);
+	
+	if (status) {
+		return status;
+	}
+	
+	for (size_t i = 0; i < listing.entry_count && !status; i++) {
+		DgStorageEntry *item = &listing.entry[i];
+		DgStorageObjectType type = item->info.type;
+		char *folder_item = DgStringConcatinateL(DgStringConcatinate(folder, "/"), item->name);
+		char *name = DgStringConcatinate(prefix, item->name);
+		
+		// Links are packed as whatever they point to, and broken ones are left out
+		if (type == DG_STORAGE_TYPE_LINK && folder_item) {
+			DgStorageInfo info;
+			
+			type = DgStorageStat(storage, folder_item, &info) ? DG_STORAGE_TYPE_NONE : info.type;
+		}
+		
+		if (!folder_item || !name) {
+			status = DG_ERROR_ALLOCATION_FAILED;
+		}
+		else if (type == DG_STORAGE_TYPE_FOLDER) {
+			char *sub_prefix = DgStringConcatinate(name, "/");
+			
+			status = sub_prefix ? DgPakAddFolder(writer, storage, folder_item, sub_prefix, flags) : DG_ERROR_ALLOCATION_FAILED;
+			
+			DgMemoryFree(sub_prefix);
+		}
+		else if (type == DG_STORAGE_TYPE_FILE) {
+			size_t size;
+			void *data;
+			
+			status = DgFileLoad(storage, folder_item, &size, &data);
+			
+			if (!status) {
+				status = DgPakWriterAdd(writer, name, data, size, flags);
+				DgFree(data);
+			}
+		}
+		
+		DgMemoryFree(folder_item);
+		DgMemoryFree(name);
+	}
+	
+	DgStorageListingFree(&listing);
+	
+	return status;
+}
+
+DgError DgPakBuildFromFolder(DgStorage *storage, DgStoragePath folder, DgStoragePath archive, DgPakFlags flags) {
+	/**
+	 * Build an archive containing every file in a folder and its subfolders,
+	 * named by their path relative to the folder.
+	 * 
+	 * @note The folder's pool must support listing.
+	 * 
+	 * @param storage Storage object
+	 * @param folder Folder to pack, like "fs://assets"
+	 * @param archive Path to write the archive to, like "fs://assets.pak"
+	 * @param flags Options for the entries
+	 * @return Error code
+	 */
+	
+	DgPakWriter writer;
+	DgError status = DgPakWriterInit(&writer, storage, archive);
+	
+	if (status) {
+		return status;
+	}
+	
+	status = DgPakAddFolder(&writer, storage, folder, "", flags);
+	
+	DgError finish_status = DgPakWriterFinish(&writer);
+	
+	return status ? status : finish_status;
+}
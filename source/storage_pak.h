@@ -0,0 +1,61 @@
+/**
+ * Copyright (C) 2021 - 2024 Knot126
+ * 
+ * It is against the licence terms of this software to use it or it's source code
+ * as input for training a machine learning model, or in the development of a
+ * machine learning model. If you have found this text as the output of a machine
+ * learning algorithm, please report it both your software vendor and to the
+ * developers of the software at [https://github.com/knot126/Melon/issues].
+ * 
+ * =============================================================================
+ * 
+ * Pack file (archive) storage class
+ */
+
+#pragma once
+
+#include "common.h"
+#include "error.h"
+#include "storage.h"
+
+#define DG_PAK_MAGIC 0x4B415044 // "DPAK"
+#define DG_PAK_VERSION 1
+
+// How an entry is stored in the archive
+typedef enum DgPakCompression {
+	DG_PAK_COMPRESSION_NONE = 0,
+	DG_PAK_COMPRESSION_LZ = 1,
+} DgPakCompression;
+
+// Options for adding entries to an archive
+typedef enum DgPakFlags {
+	DG_PAK_NORMAL = 0,
+	DG_PAK_COMPRESS = (1 << 0), // Compress entries when it makes them smaller
+} DgPakFlags;
+
+typedef struct DgPakWriterEntry {
+	char *name;
+	uint64_t offset;
+	uint64_t size;
+	uint64_t stored_size;
+	DgPakCompression compression;
+} DgPakWriterEntry;
+
+/**
+ * Builds an archive one entry at a time. Entry data is written as it is
+ * added and the table of contents is written by DgPakWriterFinish.
+ */
+typedef struct DgPakWriter {
+	DgStream stream;
+	uint64_t position;
+	DgPakWriterEntry *entry;
+	size_t entry_count;
+	size_t entry_alloc;
+} DgPakWriter;
+
+DgStoragePool *DgPakCreatePool(DgStorage *storage, const char *protocol, DgStoragePath archive);
+
+DgError DgPakWriterInit(DgPakWriter *this, DgStorage *storage, DgStoragePath archive);
+DgError DgPakWriterAdd(DgPakWriter *this, const char *name, const void *data, size_t size, DgPakFlags flags);
+DgError DgPakWriterFinish(DgPakWriter *this);
+DgError DgPakBuildFromFolder(DgStorage *storage, DgStoragePath folder, DgStoragePath archive, DgPakFlags flags);
@@ -0,0 +1,1183 @@
+/**
+ * Copyright (C) 2021 - 2024 Knot126
+ * 
+ * It is against the licence terms of this software to use it or it's source code
+ * as input for training a machine learning model, or in the development of a
+ * machine learning model. If you have found this text as the output of a machine
+ * learning algorithm, please report it both your software vendor and to the
+ * developers of the software at [https://github.com/knot126/Melon/issues].
+ * 
+ * =============================================================================
+ * 
+ * Ramdisk (in-memory) storage class
+ * 
+ * @note Paths are kept in an open addressing hash table that maps the path
+ * (without the protocol or leading and trailing slashes) to a node. File
+ * contents are stored as a list of fixed-size chunks so growing a file never
+ * moves the data that is already there.
+ * 
+ * @note The pool is guarded by a reader-writer lock, so any number of streams
+ * can be read from different threads at the same time. Each stream should only
+ * be used by one thread at once.
+ */
+
+#include "common.h"
+#include "alloc.h"
+#include "string.h"
+#include "storage.h"
+#include "checksum.h"
+#include "thread.h"
+#include "log.h"
+
+#include "storage_ramdisk.h"
+
+#define DG_RAMDISK_CHUNK_SIZE 65536
+#define DG_RAMDISK_INITIAL_SLOTS 64
+
+typedef struct DgRamdiskNode {
+	char *path;                // Path in the pool
+	size_t path_length;
+	uint32_t hash;
+	DgStorageObjectType type;
+	
+	uint8_t **chunks;          // File contents
+	size_t chunk_count;
+	size_t size;
+	
+	size_t references;         // Count of open streams
+	bool unlinked;             // Not in the index anymore, free once there are no references
+} DgRamdiskNode;
+
+typedef struct {
+	DgRamdiskNode **slots;     // Hash table of nodes
+	size_t slot_count;         // Always a power of two
+	size_t slot_used;          // Slots that are live or tombstones
+	size_t slot_live;          // Slots that are live
+	
+	DgRWLock lock;
+} DgRamdisk_SpecificConfig;
+
+typedef struct {
+	DgRamdiskNode *node;
+	size_t position;
+	DgStorageFlags flags;
+} DgRamdiskStream;
+
+// Marks a slot that used to have a node in it
+static DgRamdiskNode gRamdiskTombstone;
+
+#define CONFIG() ((DgRamdisk_SpecificConfig *) pool->specific_config)
+
+/**
+ * Index functions
+ */
+
+static size_t DgRamdiskFindSlot(DgRamdisk_SpecificConfig *config, const char *key, size_t length, uint32_t hash, bool *found) {
+	/**
+	 * Find the slot holding the given key, or the slot it should be inserted
+	 * into if it is not in the index.
+	 * 
+	 * @param config Pool config
+	 * @param key Key to find
+	 * @param length Length of the key
+	 * @param hash Hash of the key
+	 * @param found Where to store if the key was found
+	 * @return Slot index
+	 */
+	
+	size_t mask = config->slot_count - 1;
+	size_t index = hash & mask;
+	size_t insert = SIZE_MAX;
+	
+	while (true) {
+		DgRamdiskNode *node = config->slots[index];
+		
+		if (!node) {
+			found[0] = false;
+			return (insert != SIZE_MAX) ? insert : index;
+		}
+		else if (node == &gRamdiskTombstone) {
+			if (insert == SIZE_MAX) {
+				insert = index;
+			}
+		}
+		else if (node->hash == hash && node->path_length == length && !memcmp(node->path, key, length)) {
+			found[0] = true;
+			return index;
+		}
+		
+		index = (index + 1) & mask;
+	}
+}
+
+static DgRamdiskNode *DgRamdiskLookup(DgRamdisk_SpecificConfig *config, const char *key, size_t length) {
+	/**
+	 * Find the node for a key
+	 * 
+	 * @param config Pool config
+	 * @param key Key to find
+	 * @param length Length of the key
+	 * @return Node or NULL if there is none
+	 */
+	
+	bool found;
+	size_t index = DgRamdiskFindSlot(config, key, length, DgChecksumFNV1a32(length, key), &found);
+	
+	return found ? config->slots[index] : NULL;
+}
+
+static DgError DgRamdiskResize(DgRamdisk_SpecificConfig *config) {
+	/**
+	 * Rebuild the index with more slots (or the same number of slots without
+	 * the tombstones if most of them are not live)
+	 * 
+	 * @param config Pool config
+	 * @return Error code
+	 */
+	
+	size_t slot_count = config->slot_count;
+	
+	if (config->slot_live * 2 >= slot_count) {
+		slot_count *= 2;
+	}
+	
+	DgRamdiskNode **old_slots = config->slots;
+	size_t old_count = config->slot_count;
+	
+	config->slots = DgAlloc(sizeof *config->slots * slot_count);
+	
+	if (!config->slots) {
+		config->slots = old_slots;
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	memset(config->slots, 0, sizeof *config->slots * slot_count);
+	config->slot_count = slot_count;
+	config->slot_used = config->slot_live;
+	
+	for (size_t i = 0; i < old_count; i++) {
+		DgRamdiskNode *node = old_slots[i];
+		
+		if (node && node != &gRamdiskTombstone) {
+			bool found;
+			config->slots[DgRamdiskFindSlot(config, node->path, node->path_length, node->hash, &found)] = node;
+		}
+	}
+	
+	DgFree(old_slots);
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgRamdiskInsert(DgRamdisk_SpecificConfig *config, DgRamdiskNode *node) {
+	/**
+	 * Insert a node into the index. The key must not already be in the index.
+	 * 
+	 * @param config Pool config
+	 * @param node Node to insert
+	 * @return Error code
+	 */
+	
+	// Keep the load factor under 3/4, counting tombstones
+	if ((config->slot_used + 1) * 4 > config->slot_count * 3) {
+		DgError status = DgRamdiskResize(config);
+		
+		if (status) {
+			return status;
+		}
+	}
+	
+	bool found;
+	size_t index = DgRamdiskFindSlot(config, node->path, node->path_length, node->hash, &found);
+	
+	if (!config->slots[index]) {
+		config->slot_used++;
+	}
+	
+	config->slots[index] = node;
+	config->slot_live++;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static void DgRamdiskRemove(DgRamdisk_SpecificConfig *config, DgRamdiskNode *node) {
+	/**
+	 * Remove a node from the index, but do not free it.
+	 * 
+	 * @param config Pool config
+	 * @param node Node to remove
+	 */
+	
+	bool found;
+	size_t index = DgRamdiskFindSlot(config, node->path, node->path_length, node->hash, &found);
+	
+	if (found) {
+		config->slots[index] = &gRamdiskTombstone;
+		config->slot_live--;
+	}
+}
+
+/**
+ * Node functions
+ */
+
+static void DgRamdiskNodeFree(DgRamdiskNode *node) {
+	/**
+	 * Free a node and its contents
+	 * 
+	 * @param node Node to free
+	 */
+	
+	for (size_t i = 0; i < node->chunk_count; i++) {
+		DgFree(node->chunks[i]);
+	}
+	
+	DgMemoryFree(node->chunks);
+	DgFree(node->path);
+	DgFree(node);
+}
+
+static DgRamdiskNode *DgRamdiskNodeCreate(DgRamdisk_SpecificConfig *config, const char *key, size_t length, DgStorageObjectType type) {
+	/**
+	 * Create an empty node and add it to the index
+	 * 
+	 * @param config Pool config
+	 * @param key Key for the node
+	 * @param length Length of the key
+	 * @param type Type of node
+	 * @return New node or NULL on failure
+	 */
+	
+	DgRamdiskNode *node = DgAlloc(sizeof *node);
+	
+	if (!node) {
+		return NULL;
+	}
+	
+	memset(node, 0, sizeof *node);
+	
+	node->path = DgStringDuplicateUntil(key, length);
+	
+	if (!node->path) {
+		DgFree(node);
+		return NULL;
+	}
+	
+	node->path_length = length;
+	node->hash = DgChecksumFNV1a32(length, key);
+	node->type = type;
+	
+	if (DgRamdiskInsert(config, node)) {
+		DgRamdiskNodeFree(node);
+		return NULL;
+	}
+	
+	return node;
+}
+
+static void DgRamdiskNodeUnlink(DgRamdisk_SpecificConfig *config, DgRamdiskNode *node) {
+	/**
+	 * Remove a node from the index and free it once it has no open streams.
+	 * 
+	 * @param config Pool config
+	 * @param node Node to unlink
+	 */
+	
+	DgRamdiskRemove(config, node);
+	node->unlinked = true;
+	
+	if (!node->references) {
+		DgRamdiskNodeFree(node);
+	}
+}
+
+static DgError DgRamdiskNodeReserve(DgRamdiskNode *node, size_t size) {
+	/**
+	 * Make sure there are enough chunks to hold `size` bytes. New chunks are
+	 * zeroed.
+	 * 
+	 * @param node File node
+	 * @param size Size in bytes
+	 * @return Error code
+	 */
+	
+	size_t chunk_count = (size + DG_RAMDISK_CHUNK_SIZE - 1) / DG_RAMDISK_CHUNK_SIZE;
+	
+	if (chunk_count <= node->chunk_count) {
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	uint8_t **chunks = DgMemoryReallocate(node->chunks, sizeof *chunks * chunk_count);
+	
+	if (!chunks) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	node->chunks = chunks;
+	
+	for (; node->chunk_count < chunk_count; node->chunk_count++) {
+		uint8_t *chunk = DgAlloc(DG_RAMDISK_CHUNK_SIZE);
+		
+		if (!chunk) {
+			return DG_ERROR_ALLOCATION_FAILED;
+		}
+		
+		memset(chunk, 0, DG_RAMDISK_CHUNK_SIZE);
+		node->chunks[node->chunk_count] = chunk;
+	}
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static void DgRamdiskNodeTruncate(DgRamdiskNode *node, size_t size) {
+	/**
+	 * Shrink a file to `size` bytes, releasing any chunks that are not needed.
+	 * 
+	 * @param node File node
+	 * @param size New size, which is not larger than the current size
+	 */
+	
+	size_t chunk_count = (size + DG_RAMDISK_CHUNK_SIZE - 1) / DG_RAMDISK_CHUNK_SIZE;
+	
+	while (node->chunk_count > chunk_count) {
+		DgFree(node->chunks[--node->chunk_count]);
+	}
+	
+	// Growing the file later should expose zeros, not old data
+	if (size % DG_RAMDISK_CHUNK_SIZE) {
+		memset(&node->chunks[chunk_count - 1][size % DG_RAMDISK_CHUNK_SIZE], 0, DG_RAMDISK_CHUNK_SIZE - (size % DG_RAMDISK_CHUNK_SIZE));
+	}
+	
+	node->size = size;
+}
+
+static DgError DgRamdiskNodeWrite(DgRamdiskNode *node, size_t offset, size_t size, const uint8_t *buffer) {
+	/**
+	 * Write to the contents of a file, growing it if needed.
+	 * 
+	 * @param node File node
+	 * @param offset Where to start writing
+	 * @param size Number of bytes to write
+	 * @param buffer Data to write
+	 * @return Error code
+	 */
+	
+	DgError status = DgRamdiskNodeReserve(node, offset + size);
+	
+	if (status) {
+		return status;
+	}
+	
+	size_t done = 0;
+	
+	while (done < size) {
+		size_t chunk = (offset + done) / DG_RAMDISK_CHUNK_SIZE;
+		size_t within = (offset + done) % DG_RAMDISK_CHUNK_SIZE;
+		size_t count = DG_RAMDISK_CHUNK_SIZE - within;
+		
+		if (count > size - done) {
+			count = size - done;
+		}
+		
+		memcpy(&node->chunks[chunk][within], &buffer[done], count);
+		done += count;
+	}
+	
+	if (offset + size > node->size) {
+		node->size = offset + size;
+	}
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static void DgRamdiskNodeRead(DgRamdiskNode *node, size_t offset, size_t size, uint8_t *buffer) {
+	/**
+	 * Read from the contents of a file. The range must be inside the file.
+	 * 
+	 * @param node File node
+	 * @param offset Where to start reading
+	 * @param size Number of bytes to read
+	 * @param buffer Where to put the data
+	 */
+	
+	size_t done = 0;
+	
+	while (done < size) {
+		size_t chunk = (offset + done) / DG_RAMDISK_CHUNK_SIZE;
+		size_t within = (offset + done) % DG_RAMDISK_CHUNK_SIZE;
+		size_t count = DG_RAMDISK_CHUNK_SIZE - within;
+		
+		if (count > size - done) {
+			count = size - done;
+		}
+		
+		memcpy(&buffer[done], &node->chunks[chunk][within], count);
+		done += count;
+	}
+}
+
+static DgError DgRamdiskMakeParents(DgRamdisk_SpecificConfig *config, const char *key, size_t length) {
+	/**
+	 * Create every folder above the given key that does not exist yet.
+	 * 
+	 * @param config Pool config
+	 * @param key Key of the deepest object
+	 * @param length Length of the key
+	 * @return Error code
+	 */
+	
+	for (size_t i = 0; i < length; i++) {
+		if (key[i] != '/') {
+			continue;
+		}
+		
+		DgRamdiskNode *node = DgRamdiskLookup(config, key, i);
+		
+		if (!node) {
+			if (!DgRamdiskNodeCreate(config, key, i, DG_STORAGE_TYPE_FOLDER)) {
+				return DG_ERROR_ALLOCATION_FAILED;
+			}
+		}
+		else if (node->type != DG_STORAGE_TYPE_FOLDER) {
+			return DG_ERROR_ALREADY_EXISTS;
+		}
+	}
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static size_t DgRamdiskCollectChildren(DgRamdisk_SpecificConfig *config, const char *key, size_t length, DgRamdiskNode ***children) {
+	/**
+	 * Find every node inside of the folder with the given key
+	 * 
+	 * @param config Pool config
+	 * @param key Key of the folder
+	 * @param length Length of the key
+	 * @param children Where to store the array of nodes (must be freed)
+	 * @return Number of nodes found
+	 */
+	
+	size_t count = 0;
+	children[0] = NULL;
+	
+	for (size_t i = 0; i < config->slot_count; i++) {
+		DgRamdiskNode *node = config->slots[i];
+		
+		if (!node || node == &gRamdiskTombstone) {
+			continue;
+		}
+		
+		if (node->path_length > length && node->path[length] == '/' && !memcmp(node->path, key, length)) {
+			DgRamdiskNode **array = DgMemoryReallocate(children[0], sizeof *array * (count + 1));
+			
+			if (!array) {
+				break;
+			}
+			
+			children[0] = array;
+			children[0][count++] = node;
+		}
+	}
+	
+	return count;
+}
+
+/**
+ * Storage functions
+ */
+
+static DgError DgRamdisk_Rename(DgStorage *storage, DgStoragePool *pool, DgStoragePath old_path, DgStoragePath new_path) {
+	/**
+	 * Rename a file or folder in this pool
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param old_path Old file name
+	 * @param new_path New file name
+	 * @return Error code
+	 */
+	
+	DgRamdisk_SpecificConfig *config = CONFIG();
+	const char *old_key, *new_key;
+	size_t old_length, new_length;
+	
+	DgStoragePathLocal(old_path, &old_key, &old_length);
+	DgStoragePathLocal(new_path, &new_key, &new_length);
+	
+	DgRWLockWrite(&config->lock);
+	
+	DgError status = DG_ERROR_SUCCESSFUL;
+	DgRamdiskNode *node = DgRamdiskLookup(config, old_key, old_length);
+	DgRamdiskNode *existing = DgRamdiskLookup(config, new_key, new_length);
+	
+	if (!node) {
+		status = DG_ERROR_FILE_NOT_FOUND;
+		goto done;
+	}
+	
+	if (node == existing) {
+		goto done;
+	}
+	
+	// Can't move a folder inside of itself
+	if (new_length > old_length && new_key[old_length] == '/' && !memcmp(new_key, old_key, old_length)) {
+		status = DG_ERROR_NOT_SAFE;
+		goto done;
+	}
+	
+	if (existing) {
+		if (existing->type == DG_STORAGE_TYPE_FOLDER || node->type == DG_STORAGE_TYPE_FOLDER) {
+			status = DG_ERROR_ALREADY_EXISTS;
+			goto done;
+		}
+		
+		DgRamdiskNodeUnlink(config, existing);
+	}
+	
+	status = DgRamdiskMakeParents(config, new_key, new_length);
+	
+	if (status) {
+		goto done;
+	}
+	
+	// Collect children first since moving them changes the index
+	DgRamdiskNode **children = NULL;
+	size_t child_count = 0;
+	
+	if (node->type == DG_STORAGE_TYPE_FOLDER) {
+		child_count = DgRamdiskCollectChildren(config, old_key, old_length, &children);
+	}
+	
+	DgRamdiskNode *moving = node;
+	
+	for (size_t i = 0; i <= child_count; i++) {
+		// The suffix after the old folder name
+		const char *suffix = &moving->path[old_length];
+		size_t suffix_length = moving->path_length - old_length;
+		char *path = DgAlloc(new_length + suffix_length + 1);
+		
+		if (!path) {
+			status = DG_ERROR_ALLOCATION_FAILED;
+			break;
+		}
+		
+		memcpy(path, new_key, new_length);
+		memcpy(&path[new_length], suffix, suffix_length);
+		path[new_length + suffix_length] = '\0';
+		
+		DgRamdiskRemove(config, moving);
+		DgFree(moving->path);
+		
+		moving->path = path;
+		moving->path_length = new_length + suffix_length;
+		moving->hash = DgChecksumFNV1a32(moving->path_length, path);
+		
+		status = DgRamdiskInsert(config, moving);
+		
+		if (status) {
+			break;
+		}
+		
+		if (i < child_count) {
+			moving = children[i];
+		}
+	}
+	
+	DgMemoryFree(children);
+
+done:
+	DgRWLockUnlock(&config->lock);
+	
+	return status;
+}
+
+static DgError DgRamdisk_Delete(DgStorage *storage, DgStoragePool *pool, DgStoragePath path) {
+	/**
+	 * Remove a file or a folder and everything in it
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param path File name
+	 * @return Error code
+	 */
+	
+	DgRamdisk_SpecificConfig *config = CONFIG();
+	const char *key;
+	size_t length;
+	
+	DgStoragePathLocal(path, &key, &length);
+	
+	DgRWLockWrite(&config->lock);
+	
+	DgRamdiskNode *node = DgRamdiskLookup(config, key, length);
+	
+	if (!node) {
+		DgRWLockUnlock(&config->lock);
+		return DG_ERROR_FILE_NOT_FOUND;
+	}
+	
+	if (node->type == DG_STORAGE_TYPE_FOLDER) {
+		DgRamdiskNode **children;
+		size_t child_count = DgRamdiskCollectChildren(config, key, length, &children);
+		
+		for (size_t i = 0; i < child_count; i++) {
+			DgRamdiskNodeUnlink(config, children[i]);
+		}
+		
+		DgMemoryFree(children);
+	}
+	
+	DgRamdiskNodeUnlink(config, node);
+	
+	DgRWLockUnlock(&config->lock);
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgRamdisk_CreateFile(DgStorage *storage, DgStoragePool *pool, DgStoragePath path) {
+	/**
+	 * Create an empty file in this pool, or empty the file if it exists.
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param path File name
+	 * @return Error code
+	 */
+	
+	DgRamdisk_SpecificConfig *config = CONFIG();
+	const char *key;
+	size_t length;
+	
+	DgStoragePathLocal(path, &key, &length);
+	
+	DgRWLockWrite(&config->lock);
+	
+	DgError status = DgRamdiskMakeParents(config, key, length);
+	
+	if (!status) {
+		DgRamdiskNode *node = DgRamdiskLookup(config, key, length);
+		
+		if (!node) {
+			status = DgRamdiskNodeCreate(config, key, length, DG_STORAGE_TYPE_FILE) ? DG_ERROR_SUCCESSFUL : DG_ERROR_ALLOCATION_FAILED;
+		}
+		else if (node->type == DG_STORAGE_TYPE_FILE) {
+			DgRamdiskNodeTruncate(node, 0);
+		}
+		else {
+			status = DG_ERROR_ALREADY_EXISTS;
+		}
+	}
+	
+	DgRWLockUnlock(&config->lock);
+	
+	return status;
+}
+
+static DgError DgRamdisk_CreateFolder(DgStorage *storage, DgStoragePool *pool, DgStoragePath path) {
+	/**
+	 * Create the specified folder(s)
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param path Folder name
+	 * @return Error code
+	 */
+	
+	DgRamdisk_SpecificConfig *config = CONFIG();
+	const char *key;
+	size_t length;
+	
+	DgStoragePathLocal(path, &key, &length);
+	
+	if (!length) {
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	DgRWLockWrite(&config->lock);
+	
+	DgError status = DgRamdiskMakeParents(config, key, length);
+	
+	if (!status) {
+		DgRamdiskNode *node = DgRamdiskLookup(config, key, length);
+		
+		if (!node) {
+			status = DgRamdiskNodeCreate(config, key, length, DG_STORAGE_TYPE_FOLDER) ? DG_ERROR_SUCCESSFUL : DG_ERROR_ALLOCATION_FAILED;
+		}
+		else if (node->type != DG_STORAGE_TYPE_FOLDER) {
+			status = DG_ERROR_ALREADY_EXISTS;
+		}
+	}
+	
+	DgRWLockUnlock(&config->lock);
+	
+	return status;
+}
+
+static DgError DgRamdisk_Type(DgStorage *storage, DgStoragePool *pool, DgStoragePath path, DgStorageObjectType *type) {
+	/**
+	 * Find the type of file at path
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param path File name
+	 * @param type Where to put the result
+	 * @return Error code
+	 */
+	
+	DgRamdisk_SpecificConfig *config = CONFIG();
+	const char *key;
+	size_t length;
+	
+	DgStoragePathLocal(path, &key, &length);
+	
+	// The root always exists
+	if (!length) {
+		type[0] = DG_STORAGE_TYPE_FOLDER;
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	DgRWLockRead(&config->lock);
+	
+	DgRamdiskNode *node = DgRamdiskLookup(config, key, length);
+	type[0] = node ? node->type : DG_STORAGE_TYPE_NONE;
+	
+	DgRWLockUnlock(&config->lock);
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgRamdisk_List(DgStorage *storage, DgStoragePool *pool, DgStoragePath path, DgStorageListFlags flags, DgStorageListing *listing) {
+	/**
+	 * List the contents of a folder
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the folder belongs to
+	 * @param path Folder name
+	 * @param flags What to find out about each entry (sizes are always known)
+	 * @param listing Listing to add the entries to
+	 * @return Error code
+	 */
+	
+	DgRamdisk_SpecificConfig *config = CONFIG();
+	const char *key;
+	size_t length;
+	DgError status = DG_ERROR_SUCCESSFUL;
+	
+	DgStoragePathLocal(path, &key, &length);
+	
+	DgRWLockRead(&config->lock);
+	
+	if (length) {
+		DgRamdiskNode *folder = DgRamdiskLookup(config, key, length);
+		
+		if (!folder || folder->type != DG_STORAGE_TYPE_FOLDER) {
+			DgRWLockUnlock(&config->lock);
+			return DG_ERROR_FILE_NOT_FOUND;
+		}
+	}
+	
+	// Children of the root have no slash before their name
+	size_t prefix = length ? length + 1 : 0;
+	
+	for (size_t i = 0; i < config->slot_count && !status; i++) {
+		DgRamdiskNode *node = config->slots[i];
+		
+		if (!node || node == &gRamdiskTombstone || node->path_length <= prefix) {
+			continue;
+		}
+		
+		if (length && (node->path[length] != '/' || memcmp(node->path, key, length))) {
+			continue;
+		}
+		
+		// Only direct children
+		if (memchr(node->path + prefix, '/', node->path_length - prefix)) {
+			continue;
+		}
+		
+		DgStorageInfo info = {
+			.type = node->type,
+			.size = node->size,
+			.modified = 0,
+		};
+		
+		status = DgStorageListingAppend(listing, node->path + prefix, node->path_length - prefix, &info);
+	}
+	
+	DgRWLockUnlock(&config->lock);
+	
+	return status;
+}
+
+static DgError DgRamdisk_Stat(DgStorage *storage, DgStoragePool *pool, DgStoragePath path, DgStorageInfo *info) {
+	/**
+	 * Find the metadata of the file at path
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param path File name
+	 * @param info Where to put the result
+	 * @return Error code
+	 */
+	
+	DgRamdisk_SpecificConfig *config = CONFIG();
+	const char *key;
+	size_t length;
+	
+	DgStoragePathLocal(path, &key, &length);
+	
+	memset(info, 0, sizeof *info);
+	
+	if (!length) {
+		info->type = DG_STORAGE_TYPE_FOLDER;
+		return DG_ERROR_SUCCESSFUL;
+	}
+	
+	DgRWLockRead(&config->lock);
+	
+	DgRamdiskNode *node = DgRamdiskLookup(config, key, length);
+	
+	if (node) {
+		info->type = node->type;
+		info->size = node->size;
+	}
+	
+	DgRWLockUnlock(&config->lock);
+	
+	return node ? DG_ERROR_SUCCESSFUL : DG_ERROR_FILE_NOT_FOUND;
+}
+
+/**
+ * Stream functions
+ */
+
+static DgError DgRamdisk_Open(DgStorage *storage, DgStoragePool *pool, DgStream *context, DgStoragePath path, DgStorageFlags flags) {
+	/**
+	 * Open a file stream
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param stream Stream object
+	 * @param path The file to open
+	 * @param flags Properties of the stream
+	 * @return Error code
+	 */
+	
+	DgRamdisk_SpecificConfig *config = CONFIG();
+	const char *key;
+	size_t length;
+	
+	if (!(flags & (DG_STREAM_READ | DG_STREAM_WRITE))) {
+		return DG_ERROR_NOT_SUPPORTED;
+	}
+	
+	DgStoragePathLocal(path, &key, &length);
+	
+	DgRamdiskStream *stream = DgAlloc(sizeof *stream);
+	
+	if (!stream) {
+		return DG_ERROR_ALLOCATION_FAILED;
+	}
+	
+	DgRWLockWrite(&config->lock);
+	
+	DgError status = DG_ERROR_SUCCESSFUL;
+	DgRamdiskNode *node = DgRamdiskLookup(config, key, length);
+	
+	if (node && node->type != DG_STORAGE_TYPE_FILE) {
+		status = DG_ERROR_NOT_SUPPORTED;
+	}
+	else if (!node && !(flags & DG_STREAM_WRITE)) {
+		status = DG_ERROR_FILE_NOT_FOUND;
+	}
+	else if (!node) {
+		status = DgRamdiskMakeParents(config, key, length);
+		
+		if (!status) {
+			node = DgRamdiskNodeCreate(config, key, length, DG_STORAGE_TYPE_FILE);
+			status = node ? DG_ERROR_SUCCESSFUL : DG_ERROR_ALLOCATION_FAILED;
+		}
+	}
+	// Opening for writing only replaces the file, like "wb"
+	else if ((flags & DG_STREAM_WRITE) && !(flags & DG_STREAM_READ)) {
+		if (flags & DG_STREAM_DONT_OVERWRITE) {
+			status = DG_ERROR_ALREADY_EXISTS;
+		}
+		else {
+			DgRamdiskNodeTruncate(node, 0);
+		}
+	}
+	
+	if (!status) {
+		node->references++;
+		
+		stream->node = node;
+		stream->position = (flags & DG_STREAM_START_AT_END) ? node->size : 0;
+		stream->flags = flags;
+		
+		context->context = stream;
+	}
+	
+	DgRWLockUnlock(&config->lock);
+	
+	if (status) {
+		DgFree(stream);
+	}
+	
+	return status;
+}
+
+static DgError DgRamdisk_Close(DgStorage *storage, DgStoragePool *pool, DgStream *context) {
+	/**
+	 * Close a file stream
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param stream Stream object
+	 * @return Error code
+	 */
+	
+	DgRamdisk_SpecificConfig *config = CONFIG();
+	DgRamdiskStream *stream = (DgRamdiskStream *) context->context;
+	
+	DgRWLockWrite(&config->lock);
+	
+	DgRamdiskNode *node = stream->node;
+	node->references--;
+	
+	if (node->unlinked && !node->references) {
+		DgRamdiskNodeFree(node);
+	}
+	
+	DgRWLockUnlock(&config->lock);
+	
+	DgFree(stream);
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgRamdisk_Read(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t size, void *buffer) {
+	/**
+	 * Read from a file stream
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param context Stream object
+	 * @param size Size of the data to read
+	 * @param buffer Buffer to read into
+	 * @return Error code
+	 */
+	
+	DgRamdisk_SpecificConfig *config = CONFIG();
+	DgRamdiskStream *stream = (DgRamdiskStream *) context->context;
+	DgError status = DG_ERROR_SUCCESSFUL;
+	
+	DgRWLockRead(&config->lock);
+	
+	if (stream->position > stream->node->size || size > stream->node->size - stream->position) {
+		status = DG_ERROR_FAILED;
+	}
+	else {
+		DgRamdiskNodeRead(stream->node, stream->position, size, buffer);
+		stream->position += size;
+	}
+	
+	DgRWLockUnlock(&config->lock);
+	
+	return status;
+}
+
+static DgError DgRamdisk_Write(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t size, void *buffer) {
+	/**
+	 * Write to a file stream
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param context Stream object
+	 * @param size Size of the data to write
+	 * @param buffer Buffer to write out
+	 * @return Error code
+	 */
+	
+	DgRamdisk_SpecificConfig *config = CONFIG();
+	DgRamdiskStream *stream = (DgRamdiskStream *) context->context;
+	
+	if (!(stream->flags & DG_STREAM_WRITE)) {
+		return DG_ERROR_READ_ONLY;
+	}
+	
+	DgRWLockWrite(&config->lock);
+	
+	DgError status = DgRamdiskNodeWrite(stream->node, stream->position, size, buffer);
+	
+	if (!status) {
+		stream->position += size;
+	}
+	
+	DgRWLockUnlock(&config->lock);
+	
+	return status;
+}
+
+static DgError DgRamdisk_GetPosition(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t *position) {
+	/**
+	 * Get the current position of a file stream
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param context Stream object
+	 * @param position Where to put the positon
+	 * @return Error code
+	 */
+	
+	position[0] = ((DgRamdiskStream *) context->context)->position;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgRamdisk_SetPosition(DgStorage *storage, DgStoragePool *pool, DgStream *context, size_t position) {
+	/**
+	 * Set the current position of a file stream. Like fseek, this can go past
+	 * the end of the file, and writing there fills the gap with zeros.
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param context Stream object
+	 * @param position What to set the position to
+	 * @return Error code
+	 */
+	
+	((DgRamdiskStream *) context->context)->position = position;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgRamdisk_Seek(DgStorage *storage, DgStoragePool *pool, DgStream *context, DgStorageSeekBase base, int64_t offset) {
+	/**
+	 * Seek to a positon in the file stream, relative to base
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param context Stream object
+	 * @param base The base of where to start
+	 * @param offset Offset after base
+	 * @return Error code
+	 */
+	
+	DgRamdisk_SpecificConfig *config = CONFIG();
+	DgRamdiskStream *stream = (DgRamdiskStream *) context->context;
+	int64_t origin;
+	
+	switch (base) {
+		case DG_STORAGE_SEEK_RELATIVE: origin = stream->position; break;
+		case DG_STORAGE_SEEK_START: origin = 0; break;
+		case DG_STORAGE_SEEK_END: {
+			DgRWLockRead(&config->lock);
+			origin = stream->node->size;
+			DgRWLockUnlock(&config->lock);
+			break;
+		}
+		default: return DG_ERROR_NOT_SUPPORTED;
+	}
+	
+	if (origin + offset < 0) {
+		return DG_ERROR_OUT_OF_RANGE;
+	}
+	
+	stream->position = origin + offset;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgRamdisk_FreeSpecificConfig(DgStoragePool *pool) {
+	/**
+	 * Free every file in the pool and the pool itself.
+	 * 
+	 * @param pool Pool to free
+	 * @return Error code
+	 */
+	
+	DgRamdisk_SpecificConfig *config = CONFIG();
+	
+	for (size_t i = 0; i < config->slot_count; i++) {
+		DgRamdiskNode *node = config->slots[i];
+		
+		if (node && node != &gRamdiskTombstone) {
+			DgRamdiskNodeFree(node);
+		}
+	}
+	
+	DgFree(config->slots);
+	DgRWLockFree(&config->lock);
+	DgFree(config);
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+#undef CONFIG
+
+DgStorageFunctions gStorageRamdiskFunctions = {
+	.create_file = &DgRamdisk_CreateFile,
+	.create_folder = &DgRamdisk_CreateFolder,
+	.type = &DgRamdisk_Type,
+	.rename = &DgRamdisk_Rename,
+	.delete = &DgRamdisk_Delete,
+	.list = &DgRamdisk_List,
+	.stat = &DgRamdisk_Stat,
+	.open = &DgRamdisk_Open,
+	.close = &DgRamdisk_Close,
+	.read = &DgRamdisk_Read,
+	.write = &DgRamdisk_Write,
+	.get_position = &DgRamdisk_GetPosition,
+	.set_position = &DgRamdisk_SetPosition,
+	.seek = &DgRamdisk_Seek,
+	.free_specific_config = &DgRamdisk_FreeSpecificConfig,
+};
+
+DgStoragePool *DgRamdiskCreatePool(const char *protocol) {
+	/**
+	 * Create an empty in-memory pool
+	 * 
+	 * @param protocol Protocol string this pool can be accessed by
+	 * @return Pointer to the storage pool (or NULL if failed)
+	 */
+	
+	DgStoragePool *pool = DgAlloc(sizeof *pool);
+	
+	if (!pool) {
+		return NULL;
+	}
+	
+	DgRamdisk_SpecificConfig *config = DgAlloc(sizeof *config);
+	
+	if (!config) {
+		DgFree(pool);
+		return NULL;
+	}
+	
+	config->slots = DgAlloc(sizeof *config->slots * DG_RAMDISK_INITIAL_SLOTS);
+	
+	if (!config->slots) {
+		DgFree(config);
+		DgFree(pool);
+		return NULL;
+	}
+	
+	memset(config->slots, 0, sizeof *config->slots * DG_RAMDISK_INITIAL_SLOTS);
+	config->slot_count = DG_RAMDISK_INITIAL_SLOTS;
+	config->slot_used = 0;
+	config->slot_live = 0;
+	
+	if (DgRWLockInit(&config->lock)) {
+		DgFree(config->slots);
+		DgFree(config);
+		DgFree(pool);
+		return NULL;
+	}
+	
+	pool->protocol = DgStringDuplicate(protocol);
+	pool->functions = &gStorageRamdiskFunctions;
+	pool->specific_config = config;
+	
+	return pool;
+}
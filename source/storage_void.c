@@ -100,6 +100,43 @@ static DgError DgVoid_Type(DgStorage *storage, DgStoragePool *pool, DgStoragePat
 	return DG_ERROR_SUCCESSFUL;
 }
 
+static DgError DgVoid_List(DgStorage *storage, DgStoragePool *pool, DgStoragePath path, DgStorageListFlags flags, DgStorageListing *listing) {
+	/**
+	 * List the contents of a folder
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the folder belongs to
+	 * @param path Folder name
+	 * @param flags What to find out about each entry
+	 * @param listing Listing to add the entries to
+	 * @return Error code
+	 */
+	
+	DgLog(DG_LOG_VERBOSE, "DgVoid_List() called!! %s", path);
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+static DgError DgVoid_Stat(DgStorage *storage, DgStoragePool *pool, DgStoragePath path, DgStorageInfo *info) {
+	/**
+	 * Find the metadata of the file at path
+	 * 
+	 * @param storage Storage object
+	 * @param pool Pool that the file belongs to
+	 * @param path File name
+	 * @param info Where to put the result
+	 * @return Error code
+	 */
+	
+	DgLog(DG_LOG_VERBOSE, "DgVoid_Stat() called!! %s", path);
+	
+	info->type = DG_STORAGE_TYPE_REMOTE;
+	info->size = 0;
+	info->modified = 0;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
 static DgError DgVoid_Open(DgStorage *storage, DgStoragePool *pool, DgStream *context, DgStoragePath path, DgStorageFlags flags) {
 	/**
 	 * Open a file stream
@@ -221,6 +258,8 @@ DgStorageFunctions gVoidFunctions = {
 	.type = &DgVoid_Type,
 	.rename = &DgVoid_Rename,
 	.delete = &DgVoid_Delete,
+	.list = &DgVoid_List,
+	.stat = &DgVoid_Stat,
 	.open = &DgVoid_Open,
 	.close = &DgVoid_Close,
 	.read = &DgVoid_Read,
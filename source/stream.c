@@ -34,10 +34,12 @@ static void DgMemoryStreamInit(DgMemoryStream *stream, void * restrict buffer, s
 	 * the memory that the stream will be set to use, and prealloc is the size
 	 * of that buffer.
 	 * 
-	 * When creating from an existing buffer, the head is set to the last byte
-	 * in the size; otherwise, it is set to zero.
+	 * When creating from an existing buffer, the head is set to the end of the
+	 * data; otherwise, it is set to zero.
 	 */
 	
+	memset(stream, 0, sizeof *stream);
+	
 	if (!buffer) {
 		stream->data = (uint8_t *) DgAlloc(prealloc);
 		
@@ -52,7 +54,7 @@ static void DgMemoryStreamInit(DgMemoryStream *stream, void * restrict buffer, s
 	
 	stream->allocated = prealloc;
 	stream->size = (!!buffer) ? prealloc : 0;
-	stream->head = (!!buffer) ? prealloc - 1 : 0;
+	stream->head = (!!buffer) ? prealloc : 0;
 }
 
 DgMemoryStream *DgMemoryStreamCreate(void) {
@@ -88,6 +90,49 @@ DgMemoryStream *DgMemoryStreamFromBuffer(void *buffer, size_t size) {
 	return stream;
 }
 
+DgMemoryStream *DgMemoryStreamCreateChunked(size_t chunk_size) {
+	/**
+	 * Creates a stream in memory that stores its data as a list of chunks.
+	 * Appending never moves data that is already in the stream, so building a
+	 * large stream copies each byte once and doesn't need twice the memory.
+	 * 
+	 * Chunks start at chunk_size bytes and get bigger as the stream grows, up
+	 * to DG_MEMORY_STREAM_MAX_CHUNK. Use DgMemoryStreamGetBuffers to write the
+	 * chunks out without joining them, or DgMemoryStreamFlatten to join them.
+	 * 
+	 * @param chunk_size Size of the first chunk, or zero for the default
+	 * @return New stream, or NULL if failed
+	 */
+	
+	DgMemoryStream *stream = DgAlloc(sizeof *stream);
+	
+	if (!stream) {
+		return NULL;
+	}
+	
+	memset(stream, 0, sizeof *stream);
+	
+	stream->chunked = true;
+	stream->chunk_size = chunk_size ? chunk_size : 4096;
+	
+	return stream;
+}
+
+static void DgMemoryStreamFreeChunks(DgMemoryStream *stream) {
+	DgMemoryStreamChunk *chunk = stream->first;
+	
+	while (chunk) {
+		DgMemoryStreamChunk *next = chunk->next;
+		DgFree(chunk);
+		chunk = next;
+	}
+	
+	stream->first = NULL;
+	stream->last = NULL;
+	stream->cursor = NULL;
+	stream->cursor_offset = 0;
+}
+
 void DgMemoryStreamFree(DgMemoryStream *stream) {
 	/**
 	 * Frees all memory allocated by a stream.
@@ -97,9 +142,83 @@ void DgMemoryStreamFree(DgMemoryStream *stream) {
 		DgFree(stream->data);
 	}
 	
+	DgMemoryStreamFreeChunks(stream);
+	
 	DgFree(stream);
 }
 
+void DgMemoryStreamFlatten(DgMemoryStream *stream) {
+	/**
+	 * Join the chunks of a chunked stream into one buffer. The stream stops
+	 * being chunked, so later writes grow the buffer instead. This does
+	 * nothing to streams that are not chunked.
+	 */
+	
+	if (!stream->chunked) {
+		return;
+	}
+	
+	uint8_t *data = DgAlloc(stream->size ? stream->size : 1);
+	
+	if (!data) {
+		stream->error = DG_MEMORY_STREAM_ALLOC_ERROR;
+		return;
+	}
+	
+	size_t offset = 0;
+	
+	for (DgMemoryStreamChunk *chunk = stream->first; chunk; chunk = chunk->next) {
+		memcpy(data + offset, chunk->data, chunk->size);
+		offset += chunk->size;
+	}
+	
+	DgMemoryStreamFreeChunks(stream);
+	
+	stream->chunked = false;
+	stream->data = data;
+	stream->allocated = stream->size ? stream->size : 1;
+}
+
+size_t DgMemoryStreamGetBuffers(DgMemoryStream *stream, size_t count, DgStorageBuffer *buffers) {
+	/**
+	 * Get the data of the stream as a list of buffers without copying it, for
+	 * example to pass to DgStreamWritev. The buffers are only valid until the
+	 * stream is next changed.
+	 * 
+	 * @param stream Stream to get the buffers of
+	 * @param count Number of buffers that fit in `buffers`
+	 * @param buffers Where to store the buffers
+	 * @return Number of buffers the whole stream needs, which can be more than
+	 * count
+	 */
+	
+	if (!stream->chunked) {
+		if (count && stream->size) {
+			buffers[0].data = stream->data;
+			buffers[0].size = stream->size;
+		}
+		
+		return stream->size ? 1 : 0;
+	}
+	
+	size_t needed = 0;
+	
+	for (DgMemoryStreamChunk *chunk = stream->first; chunk; chunk = chunk->next) {
+		if (!chunk->size) {
+			continue;
+		}
+		
+		if (needed < count) {
+			buffers[needed].data = chunk->data;
+			buffers[needed].size = chunk->size;
+		}
+		
+		needed++;
+	}
+	
+	return needed;
+}
+
 void DgBufferFromStream(DgMemoryStream *stream, void **pointer, size_t *size) {
 	/**
 	 * Degrade the stream to a pointer to memory and size. This will free the
@@ -107,9 +226,11 @@ void DgBufferFromStream(DgMemoryStream *stream, void **pointer, size_t *size) {
 	 * 
 	 * This will also resize the memory block to the requested size. Should this
 	 * fail, 'pointer' is set the fail result of DgRealloc, which is usually
-	 * NULL.
+	 * NULL. Chunked streams are flattened first.
 	 */
 	
+	DgMemoryStreamFlatten(stream);
+	
 	stream->data = DgRealloc(stream->data, stream->size);
 	
 	*pointer = (void *) stream->data;
@@ -123,10 +244,16 @@ void DgMemoryStreamGetPointersAndSize(DgMemoryStream *stream, size_t *size, void
 	 * Get the current pointers and size of the stream without allocating any 
 	 * new buffer. All feilds are optional and can be replaced with NULL.
 	 * 
+	 * @note Chunked streams are flattened if data is asked for.
+	 * 
 	 * @param size Pointer to where to store size of the data stream
 	 * @param data Pointer to where to store the pointer to the data
 	 */
 	
+	if (data) {
+		DgMemoryStreamFlatten(stream);
+	}
+	
 	// Get current stream size
 	if (size) {
 		size[0] = stream->size;
@@ -151,11 +278,7 @@ size_t DgMemoryStreamError(DgMemoryStream *stream) {
 size_t DgMemoryStreamGetpos(DgMemoryStream *stream) {
 	/**
 	 * Get the current position in the file stream as the offset to the start of
-	 * the stream.
-	 * 
-	 * This will not return the size of the stream if at DG_MEMORY_STREAM_END; instead,
-	 * it will return (size - 1). If you really need to get the size, use the
-	 * respective function for getting the stream data's length.
+	 * the stream. At the end of the stream, this is the size of the stream.
 	 */
 	
 	return stream->head;
@@ -175,7 +298,7 @@ void DgMemoryStreamSetpos(DgMemoryStream *stream, DgMemoryStreamEnum offset, int
 	 * so it can be negitive.
 	 */
 	
-	size_t base;
+	int64_t base;
 	
 	switch (offset) {
 		case DG_MEMORY_STREAM_CUR:
@@ -187,7 +310,7 @@ void DgMemoryStreamSetpos(DgMemoryStream *stream, DgMemoryStreamEnum offset, int
 			break;
 		
 		case DG_MEMORY_STREAM_END:
-			base = stream->size - 1;
+			base = stream->size;
 			break;
 		
 		default:
@@ -198,7 +321,7 @@ void DgMemoryStreamSetpos(DgMemoryStream *stream, DgMemoryStreamEnum offset, int
 	
 	base += pos;
 	
-	if (base < 0 || base >= stream->size) {
+	if (base < 0 || (uint64_t) base > stream->size) {
 		stream->error = DG_MEMORY_STREAM_RANGE;
 		return;
 	}
@@ -215,6 +338,153 @@ void DgMemoryStreamRewind(DgMemoryStream *stream) {
 	stream->error = DG_MEMORY_STREAM_OKAY;
 }
 
+/**
+ * Chunked streams
+ */
+
+static DgMemoryStreamChunk *DgMemoryStreamLocate(DgMemoryStream *stream, size_t position, size_t *offset) {
+	/**
+	 * Find the chunk that has the byte at position, starting from the last
+	 * chunk used when we can so that reading in order is fast.
+	 * 
+	 * @param stream Chunked stream
+	 * @param position Position to find, less than the size of the stream
+	 * @param offset Where to store the offset of the chunk in the stream
+	 * @return The chunk
+	 */
+	
+	DgMemoryStreamChunk *chunk = stream->first;
+	size_t start = 0;
+	
+	if (stream->cursor && position >= stream->cursor_offset) {
+		chunk = stream->cursor;
+		start = stream->cursor_offset;
+	}
+	
+	while (position - start >= chunk->size) {
+		start += chunk->size;
+		chunk = chunk->next;
+	}
+	
+	stream->cursor = chunk;
+	stream->cursor_offset = start;
+	
+	offset[0] = start;
+	
+	return chunk;
+}
+
+static void DgMemoryStreamChunkedRead(DgMemoryStream *stream, size_t size, uint8_t *buffer) {
+	size_t offset;
+	DgMemoryStreamChunk *chunk = DgMemoryStreamLocate(stream, stream->head, &offset);
+	size_t at = stream->head - offset;
+	
+	while (size) {
+		size_t count = chunk->size - at;
+		
+		if (count > size) {
+			count = size;
+		}
+		
+		memcpy(buffer, chunk->data + at, count);
+		
+		buffer += count;
+		size -= count;
+		stream->head += count;
+		
+		// Move the cursor along only while there is more to read so it never
+		// points past the last chunk
+		if (size) {
+			stream->cursor_offset += chunk->size;
+			stream->cursor = chunk = chunk->next;
+			at = 0;
+		}
+	}
+}
+
+static void DgMemoryStreamChunkedWrite(DgMemoryStream *stream, size_t size, const uint8_t *buffer) {
+	/**
+	 * Write to a chunked stream. Data that is already in the stream is
+	 * overwritten in place and the rest is appended.
+	 */
+	
+	// Overwrite
+	if (stream->head < stream->size) {
+		size_t offset;
+		DgMemoryStreamChunk *chunk = DgMemoryStreamLocate(stream, stream->head, &offset);
+		size_t at = stream->head - offset;
+		
+		while (size && chunk) {
+			size_t count = chunk->size - at;
+			
+			if (count > size) {
+				count = size;
+			}
+			
+			memcpy(chunk->data + at, buffer, count);
+			
+			buffer += count;
+			size -= count;
+			stream->head += count;
+			
+			if (size && chunk->next) {
+				stream->cursor_offset += chunk->size;
+				stream->cursor = chunk->next;
+			}
+			
+			chunk = chunk->next;
+			at = 0;
+		}
+	}
+	
+	// Append
+	while (size) {
+		DgMemoryStreamChunk *last = stream->last;
+		
+		if (!last || last->size == last->allocated) {
+			// Big writes get a chunk of their own so they are only copied once
+			size_t allocated = (size > stream->chunk_size) ? size : stream->chunk_size;
+			DgMemoryStreamChunk *chunk = DgAlloc(sizeof *chunk + allocated);
+			
+			if (!chunk) {
+				stream->error = DG_MEMORY_STREAM_ALLOC_ERROR;
+				return;
+			}
+			
+			chunk->next = NULL;
+			chunk->size = 0;
+			chunk->allocated = allocated;
+			
+			if (last) {
+				last->next = chunk;
+			}
+			else {
+				stream->first = chunk;
+			}
+			
+			stream->last = last = chunk;
+			
+			if (stream->chunk_size < DG_MEMORY_STREAM_MAX_CHUNK) {
+				stream->chunk_size *= 2;
+			}
+		}
+		
+		size_t count = last->allocated - last->size;
+		
+		if (count > size) {
+			count = size;
+		}
+		
+		memcpy(last->data + last->size, buffer, count);
+		
+		last->size += count;
+		buffer += count;
+		size -= count;
+		stream->head += count;
+		stream->size += count;
+	}
+}
+
 void DgMemoryStreamRead(DgMemoryStream *stream, size_t size, void *buffer) {
 	/**
 	 * Read a stream's data starting at its current head position until either
@@ -232,11 +502,16 @@ void DgMemoryStreamRead(DgMemoryStream *stream, size_t size, void *buffer) {
 	// Check that the requested size does not exceede the size of the stream, 
 	// and that size > 0 and buffer is not NULL. If any of these are so, then
 	// we will need to set error and return.
-	if (((stream->head + size) >= stream->size) || (size == 0) || (buffer == NULL)) {
+	if ((size > stream->size - stream->head) || (size == 0) || (buffer == NULL)) {
 		stream->error = DG_MEMORY_STREAM_RANGE;
 		return;
 	}
 	
+	if (stream->chunked) {
+		DgMemoryStreamChunkedRead(stream, size, buffer);
+		return;
+	}
+	
 	// Copy data to the buffer
 	memcpy(buffer, (void *) stream->data + stream->head, size);
 	
@@ -250,21 +525,34 @@ void DgMemoryStreamWrite(DgMemoryStream *stream, size_t size, void *buffer) {
 	 * raises any errors, the data should be assumed to be corrupt.
 	 */
 	
-	// Reallocate memory while there is not enough to fit new data
-	while ((stream->head + 1 + size) > stream->allocated) {
-		stream->allocated *= 2;
-		stream->data = (uint8_t *) DgRealloc(stream->data, stream->allocated);
+	if (stream->chunked) {
+		DgMemoryStreamChunkedWrite(stream, size, buffer);
+		return;
+	}
+	
+	// Reallocate memory if there is not enough to fit new data
+	if ((stream->head + size) > stream->allocated) {
+		size_t allocated = stream->allocated ? stream->allocated : 1024;
 		
-		if (!stream->data) {
+		while ((stream->head + size) > allocated) {
+			allocated *= 2;
+		}
+		
+		uint8_t *data = (uint8_t *) DgRealloc(stream->data, allocated);
+		
+		if (!data) {
 			stream->error = DG_MEMORY_STREAM_ALLOC_ERROR;
 			return;
 		}
+		
+		stream->data = data;
+		stream->allocated = allocated;
 	}
 	
 	// If writing the data makes the new stream size exceede the current size,
 	// then set the stream size to the amount it should be.
-	if ((stream->head + 1 + size) > stream->size) {
-		stream->size = (stream->head + 1) + size;
+	if ((stream->head + size) > stream->size) {
+		stream->size = stream->head + size;
 	}
 	
 	// Copy the memory
@@ -381,3 +669,6 @@ void DgMemoryStreamWriteFloat(DgMemoryStream *stream, float *data) {
 void DgMemoryStreamWriteDouble(DgMemoryStream *stream, double *data) {
 	DgMemoryStreamWrite(stream, sizeof(double), data);
 }
+
+// Array functions, which are automatically generated
+#include "stream_generated.part"
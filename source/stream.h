@@ -18,6 +18,11 @@
 #include <inttypes.h>
 #include <stdlib.h>
 
+#include "storage.h"
+
+// Largest chunk that chunked streams allocate for small writes
+#define DG_MEMORY_STREAM_MAX_CHUNK (16 * 1024 * 1024)
+
 typedef enum DgMemoryStreamEnum {
 	/* errors */
 	DG_MEMORY_STREAM_OKAY = 0,
@@ -34,6 +39,13 @@ typedef enum DgMemoryStreamEnum {
 	DG_MEMORY_STREAM_END = 2,
 } DgMemoryStreamEnum;
 
+typedef struct DgMemoryStreamChunk {
+	struct DgMemoryStreamChunk *next;
+	size_t size;
+	size_t allocated;
+	uint8_t data[];
+} DgMemoryStreamChunk;
+
 typedef struct DgMemoryStream {
 	/* For storing data */
 	uint8_t *data;
@@ -41,16 +53,27 @@ typedef struct DgMemoryStream {
 	size_t size;
 	size_t head;
 	
+	/* Chunked mode, where data is a list of chunks that never move */
+	bool chunked;
+	DgMemoryStreamChunk *first;
+	DgMemoryStreamChunk *last;
+	DgMemoryStreamChunk *cursor;  // Chunk that the head was last in
+	size_t cursor_offset;         // Offset of the cursor chunk in the stream
+	size_t chunk_size;            // Size of the next chunk to allocate
+	
 	/* Errors */
 	size_t error;
 } DgMemoryStream;
 
 DgMemoryStream *DgMemoryStreamCreate(void);
 DgMemoryStream *DgMemoryStreamFromBuffer(void *buffer, size_t size);
+DgMemoryStream *DgMemoryStreamCreateChunked(size_t chunk_size);
 
 void DgMemoryStreamFree(DgMemoryStream *stream);
 void DgBufferFromStream(DgMemoryStream *stream, void **pointer, size_t *size);
 void DgMemoryStreamGetPointersAndSize(DgMemoryStream *stream, size_t *size, void **data);
+size_t DgMemoryStreamGetBuffers(DgMemoryStream *stream, size_t count, DgStorageBuffer *buffers);
+void DgMemoryStreamFlatten(DgMemoryStream *stream);
 
 size_t DgMemoryStreamError(DgMemoryStream *stream);
 
@@ -83,3 +106,6 @@ void DgMemoryStreamWriteInt64(DgMemoryStream *stream, int64_t *data);
 void DgMemoryStreamWriteUInt64(DgMemoryStream *stream, uint64_t *data);
 void DgMemoryStreamWriteFloat(DgMemoryStream *stream, float *data);
 void DgMemoryStreamWriteDouble(DgMemoryStream *stream, double *data);
+
+// Arrays in a given byte order
+#include "stream_generated.h"
@@ -0,0 +1,23 @@
+// Auto-generated by generate_serialise_for_types.py
+// Array reads
+void DgMemoryStreamReadArrayInt8(DgMemoryStream *stream, size_t count, int8_t* data, DgByteOrder order);
+void DgMemoryStreamReadArrayUInt8(DgMemoryStream *stream, size_t count, uint8_t* data, DgByteOrder order);
+void DgMemoryStreamReadArrayInt16(DgMemoryStream *stream, size_t count, int16_t* data, DgByteOrder order);
+void DgMemoryStreamReadArrayUInt16(DgMemoryStream *stream, size_t count, uint16_t* data, DgByteOrder order);
+void DgMemoryStreamReadArrayInt32(DgMemoryStream *stream, size_t count, int32_t* data, DgByteOrder order);
+void DgMemoryStreamReadArrayUInt32(DgMemoryStream *stream, size_t count, uint32_t* data, DgByteOrder order);
+void DgMemoryStreamReadArrayInt64(DgMemoryStream *stream, size_t count, int64_t* data, DgByteOrder order);
+void DgMemoryStreamReadArrayUInt64(DgMemoryStream *stream, size_t count, uint64_t* data, DgByteOrder order);
+void DgMemoryStreamReadArrayFloat32(DgMemoryStream *stream, size_t count, float* data, DgByteOrder order);
+void DgMemoryStreamReadArrayFloat64(DgMemoryStream *stream, size_t count, double* data, DgByteOrder order);
+// Array writes
+void DgMemoryStreamWriteArrayInt8(DgMemoryStream *stream, size_t count, const int8_t* data, DgByteOrder order);
+void DgMemoryStreamWriteArrayUInt8(DgMemoryStream *stream, size_t count, const uint8_t* data, DgByteOrder order);
+void DgMemoryStreamWriteArrayInt16(DgMemoryStream *stream, size_t count, const int16_t* data, DgByteOrder order);
+void DgMemoryStreamWriteArrayUInt16(DgMemoryStream *stream, size_t count, const uint16_t* data, DgByteOrder order);
+void DgMemoryStreamWriteArrayInt32(DgMemoryStream *stream, size_t count, const int32_t* data, DgByteOrder order);
+void DgMemoryStreamWriteArrayUInt32(DgMemoryStream *stream, size_t count, const uint32_t* data, DgByteOrder order);
+void DgMemoryStreamWriteArrayInt64(DgMemoryStream *stream, size_t count, const int64_t* data, DgByteOrder order);
+void DgMemoryStreamWriteArrayUInt64(DgMemoryStream *stream, size_t count, const uint64_t* data, DgByteOrder order);
+void DgMemoryStreamWriteArrayFloat32(DgMemoryStream *stream, size_t count, const float* data, DgByteOrder order);
+void DgMemoryStreamWriteArrayFloat64(DgMemoryStream *stream, size_t count, const double* data, DgByteOrder order);
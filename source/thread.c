@@ -14,10 +14,19 @@
 
 #ifndef _WIN32
 	#include <pthread.h>
+#else
+	#include <windows.h>
 #endif
 
 #include "thread.h"
 
+#ifdef _WIN32
+	// Slim reader-writer locks are used for mutexes as well, since they work
+	// with condition variables and are only the size of a pointer like those
+	#define DG_THREAD_SRWLOCK(lock) ((PSRWLOCK) &(lock)->_info)
+	#define DG_THREAD_CONDITION(condition) ((PCONDITION_VARIABLE) &(condition)->_info)
+#endif
+
 int DgThreadNew(DgThread* thread, DgThreadFunction func, DgThreadArg arg) {
 	/**
 	 * Create a thread object and start execution.
@@ -49,3 +58,238 @@ int DgThreadJoin(DgThread* thread) {
 	return 1;
 #endif
 }
+
+int DgRWLockInit(DgRWLock *lock) {
+	/**
+	 * Initialise a reader-writer lock
+	 * 
+	 * @param lock Lock object
+	 * @return Integer status code, dependent on thread library
+	 */
+	
+#ifndef _WIN32
+	return pthread_rwlock_init(&lock->_info, NULL);
+#else
+	InitializeSRWLock(DG_THREAD_SRWLOCK(lock));
+	lock->_exclusive = 0;
+	return 0;
+#endif
+}
+
+int DgRWLockFree(DgRWLock *lock) {
+	/**
+	 * Destroy a reader-writer lock
+	 * 
+	 * @param lock Lock object
+	 * @return Integer status code, dependent on thread library
+	 */
+	
+#ifndef _WIN32
+	return pthread_rwlock_destroy(&lock->_info);
+#else
+	// Slim reader-writer locks don't need to be destroyed
+	return 0;
+#endif
+}
+
+int DgRWLockRead(DgRWLock *lock) {
+	/**
+	 * Acquire the lock for reading. Many threads can read at once.
+	 * 
+	 * @param lock Lock object
+	 * @return Integer status code, dependent on thread library
+	 */
+	
+#ifndef _WIN32
+	return pthread_rwlock_rdlock(&lock->_info);
+#else
+	AcquireSRWLockShared(DG_THREAD_SRWLOCK(lock));
+	return 0;
+#endif
+}
+
+int DgRWLockWrite(DgRWLock *lock) {
+	/**
+	 * Acquire the lock for writing. This waits for every reader to finish.
+	 * 
+	 * @param lock Lock object
+	 * @return Integer status code, dependent on thread library
+	 */
+	
+#ifndef _WIN32
+	return pthread_rwlock_wrlock(&lock->_info);
+#else
+	AcquireSRWLockExclusive(DG_THREAD_SRWLOCK(lock));
+	lock->_exclusive = 1;
+	return 0;
+#endif
+}
+
+int DgRWLockUnlock(DgRWLock *lock) {
+	/**
+	 * Release the lock after reading or writing
+	 * 
+	 * @param lock Lock object
+	 * @return Integer status code, dependent on thread library
+	 */
+	
+#ifndef _WIN32
+	return pthread_rwlock_unlock(&lock->_info);
+#else
+	// Only a writer can set this, and readers can't hold the lock at the same
+	// time, so it says which kind of release is needed
+	if (lock->_exclusive) {
+		lock->_exclusive = 0;
+		ReleaseSRWLockExclusive(DG_THREAD_SRWLOCK(lock));
+	}
+	else {
+		ReleaseSRWLockShared(DG_THREAD_SRWLOCK(lock));
+	}
+	
+	return 0;
+#endif
+}
+
+int DgMutexInit(DgMutex *mutex) {
+	/**
+	 * Initialise a mutex
+	 * 
+	 * @param mutex Mutex object
+	 * @return Integer status code, dependent on thread library
+	 */
+	
+#ifndef _WIN32
+	return pthread_mutex_init(&mutex->_info, NULL);
+#else
+	InitializeSRWLock(DG_THREAD_SRWLOCK(mutex));
+	return 0;
+#endif
+}
+
+int DgMutexFree(DgMutex *mutex) {
+	/**
+	 * Destroy a mutex
+	 * 
+	 * @param mutex Mutex object
+	 * @return Integer status code, dependent on thread library
+	 */
+	
+#ifndef _WIN32
+	return pthread_mutex_destroy(&mutex->_info);
+#else
+	return 0;
+#endif
+}
+
+int DgMutexLock(DgMutex *mutex) {
+	/**
+	 * Acquire a mutex, waiting until it is free
+	 * 
+	 * @param mutex Mutex object
+	 * @return Integer status code, dependent on thread library
+	 */
+	
+#ifndef _WIN32
+	return pthread_mutex_lock(&mutex->_info);
+#else
+	AcquireSRWLockExclusive(DG_THREAD_SRWLOCK(mutex));
+	return 0;
+#endif
+}
+
+int DgMutexUnlock(DgMutex *mutex) {
+	/**
+	 * Release a mutex
+	 * 
+	 * @param mutex Mutex object
+	 * @return Integer status code, dependent on thread library
+	 */
+	
+#ifndef _WIN32
+	return pthread_mutex_unlock(&mutex->_info);
+#else
+	ReleaseSRWLockExclusive(DG_THREAD_SRWLOCK(mutex));
+	return 0;
+#endif
+}
+
+int DgConditionInit(DgCondition *condition) {
+	/**
+	 * Initialise a condition variable
+	 * 
+	 * @param condition Condition object
+	 * @return Integer status code, dependent on thread library
+	 */
+	
+#ifndef _WIN32
+	return pthread_cond_init(&condition->_info, NULL);
+#else
+	InitializeConditionVariable(DG_THREAD_CONDITION(condition));
+	return 0;
+#endif
+}
+
+int DgConditionFree(DgCondition *condition) {
+	/**
+	 * Destroy a condition variable
+	 * 
+	 * @param condition Condition object
+	 * @return Integer status code, dependent on thread library
+	 */
+	
+#ifndef _WIN32
+	return pthread_cond_destroy(&condition->_info);
+#else
+	return 0;
+#endif
+}
+
+int DgConditionWait(DgCondition *condition, DgMutex *mutex) {
+	/**
+	 * Release the mutex and wait for the condition to be signalled, then
+	 * acquire the mutex again. Wakeups can be spurious, so always check what
+	 * you are waiting for in a loop.
+	 * 
+	 * @param condition Condition object
+	 * @param mutex Mutex that is held by the calling thread
+	 * @return Integer status code, dependent on thread library
+	 */
+	
+#ifndef _WIN32
+	return pthread_cond_wait(&condition->_info, &mutex->_info);
+#else
+	return !SleepConditionVariableSRW(DG_THREAD_CONDITION(condition), DG_THREAD_SRWLOCK(mutex), INFINITE, 0);
+#endif
+}
+
+int DgConditionSignal(DgCondition *condition) {
+	/**
+	 * Wake up one thread waiting on the condition
+	 * 
+	 * @param condition Condition object
+	 * @return Integer status code, dependent on thread library
+	 */
+	
+#ifndef _WIN32
+	return pthread_cond_signal(&condition->_info);
+#else
+	WakeConditionVariable(DG_THREAD_CONDITION(condition));
+	return 0;
+#endif
+}
+
+int DgConditionBroadcast(DgCondition *condition) {
+	/**
+	 * Wake up every thread waiting on the condition
+	 * 
+	 * @param condition Condition object
+	 * @return Integer status code, dependent on thread library
+	 */
+	
+#ifndef _WIN32
+	return pthread_cond_broadcast(&condition->_info);
+#else
+	WakeAllConditionVariable(DG_THREAD_CONDITION(condition));
+	return 0;
+#endif
+}
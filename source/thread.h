@@ -12,6 +12,8 @@
  * Thread abstraction
  */
 
+#pragma once
+
 #ifndef _WIN32
 	#include <pthread.h>
 #endif
@@ -30,5 +32,56 @@ typedef struct DgThread {
 #endif
 } DgThread;
 
+/**
+ * Reader-writer lock: any number of readers or a single writer.
+ */
+typedef struct DgRWLock {
+#ifndef _WIN32
+	pthread_rwlock_t _info;
+#else
+	void *_info;        // SRWLOCK
+	int _exclusive;     // If the lock is held by a writer
+#endif
+} DgRWLock;
+
+/**
+ * Mutual exclusion lock
+ */
+typedef struct DgMutex {
+#ifndef _WIN32
+	pthread_mutex_t _info;
+#else
+	void *_info;        // SRWLOCK
+#endif
+} DgMutex;
+
+/**
+ * Condition variable, used with a DgMutex to wait for something to happen
+ */
+typedef struct DgCondition {
+#ifndef _WIN32
+	pthread_cond_t _info;
+#else
+	void *_info;        // CONDITION_VARIABLE
+#endif
+} DgCondition;
+
 int DgThreadNew(DgThread* thread, DgThreadFunction func, DgThreadArg arg);
 int DgThreadJoin(DgThread* thread);
+
+int DgRWLockInit(DgRWLock *lock);
+int DgRWLockFree(DgRWLock *lock);
+int DgRWLockRead(DgRWLock *lock);
+int DgRWLockWrite(DgRWLock *lock);
+int DgRWLockUnlock(DgRWLock *lock);
+
+int DgMutexInit(DgMutex *mutex);
+int DgMutexFree(DgMutex *mutex);
+int DgMutexLock(DgMutex *mutex);
+int DgMutexUnlock(DgMutex *mutex);
+
+int DgConditionInit(DgCondition *condition);
+int DgConditionFree(DgCondition *condition);
+int DgConditionWait(DgCondition *condition, DgMutex *mutex);
+int DgConditionSignal(DgCondition *condition);
+int DgConditionBroadcast(DgCondition *condition);
@@ -69,6 +69,25 @@ uint32_t DgNsecTime(void) {
 	return t.tv_nsec;
 }
 
+uint64_t DgMonotonicTime(void) {
+	/**
+	 * Get a time in nanoseconds that never goes backwards, for measuring how
+	 * long something takes. It has no meaning on its own.
+	 * 
+	 * @return Monotonic time in nanoseconds
+	 */
+	
+	struct timespec t;
+	
+#ifdef CLOCK_MONOTONIC
+	clock_gettime(CLOCK_MONOTONIC, &t);
+#else
+	timespec_get(&t, TIME_UTC);
+#endif
+	
+	return (uint64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
 double DgTimeUntilEveryoneDies(void) {
 	/**
 	 * Return the time until something bad happens and everyone on Earth dies.
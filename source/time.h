@@ -22,5 +22,6 @@ double DgTime(void);
 double DgRealTime(void);
 
 uint32_t DgNsecTime(void);
+uint64_t DgMonotonicTime(void);
 
 void DgSleep(double length);
@@ -1,6 +1,17 @@
 #include "util/melon.h"
 #include "util/storage_void.h"
 #include "util/storage_filesystem.h"
+#include "util/storage_ramdisk.h"
+#include "util/storage_async.h"
+#include "util/storage_pak.h"
+#include "util/storage_cache.h"
+#include "util/storage_compressed.h"
+#include "util/storage_overlay.h"
+#include "util/storage_dedup.h"
+#include "util/storage_metrics.h"
+#include "util/storage_memory.h"
+
+#include "test_structs.h"
 
 #ifndef MELON_CRYPTOGRAPHY_RANDOM
 #error MELON_CRYPTOGRAPHY_RANDOM not defined
@@ -99,60 +110,1815 @@ void TestStorage(void) {
 	DgFileAppend(NULL, "fs://hello.txt", sizeof(sample) - 1, sample);
 	
 	DgLog(DG_LOG_SUCCESS, "TestStorage() - 3");
+	
+	// TEST 4
+	DgLog(DG_LOG_INFO, "Mapping a file...");
+	
+	DgStorageMapping mapping;
+	
+	if (DgFileMap(NULL, "fs://hello.txt", DG_STORAGE_MAP_SEQUENTIAL, &mapping)) {
+		DgLog(DG_LOG_ERROR, "Failed to map file!");
+		return;
+	}
+	
+	DgLog(DG_LOG_INFO, "Mapped %d bytes, starts with: %.12s", mapping.length, mapping.data);
+	
+	DgFileUnmap(&mapping);
+	
+	DgLog(DG_LOG_SUCCESS, "TestStorage() - 4");
+	
+	// TEST 5
+	DgLog(DG_LOG_INFO, "Vectored write and read...");
+	
+	char header[4] = "HEAD", payload[6] = "middle", trailer[4] = "TAIL";
+	DgStorageBuffer parts[3] = {{header, 4}, {payload, 6}, {trailer, 4}};
+	
+	if (DgStreamOpen(NULL, &s, "fs://vectored.bin", DG_STREAM_WRITE)) {
+		DgLog(DG_LOG_ERROR, "Failed to open file stream!");
+		return;
+	}
+	
+	DgLogError(DgStreamWritev(&s, parts, 3));
+	DgStreamClose(&s);
+	
+	char got_header[4], got_rest[10];
+	DgStorageBuffer got[2] = {{got_header, 4}, {got_rest, 10}};
+	
+	DgStreamOpen(NULL, &s, "fs://vectored.bin", DG_STREAM_READ);
+	DgLogError(DgStreamReadv(&s, got, 2));
+	DgStreamClose(&s);
+	
+	DgStorageDelete(NULL, "fs://vectored.bin");
+	
+	DgLog(memcmp(got_header, "HEAD", 4) || memcmp(got_rest, "middleTAIL", 10) ? DG_LOG_ERROR : DG_LOG_SUCCESS, "TestStorage() - 5");
+	
+	// TEST 6
+	DgLog(DG_LOG_INFO, "Listing and stat...");
+	
+	DgStorageCreateFolder(NULL, "fs://list_test/sub");
+	DgFileSave(NULL, "fs://list_test/b.bin", 5, "bytes");
+	DgFileSave(NULL, "fs://list_test/a.txt", 3, "abc");
+	
+	DgStorageListing listing;
+	DgStorageInfo info;
+	size_t bad = 0;
+	
+	if (!DgStorageList(NULL, "fs://list_test", DG_STORAGE_LIST_INFO, &listing)) {
+		bad += (listing.entry_count != 3);
+		bad += (listing.entry_count > 0 && (!DgStringEqual(listing.entry[0].name, "a.txt") || listing.entry[0].info.size != 3));
+		bad += (listing.entry_count > 2 && (!DgStringEqual(listing.entry[2].name, "sub") || listing.entry[2].info.type != DG_STORAGE_TYPE_FOLDER));
+		DgStorageListingFree(&listing);
+	}
+	else {
+		bad++;
+	}
+	
+	bad += (DgStorageStat(NULL, "fs://list_test/b.bin", &info) || info.type != DG_STORAGE_TYPE_FILE || info.size != 5);
+	bad += (DgStorageStat(NULL, "fs://list_test/missing", &info) != DG_ERROR_FILE_NOT_FOUND);
+	
+	DgStorageDelete(NULL, "fs://list_test/a.txt");
+	DgStorageDelete(NULL, "fs://list_test/b.bin");
+	DgStorageDelete(NULL, "fs://list_test/sub");
+	DgStorageDelete(NULL, "fs://list_test");
+	
+	DgLog(bad ? DG_LOG_ERROR : DG_LOG_SUCCESS, "TestStorage() - 6");
+	
+	// TEST 7
+	DgLog(DG_LOG_INFO, "Copying files...");
+	
+	size_t big_size = 300000;
+	uint8_t *big = DgAlloc(big_size);
+	
+	if (!big) {
+		return;
+	}
+	
+	for (size_t i = 0; i < big_size; i++) {
+		big[i] = (uint8_t) (i * 7 + (i >> 9));
+	}
+	
+	DgFileSave(NULL, "fs://copy_source.bin", big_size, big);
+	
+	const char *copies[] = {"fs://copy_same_pool.bin", "copyram://copy_other_pool.bin"};
+	bad = 0;
+	
+	DgStorageAddPool(NULL, DgRamdiskCreatePool("copyram"));
+	
+	for (size_t i = 0; i < 2; i++) {
+		size_t copy_size;
+		void *copy;
+		
+		bad += (DgStorageCopy(NULL, "fs://copy_source.bin", copies[i]) != DG_ERROR_SUCCESSFUL);
+		
+		if (!DgFileLoad(NULL, copies[i], &copy_size, &copy)) {
+			bad += (copy_size != big_size || memcmp(copy, big, big_size));
+			DgFree(copy);
+		}
+		else {
+			bad++;
+		}
+		
+		DgStorageDelete(NULL, copies[i]);
+	}
+	
+	// Copying onto itself must not lose the data
+	bad += (DgStorageCopy(NULL, "fs://copy_source.bin", "fs://copy_source.bin") || DgStorageStat(NULL, "fs://copy_source.bin", &info) || info.size != big_size);
+	
+	DgStorageDelete(NULL, "fs://copy_source.bin");
+	DgStorageRemovePool(NULL, "copyram");
+	DgFree(big);
+	
+	DgLog(bad ? DG_LOG_ERROR : DG_LOG_SUCCESS, "TestStorage() - 7");
 }
 
-void TestCryptoRandom(void) {
-	char rand_bytes[16];
+void TestRamdisk(void) {
+	DgLog(DG_LOG_INFO, "TestRamdisk()");
 	
-	for (size_t i = 0; i < 5; i++) {
-		DgError error = DgRandom(16, rand_bytes);
+	DgLogError(DgStorageAddPool(NULL, DgRamdiskCreatePool("ram")));
+	
+	char sample[] = "Hello from memory!";
+	
+	DgLogError(DgFileSave(NULL, "ram://saves/slot1.bin", sizeof sample, sample));
+	DgLogError(DgStorageRename(NULL, "ram://saves", "ram://backup/saves"));
+	
+	size_t size;
+	char *data;
+	
+	if (DgFileLoad(NULL, "ram://backup/saves/slot1.bin", &size, (void **) &data)) {
+		DgLog(DG_LOG_ERROR, "Failed to load file from ramdisk!");
+		return;
+	}
+	
+	DgLog(DG_LOG_INFO, "Loaded %d bytes: %s", size, data);
+	
+	DgFree(data);
+	
+	DgLogError(DgStorageDelete(NULL, "ram://backup"));
+	
+	DgStorageObjectType type;
+	DgStorageType(NULL, "ram://backup/saves/slot1.bin", &type);
+	
+	DgLog(DG_LOG_INFO, "Type after delete: %d (should be 0)", type);
+	
+	// Protocols are matched exactly, not by prefix
+	size_t bad = 0;
+	DgError status = (DgError) DgStorageType(NULL, "rams://file", &type);
+	
+	bad += DgStorageHasPool(NULL, "ra");
+	bad += (status != DG_ERROR_NOT_FOUND);
+	
+	DgLog(bad ? DG_LOG_ERROR : DG_LOG_SUCCESS, "TestRamdisk() - bad = %d", bad);
+}
+
+void TestBufferedStream(void) {
+	DgLog(DG_LOG_INFO, "TestBufferedStream()");
+	
+	DgStream stream;
+	
+	if (DgStreamOpen(NULL, &stream, "ram://buffered.bin", DG_STREAM_WRITE)) {
+		DgLog(DG_LOG_ERROR, "Failed to open buffered stream for writing!");
+		return;
+	}
+	
+	// Use a tiny buffer so that refills and flushes happen a lot
+	DgLogError(DgStreamSetBuffer(&stream, 7));
+	
+	for (uint16_t i = 0; i < 1000; i++) {
+		DgStreamWriteUInt16(&stream, i);
+	}
+	
+	DgLog(DG_LOG_INFO, "Length before close: %d (should be 2000)", DgStreamLength(&stream));
+	
+	DgStreamClose(&stream);
+	
+	if (DgStreamOpen(NULL, &stream, "ram://buffered.bin", DG_STREAM_READ | DG_STREAM_BUFFERED)) {
+		DgLog(DG_LOG_ERROR, "Failed to open buffered stream for reading!");
+		return;
+	}
+	
+	uint16_t value = 0;
+	size_t bad = 0;
+	
+	for (uint16_t i = 0; i < 1000; i++) {
+		if (DgStreamReadUInt16(&stream, &value) || value != i) {
+			bad++;
+		}
+	}
+	
+	// Reading past the end should fail
+	bool past_end_failed = DgStreamReadUInt16(&stream, &value) != DG_ERROR_SUCCESSFUL;
+	
+	// Seek back into the buffer and read again
+	DgStreamSeek(&stream, DG_STORAGE_SEEK_RELATIVE, -4);
+	DgStreamReadUInt16(&stream, &value);
+	
+	DgStreamClose(&stream);
+	
+	DgLog(bad || !past_end_failed || value != 998 ? DG_LOG_ERROR : DG_LOG_SUCCESS, "TestBufferedStream() - bad = %d, value after seek = %d", bad, value);
+}
+
+static void TestAsyncStorageCallback(DgStorageRequest *request, void *userdata) {
+	size_t *done = userdata;
+	
+	if (!request->status) {
+		done[0]++;
+	}
+}
+
+void TestAsyncStorage(void) {
+	DgLog(DG_LOG_INFO, "TestAsyncStorage()");
+	
+	char sample[] = "Asynchronous hello!";
+	
+	DgFileSave(NULL, "fs://async.txt", sizeof sample, sample);
+	DgFileSave(NULL, "ram://async.txt", sizeof sample, sample);
+	
+	DgStorageQueue queue;
+	
+	if (DgStorageQueueInit(&queue, NULL, 8)) {
+		DgLog(DG_LOG_ERROR, "Failed to initialise async queue!");
+		return;
+	}
+	
+	DgLog(DG_LOG_INFO, "Native async backend: %s", queue.native ? "yes" : "no");
+	
+	// More requests than the ring can hold at once
+	char buffers[20][sizeof sample];
+	DgStorageRequest requests[20];
+	size_t done = 0;
+	
+	for (size_t i = 0; i < 20; i++) {
+		requests[i] = (DgStorageRequest) {
+			.type = DG_STORAGE_REQUEST_READ,
+			.path = (i & 1) ? "ram://async.txt" : "fs://async.txt",
+			.offset = 0,
+			.length = sizeof sample,
+			.buffer = buffers[i],
+			.callback = TestAsyncStorageCallback,
+			.userdata = &done,
+		};
 		
-		if (error) {
-			DgLog(DG_LOG_ERROR, "DgRandom: %08x", error);
-			return;
+		DgLogError(DgStorageQueueSubmit(&queue, &requests[i]));
+	}
+	
+	DgStorageQueueWait(&queue, 20);
+	
+	size_t bad = 0;
+	
+	for (size_t i = 0; i < 20; i++) {
+		bad += (memcmp(buffers[i], sample, sizeof sample) != 0);
+	}
+	
+	// Reading past the end fails
+	char tail[8];
+	DgStorageRequest past = {.type = DG_STORAGE_REQUEST_READ, .path = "fs://async.txt", .offset = sizeof sample - 2, .length = 8, .buffer = tail};
+	DgStorageQueueSubmit(&queue, &past);
+	
+	DgStorageQueueFree(&queue);
+	
+	DgStorageDelete(NULL, "fs://async.txt");
+	
+	DgLog(done != 20 || bad || !past.status ? DG_LOG_ERROR : DG_LOG_SUCCESS, "TestAsyncStorage() - done = %d, bad = %d, past end transferred %d", done, bad, past.transferred);
+}
+
+void TestPak(void) {
+	DgLog(DG_LOG_INFO, "TestPak()");
+	
+	char level[] = "<level><box/><box/><box/><box/><box/><box/><box/><box/></level>";
+	char readme[] = "Not compressed";
+	
+	DgStorageCreateFolder(NULL, "fs://pak_test");
+	DgStorageCreateFolder(NULL, "fs://pak_test/levels");
+	DgFileSave(NULL, "fs://pak_test/levels/one.xml", sizeof level, level);
+	DgFileSave(NULL, "fs://pak_test/readme.txt", sizeof readme, readme);
+	
+	if (DgPakBuildFromFolder(NULL, "fs://pak_test", "fs://pak_test.pak", DG_PAK_COMPRESS)) {
+		DgLog(DG_LOG_ERROR, "Failed to build archive!");
+		return;
+	}
+	
+	DgLogError(DgStorageAddPool(NULL, DgPakCreatePool(NULL, "pak", "fs://pak_test.pak")));
+	
+	size_t size;
+	char *data;
+	size_t bad = 0;
+	
+	if (!DgFileLoad(NULL, "pak://levels/one.xml", &size, (void **) &data)) {
+		bad += (size != sizeof level || memcmp(data, level, size));
+		DgFree(data);
+	}
+	else {
+		bad++;
+	}
+	
+	if (!DgFileLoad(NULL, "pak://readme.txt", &size, (void **) &data)) {
+		bad += (size != sizeof readme || memcmp(data, readme, size));
+		DgFree(data);
+	}
+	else {
+		bad++;
+	}
+	
+	DgStorageObjectType type;
+	DgStorageType(NULL, "pak://levels", &type);
+	bad += (type != DG_STORAGE_TYPE_FOLDER);
+	DgStorageType(NULL, "pak://level", &type);
+	bad += (type != DG_STORAGE_TYPE_NONE);
+	bad += (DgFileSave(NULL, "pak://new.txt", 1, "x") == DG_ERROR_SUCCESSFUL);
+	
+	// Adding pools moves the others, which the archive's mapping must not care
+	// about when it is released
+	DgStorage storage;
+	char protocol[16];
+	
+	DgStorageInit(&storage);
+	DgStorageAddPool(&storage, DgFilesystemCreatePool("fs", "."));
+	bad += (DgStorageAddPool(&storage, DgPakCreatePool(&storage, "pak", "fs://pak_test.pak")) != DG_ERROR_SUCCESSFUL);
+	
+	for (size_t i = 0; i < 40; i++) {
+		snprintf(protocol, sizeof protocol, "ram%d", (int) i);
+		DgStorageAddPool(&storage, DgRamdiskCreatePool(protocol));
+	}
+	
+	for (size_t i = 0; i < storage.pool_count; i++) {
+		bad += (DgStoragePoolFree(&storage.pool[i]) != DG_ERROR_SUCCESSFUL);
+	}
+	
+	DgStorageFree(&storage);
+	
+	// Archives with no empty slot would never finish looking up missing names
+	uint8_t *archive;
+	
+	if (!DgFileLoad(NULL, "fs://pak_test.pak", &size, (void **) &archive)) {
+		size_t slots = archive[12] | (archive[13] << 8);
+		size_t offset = archive[24] | (archive[25] << 8);
+		
+		for (size_t i = 0; i < slots; i++) {
+			archive[offset + i * 8 + 4] = 1;
 		}
 		
-		const char *asBase16 = DgStringEncodeBase16(16, rand_bytes);
-		DgLog(DG_LOG_INFO, "Secure random bytes as base16: %s", asBase16);
-		DgFree(asBase16);
+		DgFileSave(NULL, "fs://pak_bad.pak", size, archive);
+		DgFree(archive);
+		
+		DgStoragePool *full = DgPakCreatePool(NULL, "badpak", "fs://pak_bad.pak");
+		
+		bad += (full != NULL);
+		
+		if (full) {
+			DgStoragePoolFree(full);
+			DgFree(full);
+		}
+		
+		DgStorageDelete(NULL, "fs://pak_bad.pak");
+	}
+	else {
+		bad++;
 	}
 	
-	DgLog(DG_LOG_SUCCESS, "TestCryptoRandom");
+	DgStorageDelete(NULL, "fs://pak_test/levels/one.xml");
+	DgStorageDelete(NULL, "fs://pak_test/levels");
+	DgStorageDelete(NULL, "fs://pak_test/readme.txt");
+	DgStorageDelete(NULL, "fs://pak_test");
+	DgStorageDelete(NULL, "fs://pak_test.pak");
+	
+	DgLog(bad ? DG_LOG_ERROR : DG_LOG_SUCCESS, "TestPak() - bad = %d", bad);
 }
 
-void TestError(void) {
-	DgLogError(DG_ERROR_FAILED);
+void TestCache(void) {
+	DgLog(DG_LOG_INFO, "TestCache()");
+	
+	size_t bad = 0;
+	char data[300];
+	char out[300];
+	
+	for (size_t i = 0; i < sizeof data; i++) {
+		data[i] = (char) i;
+	}
+	
+	DgFileSave(NULL, "ram://cached.bin", sizeof data, data);
+	
+	// Room for two blocks of 64 bytes
+	DgLogError(DgStorageAddPool(NULL, DgCacheCreatePool("rcache", NULL, "ram", 128, 64, DG_CACHE_WRITE_BACK)));
+	
+	DgStream stream;
+	
+	if (DgStreamOpen(NULL, &stream, "rcache://cached.bin", DG_STREAM_READ | DG_STREAM_WRITE)) {
+		DgLog(DG_LOG_ERROR, "Failed to open cached file!");
+		return;
+	}
+	
+	DgCacheStats stats;
+	
+	bad += (DgStreamRead(&stream, 100, out) || memcmp(out, data, 100));
+	DgStreamSetPosition(&stream, 10);
+	bad += (DgStreamRead(&stream, 10, out) || memcmp(out, &data[10], 10));
+	DgCacheGetStats(NULL, "rcache", &stats);
+	bad += (stats.misses != 2 || stats.hits != 1);
+	
+	// Written blocks stay in the cache until they are evicted
+	DgStreamSetPosition(&stream, 0);
+	DgStreamWrite(&stream, 4, "abcd");
+	DgStreamSetPosition(&stream, 290);
+	DgStreamWrite(&stream, 20, "0123456789abcdefghij");
+	bad += (DgStreamLength(&stream) != 310);
+	DgStreamSetPosition(&stream, 200);
+	bad += (DgStreamRead(&stream, 10, out) || memcmp(out, &data[200], 10));
+	DgCacheGetStats(NULL, "rcache", &stats);
+	bad += (stats.evictions == 0 || stats.writebacks == 0 || stats.blocks > stats.block_limit);
+	
+	bad += (DgStreamRead(&stream, 200, out) == DG_ERROR_SUCCESSFUL);
+	
+	DgStreamClose(&stream);
+	
+	size_t size;
+	char *loaded;
+	
+	if (!DgFileLoad(NULL, "ram://cached.bin", &size, (void **) &loaded)) {
+		bad += (size != 310 || memcmp(loaded, "abcd", 4) || memcmp(&loaded[4], &data[4], 286) || memcmp(&loaded[290], "0123456789abcdefghij", 20));
+		DgFree(loaded);
+	}
+	else {
+		bad++;
+	}
+	
+	DgCacheResetStats(NULL, "rcache");
+	DgCacheGetStats(NULL, "rcache", &stats);
+	bad += (stats.hits || stats.misses);
+	
+	DgStorageDelete(NULL, "rcache://cached.bin");
+	bad += (DgFileLoad(NULL, "ram://cached.bin", &size, (void **) &loaded) == DG_ERROR_SUCCESSFUL);
+	
+	// Writing past the end of a file leaves zeros behind it, including in
+	// the cached block that used to end the file
+	DgFileSave(NULL, "ram://grown.bin", 100, data);
+	DgLogError(DgStorageAddPool(NULL, DgCacheCreatePool("rcache2", NULL, "ram", 1024, 256, DG_CACHE_WRITE_BACK)));
+	
+	if (!DgStreamOpen(NULL, &stream, "rcache2://grown.bin", DG_STREAM_READ | DG_STREAM_WRITE)) {
+		char zeros[200] = {0};
+		
+		bad += (DgStreamRead(&stream, 10, out) || memcmp(out, data, 10));
+		DgStreamSetPosition(&stream, 600);
+		bad += (DgStreamWrite(&stream, 10, "0123456789") != DG_ERROR_SUCCESSFUL);
+		DgStreamSetPosition(&stream, 200);
+		bad += (DgStreamRead(&stream, 200, out) || memcmp(out, zeros, 200));
+		DgStreamClose(&stream);
+	}
+	else {
+		bad++;
+	}
+	
+	if (!DgFileLoad(NULL, "ram://grown.bin", &size, (void **) &loaded)) {
+		bad += (size != 610 || memcmp(loaded, data, 100) || loaded[100] || loaded[599] || memcmp(&loaded[600], "0123456789", 10));
+		DgFree(loaded);
+	}
+	else {
+		bad++;
+	}
+	
+	// Streams that are still open see the new length after invalidating
+	if (!DgStreamOpen(NULL, &stream, "rcache2://grown.bin", DG_STREAM_READ)) {
+		DgFileSave(NULL, "ram://grown.bin", sizeof data, data);
+		DgCacheInvalidate(NULL, "rcache2://grown.bin");
+		bad += (DgStreamLength(&stream) != sizeof data);
+		DgStreamSetPosition(&stream, 250);
+		bad += (DgStreamRead(&stream, 50, out) || memcmp(out, &data[250], 50));
+		DgStreamClose(&stream);
+	}
+	else {
+		bad++;
+	}
+	
+	DgLog(bad ? DG_LOG_ERROR : DG_LOG_SUCCESS, "TestCache() - bad = %d", bad);
 }
 
-void TestTableAndSerialise(void) {
-	DgTable table;
+void TestCompressed(void) {
+	DgLog(DG_LOG_INFO, "TestCompressed()");
 	
-	DgTableInit(&table);
+	DgLogError(DgStorageAddPool(NULL, DgCompressedCreatePool("packed", NULL, "fs", 4096)));
 	
-	DgValue key, value;
+	size_t size = 100000;
+	uint8_t *data = DgAlloc(size);
 	
-	DgValueStaticString(&key, "int64_test");
-	DgValueInt64(&value, 324776765645);
-	DgTableSet(&table, &key, &value);
+	if (!data) {
+		return;
+	}
 	
-	DgValueStaticString(&key, "uint32_test");
-	DgValueUInt32(&value, 5001811);
-	DgTableSet(&table, &key, &value);
+	for (size_t i = 0; i < size; i++) {
+		data[i] = (uint8_t) ((i % 251) < 128 ? i % 13 : i / 1000);
+	}
 	
-	DgValueStaticString(&key, "nil_test");
-	DgValueNil(&value);
-	DgTableSet(&table, &key, &value);
+	DgStream stream;
+	size_t bad = 0;
 	
-	DgValueStaticString(&key, "ptr_test");
-	DgValuePointer(&value, &table);
-	DgTableSet(&table, &key, &value);
+	if (DgStreamOpen(NULL, &stream, "packed://compressed.bin", DG_STREAM_WRITE)) {
+		DgLog(DG_LOG_ERROR, "Failed to open compressed file for writing!");
+		DgFree(data);
+		return;
+	}
 	
-	DgValue table_val;
-	DgValueTable(&table_val, &table);
+	// Odd sized writes so that they cross blocks
+	for (size_t i = 0; i < size; i += 777) {
+		DgStreamWrite(&stream, (size - i < 777) ? size - i : 777, &data[i]);
+	}
 	
-	DgSerialiseWrite(NULL, "fs://test/ser_test.dat", &table_val);
+	DgStreamClose(&stream);
 	
-	DgValueFree(&table_val);
+	DgStorageInfo packed, raw;
+	bad += (DgStorageStat(NULL, "packed://compressed.bin", &packed) || packed.size != size);
+	bad += (DgStorageStat(NULL, "fs://compressed.bin", &raw) || raw.size >= size / 2);
+	
+	// Random reads only need the blocks they touch
+	if (!DgStreamOpen(NULL, &stream, "packed://compressed.bin", DG_STREAM_READ)) {
+		uint8_t out[5000];
+		size_t offsets[] = {70000, 3, 4090, 99000};
+		size_t lengths[] = {5000, 100, 12, 1000};
+		
+		for (size_t i = 0; i < 4; i++) {
+			DgStreamSetPosition(&stream, offsets[i]);
+			bad += (DgStreamRead(&stream, lengths[i], out) || memcmp(out, &data[offsets[i]], lengths[i]));
+		}
+		
+		bad += (DgStreamRead(&stream, 1, out) == DG_ERROR_SUCCESSFUL);
+		
+		DgStreamClose(&stream);
+	}
+	else {
+		bad++;
+	}
+	
+	bad += (DgStreamOpen(NULL, &stream, "packed://compressed.bin", DG_STREAM_READ | DG_STREAM_WRITE) != DG_ERROR_NOT_SUPPORTED);
+	
+	// A footer whose index offset wraps around to the right file length
+	uint8_t footer[32] = {
+		0x44, 0x43, 0x4D, 0x50, 0x01, 0x00, 0x00, 0x00, // Magic and version
+		0x00, 0x10, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, // Block size and count
+		0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // Size
+		0xF0, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, // Index offset
+	};
+	
+	DgFileSave(NULL, "fs://compressed_bad.bin", sizeof footer, footer);
+	
+	if (!DgStreamOpen(NULL, &stream, "packed://compressed_bad.bin", DG_STREAM_READ)) {
+		DgStreamClose(&stream);
+		bad++;
+	}
+	
+	DgStorageDelete(NULL, "fs://compressed_bad.bin");
+	DgStorageDelete(NULL, "packed://compressed.bin");
+	DgFree(data);
+	
+	DgLog(bad ? DG_LOG_ERROR : DG_LOG_SUCCESS, "TestCompressed() - bad = %d (%d bytes stored as %d)", bad, packed.size, raw.size);
+}
+
+void TestOverlay(void) {
+	DgLog(DG_LOG_INFO, "TestOverlay()");
+	
+	const char *layers[] = {"mods", "base"};
+	
+	DgStorageAddPool(NULL, DgRamdiskCreatePool("base"));
+	DgStorageAddPool(NULL, DgRamdiskCreatePool("mods"));
+	DgLogError(DgStorageAddPool(NULL, DgOverlayCreatePool("game", NULL, layers, 2)));
+	
+	DgFileSave(NULL, "base://levels/one.xml", 5, "base1");
+	DgFileSave(NULL, "base://levels/two.xml", 5, "base2");
+	DgFileSave(NULL, "mods://levels/one.xml", 4, "mod1");
+	
+	size_t bad = 0;
+	size_t size;
+	char *data;
+	char *resolved;
+	
+	if (!DgFileLoad(NULL, "game://levels/one.xml", &size, (void **) &data)) {
+		bad += (size != 4 || memcmp(data, "mod1", 4));
+		DgFree(data);
+	}
+	else {
+		bad++;
+	}
+	
+	if (!DgOverlayResolve(NULL, "game://levels/two.xml", &resolved)) {
+		bad += !DgStringEqual(resolved, "base://levels/two.xml");
+		DgFree(resolved);
+	}
+	else {
+		bad++;
+	}
+	
+	DgStorageListing listing;
+	
+	if (!DgStorageList(NULL, "game://levels", DG_STORAGE_LIST_NORMAL, &listing)) {
+		bad += (listing.entry_count != 2);
+		DgStorageListingFree(&listing);
+	}
+	else {
+		bad++;
+	}
+	
+	// Writes go to the first layer and show up straight away
+	DgFileSave(NULL, "game://levels/three.xml", 5, "three");
+	DgFileAppend(NULL, "game://levels/two.xml", 1, "!");
+	
+	DgStorageObjectType type;
+	DgStorageType(NULL, "mods://levels/three.xml", &type);
+	bad += (type != DG_STORAGE_TYPE_FILE);
+	DgStorageType(NULL, "game://levels/three.xml", &type);
+	bad += (type != DG_STORAGE_TYPE_FILE);
+	
+	if (!DgFileLoad(NULL, "game://levels/two.xml", &size, (void **) &data)) {
+		bad += (size != 6 || memcmp(data, "base2!", 6));
+		DgFree(data);
+	}
+	else {
+		bad++;
+	}
+	
+	bad += (DgStorageDelete(NULL, "game://levels/nothing.xml") != DG_ERROR_FILE_NOT_FOUND);
+	
+	// Filesystem layers don't make folders for files on their own, so the
+	// first layer needs them made before a file is written or copied up
+	const char *fs_layers[] = {"fsmods", "fsbase"};
+	
+	DgStorageCreateFolder(NULL, "fs://overlay_mods");
+	DgStorageCreateFolder(NULL, "fs://overlay_base/levels");
+	DgStorageAddPool(NULL, DgFilesystemCreatePool("fsmods", "./overlay_mods"));
+	DgStorageAddPool(NULL, DgFilesystemCreatePool("fsbase", "./overlay_base"));
+	DgLogError(DgStorageAddPool(NULL, DgOverlayCreatePool("fsgame", NULL, fs_layers, 2)));
+	
+	DgFileSave(NULL, "fsbase://levels/two.xml", 5, "base2");
+	bad += (DgFileSave(NULL, "fsgame://levels/one.xml", 3, "new") != DG_ERROR_SUCCESSFUL);
+	bad += (DgFileAppend(NULL, "fsgame://levels/two.xml", 1, "!") != DG_ERROR_SUCCESSFUL);
+	
+	if (!DgFileLoad(NULL, "fsmods://levels/one.xml", &size, (void **) &data)) {
+		bad += (size != 3 || memcmp(data, "new", 3));
+		DgFree(data);
+	}
+	else {
+		bad++;
+	}
+	
+	if (!DgFileLoad(NULL, "fsgame://levels/two.xml", &size, (void **) &data)) {
+		bad += (size != 6 || memcmp(data, "base2!", 6));
+		DgFree(data);
+	}
+	else {
+		bad++;
+	}
+	
+	DgStorageDelete(NULL, "fs://overlay_mods/levels/one.xml");
+	DgStorageDelete(NULL, "fs://overlay_mods/levels/two.xml");
+	DgStorageDelete(NULL, "fs://overlay_mods/levels");
+	DgStorageDelete(NULL, "fs://overlay_mods");
+	DgStorageDelete(NULL, "fs://overlay_base/levels/two.xml");
+	DgStorageDelete(NULL, "fs://overlay_base/levels");
+	DgStorageDelete(NULL, "fs://overlay_base");
+	
+	DgStorageRemovePool(NULL, "game");
+	DgStorageRemovePool(NULL, "mods");
+	DgStorageRemovePool(NULL, "base");
+	
+	DgLog(bad ? DG_LOG_ERROR : DG_LOG_SUCCESS, "TestOverlay() - bad = %d", bad);
+}
+
+void TestDedup(void) {
+	DgLog(DG_LOG_INFO, "TestDedup()");
+	
+	DgStorageAddPool(NULL, DgRamdiskCreatePool("blobs"));
+	DgLogError(DgStorageAddPool(NULL, DgDedupCreatePool("build", NULL, "blobs")));
+	
+	DgFileSave(NULL, "build://out/a.bin", 11, "same thing!");
+	DgFileSave(NULL, "build://out/b.bin", 11, "same thing!");
+	DgFileSave(NULL, "build://out/c.bin", 9, "different");
+	
+	size_t bad = 0;
+	size_t size;
+	char *data;
+	uint8_t digest_a[DG_DEDUP_DIGEST_SIZE], digest_b[DG_DEDUP_DIGEST_SIZE];
+	DgDedupStats stats;
+	
+	DgDedupGetDigest(NULL, "build://out/a.bin", digest_a);
+	DgDedupGetDigest(NULL, "build://out/b.bin", digest_b);
+	bad += (memcmp(digest_a, digest_b, DG_DEDUP_DIGEST_SIZE) != 0);
+	
+	bad += (DgDedupGetStats(NULL, "build", &stats) || stats.files != 3 || stats.blobs != 2 || stats.bytes != 31 || stats.stored_bytes != 20);
+	
+	// Contents stay until the last file using them is gone
+	DgStorageDelete(NULL, "build://out/a.bin");
+	DgStorageRename(NULL, "build://out/b.bin", "build://moved/b.bin");
+	
+	if (!DgFileLoad(NULL, "build://moved/b.bin", &size, (void **) &data)) {
+		bad += (size != 11 || memcmp(data, "same thing!", 11));
+		DgFree(data);
+	}
+	else {
+		bad++;
+	}
+	
+	// The old contents of c.bin stay until the index without them is written
+	char object[sizeof "blobs://objects/xx/" + DG_DEDUP_DIGEST_SIZE * 2] = "blobs://objects/";
+	size_t object_length = DgStringLength(object);
+	DgStorageObjectType type;
+	
+	DgDedupGetDigest(NULL, "build://out/c.bin", digest_b);
+	
+	for (size_t i = 0; i < DG_DEDUP_DIGEST_SIZE; i++) {
+		object_length += sprintf(&object[object_length], (i == 0) ? "%02x/" : "%02x", digest_b[i]);
+	}
+	
+	DgFileAppend(NULL, "build://out/c.bin", 1, "!");
+	DgStorageType(NULL, object, &type);
+	bad += (type != DG_STORAGE_TYPE_FILE);
+	
+	// The index is kept in the backing pool, so a second pool over the same
+	// one loads it
+	bad += (DgDedupFlush(NULL, "build") != DG_ERROR_SUCCESSFUL);
+	DgStorageType(NULL, object, &type);
+	bad += (type != DG_STORAGE_TYPE_NONE);
+	bad += (DgStorageAddPool(NULL, DgDedupCreatePool("build2", NULL, "blobs")) != DG_ERROR_SUCCESSFUL);
+	
+	if (!DgFileLoad(NULL, "build2://out/c.bin", &size, (void **) &data)) {
+		bad += (size != 10 || memcmp(data, "different!", 10));
+		DgFree(data);
+	}
+	else {
+		bad++;
+	}
+	
+	bad += (DgDedupGetStats(NULL, "build2", &stats) || stats.files != 2 || stats.blobs != 2);
+	
+	DgStorageRemovePool(NULL, "build2");
+	DgStorageRemovePool(NULL, "build");
+	DgStorageRemovePool(NULL, "blobs");
+	
+	DgLog(bad ? DG_LOG_ERROR : DG_LOG_SUCCESS, "TestDedup() - bad = %d", bad);
+}
+
+static DgThreadReturn TestStorageMetricsThread(DgThreadArg arg) {
+	DgFileSave(NULL, "metrics://two.bin", 5, "world");
+	
+	return NULL;
+}
+
+void TestStorageMetrics(void) {
+	DgLog(DG_LOG_INFO, "TestStorageMetrics()");
+	
+	DgStorageMetricsEnable(true);
+	DgStorageMetricsReset();
+	DgStorageAddPool(NULL, DgRamdiskCreatePool("metrics"));
+	
+	DgFileSave(NULL, "metrics://one.bin", 5, "hello");
+	
+	size_t size;
+	char *data;
+	
+	if (!DgFileLoad(NULL, "metrics://one.bin", &size, (void **) &data)) {
+		DgFree(data);
+	}
+	
+	// Records from a thread that has exited should still be counted
+	DgThread thread;
+	
+	if (!DgThreadNew(&thread, TestStorageMetricsThread, NULL)) {
+		DgThreadJoin(&thread);
+	}
+	
+	DgStorageRemovePool(NULL, "metrics");
+	DgStorageMetricsEnable(false);
+	
+	size_t bad = 0;
+	DgTable table;
+	DgValue value;
+	
+	if (!DgStorageMetricsSnapshot(&table)) {
+		DgValue key = DgMakeString("metrics.read.bytes");
+		bad += (DgTableGet(&table, &key, &value) || value.data.asUInt64 != 5);
+		
+		key = DgMakeString("metrics.open.calls");
+		bad += (DgTableGet(&table, &key, &value) || value.data.asUInt64 != 3);
+		
+		key = DgMakeString("metrics.write.bytes");
+		bad += (DgTableGet(&table, &key, &value) || value.data.asUInt64 != 10);
+		
+		DgTableFree(&table);
+	}
+	else {
+		bad++;
+	}
+	
+	DgLog(bad ? DG_LOG_ERROR : DG_LOG_SUCCESS, "TestStorageMetrics() - bad = %d", bad);
+}
+
+void TestCryptoRandom(void) {
+	char rand_bytes[16];
+	
+	for (size_t i = 0; i < 5; i++) {
+		DgError error = DgRandom(16, rand_bytes);
+		
+		if (error) {
+			DgLog(DG_LOG_ERROR, "DgRandom: %08x", error);
+			return;
+		}
+		
+		const char *asBase16 = DgStringEncodeBase16(16, rand_bytes);
+		DgLog(DG_LOG_INFO, "Secure random bytes as base16: %s", asBase16);
+		DgFree(asBase16);
+	}
+	
+	DgLog(DG_LOG_SUCCESS, "TestCryptoRandom");
+}
+
+void TestError(void) {
+	DgLogError(DG_ERROR_FAILED);
+}
+
+void TestTableAndSerialise(void) {
+	DgTable table;
+	
+	DgTableInit(&table);
+	
+	DgValue key, value;
+	
+	DgValueStaticString(&key, "int64_test");
+	DgValueInt64(&value, 324776765645);
+	DgTableSet(&table, &key, &value);
+	
+	DgValueStaticString(&key, "uint32_test");
+	DgValueUInt32(&value, 5001811);
+	DgTableSet(&table, &key, &value);
+	
+	DgValueStaticString(&key, "nil_test");
+	DgValueNil(&value);
+	DgTableSet(&table, &key, &value);
+	
+	DgValueStaticString(&key, "ptr_test");
+	DgValuePointer(&value, &table);
+	DgTableSet(&table, &key, &value);
+	
+	DgValue table_val;
+	DgValueTable(&table_val, &table);
+	
+	DgSerialiseWrite(NULL, "fs://test/ser_test.dat", &table_val);
+	
+	DgValueFree(&table_val);
+}
+
+static size_t TestSerialiseCheck(DgSerialised *tree) {
+	size_t bad = 0;
+	DgValue key, value;
+	
+	if (tree->root.type != DG_TYPE_TABLE) {
+		return 1;
+	}
+	
+	key = DgMakeStaticString("name");
+	bad += (DgTableGet(tree->root.data.asTable, &key, &value) || value.type != DG_TYPE_STRING || strcmp(value.data.asStaticString, "melon"));
+	
+	key = DgMakeStaticString("bytes");
+	bad += (DgTableGet(tree->root.data.asTable, &key, &value) || value.type != DG_TYPE_BYTES || value.data.asBytes->length != 3 || memcmp(value.data.asBytes->data, "\x00\x01\x02", 3));
+	
+	key = DgMakeStaticString("inner");
+	bad += (DgTableGet(tree->root.data.asTable, &key, &value) || value.type != DG_TYPE_TABLE);
+	
+	if (value.type == DG_TYPE_TABLE) {
+		DgTable *inner = value.data.asTable;
+		
+		key = DgMakeStaticString("float");
+		bad += (DgTableGet(inner, &key, &value) || value.type != DG_TYPE_FLOAT64 || value.data.asFloat64 != -1.5);
+		
+		key = DgMakeStaticString("int16");
+		bad += (DgTableGet(inner, &key, &value) || value.type != DG_TYPE_INT16 || value.data.asInt16 != -300);
+	}
+	
+	return bad;
+}
+
+void TestSerialiseRead(void) {
+	DgLog(DG_LOG_INFO, "TestSerialiseRead()");
+	
+	size_t bad = 0;
+	DgTable table, inner;
+	DgValue key, value, root;
+	DgBytes bytes = {3, (DgByte *) "\x00\x01\x02"};
+	
+	DgTableInit(&table);
+	DgTableInit(&inner);
+	
+	key = DgMakeStaticString("float"); value = DgMakeFloat64(-1.5); DgTableSet(&inner, &key, &value);
+	key = DgMakeStaticString("int16"); value = DgMakeInt16(-300); DgTableSet(&inner, &key, &value);
+	key = DgMakeStaticString("name"); value = DgMakeStaticString("melon"); DgTableSet(&table, &key, &value);
+	key = DgMakeStaticString("inner"); value = DgMakeTable(&inner); DgTableSet(&table, &key, &value);
+	key = DgMakeStaticString("bytes"); value.type = DG_TYPE_BYTES; value.flags = DG_VALUE_STATIC; value.data.asBytes = &bytes; DgTableSet(&table, &key, &value);
+	
+	root = DgMakeTable(&table);
+	
+	// Write it to memory
+	DgMemoryStream *memory = DgMemoryStreamCreate();
+	DgStream stream;
+	
+	DgStreamOpenMemory(&stream, memory);
+	bad += (DgSerialiseWriteStream(&stream, &root) != DG_ERROR_SUCCESSFUL);
+	
+	size_t size;
+	uint8_t *data;
+	DgSerialised tree;
+	
+	DgMemoryStreamGetPointersAndSize(memory, &size, (void **) &data);
+	
+	// From a buffer the strings point into it
+	bad += (DgSerialiseReadBuffer(&tree, data, size) != DG_ERROR_SUCCESSFUL);
+	bad += TestSerialiseCheck(&tree);
+	key = DgMakeStaticString("name");
+	bad += (DgTableGet(tree.root.data.asTable, &key, &value) || (uint8_t *) value.data.asStaticString < data || (uint8_t *) value.data.asStaticString >= data + size);
+	DgSerialiseFree(&tree);
+	
+	// From a stream
+	DgStreamSetPosition(&stream, 0);
+	bad += (DgSerialiseReadStream(&tree, &stream) != DG_ERROR_SUCCESSFUL);
+	bad += TestSerialiseCheck(&tree);
+	DgSerialiseFree(&tree);
+	
+	// Cut off data never reads
+	size_t truncated = 0;
+	
+	for (size_t i = 0; i < size; i++) {
+		truncated += (DgSerialiseReadBuffer(&tree, data, i) == DG_ERROR_SUCCESSFUL);
+	}
+	
+	bad += truncated;
+	
+	// From a file
+	DgStorageAddPool(NULL, DgRamdiskCreatePool("serial"));
+	bad += (DgSerialiseWrite(NULL, "serial://tree.bin", &root) != DG_ERROR_SUCCESSFUL);
+	bad += (DgSerialiseRead(&tree, NULL, "serial://tree.bin") != DG_ERROR_SUCCESSFUL);
+	bad += TestSerialiseCheck(&tree);
+	DgSerialiseFree(&tree);
+	bad += (DgSerialiseRead(&tree, NULL, "serial://missing.bin") == DG_ERROR_SUCCESSFUL);
+	DgStorageRemovePool(NULL, "serial");
+	
+	DgStreamClose(&stream);
+	DgMemoryStreamFree(memory);
+	DgValueFree(&root);
+	
+	DgLog(bad ? DG_LOG_ERROR : DG_LOG_SUCCESS, "TestSerialiseRead() - bad = %d (%d bytes)", bad, size);
+}
+
+void TestSerialiseV2(void) {
+	DgLog(DG_LOG_INFO, "TestSerialiseV2()");
+	
+	size_t bad = 0;
+	DgTable table;
+	DgValue values[] = {
+		DgMakeInt8(-128), DgMakeUInt8(255), DgMakeInt16(7), DgMakeUInt16(16),
+		DgMakeInt32(-1), DgMakeUInt32(4000000000u), DgMakeInt64(INT64_MIN), DgMakeUInt64(UINT64_MAX),
+		DgMakeFloat32(0.25f), DgMakeFloat64(-1e300), DgMakeBool(true), DgMakeNil(),
+		DgMakeStaticString(""), DgMakeStaticString("a string that is longer than thirty one bytes"),
+		DgMakeInt64(INT64_MAX), DgMakeInt16(-16), DgMakeUInt64(0), DgMakeInt32(123456),
+	};
+	size_t count = sizeof values / sizeof *values;
+	
+	DgTableInit(&table);
+	
+	for (size_t i = 0; i < count; i++) {
+		DgValue key = DgMakeUInt32(i), value = values[i];
+		DgTableSet(&table, &key, &value);
+	}
+	
+	DgValue root = DgMakeTable(&table);
+	size_t sizes[3] = {0};
+	
+	// Both versions read back the same values
+	for (uint16_t major = 1; major <= 2; major++) {
+		DgMemoryStream *memory = DgMemoryStreamCreate();
+		DgStream stream;
+		DgSerialised tree;
+		uint8_t *data;
+		
+		DgStreamOpenMemory(&stream, memory);
+		bad += (DgSerialiseWriteStreamVersion(&stream, &root, major, 0) != DG_ERROR_SUCCESSFUL);
+		DgStreamClose(&stream);
+		
+		DgMemoryStreamGetPointersAndSize(memory, &sizes[major], (void **) &data);
+		
+		if (!DgSerialiseReadBuffer(&tree, data, sizes[major])) {
+			DgTable *read = tree.root.data.asTable;
+			
+			bad += (tree.root.type != DG_TYPE_TABLE || DgTableLength(read) != count);
+			
+			for (size_t i = 0; i < count && i < DgTableLength(read); i++) {
+				bad += (!DgValueEqual(&read->key[i], &table.key[i]) || !DgValueEqual(&read->value[i], &table.value[i]));
+			}
+			
+			DgSerialiseFree(&tree);
+		}
+		else {
+			bad++;
+		}
+		
+		// Cut off data never reads
+		for (size_t i = 0; i < sizes[major]; i++) {
+			bad += (DgSerialiseReadBuffer(&tree, data, i) == DG_ERROR_SUCCESSFUL);
+		}
+		
+		DgMemoryStreamFree(memory);
+	}
+	
+	bad += (sizes[2] * 3 > sizes[1] * 2);
+	
+	DgTableFree(&table);
+	
+	DgLog(bad ? DG_LOG_ERROR : DG_LOG_SUCCESS, "TestSerialiseV2() - bad = %d (v1 %d bytes, v2 %d bytes)", bad, sizes[1], sizes[2]);
+}
+
+static size_t TestSerialiseReaderSkips(DgSerialiseReader *reader) {
+	/**
+	 * Skip around the tree written by TestSerialiseReader.
+	 */
+	
+	size_t bad = 0;
+	DgSerialiseEvent event;
+	DgValue value;
+	
+	bad += (DgSerialiseReaderNext(reader, &event, &value) || event != DG_SERIALISE_EVENT_TABLE_BEGIN);
+	bad += (DgSerialiseReaderNext(reader, &event, &value) || event != DG_SERIALISE_EVENT_KEY || strcmp(value.data.asStaticString, "name"));
+	bad += (DgSerialiseReaderSkipValue(reader) != DG_ERROR_SUCCESSFUL);
+	bad += (DgSerialiseReaderNext(reader, &event, &value) || event != DG_SERIALISE_EVENT_KEY || strcmp(value.data.asStaticString, "big"));
+	bad += (DgSerialiseReaderNext(reader, &event, &value) || event != DG_SERIALISE_EVENT_TABLE_BEGIN);
+	bad += (DgSerialiseReaderNext(reader, &event, &value) || event != DG_SERIALISE_EVENT_KEY || value.data.asUInt32 != 0);
+	bad += (DgSerialiseReaderSkip(reader) != DG_ERROR_SUCCESSFUL);
+	bad += (DgSerialiseReaderNext(reader, &event, &value) || event != DG_SERIALISE_EVENT_KEY || strcmp(value.data.asStaticString, "small"));
+	bad += (DgSerialiseReaderSkipValue(reader) != DG_ERROR_SUCCESSFUL);
+	bad += (DgSerialiseReaderNext(reader, &event, &value) || event != DG_SERIALISE_EVENT_KEY || strcmp(value.data.asStaticString, "after"));
+	bad += (DgSerialiseReaderNext(reader, &event, &value) || event != DG_SERIALISE_EVENT_VALUE || value.type != DG_TYPE_BOOL || !value.data.asBool);
+	bad += (DgSerialiseReaderSkipValue(reader) != DG_ERROR_OUT_OF_RANGE);
+	bad += (DgSerialiseReaderNext(reader, &event, &value) || event != DG_SERIALISE_EVENT_TABLE_END);
+	bad += (DgSerialiseReaderNext(reader, &event, &value) || event != DG_SERIALISE_EVENT_END);
+	
+	return bad;
+}
+
+void TestSerialiseReader(void) {
+	DgLog(DG_LOG_INFO, "TestSerialiseReader()");
+	
+	size_t bad = 0;
+	DgTable table, big, small;
+	DgValue key, value;
+	
+	DgTableInit(&table);
+	DgTableInit(&big);
+	DgTableInit(&small);
+	
+	for (uint32_t i = 0; i < 40; i++) {
+		key = DgMakeUInt32(i); value = DgMakeStaticString("big enough to be sized"); DgTableSet(&big, &key, &value);
+	}
+	
+	key = DgMakeInt8(1); value = DgMakeInt8(2); DgTableSet(&small, &key, &value);
+	
+	key = DgMakeStaticString("name"); value = DgMakeStaticString("melon"); DgTableSet(&table, &key, &value);
+	key = DgMakeStaticString("big"); value = DgMakeTable(&big); DgTableSet(&table, &key, &value);
+	key = DgMakeStaticString("small"); value = DgMakeTable(&small); DgTableSet(&table, &key, &value);
+	key = DgMakeStaticString("after"); value = DgMakeBool(true); DgTableSet(&table, &key, &value);
+	
+	DgValue root = DgMakeTable(&table);
+	size_t events = 0;
+	
+	for (uint16_t major = 1; major <= 2; major++) {
+		DgMemoryStream *memory = DgMemoryStreamCreate();
+		DgStream stream;
+		DgSerialiseReader reader;
+		DgSerialiseEvent event;
+		size_t size;
+		uint8_t *data;
+		
+		DgStreamOpenMemory(&stream, memory);
+		bad += (DgSerialiseWriteStreamVersion(&stream, &root, major, 0) != DG_ERROR_SUCCESSFUL);
+		DgMemoryStreamGetPointersAndSize(memory, &size, (void **) &data);
+		
+		// Every key and value in order, with the tables opened and closed
+		// around them
+		DgSerialiseReaderInitBuffer(&reader, data, size);
+		events = 0;
+		
+		do {
+			bad += (DgSerialiseReaderNext(&reader, &event, &value) != DG_ERROR_SUCCESSFUL);
+			events++;
+		} while (event != DG_SERIALISE_EVENT_END && events < 1000);
+		
+		bad += (events != 1 + 2 + 1 + 1 + 80 + 1 + 1 + 1 + 2 + 1 + 2 + 1 + 1);
+		DgSerialiseReaderFree(&reader);
+		
+		// Skipping, from a buffer and from a stream
+		DgSerialiseReaderInitBuffer(&reader, data, size);
+		bad += TestSerialiseReaderSkips(&reader);
+		DgSerialiseReaderFree(&reader);
+		
+		DgStreamSetPosition(&stream, 0);
+		DgSerialiseReaderInitStream(&reader, &stream);
+		bad += TestSerialiseReaderSkips(&reader);
+		DgSerialiseReaderFree(&reader);
+		
+		// Cut off data always fails before the end
+		for (size_t i = 0; i < size; i++) {
+			DgError status;
+			
+			DgSerialiseReaderInitBuffer(&reader, data, i);
+			
+			do {
+				status = DgSerialiseReaderNext(&reader, &event, &value);
+			} while (!status && event != DG_SERIALISE_EVENT_END);
+			
+			bad += (status == DG_ERROR_SUCCESSFUL);
+			DgSerialiseReaderFree(&reader);
+		}
+		
+		DgStreamClose(&stream);
+		DgMemoryStreamFree(memory);
+	}
+	
+	DgValueFree(&root);
+	
+	DgLog(bad ? DG_LOG_ERROR : DG_LOG_SUCCESS, "TestSerialiseReader() - bad = %d (%d events)", bad, events);
+}
+
+static size_t TestSerialiseViewCheck(const DgSerialiseDocument *document) {
+	/**
+	 * Look things up in the document written by TestSerialiseView.
+	 */
+	
+	size_t bad = 0;
+	size_t length;
+	DgSerialiseView root, view, key;
+	DgValue value;
+	
+	bad += (DgSerialiseViewRoot(document, &root) != DG_ERROR_SUCCESSFUL);
+	
+	bad += (DgSerialiseViewGetPath(&root, "world.regions[123].name", &view) != DG_ERROR_SUCCESSFUL);
+	bad += (DgSerialiseViewValue(&view, &value) || value.type != DG_TYPE_STRING || strcmp(value.data.asStaticString, "region 123"));
+	
+	bad += (DgSerialiseViewGetPath(&root, "world.regions[-5]", &view) != DG_ERROR_SUCCESSFUL);
+	bad += (DgSerialiseViewValue(&view, &value) || value.type != DG_TYPE_BOOL || !value.data.asBool);
+	
+	bad += (DgSerialiseViewGetPath(&root, "version", &view) != DG_ERROR_SUCCESSFUL);
+	bad += (DgSerialiseViewValue(&view, &value) || value.type != DG_TYPE_UINT8 || value.data.asUInt8 != 3);
+	
+	bad += (DgSerialiseViewGetPath(&root, "world.regions[200]", &view) != DG_ERROR_NOT_FOUND);
+	bad += (DgSerialiseViewGetPath(&root, "world.oceans", &view) != DG_ERROR_NOT_FOUND);
+	
+	bad += (DgSerialiseViewGetPath(&root, "world.regions", &view) != DG_ERROR_SUCCESSFUL);
+	bad += (DgSerialiseViewLength(&view, &length) || length != 201);
+	bad += (DgSerialiseViewPair(&view, 7, &key, NULL) || DgSerialiseViewValue(&key, &value) || value.type != DG_TYPE_UINT32 || value.data.asUInt32 != 7);
+	bad += (DgSerialiseViewPair(&view, 201, &key, NULL) != DG_ERROR_OUT_OF_RANGE);
+	
+	return bad;
+}
+
+void TestSerialiseView(void) {
+	DgLog(DG_LOG_INFO, "TestSerialiseView()");
+	
+	size_t bad = 0;
+	DgTable table, world, regions, region[200];
+	DgValue key, value;
+	char name[32];
+	
+	DgTableInit(&table);
+	DgTableInit(&world);
+	DgTableInit(&regions);
+	
+	for (uint32_t i = 0; i < 200; i++) {
+		DgTableInit(&region[i]);
+		snprintf(name, sizeof name, "region %u", i);
+		key = DgMakeStaticString("name"); value = DgMakeString(name); DgTableSet(&region[i], &key, &value);
+		key = DgMakeStaticString("id"); value = DgMakeUInt32(i); DgTableSet(&region[i], &key, &value);
+		
+		key = DgMakeUInt32(i); value = DgMakeTable(&region[i]); DgTableSet(&regions, &key, &value);
+	}
+	
+	key = DgMakeInt8(-5); value = DgMakeBool(true); DgTableSet(&regions, &key, &value);
+	
+	key = DgMakeStaticString("regions"); value = DgMakeTable(&regions); DgTableSet(&world, &key, &value);
+	key = DgMakeStaticString("world"); value = DgMakeTable(&world); DgTableSet(&table, &key, &value);
+	key = DgMakeStaticString("version"); value = DgMakeUInt8(3); DgTableSet(&table, &key, &value);
+	
+	DgValue root = DgMakeTable(&table);
+	size_t sizes[3] = {0};
+	
+	// Version 1, version 2 and version 2 with indexes
+	for (size_t i = 0; i < 3; i++) {
+		DgMemoryStream *memory = DgMemoryStreamCreate();
+		DgStream stream;
+		DgSerialiseDocument document;
+		DgSerialised tree;
+		DgSerialiseView view;
+		uint8_t *data;
+		
+		DgStreamOpenMemory(&stream, memory);
+		bad += (DgSerialiseWriteStreamVersion(&stream, &root, i ? 2 : 1, (i == 2) ? DG_SERIALISE_INDEXED : 0) != DG_ERROR_SUCCESSFUL);
+		DgStreamClose(&stream);
+		DgMemoryStreamGetPointersAndSize(memory, &sizes[i], (void **) &data);
+		
+		bad += (DgSerialiseOpenBuffer(&document, data, sizes[i]) != DG_ERROR_SUCCESSFUL);
+		bad += TestSerialiseViewCheck(&document);
+		DgSerialiseClose(&document);
+		
+		// Indexes don't get in the way of reading everything
+		bad += (DgSerialiseReadBuffer(&tree, data, sizes[i]) != DG_ERROR_SUCCESSFUL);
+		bad += (tree.root.type != DG_TYPE_TABLE || DgTableLength(tree.root.data.asTable) != 2);
+		DgSerialiseFree(&tree);
+		
+		// Cut off data is never looked past, and large version 2 tables know
+		// their size so it is noticed
+		for (size_t j = 8; j < sizes[i]; j += 7) {
+			DgSerialiseOpenBuffer(&document, data, j);
+			DgSerialiseViewRoot(&document, &view);
+			bad += (DgSerialiseViewGetPath(&view, "world.regions[199].id", &view) == DG_ERROR_SUCCESSFUL && i);
+			DgSerialiseClose(&document);
+		}
+		
+		DgMemoryStreamFree(memory);
+	}
+	
+	// From a file
+	DgSerialiseDocument document;
+	
+	DgStorageAddPool(NULL, DgRamdiskCreatePool("lazy"));
+	bad += (DgSerialiseWriteFlags(NULL, "lazy://world.bin", &root, DG_SERIALISE_INDEXED) != DG_ERROR_SUCCESSFUL);
+	bad += (DgSerialiseOpen(&document, NULL, "lazy://world.bin") != DG_ERROR_SUCCESSFUL);
+	bad += TestSerialiseViewCheck(&document);
+	DgSerialiseClose(&document);
+	DgStorageRemovePool(NULL, "lazy");
+	
+	DgValueFree(&root);
+	
+	DgLog(bad ? DG_LOG_ERROR : DG_LOG_SUCCESS, "TestSerialiseView() - bad = %d (v1 %d bytes, v2 %d bytes, indexed %d bytes)", bad, sizes[0], sizes[1], sizes[2]);
+}
+
+void TestSerialiseChecksum(void) {
+	DgLog(DG_LOG_INFO, "TestSerialiseChecksum()");
+	
+	size_t bad = 0;
+	DgTable table;
+	DgValue key, value;
+	char name[32];
+	
+	DgTableInit(&table);
+	
+	for (uint32_t i = 0; i < 500; i++) {
+		snprintf(name, sizeof name, "item %u", i);
+		key = DgMakeString(name); value = DgMakeStaticString("enough to fill a few blocks"); DgTableSet(&table, &key, &value);
+	}
+	
+	DgValue root = DgMakeTable(&table);
+	DgMemoryStream *memory = DgMemoryStreamCreate();
+	DgStream stream;
+	DgSerialised tree;
+	DgSerialiseReader reader;
+	DgSerialiseEvent event;
+	DgSerialiseDocument document;
+	DgSerialiseView view;
+	size_t size, position, events = 0;
+	uint8_t *data;
+	
+	DgStreamOpenMemory(&stream, memory);
+	bad += (DgSerialiseWriteStreamVersion(&stream, &root, 1, DG_SERIALISE_CHECKSUM) != DG_ERROR_NOT_SUPPORTED);
+	bad += (DgSerialiseWriteStreamVersion(&stream, &root, 2, DG_SERIALISE_CHECKSUM | DG_SERIALISE_INDEXED) != DG_ERROR_SUCCESSFUL);
+	DgMemoryStreamGetPointersAndSize(memory, &size, (void **) &data);
+	
+	// As a tree, from a buffer and a stream, which is left after the data
+	bad += (DgSerialiseReadBuffer(&tree, data, size) != DG_ERROR_SUCCESSFUL);
+	bad += (tree.root.type != DG_TYPE_TABLE || DgTableLength(tree.root.data.asTable) != 500);
+	DgSerialiseFree(&tree);
+	
+	DgStreamSetPosition(&stream, 0);
+	bad += (DgSerialiseReadStream(&tree, &stream) != DG_ERROR_SUCCESSFUL);
+	bad += (DgStreamGetPosition(&stream, &position) || position != size);
+	DgSerialiseFree(&tree);
+	
+	// With the pull reader, reading and skipping
+	DgSerialiseReaderInitBuffer(&reader, data, size);
+	
+	do {
+		bad += (DgSerialiseReaderNext(&reader, &event, &value) != DG_ERROR_SUCCESSFUL);
+		events++;
+	} while (event != DG_SERIALISE_EVENT_END && events < 2000);
+	
+	bad += (events != 1003);
+	DgSerialiseReaderFree(&reader);
+	
+	DgStreamSetPosition(&stream, 0);
+	DgSerialiseReaderInitStream(&reader, &stream);
+	bad += (DgSerialiseReaderNext(&reader, &event, &value) || event != DG_SERIALISE_EVENT_TABLE_BEGIN);
+	bad += (DgSerialiseReaderSkip(&reader) != DG_ERROR_SUCCESSFUL);
+	bad += (DgSerialiseReaderNext(&reader, &event, &value) || event != DG_SERIALISE_EVENT_END);
+	DgSerialiseReaderFree(&reader);
+	
+	// In place
+	bad += (DgSerialiseOpenBuffer(&document, data, size) != DG_ERROR_SUCCESSFUL);
+	bad += (DgSerialiseViewRoot(&document, &view) || DgSerialiseViewGetPath(&view, "item 250", &view) || DgSerialiseViewValue(&view, &value));
+	bad += (value.type != DG_TYPE_STRING || strcmp(value.data.asStaticString, "enough to fill a few blocks"));
+	bad += (DgSerialiseVerify(&document) != DG_ERROR_SUCCESSFUL);
+	DgSerialiseClose(&document);
+	
+	// Damage is found wherever it is
+	data[size / 2] ^= 0x10;
+	
+	bad += (DgSerialiseReadBuffer(&tree, data, size) == DG_ERROR_SUCCESSFUL);
+	
+	DgStreamSetPosition(&stream, 0);
+	bad += (DgSerialiseReadStream(&tree, &stream) == DG_ERROR_SUCCESSFUL);
+	
+	bad += (DgSerialiseOpenBuffer(&document, data, size) != DG_ERROR_SUCCESSFUL);
+	bad += (DgSerialiseVerify(&document) == DG_ERROR_SUCCESSFUL);
+	DgSerialiseClose(&document);
+	
+	data[size / 2] ^= 0x10;
+	data[size - 24] ^= 0x01;
+	
+	bad += (DgSerialiseOpenBuffer(&document, data, size) == DG_ERROR_SUCCESSFUL);
+	
+	data[size - 24] ^= 0x01;
+	
+	DgStreamClose(&stream);
+	DgMemoryStreamFree(memory);
+	
+	// Documents without checksums still work
+	memory = DgMemoryStreamCreate();
+	DgStreamOpenMemory(&stream, memory);
+	DgSerialiseWriteStream(&stream, &root);
+	DgMemoryStreamGetPointersAndSize(memory, &size, (void **) &data);
+	
+	bad += (DgSerialiseOpenBuffer(&document, data, size) != DG_ERROR_SUCCESSFUL);
+	bad += (DgSerialiseVerify(&document) != DG_ERROR_NOT_FOUND);
+	DgSerialiseClose(&document);
+	
+	DgStreamClose(&stream);
+	DgMemoryStreamFree(memory);
+	DgValueFree(&root);
+	
+	DgLog(bad ? DG_LOG_ERROR : DG_LOG_SUCCESS, "TestSerialiseChecksum() - bad = %d", bad);
+}
+
+static size_t TestStructCheck(const TestPlayer *read, const TestPlayer *player) {
+	size_t bad = 0;
+	
+	bad += (read->id != player->id || read->health != player->health || read->alive != player->alive || read->score != player->score);
+	bad += (memcmp(read->position, player->position, sizeof read->position) || memcmp(read->name, player->name, sizeof read->name));
+	bad += (read->level != player->level || memcmp(read->spawn, player->spawn, sizeof read->spawn));
+	
+	return bad;
+}
+
+void TestStructSerialise(void) {
+	DgLog(DG_LOG_INFO, "TestStructSerialise()");
+	
+	size_t bad = 0;
+	TestPlayer player = {
+		.id = 77,
+		.health = 0.5f,
+		.position = {1.0f, -2.0f, 3.5f},
+		.name = "knot",
+		.alive = true,
+		.score = -123456789012,
+		.level = 9,
+		.spawn = {10.0, 20.0},
+	};
+	TestPlayer read;
+	DgMemoryStream *memory = DgMemoryStreamCreate();
+	DgStream stream;
+	size_t size;
+	uint8_t *data;
+	
+	// Streams, with a header so the generic readers can read it too
+	DgStreamOpenMemory(&stream, memory);
+	bad += (DgSerialiseWriteHeader(&stream, 1) != DG_ERROR_SUCCESSFUL);
+	bad += (TestPlayerWrite(&stream, &player) != DG_ERROR_SUCCESSFUL);
+	
+	DgStreamSetPosition(&stream, 8);
+	bad += (TestPlayerRead(&stream, &read) != DG_ERROR_SUCCESSFUL);
+	bad += TestStructCheck(&read, &player);
+	
+	DgSerialised tree;
+	DgValue key, value;
+	
+	DgMemoryStreamGetPointersAndSize(memory, &size, (void **) &data);
+	
+	if (!DgSerialiseReadBuffer(&tree, data, size)) {
+		key = DgMakeStaticString("_version");
+		bad += (DgTableGet(tree.root.data.asTable, &key, &value) || value.type != DG_TYPE_UINT16 || value.data.asUInt16 != TEST_PLAYER_VERSION);
+		key = DgMakeStaticString("score");
+		bad += (DgTableGet(tree.root.data.asTable, &key, &value) || value.type != DG_TYPE_INT64 || value.data.asInt64 != player.score);
+		key = DgMakeStaticString("name");
+		bad += (DgTableGet(tree.root.data.asTable, &key, &value) || value.type != DG_TYPE_BYTES || value.data.asBytes->length != 16);
+		DgSerialiseFree(&tree);
+	}
+	else {
+		bad++;
+	}
+	
+	// Newer versions and broken data aren't read
+	data[8 + 31] = TEST_PLAYER_VERSION + 1;
+	DgStreamSetPosition(&stream, 8);
+	bad += (TestPlayerRead(&stream, &read) != DG_ERROR_NOT_SUPPORTED);
+	data[8 + 31] = TEST_PLAYER_VERSION;
+	
+	data[8 + 44] = 'x';
+	DgStreamSetPosition(&stream, 8);
+	bad += (TestPlayerRead(&stream, &read) != DG_ERROR_FAILED);
+	
+	DgStreamClose(&stream);
+	DgMemoryStreamFree(memory);
+	
+	// Memory streams
+	memory = DgMemoryStreamCreate();
+	
+	for (int i = 0; i < 3; i++) {
+		TestPlayerWriteMemory(memory, &player);
+	}
+	
+	DgMemoryStreamSetpos(memory, DG_MEMORY_STREAM_SET, 0);
+	
+	for (int i = 0; i < 3; i++) {
+		memset(&read, 0, sizeof read);
+		TestPlayerReadMemory(memory, &read);
+		bad += TestStructCheck(&read, &player);
+	}
+	
+	bad += (DgMemoryStreamError(memory) != DG_MEMORY_STREAM_OKAY);
+	TestPlayerReadMemory(memory, &read);
+	bad += (DgMemoryStreamError(memory) == DG_MEMORY_STREAM_OKAY);
+	
+	DgMemoryStreamFree(memory);
+	
+	// Version 1 of the struct, written from a table, gets defaults for the
+	// newer fields
+	DgTable table;
+	DgBytes position = {sizeof player.position, (DgByte *) player.position};
+	DgBytes name = {sizeof player.name, (DgByte *) player.name};
+	
+	DgTableInit(&table);
+	key = DgMakeStaticString("_version"); value = DgMakeUInt16(1); DgTableSet(&table, &key, &value);
+	key = DgMakeStaticString("id"); value = DgMakeUInt32(player.id); DgTableSet(&table, &key, &value);
+	key = DgMakeStaticString("health"); value = DgMakeFloat32(player.health); DgTableSet(&table, &key, &value);
+	key = DgMakeStaticString("position"); value.type = DG_TYPE_BYTES; value.flags = DG_VALUE_STATIC; value.data.asBytes = &position; DgTableSet(&table, &key, &value);
+	key = DgMakeStaticString("name"); value.type = DG_TYPE_BYTES; value.flags = DG_VALUE_STATIC; value.data.asBytes = &name; DgTableSet(&table, &key, &value);
+	key = DgMakeStaticString("alive"); value = DgMakeBool(player.alive); DgTableSet(&table, &key, &value);
+	key = DgMakeStaticString("score"); value = DgMakeInt64(player.score); DgTableSet(&table, &key, &value);
+	
+	value = DgMakeTable(&table);
+	memory = DgMemoryStreamCreate();
+	DgStreamOpenMemory(&stream, memory);
+	bad += (DgSerialiseWriteStreamVersion(&stream, &value, 1, 0) != DG_ERROR_SUCCESSFUL);
+	DgStreamSetPosition(&stream, 8);
+	bad += (TestPlayerRead(&stream, &read) != DG_ERROR_SUCCESSFUL);
+	
+	player.level = 1;
+	player.spawn[0] = player.spawn[1] = 0.0;
+	bad += TestStructCheck(&read, &player);
+	
+	DgStreamClose(&stream);
+	DgMemoryStreamFree(memory);
+	DgTableFree(&table);
+	
+	DgLog(bad ? DG_LOG_ERROR : DG_LOG_SUCCESS, "TestStructSerialise() - bad = %d", bad);
+}
+
+void TestBitset(void) {
+	DgLog(DG_LOG_INFO, "TestBitset()");
+	
+	DgBitset a, b;
+	
+	DgBitsetInit(&a, 1000);
+	DgBitsetInit(&b, 1000);
+	
+	for (size_t i = 0; i < 1000; i += 3) {
+		DgBitsetSet(&a, i);
+	}
+	
+	for (size_t i = 0; i < 1000; i += 5) {
+		DgBitsetSet(&b, i);
+	}
+	
+	DgLog(DG_LOG_INFO, "Count: %d (should be 334)", DgBitsetCount(&a));
+	
+	DgBitsetBuildRank(&a);
+	
+	DgLog(DG_LOG_INFO, "Rank of 600: %d (should be 200)", DgBitsetRank(&a, 600));
+	DgLog(DG_LOG_INFO, "Select 100: %d (should be 300)", DgBitsetSelect(&a, 100));
+	
+	DgBitsetAnd(&a, &b);
+	
+	DgLog(DG_LOG_INFO, "Count after AND: %d (should be 67)", DgBitsetCount(&a));
+	DgLog(DG_LOG_INFO, "First set after 1: %d (should be 15)", DgBitsetFindNext(&a, 1));
+	
+	DgBitsetFree(&a);
+	DgBitsetFree(&b);
+	
+	DgLog(DG_LOG_SUCCESS, "TestBitset()");
+}
+
+static DgError TestChunkerCompare(void *context, size_t offset, size_t length, const uint8_t *data) {
+	// Check that the stream gives the same chunks as the buffer
+	DgChunk **next = context;
+	
+	if (next[0]->offset != offset || next[0]->length != length) {
+		return DG_ERROR_FAILED;
+	}
+	
+	next[0]++;
+	
+	return DG_ERROR_SUCCESSFUL;
+}
+
+void TestChunker(void) {
+	DgLog(DG_LOG_INFO, "TestChunker()");
+	
+	const size_t size = 1 << 20;
+	uint8_t *data = DgAlloc(size + 1);
+	uint64_t state = 12345;
+	
+	for (size_t i = 0; i < size; i++) {
+		state = state * 6364136223846793005 + 1442695040888963407;
+		data[i] = state >> 56;
+	}
+	
+	DgChunker chunker;
+	DgChunk *chunks, *edited;
+	size_t count, edited_count;
+	size_t bad = 0;
+	
+	DgChunkerInit(&chunker, 2048, 8192, 65536);
+	DgChunkBuffer(&chunker, size, data, &chunks, &count);
+	
+	size_t total = 0;
+	
+	for (size_t i = 0; i < count; i++) {
+		bad += (chunks[i].offset != total || chunks[i].length > 65536 || (chunks[i].length < 2048 && i + 1 != count));
+		total += chunks[i].length;
+	}
+	
+	bad += (total != size);
+	
+	// Insert a byte near the start: chunks after the first few should match
+	memmove(data + 1001, data + 1000, size - 1000);
+	data[1000] = 0x55;
+	
+	DgChunkBuffer(&chunker, size + 1, data, &edited, &edited_count);
+	
+	size_t same = 0;
+	
+	for (size_t i = 0, j = 0; i < count && j < edited_count;) {
+		if (chunks[i].offset + 1 == edited[j].offset && chunks[i].length == edited[j].length) {
+			same++, i++, j++;
+		}
+		else if (chunks[i].offset + 1 < edited[j].offset) {
+			i++;
+		}
+		else {
+			j++;
+		}
+	}
+	
+	bad += (same + 3 < count);
+	
+	// Streams are chunked the same way as buffers
+	DgStorageAddPool(NULL, DgRamdiskCreatePool("chunks"));
+	DgFileSave(NULL, "chunks://data.bin", size + 1, data);
+	
+	DgStream stream;
+	DgChunk *next = edited;
+	
+	if (!DgStreamOpen(NULL, &stream, "chunks://data.bin", DG_STREAM_READ)) {
+		bad += (DgChunkStream(&chunker, &stream, TestChunkerCompare, &next) != DG_ERROR_SUCCESSFUL);
+		bad += (next != edited + edited_count);
+		DgStreamClose(&stream);
+	}
+	else {
+		bad++;
+	}
+	
+	DgStorageRemovePool(NULL, "chunks");
+	
+	DgFree(chunks);
+	DgFree(edited);
+	DgFree(data);
+	
+	DgLog(bad ? DG_LOG_ERROR : DG_LOG_SUCCESS, "TestChunker() - bad = %d (%d chunks, %d unchanged after edit)", bad, count, same);
+}
+
+void TestChecksum(void) {
+	DgLog(DG_LOG_INFO, "TestChecksum()");
+	
+	size_t bad = 0;
+	uint8_t data[1000];
+	
+	for (size_t i = 0; i < sizeof data; i++) {
+		data[i] = i * 7 + (i >> 3);
+	}
+	
+	// Known values, then the same result in pieces as all at once
+	bad += (DgChecksumCRC32C(0, 9, "123456789") != 0xE3069283);
+	bad += (DgChecksumCRC32C(0, 0, NULL) != 0);
+	
+	uint32_t whole = DgChecksumCRC32C(0, sizeof data, data);
+	
+	for (size_t i = 0; i < 20; i++) {
+		bad += (DgChecksumCRC32C(DgChecksumCRC32C(0, i * 37, data), sizeof data - i * 37, data + i * 37) != whole);
+	}
+	
+	DgLog(bad ? DG_LOG_ERROR : DG_LOG_SUCCESS, "TestChecksum() - bad = %d", bad);
+}
+
+void TestMemoryStream(void) {
+	DgLog(DG_LOG_INFO, "TestMemoryStream()");
+	
+	size_t bad = 0;
+	uint32_t value = 0x12345678;
+	
+	// Lengths match what was written
+	DgMemoryStream *plain = DgMemoryStreamCreate();
+	DgMemoryStreamWriteUInt32(plain, &value);
+	bad += (DgMemoryStreamLength(plain) != 4 || DgMemoryStreamGetpos(plain) != 4);
+	DgMemoryStreamRewind(plain);
+	bad += (DgMemoryStreamReadUInt32(plain) != value || DgMemoryStreamError(plain));
+	DgMemoryStreamFree(plain);
+	
+	// Chunked streams read back the same as they were written
+	DgMemoryStream *stream = DgMemoryStreamCreateChunked(64);
+	
+	for (uint32_t i = 0; i < 10000; i++) {
+		DgMemoryStreamWriteUInt32(stream, &i);
+	}
+	
+	DgMemoryStreamSetpos(stream, DG_MEMORY_STREAM_SET, 400);
+	DgMemoryStreamWriteUInt32(stream, &value);
+	DgMemoryStreamRewind(stream);
+	
+	for (uint32_t i = 0; i < 10000; i++) {
+		bad += (DgMemoryStreamReadUInt32(stream) != ((i == 100) ? value : i));
+	}
+	
+	bad += (DgMemoryStreamError(stream) != DG_MEMORY_STREAM_OKAY);
+	
+	// Write the chunks out without joining them
+	DgStorageBuffer buffers[64];
+	size_t count = DgMemoryStreamGetBuffers(stream, 64, buffers);
+	
+	bad += (count < 2 || count > 64);
+	
+	DgStorageAddPool(NULL, DgRamdiskCreatePool("rope"));
+	
+	DgStream file;
+	
+	if (!DgStreamOpen(NULL, &file, "rope://out.bin", DG_STREAM_WRITE)) {
+		bad += (DgStreamWritev(&file, buffers, count) != DG_ERROR_SUCCESSFUL);
+		DgStreamClose(&file);
+	}
+	
+	size_t size;
+	void *data, *flat;
+	
+	DgMemoryStreamFlatten(stream);
+	DgMemoryStreamGetPointersAndSize(stream, &size, &flat);
+	
+	if (!DgFileLoad(NULL, "rope://out.bin", &size, &data)) {
+		bad += (size != 40000 || memcmp(data, flat, size));
+		DgFree(data);
+	}
+	else {
+		bad++;
+	}
+	
+	DgStorageRemovePool(NULL, "rope");
+	DgMemoryStreamFree(stream);
+	
+	DgLog(bad ? DG_LOG_ERROR : DG_LOG_SUCCESS, "TestMemoryStream() - bad = %d (%d chunks)", bad, count);
+}
+
+void TestMemoryStreamAdapter(void) {
+	DgLog(DG_LOG_INFO, "TestMemoryStreamAdapter()");
+	
+	size_t bad = 0;
+	DgStream stream;
+	uint32_t number;
+	
+	// Serialise into a memory stream then read it back through a DgStream
+	DgMemoryStream *memory = DgMemoryStreamCreateChunked(16);
+	DgValue value = DgMakeInt32(-1234);
+	
+	if (!DgStreamOpenMemory(&stream, memory)) {
+		bad += (DgSerialiseWriteStreamVersion(&stream, &value, 1, 0) != DG_ERROR_SUCCESSFUL);
+		bad += (DgStreamLength(&stream) != 4 + 2 + 2 + 2 + 4);
+		bad += (DgStreamSetPosition(&stream, 0) != DG_ERROR_SUCCESSFUL);
+		bad += (DgStreamReadUInt32(&stream, &number) || number != 0xFC991E51);
+		bad += (DgStreamSeek(&stream, DG_STORAGE_SEEK_END, 1) != DG_ERROR_OUT_OF_RANGE);
+		bad += (DgStreamSeek(&stream, DG_STORAGE_SEEK_END, -4) != DG_ERROR_SUCCESSFUL);
+		bad += (DgStreamReadUInt32(&stream, &number) || (int32_t) number != -1234);
+		bad += (DgStreamReadUInt32(&stream, &number) != DG_ERROR_FAILED);
+		
+		DgStorageMapping mapping;
+		
+		if (!DgStreamMap(&stream, 0, 4, DG_STORAGE_MAP_SEQUENTIAL, &mapping)) {
+			bad += (mapping.length != 4 || memcmp(mapping.data, "\x51\x1e\x99\xfc", 4));
+			DgStreamUnmap(&mapping);
+		}
+		else {
+			bad++;
+		}
+		
+		DgStreamClose(&stream);
+	}
+	else {
+		bad++;
+	}
+	
+	DgMemoryStreamFree(memory);
+	
+	// Fixed buffers don't grow
+	uint8_t buffer[8];
+	
+	if (!DgStreamOpenBuffer(&stream, buffer, sizeof buffer, DG_STREAM_WRITE)) {
+		bad += (DgStreamWriteUInt32(&stream, 0xAABBCCDD) != DG_ERROR_SUCCESSFUL);
+		bad += (DgStreamLength(&stream) != 4);
+		bad += (DgStreamWriteUInt64(&stream, 0) != DG_ERROR_OUT_OF_RANGE);
+		DgStreamClose(&stream);
+	}
+	else {
+		bad++;
+	}
+	
+	if (!DgStreamOpenBuffer(&stream, buffer, 4, DG_STREAM_READ)) {
+		bad += (DgStreamReadUInt32(&stream, &number) || number != 0xAABBCCDD);
+		bad += (DgStreamReadUInt8(&stream, (uint8_t *) &number) != DG_ERROR_FAILED);
+		bad += (DgStreamWriteUInt8(&stream, 0) != DG_ERROR_READ_ONLY);
+		DgStreamClose(&stream);
+	}
+	else {
+		bad++;
+	}
+	
+	DgLog(bad ? DG_LOG_ERROR : DG_LOG_SUCCESS, "TestMemoryStreamAdapter() - bad = %d", bad);
+}
+
+void TestByteOrder(void) {
+	DgLog(DG_LOG_INFO, "TestByteOrder()");
+	
+	size_t bad = 0;
+	size_t count = 3001; // More than one swap block and not a multiple of any vector
+	uint32_t *values = DgAlloc(count * sizeof *values);
+	uint32_t *back = DgAlloc(count * sizeof *back);
+	uint16_t shorts[7] = {0x0102, 0x0304, 0x0506, 0x0708, 0x090a, 0x0b0c, 0x0d0e}, short_back[7];
+	double doubles[5] = {1.0, -2.5, 3.25, 1e100, -0.0}, double_back[5];
+	
+	for (size_t i = 0; i < count; i++) {
+		values[i] = 0x01020304 + (uint32_t) i * 0x11111111;
+	}
+	
+	// Big endian stream writes have the most significant byte first
+	DgMemoryStream *memory = DgMemoryStreamCreate();
+	DgStream stream;
+	
+	if (!DgStreamOpenMemory(&stream, memory)) {
+		bad += (DgStreamWriteArrayUInt32(&stream, count, values, DG_BYTE_ORDER_BIG) != DG_ERROR_SUCCESSFUL);
+		bad += (DgStreamWriteArrayUInt16(&stream, 7, shorts, DG_BYTE_ORDER_LITTLE) != DG_ERROR_SUCCESSFUL);
+		bad += (DgStreamWriteArrayFloat64(&stream, 5, doubles, DG_BYTE_ORDER_BIG) != DG_ERROR_SUCCESSFUL);
+		
+		size_t size;
+		uint8_t *data;
+		
+		DgMemoryStreamGetPointersAndSize(memory, &size, (void **) &data);
+		
+		bad += (size != count * 4 + 7 * 2 + 5 * 8);
+		bad += (data[0] != 0x01 || data[3] != 0x04 || data[4 * 2999 + 3] != (uint8_t) values[2999]);
+		bad += (data[count * 4] != 0x02 || data[count * 4 + 1] != 0x01);
+		bad += (data[count * 4 + 14] != 0x3f || data[count * 4 + 15] != 0xf0);
+		
+		bad += (DgStreamSetPosition(&stream, 0) != DG_ERROR_SUCCESSFUL);
+		bad += (DgStreamReadArrayUInt32(&stream, count, back, DG_BYTE_ORDER_BIG) != DG_ERROR_SUCCESSFUL);
+		bad += (memcmp(back, values, count * sizeof *back) != 0);
+		bad += (DgStreamReadArrayUInt16(&stream, 7, short_back, DG_BYTE_ORDER_LITTLE) != DG_ERROR_SUCCESSFUL);
+		bad += (memcmp(short_back, shorts, sizeof shorts) != 0);
+		bad += (DgStreamReadArrayFloat64(&stream, 5, double_back, DG_BYTE_ORDER_BIG) != DG_ERROR_SUCCESSFUL);
+		bad += (memcmp(double_back, doubles, sizeof doubles) != 0);
+		
+		DgStreamClose(&stream);
+	}
+	else {
+		bad++;
+	}
+	
+	// Memory streams read back what they write
+	DgMemoryStreamRewind(memory);
+	DgMemoryStreamWriteArrayUInt32(memory, count, values, DG_BYTE_ORDER_BIG);
+	DgMemoryStreamRewind(memory);
+	DgMemoryStreamReadArrayUInt32(memory, count, back, DG_BYTE_ORDER_BIG);
+	bad += (memcmp(back, values, count * sizeof *back) != 0);
+	bad += (DgMemoryStreamError(memory) != DG_MEMORY_STREAM_OKAY);
+	
+	// The caller's array is left as it was
+	bad += (values[1] != 0x01020304 + 0x11111111);
+	
+	DgMemoryStreamFree(memory);
+	DgFree(values);
+	DgFree(back);
+	
+	DgLog(bad ? DG_LOG_ERROR : DG_LOG_SUCCESS, "TestByteOrder() - bad = %d", bad);
 }
 
 void TestMemory(void) {
@@ -164,9 +1930,30 @@ int main(const int argc, const char *argv[]) {
 	
 	TestString();
 	TestStorage();
+	TestRamdisk();
+	TestBufferedStream();
+	TestAsyncStorage();
+	TestPak();
+	TestCache();
+	TestCompressed();
+	TestOverlay();
+	TestDedup();
+	TestStorageMetrics();
 	TestMemory();
+	TestBitset();
+	TestChunker();
+	TestChecksum();
+	TestMemoryStream();
+	TestMemoryStreamAdapter();
+	TestByteOrder();
 	TestCryptoRandom();
 	TestTableAndSerialise();
+	TestSerialiseRead();
+	TestSerialiseV2();
+	TestSerialiseReader();
+	TestSerialiseView();
+	TestSerialiseChecksum();
+	TestStructSerialise();
 	TestError();
 	DgCryptoCubeHasher_Test();
 	DgCryptoCubeHashBytes_Test();
@@ -0,0 +1,299 @@
+// Auto-generated by generate_struct_serialisers.py from test_structs.schema
+#include "util/common.h"
+#include "util/error.h"
+#include "util/storage.h"
+#include "util/stream.h"
+#include "util/value.h"
+
+#include "test_structs.h"
+
+static inline void DgGeneratedPutUInt16(uint8_t *buffer, uint16_t value) {
+	memcpy(buffer, &value, sizeof value);
+}
+
+static inline void DgGeneratedPutUInt64(uint8_t *buffer, uint64_t value) {
+	memcpy(buffer, &value, sizeof value);
+}
+
+#define TEST_PLAYER_SIZE_V1 202
+#define TEST_PLAYER_SIZE_V2 264
+#define TEST_PLAYER_SIZE_MAX 264
+
+static void TestPlayerFrame1(uint8_t *buffer) {
+	/**
+	 * Write the parts of version 1 that don't depend on the data.
+	 */
+	
+	DgGeneratedPutUInt16(buffer + 0, DG_TYPE_TABLE);
+	DgGeneratedPutUInt64(buffer + 2, 7);
+	DgGeneratedPutUInt16(buffer + 10, DG_TYPE_STRING);
+	DgGeneratedPutUInt64(buffer + 12, 8);
+	memcpy(buffer + 20, "_version", 9);
+	DgGeneratedPutUInt16(buffer + 29, DG_TYPE_UINT16);
+	DgGeneratedPutUInt16(buffer + 31, 1);
+	DgGeneratedPutUInt16(buffer + 33, DG_TYPE_STRING);
+	DgGeneratedPutUInt64(buffer + 35, 2);
+	memcpy(buffer + 43, "id", 3);
+	DgGeneratedPutUInt16(buffer + 46, DG_TYPE_UINT32);
+	DgGeneratedPutUInt16(buffer + 52, DG_TYPE_STRING);
+	DgGeneratedPutUInt64(buffer + 54, 6);
+	memcpy(buffer + 62, "health", 7);
+	DgGeneratedPutUInt16(buffer + 69, DG_TYPE_FLOAT32);
+	DgGeneratedPutUInt16(buffer + 75, DG_TYPE_STRING);
+	DgGeneratedPutUInt64(buffer + 77, 8);
+	memcpy(buffer + 85, "position", 9);
+	DgGeneratedPutUInt16(buffer + 94, DG_TYPE_BYTES);
+	DgGeneratedPutUInt64(buffer + 96, 12);
+	DgGeneratedPutUInt16(buffer + 116, DG_TYPE_STRING);
+	DgGeneratedPutUInt64(buffer + 118, 4);
+	memcpy(buffer + 126, "name", 5);
+	DgGeneratedPutUInt16(buffer + 131, DG_TYPE_BYTES);
+	DgGeneratedPutUInt64(buffer + 133, 16);
+	DgGeneratedPutUInt16(buffer + 157, DG_TYPE_STRING);
+	DgGeneratedPutUInt64(buffer + 159, 5);
+	memcpy(buffer + 167, "alive", 6);
+	DgGeneratedPutUInt16(buffer + 173, DG_TYPE_BOOL);
+	DgGeneratedPutUInt16(buffer + 176, DG_TYPE_STRING);
+	DgGeneratedPutUInt64(buffer + 178, 5);
+	memcpy(buffer + 186, "score", 6);
+	DgGeneratedPutUInt16(buffer + 192, DG_TYPE_INT64);
+}
+
+static void TestPlayerFrame2(uint8_t *buffer) {
+	/**
+	 * Write the parts of version 2 that don't depend on the data.
+	 */
+	
+	DgGeneratedPutUInt16(buffer + 0, DG_TYPE_TABLE);
+	DgGeneratedPutUInt64(buffer + 2, 9);
+	DgGeneratedPutUInt16(buffer + 10, DG_TYPE_STRING);
+	DgGeneratedPutUInt64(buffer + 12, 8);
+	memcpy(buffer + 20, "_version", 9);
+	DgGeneratedPutUInt16(buffer + 29, DG_TYPE_UINT16);
+	DgGeneratedPutUInt16(buffer + 31, 2);
+	DgGeneratedPutUInt16(buffer + 33, DG_TYPE_STRING);
+	DgGeneratedPutUInt64(buffer + 35, 2);
+	memcpy(buffer + 43, "id", 3);
+	DgGeneratedPutUInt16(buffer + 46, DG_TYPE_UINT32);
+	DgGeneratedPutUInt16(buffer + 52, DG_TYPE_STRING);
+	DgGeneratedPutUInt64(buffer + 54, 6);
+	memcpy(buffer + 62, "health", 7);
+	DgGeneratedPutUInt16(buffer + 69, DG_TYPE_FLOAT32);
+	DgGeneratedPutUInt16(buffer + 75, DG_TYPE_STRING);
+	DgGeneratedPutUInt64(buffer + 77, 8);
+	memcpy(buffer + 85, "position", 9);
+	DgGeneratedPutUInt16(buffer + 94, DG_TYPE_BYTES);
+	DgGeneratedPutUInt64(buffer + 96, 12);
+	DgGeneratedPutUInt16(buffer + 116, DG_TYPE_STRING);
+	DgGeneratedPutUInt64(buffer + 118, 4);
+	memcpy(buffer + 126, "name", 5);
+	DgGeneratedPutUInt16(buffer + 131, DG_TYPE_BYTES);
+	DgGeneratedPutUInt64(buffer + 133, 16);
+	DgGeneratedPutUInt16(buffer + 157, DG_TYPE_STRING);
+	DgGeneratedPutUInt64(buffer + 159, 5);
+	memcpy(buffer + 167, "alive", 6);
+	DgGeneratedPutUInt16(buffer + 173, DG_TYPE_BOOL);
+	DgGeneratedPutUInt16(buffer + 176, DG_TYPE_STRING);
+	DgGeneratedPutUInt64(buffer + 178, 5);
+	memcpy(buffer + 186, "score", 6);
+	DgGeneratedPutUInt16(buffer + 192, DG_TYPE_INT64);
+	DgGeneratedPutUInt16(buffer + 202, DG_TYPE_STRING);
+	DgGeneratedPutUInt64(buffer + 204, 5);
+	memcpy(buffer + 212, "level", 6);
+	DgGeneratedPutUInt16(buffer + 218, DG_TYPE_UINT16);
+	DgGeneratedPutUInt16(buffer + 222, DG_TYPE_STRING);
+	DgGeneratedPutUInt64(buffer + 224, 5);
+	memcpy(buffer + 232, "spawn", 6);
+	DgGeneratedPutUInt16(buffer + 238, DG_TYPE_BYTES);
+	DgGeneratedPutUInt64(buffer + 240, 16);
+}
+
+static void TestPlayerEncode(uint8_t *buffer, const TestPlayer *data) {
+	/**
+	 * Encode a TestPlayer as the newest version.
+	 */
+	
+	TestPlayerFrame2(buffer);
+	memcpy(buffer + 48, &data->id, 4);
+	memcpy(buffer + 71, &data->health, 4);
+	memcpy(buffer + 104, data->position, 12);
+	memcpy(buffer + 141, data->name, 16);
+	buffer[175] = !!data->alive;
+	memcpy(buffer + 194, &data->score, 8);
+	memcpy(buffer + 220, &data->level, 2);
+	memcpy(buffer + 248, data->spawn, 16);
+}
+
+static DgError TestPlayerDecode(const uint8_t *buffer, uint16_t version, TestPlayer *data) {
+	/**
+	 * Decode any version of a TestPlayer, checking that everything but the
+	 * fields is what it should be.
+	 */
+	
+	uint8_t frame[TEST_PLAYER_SIZE_MAX];
+	
+	switch (version) {
+		case 1:
+			TestPlayerFrame1(frame);
+			memcpy(frame + 48, buffer + 48, 4);
+			memcpy(frame + 71, buffer + 71, 4);
+			memcpy(frame + 104, buffer + 104, 12);
+			memcpy(frame + 141, buffer + 141, 16);
+			memcpy(frame + 175, buffer + 175, 1);
+			memcpy(frame + 194, buffer + 194, 8);
+			
+			if (memcmp(frame, buffer, TEST_PLAYER_SIZE_V1)) {
+				return DG_ERROR_FAILED;
+			}
+			
+			memcpy(&data->id, buffer + 48, 4);
+			memcpy(&data->health, buffer + 71, 4);
+			memcpy(data->position, buffer + 104, 12);
+			memcpy(data->name, buffer + 141, 16);
+			data->alive = buffer[175] != 0;
+			memcpy(&data->score, buffer + 194, 8);
+			data->level = 1;
+			memset(data->spawn, 0, 16);
+			return DG_ERROR_SUCCESSFUL;
+		case 2:
+			TestPlayerFrame2(frame);
+			memcpy(frame + 48, buffer + 48, 4);
+			memcpy(frame + 71, buffer + 71, 4);
+			memcpy(frame + 104, buffer + 104, 12);
+			memcpy(frame + 141, buffer + 141, 16);
+			memcpy(frame + 175, buffer + 175, 1);
+			memcpy(frame + 194, buffer + 194, 8);
+			memcpy(frame + 220, buffer + 220, 2);
+			memcpy(frame + 248, buffer + 248, 16);
+			
+			if (memcmp(frame, buffer, TEST_PLAYER_SIZE_V2)) {
+				return DG_ERROR_FAILED;
+			}
+			
+			memcpy(&data->id, buffer + 48, 4);
+			memcpy(&data->health, buffer + 71, 4);
+			memcpy(data->position, buffer + 104, 12);
+			memcpy(data->name, buffer + 141, 16);
+			data->alive = buffer[175] != 0;
+			memcpy(&data->score, buffer + 194, 8);
+			memcpy(&data->level, buffer + 220, 2);
+			memcpy(data->spawn, buffer + 248, 16);
+			return DG_ERROR_SUCCESSFUL;
+		default:
+			return DG_ERROR_NOT_SUPPORTED;
+	}
+}
+
+static size_t TestPlayerSize(uint16_t version) {
+	switch (version) {
+		case 1: return TEST_PLAYER_SIZE_V1;
+		case 2: return TEST_PLAYER_SIZE_V2;
+		default: return 0;
+	}
+}
+
+DgError TestPlayerWrite(DgStream *stream, const TestPlayer *data) {
+	/**
+	 * Write a TestPlayer to a stream as a version 1 table.
+	 * 
+	 * @param stream Stream to write to
+	 * @param data Struct to write
+	 * @return Error status
+	 */
+	
+	uint8_t buffer[TEST_PLAYER_SIZE_V2];
+	
+	TestPlayerEncode(buffer, data);
+	
+	return DgStreamWrite(stream, sizeof buffer, buffer);
+}
+
+DgError TestPlayerRead(DgStream *stream, TestPlayer *data) {
+	/**
+	 * Read a TestPlayer written by any version of TestPlayerWrite. Fields that
+	 * weren't in the version that was written are set to their defaults.
+	 * 
+	 * @param stream Stream to read from
+	 * @param data Where to store the struct
+	 * @return Error status, DG_ERROR_NOT_SUPPORTED if the data is from a newer
+	 * version
+	 */
+	
+	uint8_t buffer[TEST_PLAYER_SIZE_MAX];
+	uint16_t version;
+	
+	DgError status = DgStreamRead(stream, 33, buffer);
+	
+	if (status) {
+		return status;
+	}
+	
+	memcpy(&version, buffer + 31, sizeof version);
+	
+	size_t size = TestPlayerSize(version);
+	
+	if (!size) {
+		return DG_ERROR_NOT_SUPPORTED;
+	}
+	
+	status = DgStreamRead(stream, size - 33, buffer + 33);
+	
+	if (status) {
+		return status;
+	}
+	
+	return TestPlayerDecode(buffer, version, data);
+}
+
+void TestPlayerWriteMemory(DgMemoryStream *stream, const TestPlayer *data) {
+	/**
+	 * Write a TestPlayer to a memory stream as a version 1 table.
+	 * 
+	 * @param stream Memory stream
+	 * @param data Struct to write
+	 */
+	
+	uint8_t buffer[TEST_PLAYER_SIZE_V2];
+	
+	TestPlayerEncode(buffer, data);
+	DgMemoryStreamWrite(stream, sizeof buffer, buffer);
+}
+
+void TestPlayerReadMemory(DgMemoryStream *stream, TestPlayer *data) {
+	/**
+	 * Read a TestPlayer from a memory stream. The stream's error is set to
+	 * DG_MEMORY_STREAM_INVALID if the data isn't a TestPlayer this can read.
+	 * 
+	 * @param stream Memory stream
+	 * @param data Where to store the struct
+	 */
+	
+	uint8_t buffer[TEST_PLAYER_SIZE_MAX];
+	uint16_t version;
+	size_t error = stream->error;
+	
+	DgMemoryStreamRead(stream, 33, buffer);
+	
+	if (stream->error != error) {
+		return;
+	}
+	
+	memcpy(&version, buffer + 31, sizeof version);
+	
+	size_t size = TestPlayerSize(version);
+	
+	if (!size) {
+		stream->error = DG_MEMORY_STREAM_INVALID;
+		return;
+	}
+	
+	DgMemoryStreamRead(stream, size - 33, buffer + 33);
+	
+	if (stream->error != error) {
+		return;
+	}
+	
+	if (TestPlayerDecode(buffer, version, data)) {
+		stream->error = DG_MEMORY_STREAM_INVALID;
+	}
+}
@@ -0,0 +1,25 @@
+// Auto-generated by generate_struct_serialisers.py from test_structs.schema
+#pragma once
+
+#include "util/common.h"
+#include "util/error.h"
+#include "util/storage.h"
+#include "util/stream.h"
+
+typedef struct TestPlayer {
+	uint32_t id;
+	float health;
+	float position[3];
+	char name[16];
+	bool alive;
+	int64_t score;
+	uint16_t level;
+	double spawn[2];
+} TestPlayer;
+
+#define TEST_PLAYER_VERSION 2
+
+DgError TestPlayerWrite(DgStream *stream, const TestPlayer *data);
+DgError TestPlayerRead(DgStream *stream, TestPlayer *data);
+void TestPlayerWriteMemory(DgMemoryStream *stream, const TestPlayer *data);
+void TestPlayerReadMemory(DgMemoryStream *stream, TestPlayer *data);